@@ -0,0 +1,216 @@
+// Synthetic EPUB generator for benchmarking.
+//
+// Writes a valid EPUB with a configurable number of chapters, paragraphs
+// per chapter and words per paragraph, plus binary assets (images) of a
+// given size that a translation run must carry through unchanged. The
+// output is deterministic for a given seed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <getopt.h>
+#include <zip.h>
+
+static const char *words[] = {
+    "the", "old", "lighthouse", "keeper", "walked", "slowly", "along", "shore",
+    "while", "storm", "gathered", "over", "grey", "sea", "and", "gulls", "cried",
+    "above", "harbour", "where", "fishing", "boats", "rocked", "against", "their",
+    "moorings", "she", "remembered", "winter", "when", "village", "lost", "power",
+    "for", "three", "days", "nobody", "spoke", "about", "letter", "found", "under",
+    "floorboards", "of", "chapel", "its", "ink", "faded", "almost", "nothing"
+};
+#define WORD_COUNT (sizeof(words) / sizeof(words[0]))
+
+typedef struct {
+    int chapters;
+    int paragraphs;
+    int words;          // Per paragraph
+    int assets;
+    int asset_kb;
+    unsigned int seed;
+} gen_options_t;
+
+// Appends to a growing buffer
+typedef struct {
+    char *data;
+    size_t size;
+    size_t capacity;
+} text_buffer_t;
+
+static void __attribute__((format(printf, 2, 3))) append(text_buffer_t *b, const char *fmt, ...) {
+    for (;;) {
+        va_list args;
+        va_start(args, fmt);
+        int n = vsnprintf(b->data + b->size, b->capacity - b->size, fmt, args);
+        va_end(args);
+        if (n >= 0 && b->size + n < b->capacity) {
+            b->size += n;
+            return;
+        }
+        b->capacity = b->capacity ? b->capacity * 2 : 4096;
+        b->data = realloc(b->data, b->capacity);
+    }
+}
+
+static void append_paragraph(text_buffer_t *b, int word_count, unsigned int *seed) {
+    append(b, "    <p>");
+    int sentence_start = 1;
+    for (int w = 0; w < word_count; w++) {
+        const char *word = words[rand_r(seed) % WORD_COUNT];
+        if (sentence_start) {
+            append(b, "%s%c%s", w > 0 ? " " : "", word[0] - 'a' + 'A', word + 1);
+        } else {
+            append(b, " %s", word);
+        }
+        sentence_start = (rand_r(seed) % 12 == 0) || w == word_count - 1;
+        if (sentence_start) append(b, ".");
+    }
+    // Some inline markup, so text nodes are split like in real books
+    if (word_count > 8) append(b, " <em>%s</em> %s.", words[rand_r(seed) % WORD_COUNT], words[rand_r(seed) % WORD_COUNT]);
+    append(b, "</p>\n");
+}
+
+static int add_buffer(zip_t *zip, const char *name, void *data, size_t size, int store) {
+    zip_source_t *source = zip_source_buffer(zip, data, size, 1); // libzip frees data
+    if (!source) return -1;
+    zip_int64_t index = zip_file_add(zip, name, source, ZIP_FL_OVERWRITE | ZIP_FL_ENC_UTF_8);
+    if (index < 0) {
+        zip_source_free(source);
+        return -1;
+    }
+    if (store) zip_set_file_compression(zip, index, ZIP_CM_STORE, 0);
+    return 0;
+}
+
+static int add_text(zip_t *zip, const char *name, text_buffer_t *b) {
+    int rc = add_buffer(zip, name, b->data, b->size, 0);
+    memset(b, 0, sizeof(*b));
+    return rc;
+}
+
+static void print_usage(const char *progname) {
+    printf("Usage: %s [options] <output.epub>\n", progname);
+    printf("  -c, --chapters <n>     Number of chapters (default 20)\n");
+    printf("  -p, --paragraphs <n>   Paragraphs per chapter (default 40)\n");
+    printf("  -w, --words <n>        Words per paragraph (default 60)\n");
+    printf("  -a, --assets <n>       Number of image assets (default 5)\n");
+    printf("  -k, --asset-kb <n>     Size of each asset in KiB (default 256)\n");
+    printf("  -s, --seed <n>         Random seed (default 1)\n");
+}
+
+int main(int argc, char *argv[]) {
+    gen_options_t opt = { 20, 40, 60, 5, 256, 1 };
+    static struct option long_options[] = {
+        {"chapters", required_argument, 0, 'c'},
+        {"paragraphs", required_argument, 0, 'p'},
+        {"words", required_argument, 0, 'w'},
+        {"assets", required_argument, 0, 'a'},
+        {"asset-kb", required_argument, 0, 'k'},
+        {"seed", required_argument, 0, 's'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "c:p:w:a:k:s:h", long_options, NULL)) != -1) {
+        switch (c) {
+            case 'c': opt.chapters = atoi(optarg); break;
+            case 'p': opt.paragraphs = atoi(optarg); break;
+            case 'w': opt.words = atoi(optarg); break;
+            case 'a': opt.assets = atoi(optarg); break;
+            case 'k': opt.asset_kb = atoi(optarg); break;
+            case 's': opt.seed = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 'h': print_usage(argv[0]); return 0;
+            default: print_usage(argv[0]); return 1;
+        }
+    }
+    if (optind >= argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    const char *output = argv[optind];
+
+    int err = 0;
+    zip_t *zip = zip_open(output, ZIP_CREATE | ZIP_TRUNCATE, &err);
+    if (!zip) {
+        fprintf(stderr, "Error creating %s: %d\n", output, err);
+        return 1;
+    }
+
+    // mimetype first and stored, as the spec requires
+    add_buffer(zip, "mimetype", strdup("application/epub+zip"), 20, 1);
+
+    text_buffer_t b = {0};
+    append(&b, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+               "<container version=\"1.0\" xmlns=\"urn:oasis:names:tc:opendocument:xmlns:container\">\n"
+               "  <rootfiles>\n"
+               "    <rootfile full-path=\"OEBPS/content.opf\" media-type=\"application/oebps-package+xml\"/>\n"
+               "  </rootfiles>\n"
+               "</container>\n");
+    add_text(zip, "META-INF/container.xml", &b);
+
+    append(&b, "body { font-family: serif; margin: 1em; }\np { text-indent: 1.5em; }\n");
+    add_text(zip, "OEBPS/style.css", &b);
+
+    unsigned int seed = opt.seed;
+    for (int i = 0; i < opt.assets; i++) {
+        size_t size = (size_t)opt.asset_kb * 1024;
+        unsigned char *data = malloc(size > 0 ? size : 1);
+        // Random bytes: incompressible, like real JPEG/PNG data
+        for (size_t k = 0; k < size; k++) data[k] = (unsigned char)rand_r(&seed);
+        char name[64];
+        snprintf(name, sizeof(name), "OEBPS/images/img%03d.png", i + 1);
+        add_buffer(zip, name, data, size, 0);
+    }
+
+    for (int ch = 1; ch <= opt.chapters; ch++) {
+        append(&b, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                   "<html xmlns=\"http://www.w3.org/1999/xhtml\">\n"
+                   "<head>\n  <title>Chapter %d</title>\n"
+                   "  <link rel=\"stylesheet\" type=\"text/css\" href=\"style.css\"/>\n</head>\n"
+                   "<body>\n  <h1>Chapter %d</h1>\n", ch, ch);
+        for (int p = 0; p < opt.paragraphs; p++) {
+            append_paragraph(&b, opt.words, &seed);
+        }
+        if (opt.assets > 0) {
+            append(&b, "    <p><img src=\"images/img%03d.png\" alt=\"\"/></p>\n", (ch - 1) % opt.assets + 1);
+        }
+        append(&b, "</body>\n</html>\n");
+
+        char name[64];
+        snprintf(name, sizeof(name), "OEBPS/chapter%03d.xhtml", ch);
+        add_text(zip, name, &b);
+    }
+
+    append(&b, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+               "<package xmlns=\"http://www.idpf.org/2007/opf\" version=\"3.0\" unique-identifier=\"bookid\">\n"
+               "  <metadata xmlns:dc=\"http://purl.org/dc/elements/1.1/\">\n"
+               "    <dc:identifier id=\"bookid\">urn:uuid:bench-%u</dc:identifier>\n"
+               "    <dc:title>Benchmark Book</dc:title>\n"
+               "    <dc:creator>epubtrans bench</dc:creator>\n"
+               "    <dc:language>en</dc:language>\n"
+               "  </metadata>\n"
+               "  <manifest>\n"
+               "    <item id=\"css\" href=\"style.css\" media-type=\"text/css\"/>\n", opt.seed);
+    for (int i = 0; i < opt.assets; i++) {
+        append(&b, "    <item id=\"img%03d\" href=\"images/img%03d.png\" media-type=\"image/png\"/>\n", i + 1, i + 1);
+    }
+    for (int ch = 1; ch <= opt.chapters; ch++) {
+        append(&b, "    <item id=\"ch%03d\" href=\"chapter%03d.xhtml\" media-type=\"application/xhtml+xml\"/>\n", ch, ch);
+    }
+    append(&b, "  </manifest>\n  <spine>\n");
+    for (int ch = 1; ch <= opt.chapters; ch++) {
+        append(&b, "    <itemref idref=\"ch%03d\"/>\n", ch);
+    }
+    append(&b, "  </spine>\n</package>\n");
+    add_text(zip, "OEBPS/content.opf", &b);
+
+    if (zip_close(zip) != 0) {
+        fprintf(stderr, "Error writing %s: %s\n", output, zip_strerror(zip));
+        zip_discard(zip);
+        return 1;
+    }
+    printf("Generated %s: %d chapters x %d paragraphs x %d words, %d assets of %d KiB\n",
+        output, opt.chapters, opt.paragraphs, opt.words, opt.assets, opt.asset_kb);
+    return 0;
+}
@@ -0,0 +1,482 @@
+// Local OpenAI-compatible chat-completions stub for benchmarking.
+//
+// Replies echo the last user message back (so batch markers survive the
+// round trip) after a configurable latency plus generation time. Errors
+// and 429 throttling can be injected at a given rate. GET /stats returns
+// request counts and latency percentiles as JSON.
+//
+// Replies report the part of the prompt shared with one of the last few
+// prompts as cached (usage.prompt_tokens_details.cached_tokens), the way
+// providers with prefix caching do.
+//
+// With --batch it answers a batch API request file offline instead: every
+// line becomes a result line on stdout, failed at --error-rate.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <json-c/json.h>
+
+typedef struct {
+    int port;
+    int latency_ms;         // Time to first token
+    int tokens_per_sec;     // Generation speed (0 = instant)
+    double error_rate;      // Fraction of requests answered with HTTP 500
+    double throttle_rate;   // Fraction of requests answered with HTTP 429
+} server_options_t;
+
+static server_options_t options = { 18080, 200, 100, 0.0, 0.0 };
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static double *latencies = NULL;    // Milliseconds of every successful request
+static size_t latency_count = 0;
+static size_t latency_capacity = 0;
+static long request_count = 0;
+static long error_count = 0;
+static long throttle_count = 0;
+static long completion_tokens = 0;
+static unsigned int random_seed = 1;
+
+// Prompts of the last requests, for the prefix cache emulation
+#define PREFIX_CACHE_SLOTS 32
+static char *recent_prompts[PREFIX_CACHE_SLOTS];
+static int recent_next = 0;
+static long cached_tokens = 0;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void sleep_ms(double ms) {
+    if (ms <= 0) return;
+    struct timespec ts = { (time_t)(ms / 1000), (long)((ms - (long)(ms / 1000) * 1000) * 1e6) };
+    nanosleep(&ts, NULL);
+}
+
+static int write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0) return -1;
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int send_response(int fd, int status, const char *reason, const char *extra_headers, const char *body) {
+    char header[512];
+    int n = snprintf(header, sizeof(header),
+        "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n%s\r\n",
+        status, reason, strlen(body), extra_headers ? extra_headers : "");
+    if (write_all(fd, header, n) != 0) return -1;
+    return write_all(fd, body, strlen(body));
+}
+
+static double random_unit(void) {
+    pthread_mutex_lock(&stats_lock);
+    double r = rand_r(&random_seed) / (double)RAND_MAX;
+    pthread_mutex_unlock(&stats_lock);
+    return r;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(const double *sorted, size_t count, double p) {
+    if (count == 0) return 0;
+    size_t index = (size_t)(p * (count - 1) + 0.5);
+    return sorted[index];
+}
+
+static int handle_stats(int fd) {
+    pthread_mutex_lock(&stats_lock);
+    double *sorted = malloc((latency_count ? latency_count : 1) * sizeof(double));
+    memcpy(sorted, latencies, latency_count * sizeof(double));
+    size_t count = latency_count;
+    char body[512];
+    qsort(sorted, count, sizeof(double), compare_double);
+    snprintf(body, sizeof(body),
+        "{\"requests\": %ld, \"errors\": %ld, \"throttled\": %ld, \"completion_tokens\": %ld, "
+        "\"cached_tokens\": %ld, \"p50_ms\": %.1f, \"p99_ms\": %.1f}\n",
+        request_count, error_count, throttle_count, completion_tokens, cached_tokens,
+        percentile(sorted, count, 0.50), percentile(sorted, count, 0.99));
+    pthread_mutex_unlock(&stats_lock);
+    free(sorted);
+    return send_response(fd, 200, "OK", NULL, body);
+}
+
+static void record(double started, int tokens) {
+    double elapsed = now_ms() - started;
+    pthread_mutex_lock(&stats_lock);
+    if (latency_count == latency_capacity) {
+        latency_capacity = latency_capacity ? latency_capacity * 2 : 1024;
+        latencies = realloc(latencies, latency_capacity * sizeof(double));
+    }
+    latencies[latency_count++] = elapsed;
+    completion_tokens += tokens;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+// Streams `content` as server-sent events in chunked encoding, a few
+// characters per event, paced at the configured generation speed
+static int send_stream(int fd, const char *content, int tokens) {
+    const char *header = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nTransfer-Encoding: chunked\r\n\r\n";
+    if (write_all(fd, header, strlen(header)) != 0) return -1;
+
+    size_t len = strlen(content);
+    size_t step = 16;
+    size_t events = (len + step - 1) / step;
+    double per_event = options.tokens_per_sec > 0 && events > 0 ? tokens * 1000.0 / options.tokens_per_sec / events : 0;
+
+    for (size_t pos = 0; pos <= len; pos += step) {
+        char piece[17];
+        size_t n = len - pos < step ? len - pos : step;
+        memcpy(piece, content + pos, n);
+        piece[n] = 0;
+
+        struct json_object *event = json_object_new_object();
+        struct json_object *choices = json_object_new_array();
+        struct json_object *choice = json_object_new_object();
+        struct json_object *delta = json_object_new_object();
+        json_object_object_add(delta, "content", json_object_new_string(piece));
+        json_object_object_add(choice, "delta", delta);
+        json_object_array_add(choices, choice);
+        json_object_object_add(event, "choices", choices);
+
+        char chunk[512];
+        const char *data = json_object_to_json_string(event);
+        int data_len = snprintf(chunk, sizeof(chunk), "data: %s\n\n", data);
+        json_object_put(event);
+
+        char size_line[32];
+        int size_len = snprintf(size_line, sizeof(size_line), "%x\r\n", data_len);
+        if (write_all(fd, size_line, size_len) != 0 || write_all(fd, chunk, data_len) != 0 ||
+            write_all(fd, "\r\n", 2) != 0) return -1;
+        sleep_ms(per_event);
+        if (n < step) break;
+    }
+
+    const char *done = "data: [DONE]\n\n";
+    char tail[64];
+    int tail_len = snprintf(tail, sizeof(tail), "%zx\r\n%s\r\n0\r\n\r\n", strlen(done), done);
+    return write_all(fd, tail, tail_len);
+}
+
+// The last user message of a chat-completion request
+static const char* last_message(struct json_object *request) {
+    struct json_object *messages, *last, *content;
+    if (request && json_object_object_get_ex(request, "messages", &messages) &&
+        json_object_array_length(messages) > 0 &&
+        (last = json_object_array_get_idx(messages, json_object_array_length(messages) - 1)) &&
+        json_object_object_get_ex(last, "content", &content)) {
+        return json_object_get_string(content);
+    }
+    return "";
+}
+
+// All message contents of a request, in order: what a prefix cache keys on
+static char* prompt_text(struct json_object *request) {
+    struct json_object *messages, *content;
+    size_t size = 1;
+    if (!request || !json_object_object_get_ex(request, "messages", &messages)) return strdup("");
+    size_t count = json_object_array_length(messages);
+    for (size_t i = 0; i < count; i++) {
+        if (json_object_object_get_ex(json_object_array_get_idx(messages, i), "content", &content)) {
+            size += strlen(json_object_get_string(content)) + 1;
+        }
+    }
+    char *text = malloc(size);
+    size_t pos = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (json_object_object_get_ex(json_object_array_get_idx(messages, i), "content", &content)) {
+            pos += snprintf(text + pos, size - pos, "%s\n", json_object_get_string(content));
+        }
+    }
+    text[pos] = 0;
+    return text;
+}
+
+// Tokens of the longest prefix the prompt shares with a recent one
+static int cached_prefix_tokens(struct json_object *request) {
+    char *prompt = prompt_text(request);
+    size_t best = 0;
+    pthread_mutex_lock(&stats_lock);
+    for (int i = 0; i < PREFIX_CACHE_SLOTS; i++) {
+        const char *old = recent_prompts[i];
+        size_t k = 0;
+        while (old && old[k] && old[k] == prompt[k]) k++;
+        if (k > best) best = k;
+    }
+    free(recent_prompts[recent_next]);
+    recent_prompts[recent_next] = prompt;
+    recent_next = (recent_next + 1) % PREFIX_CACHE_SLOTS;
+    cached_tokens += (long)(best / 4);
+    pthread_mutex_unlock(&stats_lock);
+    return (int)(best / 4);
+}
+
+// A chat completion echoing `text`
+static struct json_object* build_reply(const char *text, size_t request_size, int tokens, int cached) {
+    struct json_object *reply = json_object_new_object();
+    struct json_object *choices = json_object_new_array();
+    struct json_object *choice = json_object_new_object();
+    struct json_object *message = json_object_new_object();
+    struct json_object *usage = json_object_new_object();
+    json_object_object_add(message, "role", json_object_new_string("assistant"));
+    json_object_object_add(message, "content", json_object_new_string(text));
+    json_object_object_add(choice, "message", message);
+    json_object_array_add(choices, choice);
+    json_object_object_add(reply, "choices", choices);
+    json_object_object_add(usage, "prompt_tokens", json_object_new_int((int)(request_size / 4)));
+    json_object_object_add(usage, "completion_tokens", json_object_new_int(tokens));
+    json_object_object_add(usage, "total_tokens", json_object_new_int((int)(request_size / 4) + tokens));
+    struct json_object *details = json_object_new_object();
+    json_object_object_add(details, "cached_tokens", json_object_new_int(cached));
+    json_object_object_add(usage, "prompt_tokens_details", details);
+    json_object_object_add(reply, "usage", usage);
+    return reply;
+}
+
+static int handle_completion(int fd, const char *body) {
+    double started = now_ms();
+    pthread_mutex_lock(&stats_lock);
+    request_count++;
+    pthread_mutex_unlock(&stats_lock);
+
+    double r = random_unit();
+    if (r < options.throttle_rate) {
+        pthread_mutex_lock(&stats_lock);
+        throttle_count++;
+        pthread_mutex_unlock(&stats_lock);
+        return send_response(fd, 429, "Too Many Requests", "Retry-After: 1\r\n",
+            "{\"error\": {\"message\": \"Rate limit reached\", \"type\": \"requests\"}}");
+    }
+    if (r < options.throttle_rate + options.error_rate) {
+        pthread_mutex_lock(&stats_lock);
+        error_count++;
+        pthread_mutex_unlock(&stats_lock);
+        return send_response(fd, 500, "Internal Server Error", NULL,
+            "{\"error\": {\"message\": \"Injected failure\", \"type\": \"server_error\"}}");
+    }
+
+    struct json_object *request = json_tokener_parse(body);
+    struct json_object *stream;
+    const char *text = last_message(request);
+    int streaming = 0;
+    if (request && json_object_object_get_ex(request, "stream", &stream)) {
+        streaming = json_object_get_boolean(stream);
+    }
+
+    // ~4 characters per token is close enough for pacing
+    int tokens = (int)(strlen(text) / 4) + 1;
+    sleep_ms(options.latency_ms);
+
+    int rc;
+    if (streaming) {
+        rc = send_stream(fd, text, tokens);
+    } else {
+        if (options.tokens_per_sec > 0) sleep_ms(tokens * 1000.0 / options.tokens_per_sec);
+
+        struct json_object *reply = build_reply(text, strlen(body), tokens, cached_prefix_tokens(request));
+        rc = send_response(fd, 200, "OK", NULL, json_object_to_json_string(reply));
+        json_object_put(reply);
+    }
+    if (request) json_object_put(request);
+
+    if (rc == 0) record(started, tokens);
+    return rc;
+}
+
+// Serves requests on one keep-alive connection until the client closes it
+static void* connection_main(void *arg) {
+    int fd = (int)(long)arg;
+    size_t capacity = 65536, size = 0;
+    char *buf = malloc(capacity);
+
+    for (;;) {
+        // Read until the end of the headers
+        char *header_end = NULL;
+        while (!(header_end = memmem(buf, size, "\r\n\r\n", 4))) {
+            if (size == capacity) {
+                capacity *= 2;
+                buf = realloc(buf, capacity);
+            }
+            ssize_t n = recv(fd, buf + size, capacity - size, 0);
+            if (n <= 0) goto done;
+            size += n;
+        }
+        size_t header_len = header_end - buf + 4;
+
+        size_t content_length = 0;
+        for (char *p = buf; p < header_end; p = strstr(p, "\r\n") + 2) {
+            if (strncasecmp(p, "Content-Length:", 15) == 0) content_length = strtoul(p + 15, NULL, 10);
+        }
+
+        // Read the body
+        while (size < header_len + content_length) {
+            if (header_len + content_length + 1 > capacity) {
+                capacity = header_len + content_length + 1;
+                buf = realloc(buf, capacity);
+            }
+            ssize_t n = recv(fd, buf + size, capacity - size, 0);
+            if (n <= 0) goto done;
+            size += n;
+        }
+
+        char *body = strndup(buf + header_len, content_length);
+        int rc;
+        if (strncmp(buf, "GET /stats", 10) == 0) {
+            rc = handle_stats(fd);
+        } else if (strncmp(buf, "POST ", 5) == 0) {
+            rc = handle_completion(fd, body);
+        } else {
+            rc = send_response(fd, 404, "Not Found", NULL, "{}");
+        }
+        free(body);
+        if (rc != 0) break;
+
+        // Keep whatever the client already sent of the next request
+        size_t consumed = header_len + content_length;
+        memmove(buf, buf + consumed, size - consumed);
+        size -= consumed;
+    }
+done:
+    free(buf);
+    close(fd);
+    return NULL;
+}
+
+// Answers a batch API request file (one request per line) with a result
+// file in the provider's format on stdout
+static int answer_batch(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror("Failed to open batch requests");
+        return 1;
+    }
+    char *line = NULL;
+    size_t line_size = 0;
+    long count = 0;
+    while (getline(&line, &line_size, f) != -1) {
+        struct json_object *request = json_tokener_parse(line);
+        struct json_object *custom_id, *body;
+        if (!request || !json_object_object_get_ex(request, "custom_id", &custom_id) ||
+            !json_object_object_get_ex(request, "body", &body)) {
+            if (request) json_object_put(request);
+            continue;
+        }
+
+        struct json_object *result = json_object_new_object();
+        struct json_object *response = json_object_new_object();
+        char request_id[32];
+        snprintf(request_id, sizeof(request_id), "req_%ld", ++count);
+        json_object_object_add(result, "id", json_object_new_string(request_id));
+        json_object_object_add(result, "custom_id", json_object_get(custom_id));
+        if (random_unit() < options.error_rate) {
+            struct json_object *error = json_object_new_object();
+            struct json_object *error_body = json_object_new_object();
+            json_object_object_add(error, "message", json_object_new_string("Injected failure"));
+            json_object_object_add(error, "type", json_object_new_string("server_error"));
+            json_object_object_add(error_body, "error", error);
+            json_object_object_add(response, "status_code", json_object_new_int(500));
+            json_object_object_add(response, "body", error_body);
+        } else {
+            const char *text = last_message(body);
+            int tokens = (int)(strlen(text) / 4) + 1;
+            json_object_object_add(response, "status_code", json_object_new_int(200));
+            json_object_object_add(response, "body", build_reply(text, strlen(json_object_to_json_string(body)), tokens, 0));
+        }
+        json_object_object_add(response, "request_id", json_object_new_string(request_id));
+        json_object_object_add(result, "response", response);
+        json_object_object_add(result, "error", NULL);
+        printf("%s\n", json_object_to_json_string_ext(result, JSON_C_TO_STRING_PLAIN));
+        json_object_put(result);
+        json_object_put(request);
+    }
+    free(line);
+    fclose(f);
+    return 0;
+}
+
+static void print_usage(const char *progname) {
+    printf("Usage: %s [options]\n", progname);
+    printf("  -p, --port <n>            Port to listen on (default 18080)\n");
+    printf("  -l, --latency <ms>        Time to first token (default 200)\n");
+    printf("  -t, --tokens-per-sec <n>  Generation speed, 0 = instant (default 100)\n");
+    printf("  -e, --error-rate <f>      Fraction of requests failing with HTTP 500 (default 0)\n");
+    printf("  -r, --throttle-rate <f>   Fraction of requests throttled with HTTP 429 (default 0)\n");
+    printf("  -b, --batch <file>        Write results for a batch API request file to stdout and exit\n");
+}
+
+int main(int argc, char *argv[]) {
+    static struct option long_options[] = {
+        {"port", required_argument, 0, 'p'},
+        {"latency", required_argument, 0, 'l'},
+        {"tokens-per-sec", required_argument, 0, 't'},
+        {"error-rate", required_argument, 0, 'e'},
+        {"throttle-rate", required_argument, 0, 'r'},
+        {"batch", required_argument, 0, 'b'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}
+    };
+    const char *batch_file = NULL;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "p:l:t:e:r:b:h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'p': options.port = atoi(optarg); break;
+            case 'l': options.latency_ms = atoi(optarg); break;
+            case 't': options.tokens_per_sec = atoi(optarg); break;
+            case 'e': options.error_rate = atof(optarg); break;
+            case 'r': options.throttle_rate = atof(optarg); break;
+            case 'b': batch_file = optarg; break;
+            case 'h': print_usage(argv[0]); return 0;
+            default: print_usage(argv[0]); return 1;
+        }
+    }
+
+    if (batch_file) return answer_batch(batch_file);
+
+    signal(SIGPIPE, SIG_IGN);
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(options.port);
+    if (bind(server, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(server, 128) != 0) {
+        perror("Failed to listen");
+        return 1;
+    }
+    printf("Mock LLM listening on 127.0.0.1:%d (latency %d ms, %d tokens/s, errors %.2f, 429s %.2f)\n",
+        options.port, options.latency_ms, options.tokens_per_sec, options.error_rate, options.throttle_rate);
+    fflush(stdout);
+
+    for (;;) {
+        int fd = accept(server, NULL, NULL);
+        if (fd < 0) continue;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, connection_main, (void*)(long)fd) != 0) {
+            close(fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+}
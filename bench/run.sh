@@ -0,0 +1,93 @@
+#!/bin/sh
+# Runs epubtrans against the local mock server on a synthetic book and
+# reports throughput. Invoked by `make bench`; every knob is an environment
+# variable so runs are easy to compare:
+#
+#   BENCH_CHAPTERS, BENCH_PARAGRAPHS, BENCH_WORDS   Book shape
+#   BENCH_ASSETS, BENCH_ASSET_KB                    Binary assets
+#   BENCH_WORKERS                                   "workers" in the config
+#   BENCH_LATENCY (ms), BENCH_TPS                   Mock server timing
+#   BENCH_ERROR_RATE, BENCH_THROTTLE_RATE           Injected 5xx / 429 (0..1)
+#   BENCH_PORT, BENCH_ARGS                          Mock port, extra epubtrans args
+
+set -e
+
+CHAPTERS=${BENCH_CHAPTERS:-20}
+PARAGRAPHS=${BENCH_PARAGRAPHS:-40}
+WORDS=${BENCH_WORDS:-60}
+ASSETS=${BENCH_ASSETS:-5}
+ASSET_KB=${BENCH_ASSET_KB:-256}
+WORKERS=${BENCH_WORKERS:-4}
+LATENCY=${BENCH_LATENCY:-200}
+TPS=${BENCH_TPS:-100}
+ERROR_RATE=${BENCH_ERROR_RATE:-0}
+THROTTLE_RATE=${BENCH_THROTTLE_RATE:-0}
+PORT=${BENCH_PORT:-18080}
+
+WORK_DIR=$(mktemp -d "${TMPDIR:-/tmp}/epubtrans-bench.XXXXXX")
+MOCK_PID=
+
+cleanup() {
+    [ -n "$MOCK_PID" ] && kill "$MOCK_PID" 2>/dev/null
+    rm -rf "$WORK_DIR"
+}
+trap cleanup EXIT INT TERM
+
+bench/gen_epub -c "$CHAPTERS" -p "$PARAGRAPHS" -w "$WORDS" -a "$ASSETS" -k "$ASSET_KB" "$WORK_DIR/book.epub"
+
+bench/mock_server -p "$PORT" -l "$LATENCY" -t "$TPS" -e "$ERROR_RATE" -r "$THROTTLE_RATE" > "$WORK_DIR/mock.log" 2>&1 &
+MOCK_PID=$!
+
+# Wait for the mock to accept connections
+i=0
+until curl -s -o /dev/null "http://127.0.0.1:$PORT/stats"; do
+    i=$((i + 1))
+    if [ "$i" -ge 50 ]; then
+        echo "Mock server did not start:" >&2
+        cat "$WORK_DIR/mock.log" >&2
+        exit 1
+    fi
+    sleep 0.1
+done
+
+cat > "$WORK_DIR/config.json" <<EOF
+{
+    "llm_provider": "openai",
+    "model": "bench-model",
+    "api_key": "bench",
+    "api_endpoint": "http://127.0.0.1:$PORT/v1/chat/completions",
+    "target_language": "fr",
+    "context_window": 4096,
+    "workers": $WORKERS
+}
+EOF
+
+START=$(date +%s.%N)
+./epubtrans -c "$WORK_DIR/config.json" $BENCH_ARGS "$WORK_DIR/book.epub" "$WORK_DIR/out.epub" > "$WORK_DIR/run.log" 2>&1 || {
+    echo "epubtrans failed:" >&2
+    tail -n 20 "$WORK_DIR/run.log" >&2
+    exit 1
+}
+END=$(date +%s.%N)
+
+STATS=$(curl -s "http://127.0.0.1:$PORT/stats")
+
+# Pulls a number out of the flat /stats JSON
+stat() {
+    echo "$STATS" | sed -n "s/.*\"$1\": *\([0-9.]*\).*/\1/p"
+}
+
+echo
+echo "Book:            $CHAPTERS chapters x $PARAGRAPHS paragraphs x $WORDS words, $ASSETS assets of $ASSET_KB KiB"
+echo "Mock server:     ${LATENCY} ms latency, $TPS tokens/s, error rate $ERROR_RATE, throttle rate $THROTTLE_RATE"
+awk -v start="$START" -v end="$END" -v chapters="$CHAPTERS" \
+    -v requests="$(stat requests)" -v errors="$(stat errors)" -v throttled="$(stat throttled)" \
+    -v tokens="$(stat completion_tokens)" -v p50="$(stat p50_ms)" -v p99="$(stat p99_ms)" 'BEGIN {
+    elapsed = end - start
+    printf "Wall time:       %.2f s\n", elapsed
+    printf "Books/hour:      %.1f\n", elapsed > 0 ? 3600 / elapsed : 0
+    printf "Requests:        %d (%.1f per chapter, %d errors, %d throttled)\n", requests, requests / chapters, errors, throttled
+    printf "Output tokens:   %d\n", tokens
+    printf "Latency:         p50 %.1f ms, p99 %.1f ms\n", p50, p99
+}'
+grep -E "^(Stage times|Requests|Tokens):" "$WORK_DIR/run.log" || true
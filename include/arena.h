@@ -0,0 +1,39 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "common.h"
+
+// Bump allocator for short-lived allocations of the translation path.
+// Memory is carved out of large blocks and released all at once by
+// arena_reset(), so a chapter's hundreds of small strings and arrays cost
+// a handful of heap calls. An arena is not thread-safe; each worker thread
+// uses its own through arena_thread().
+typedef struct arena arena_t;
+
+// Default size of a block; larger requests get a block of their own
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+arena_t* arena_create(size_t block_size);
+void arena_destroy(arena_t *arena);
+
+// Returns memory aligned for any type, or NULL when out of memory
+void* arena_alloc(arena_t *arena, size_t size);
+void* arena_calloc(arena_t *arena, size_t count, size_t size);
+
+// Grows an allocation. The last allocation is extended in place when its
+// block has room, anything else is copied.
+void* arena_realloc(arena_t *arena, void *ptr, size_t old_size, size_t new_size);
+
+char* arena_strdup(arena_t *arena, const char *s);
+char* arena_strndup(arena_t *arena, const char *s, size_t n);
+
+// Frees everything allocated so far. The blocks are kept (merged into one
+// if there were several), so the next chapter usually needs no heap call at
+// all. The arena's counters are added to the run metrics.
+void arena_reset(arena_t *arena);
+
+// The calling thread's arena, created on first use and destroyed with the
+// thread
+arena_t* arena_thread(void);
+
+#endif // ARENA_H
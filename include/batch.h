@@ -0,0 +1,31 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "common.h"
+#include "arena.h"
+
+// Segments are framed in the request and in the reply by a marker line:
+//   <<<SEG 12>>>
+//   text of segment 12
+#define BATCH_MARKER_PREFIX "<<<SEG "
+#define BATCH_MARKER_SUFFIX ">>>"
+
+// Tokens a marker line adds to a request
+#define BATCH_MARKER_TOKENS 8
+
+typedef struct {
+    int id;             // Stable id (document order within the chapter)
+    const char *text;   // Source text, not owned
+    char *translation;  // Filled by batch_parse_reply()
+} batch_segment_t;
+
+// Builds the user message carrying all segments with their markers.
+// Allocated in `arena`, or on the heap (caller frees) if it is NULL.
+char* batch_build_input(const batch_segment_t *segments, int count, arena_t *arena);
+
+// Maps the marked sections of an LLM reply back onto the segments by id.
+// Translations are allocated like batch_build_input() does.
+// Returns the number of segments that received a translation.
+int batch_parse_reply(const char *reply, batch_segment_t *segments, int count, arena_t *arena);
+
+#endif // BATCH_H
@@ -0,0 +1,53 @@
+#ifndef BATCH_API_H
+#define BATCH_API_H
+
+#include "common.h"
+#include "arena.h"
+#include "llm_client.h"
+
+// Offline mode for the provider's asynchronous batch endpoint, in two runs.
+// Export (config->batch_export_file) segments the book and writes every
+// chat completion it would send as one JSONL line instead:
+//   {"custom_id":"c3-s12-9f0c...","method":"POST","url":"/v1/chat/completions","body":{...}}
+// Import (config->batch_import_file) reads the provider's result file, one
+// line per request with the same custom_id, and takes the translations from
+// it without any network call.
+//
+// A custom id names the chapter, the first segment of the request and a
+// hash of the request itself, so the same book and settings produce the
+// same ids in both runs and a result can never land on a different text.
+
+typedef enum {
+    BATCH_API_OFF,
+    BATCH_API_EXPORT,
+    BATCH_API_IMPORT
+} batch_api_mode_t;
+
+#define BATCH_API_ID_SIZE 64
+
+// Opens the export file or loads the result file named in the config.
+// Returns -1 if it cannot be opened or read.
+int batch_api_init(config_t *config);
+void batch_api_cleanup(void);
+
+batch_api_mode_t batch_api_mode(void);
+
+void batch_api_make_id(char *id, int chapter, int first_segment, config_t *config, const llm_request_t *request);
+
+// Export: appends the request to the file. Returns 0 or -1.
+int batch_api_export(const char *id, config_t *config, const llm_request_t *request);
+
+// Import: content of the result for `id`, allocated in `arena`. NULL when
+// the result is absent or failed; the request then counts as missing.
+char* batch_api_result(const char *id, arena_t *arena);
+
+// Import: records segments a result left out (a batched reply that lost
+// some of its markers)
+void batch_api_missing(const char *id, int segments);
+
+// Export: number of requests written. Import: number of segments left
+// without a translation, after reporting them and any results no request
+// asked for.
+long batch_api_finish(void);
+
+#endif // BATCH_API_H
@@ -0,0 +1,39 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "common.h"
+#include <stdint.h>
+
+// Content-addressed key of one translation
+typedef struct {
+    uint64_t hi;
+    uint64_t lo;
+} cache_key_t;
+
+// Results of cache_acquire()
+#define CACHE_HIT   0   // *value holds the cached translation
+#define CACHE_OWNER 1   // Caller must compute the value and call cache_release()
+#define CACHE_BUSY  2   // Another thread is computing it (only when wait == 0)
+
+// Opens (or creates) the append-only cache file at config->cache_file.
+// Without a cache file every lookup behaves as a miss. Safe to call twice.
+int cache_init(config_t *config);
+void cache_cleanup(void);
+
+// Hashes everything the translation depends on: source text, target
+// language, model, prompt template and the context string.
+void cache_make_key(cache_key_t *key, const char *text, config_t *config, const char *context_string);
+
+// Mixes one more input of the translation into a key, e.g. the glossary
+// entries sent with the text
+void cache_key_add(cache_key_t *key, const char *data);
+
+// Looks the key up. On a miss the caller becomes the owner of the key and
+// other threads asking for it wait (or get CACHE_BUSY) until it is released,
+// so the same text is never requested twice at the same time.
+int cache_acquire(const cache_key_t *key, char **value, int wait);
+
+// Stores value (if not NULL) and wakes threads waiting for the key
+void cache_release(const cache_key_t *key, const char *value);
+
+#endif // CACHE_H
@@ -16,14 +16,61 @@ typedef struct {
     char *tone;
     char *api_endpoint;
     char *context_file;
+    char *cache_file;         // Persistent translation cache (NULL = disabled)
+    char *glossary_file;      // Forced translations, "term<TAB>translation" per line (NULL = none)
     char *prompt_context_init;
     char *prompt_context_update;
+    char *prompt_context_part;    // Summarizes one part of a chapter too long for one request
     char *prompt_translation;
+    char *prompt_batch;       // Appended to the translation prompt in batched mode
+    char *prompt_terminology; // Translates the terms found by the terminology pre-scan
     int sliding_window_size;
+    int terminology_terms;    // Names and terms pre-scanned and translated once per book (0 = off)
+    int workers;              // Chapters translated in parallel (default 1)
+    int in_memory;            // Translate straight from/to the archives, no temp dir
+    int skip_nonlinear;       // Leave spine items marked linear="no" untranslated
+    int stream;               // Read replies as server-sent events
+    int legacy_json;          // Build requests and parse replies with json-c instead of the built-in scanner
+    int stall_timeout;        // Seconds a stream may stay silent (0 = default)
+    int rpm_limit;            // Requests per minute (0 = learn from response headers)
+    int tpm_limit;            // Tokens per minute (0 = learn from response headers)
+    int max_retries;          // Retries of throttled/failed requests (0 = default)
+    int context_max_lag;      // Chapters the strategy context may trail behind (-1 = auto)
+    int batch_tokens;         // Token budget per request (0 = derive from context_window, -1 = no packing)
+    double langid_threshold;  // Confidence to leave text already in the target language (0 = default, < 0 = never)
+    char *metrics_file;       // JSON run report (NULL = none)
+    char *metrics_prometheus_file; // Same metrics in the Prometheus text format (NULL = none)
+    int metrics_interval;     // Seconds between report updates (0 = default, -1 = only at the end)
+    char *daemon_socket;      // Daemon mode: Unix socket accepting jobs (NULL = none)
+    char *daemon_spool;       // Daemon mode: spool directory watched for jobs (NULL = none)
+    int daemon_books;         // Daemon mode: books translated at the same time (0 = default)
+    char *batch_export_file;  // Batch API: write the requests here as JSONL instead of sending them
+    char *batch_import_file;  // Batch API: take the translations from this result JSONL
+    struct worker_pool *worker_pool; // Set by the pipeline while a book runs: its pool, shared by the strategies' parallel requests (NULL = run them in turn)
 } config_t;
 
+struct journal;
+
+// Per-chapter state threaded through the translation path
+typedef struct {
+    const char *context_string;  // Prompt context from the strategies
+    struct journal *journal;     // Resume journal (NULL = disabled)
+    int chapter;                 // Spine index, keys the chapter in the journal
+} chapter_ctx_t;
+
 config_t* load_config(const char *path);
 void free_config(config_t *config);
-int translate_xhtml(const char *path, config_t *config, const char *context_string);
+
+// Deep copy, e.g. to override settings for one book
+config_t* copy_config(const config_t *config);
+
+// Translates the XHTML file at path and writes the result to out_path
+// (atomically, through a temporary file). out_path may equal path.
+int translate_xhtml(const char *path, const char *out_path, config_t *config, const chapter_ctx_t *chapter);
+
+// Same as translate_xhtml, for a chapter held in memory.
+// *out is malloc'd and NUL-terminated; caller frees.
+int translate_xhtml_buffer(const char *data, size_t size, char **out, size_t *out_size,
+                           config_t *config, const chapter_ctx_t *chapter);
 
 #endif // COMMON_H
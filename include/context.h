@@ -17,6 +17,10 @@ void free_context(context_t *ctx);
 int save_context(const char *filename, context_t *ctx);
 context_t* load_context(const char *filename);
 
+// In-memory JSON form, as stored in the context file (caller frees)
+char* context_to_json(context_t *ctx);
+context_t* context_from_json(const char *json);
+
 // LLM Interaction
 // Initializes context from the first chunk of text (Author, chunks, etc)
 int init_context_with_llm(context_t *ctx, const char *initial_text, config_t *config);
@@ -23,6 +23,18 @@ struct ContextStrategy {
     
     // Cleanup internal state
     void (*cleanup)(void *state);
+
+    // Optional: serialize the state so an interrupted run can resume.
+    // Caller must free the returned string.
+    char* (*save_state)(void *state);
+
+    // Optional: replace the state with a snapshot from save_state
+    void (*load_state)(void *state, const char *snapshot);
+
+    // Optional: called once before any chapter is translated (and after
+    // load_state on resume) with the source XHTML of the chapters still to
+    // translate, in spine order. Entries may be NULL.
+    void (*prescan)(void *state, char **chapters, int count, config_t *config);
     
     // The internal state/data for this instance
     void *state;
@@ -31,5 +43,11 @@ struct ContextStrategy {
 // Constructor-like functions for specific strategies
 ContextStrategy* create_history_strategy();
 ContextStrategy* create_sliding_window_strategy();
+ContextStrategy* create_terminology_strategy();
+
+// The names and terms the Terminology pre-scan finds in the chapters
+// (XHTML, entries may be NULL), best first, at most `max`, one per line:
+// the list its LLM call translates. NULL if there are none (caller frees).
+char* terminology_candidates(char **chapters, int count, int max);
 
 #endif // CONTEXT_STRATEGY_H
@@ -0,0 +1,35 @@
+#ifndef CONTEXT_UPDATER_H
+#define CONTEXT_UPDATER_H
+
+#include "common.h"
+#include "context_strategy.h"
+
+// Runs the context strategies on a background thread so their LLM calls
+// overlap with the translation of the following chapters. Completed
+// chapters are submitted in spine order and applied in that order; once
+// the updater is running the strategies must only be touched through it.
+typedef struct context_updater context_updater_t;
+
+// Called on the updater thread after the strategies saw a chapter
+typedef void (*chapter_finish_fn)(void *arg);
+
+context_updater_t* context_updater_create(ContextStrategy **strategies, int strategy_count, config_t *config);
+
+// Drains the queue and stops the thread
+void context_updater_destroy(context_updater_t *updater);
+
+// Queues the next chapter in spine order. Takes ownership of `content`
+// (the translated text, may be NULL for chapters that add no context);
+// `finish` (may be NULL) runs after the strategies were updated.
+void context_updater_submit(context_updater_t *updater, char *content, chapter_finish_fn finish, void *arg);
+
+// Blocks until at least `count` submitted chapters have been applied
+void context_updater_wait(context_updater_t *updater, int count);
+
+// Combined prompt context as of the last applied chapter (caller frees)
+char* context_updater_prompt(context_updater_t *updater);
+
+// Concatenates the prompt chunks of all strategies (caller frees)
+char* build_combined_context(ContextStrategy **strategies, int strategy_count, config_t *config);
+
+#endif // CONTEXT_UPDATER_H
@@ -0,0 +1,32 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "common.h"
+
+// Long-running mode for translating many books. Jobs arrive over a Unix
+// socket (config->daemon_socket) and/or as JSON files dropped into a spool
+// directory (config->daemon_spool). All books share one worker pool, LLM
+// client, cache and rate limiter; config->daemon_books of them are
+// translated at a time, highest priority first.
+//
+// Socket protocol: one JSON request per connection, one JSON line back.
+//   {"cmd":"submit","input":"/books/a.epub","output":"/out/a_fr.epub","lang":"fr","priority":5}
+//   {"cmd":"status"}            {"cmd":"status","id":3}
+//   {"cmd":"cancel","id":3}     {"cmd":"shutdown"}
+//
+// Spool layout: job files (the submit request without "cmd") are written
+// to <spool>/new/ (via rename, so they appear complete). Accepted jobs
+// move to cur/, then to done/ or failed/; status/<name> holds the current
+// status of each job. Jobs left in cur/ by a stopped daemon are resumed
+// when it starts again.
+
+// Runs until a shutdown request or SIGINT/SIGTERM. Books in progress stop
+// after their running chapters and can be resumed. Returns 0 on a clean
+// shutdown, -1 if the daemon could not start.
+int daemon_run(config_t *config);
+
+// Client side: sends one request to a running daemon and prints the reply
+// to `out`. Returns 0 if the daemon answered "ok".
+int daemon_request(const char *socket_path, const char *request, FILE *out);
+
+#endif // DAEMON_H
@@ -5,26 +5,75 @@
 #include <zip.h>
 #include <libxml/parser.h>
 #include <libxml/tree.h>
+#include <pthread.h>
 
 typedef struct {
     char *name;
     char *href;
     char *media_type;
+    char *properties;   // e.g. "nav", "cover-image" (NULL if absent)
 } epub_item_t;
 
+// One <itemref>, resolved against the manifest when the OPF is parsed
+typedef struct {
+    char *idref;
+    int item;           // Index into the manifest, -1 if the idref is unknown
+    int linear;         // 0 for linear="no" (notes, pop-ups, answer keys)
+    char *properties;   // e.g. "page-spread-left" (NULL if absent)
+} epub_spine_item_t;
+
 typedef struct {
     char *title;
     char *author;
-    char **spine; // Array of item IDs
+    epub_spine_item_t *spine;
     int spine_count;
     epub_item_t *manifest;
     int manifest_count;
+    int *manifest_index;    // Open-addressing hash table: id -> manifest index (-1 = empty)
+    int manifest_index_size;
     char *base_dir; // Directory of the OPF file relative to EPUB root
 } epub_metadata_t;
 
+// One entry of an EPUB opened in memory
+typedef struct {
+    char *name;
+    zip_uint64_t index;  // Index in the source archive
+    char *data;          // Rewritten content, NULL while unchanged
+    size_t size;
+} epub_entry_t;
+
+// An EPUB read straight from its archive. Entries are decompressed only
+// when read, and rewritten entries are kept in memory until written out.
+typedef struct {
+    zip_t *zip;
+    epub_entry_t *entries;   // In source archive order
+    int entry_count;
+    pthread_mutex_t lock;    // libzip archives are not thread-safe
+} epub_book_t;
+
 int extract_epub(const char *path, const char *dest_dir);
-int archive_epub(const char *dest_path, const char *src_dir);
 epub_metadata_t* parse_epub_metadata(const char *root_dir);
 void free_epub_metadata(epub_metadata_t *meta);
 
+// Looks a manifest item up by id in O(1). Returns NULL if there is none.
+epub_item_t* epub_find_item(const epub_metadata_t *meta, const char *id);
+
+epub_book_t* epub_book_open(const char *path);
+void epub_book_close(epub_book_t *book);
+
+// Decompresses an entry (the rewritten version if any). Thread-safe.
+// Returns a malloc'd, NUL-terminated buffer or NULL; caller frees.
+char* epub_book_read(epub_book_t *book, const char *name, size_t *size);
+
+// Replaces an entry's content; takes ownership of data. Thread-safe.
+int epub_book_replace(epub_book_t *book, const char *name, char *data, size_t size);
+
+// Writes the book to dest_path: mimetype first and stored, then every
+// entry in source order. Unchanged entries are copied in their compressed
+// form from the source archive; rewritten ones are deflated on `threads`
+// threads before the write.
+int epub_book_write(epub_book_t *book, const char *dest_path, int threads);
+
+epub_metadata_t* parse_epub_metadata_from_book(epub_book_t *book);
+
 #endif // EPUB_H
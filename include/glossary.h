@@ -0,0 +1,39 @@
+#ifndef GLOSSARY_H
+#define GLOSSARY_H
+
+#include "common.h"
+#include "arena.h"
+
+// User glossary of forced translations (config->glossary_file), one entry
+// per line:
+//   source term<TAB>translation
+// Blank lines and lines starting with '#' are ignored. The source terms are
+// compiled once into an Aho-Corasick automaton, so a text is scanned for
+// all of them in a single pass however large the glossary is, and only the
+// entries that occur in a request are added to its prompt. Matching ignores
+// ASCII case and only accepts whole words.
+
+// Room for the entries of a typical request. Callers grow their array
+// when glossary_find() fills it, so a prompt never drops an entry.
+#define GLOSSARY_MAX_MATCHES 64
+
+// Loads and compiles the glossary. Without a glossary file nothing is
+// found. Returns -1 if the file cannot be read. Safe to call twice.
+int glossary_init(config_t *config);
+void glossary_cleanup(void);
+
+// Adds the entries occurring in text to found[0..count) (without
+// duplicates, at most `max`) and returns the new count
+int glossary_find(const char *text, size_t len, int *found, int count, int max);
+
+// Prompt section listing the entries, allocated in `arena`, or on the
+// heap (caller frees) if it is NULL. NULL when count is 0.
+char* glossary_prompt(const int *entries, int count, arena_t *arena);
+
+// Whether the forced translation of the entry appears in `translation`
+int glossary_followed(int entry, const char *translation);
+
+const char* glossary_source(int entry);
+const char* glossary_target(int entry);
+
+#endif // GLOSSARY_H
@@ -0,0 +1,39 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "common.h"
+
+// Write-ahead journal of a translation run. Every append is a single
+// checksummed record written with one write() and made durable with
+// fsync() before the call returns, so after a crash the journal holds
+// exactly the segments and chapters that were completed.
+typedef struct journal journal_t;
+
+// Opens the journal at `path`. With resume == 0 any existing journal is
+// discarded and a new run identified by `run_id` is started. With
+// resume != 0 the existing records are loaded; if they belong to another
+// run (different run_id) NULL is returned.
+journal_t* journal_open(const char *path, const char *run_id, int resume);
+void journal_close(journal_t *journal);
+
+// Identity of an input file for a run id: its size and a hash of its
+// content, so that a journal is never replayed into another book saved
+// under the same path. Returns -1 if the file cannot be read.
+int journal_input_identity(const char *path, char *id, size_t size);
+
+// Records translated segments of a chapter in one durable append
+int journal_record_segments(journal_t *journal, int chapter, const int *ids, const char **texts, int count);
+
+// Translation of a segment recorded by an earlier run, or NULL
+const char* journal_lookup_segment(journal_t *journal, int chapter, int id);
+
+// Marks a chapter as completed together with an opaque state snapshot
+int journal_record_chapter(journal_t *journal, int chapter, const char *state);
+
+// Returns 1 if an earlier run completed the chapter
+int journal_chapter_done(journal_t *journal, int chapter);
+
+// State snapshot stored with the completed chapter, or NULL
+const char* journal_chapter_state(journal_t *journal, int chapter);
+
+#endif // JOURNAL_H
@@ -0,0 +1,44 @@
+#ifndef JSON_LITE_H
+#define JSON_LITE_H
+
+#include "common.h"
+
+// Minimal JSON support for the hot path of chat completions: a writer that
+// escapes strings straight into a reusable buffer, and an extractor that
+// pulls content, usage and error out of a reply in one pass without
+// building a tree. Everything else keeps using json-c.
+
+// Growable byte buffer, always NUL-terminated. Reset keeps the memory.
+typedef struct {
+    char *data;
+    size_t size;
+    size_t capacity;
+} json_buffer_t;
+
+int json_buffer_reserve(json_buffer_t *buffer, size_t extra);
+int json_buffer_append(json_buffer_t *buffer, const char *data, size_t len);
+void json_buffer_reset(json_buffer_t *buffer);
+void json_buffer_free(json_buffer_t *buffer);
+
+// Writers; all return 0, or -1 when out of memory
+int json_write_raw(json_buffer_t *buffer, const char *text);
+int json_write_string(json_buffer_t *buffer, const char *text);   // Quoted and escaped; NULL writes null
+int json_write_double(json_buffer_t *buffer, double value);
+
+// What a chat-completion reply, or one chunk of a streamed reply, carries
+typedef struct {
+    int has_content;            // choices[0].message.content or choices[0].delta.content was a string
+    long prompt_tokens;         // usage.*, -1 when absent
+    long completion_tokens;
+    long total_tokens;
+    long cached_tokens;         // Prompt tokens served from the provider's prefix cache, -1 when absent
+    int has_error;              // An "error" member was present
+    char error[512];            // error.message (or the error string), truncated
+} json_reply_t;
+
+// Scans `len` bytes of JSON. The unescaped content is appended to `content`.
+// Returns 0, or -1 if the text is not well-formed JSON (callers then fall
+// back to json-c for a diagnostic).
+int json_extract_reply(const char *json, size_t len, json_reply_t *reply, json_buffer_t *content);
+
+#endif // JSON_LITE_H
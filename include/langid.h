@@ -0,0 +1,32 @@
+#ifndef LANGID_H
+#define LANGID_H
+
+#include "common.h"
+
+// Offline language identification. Languages that have a script to
+// themselves (Greek, Hebrew, Thai, Korean, Japanese with kana) are
+// recognised by script. In a script several languages share, Russian,
+// Arabic, Hindi and Chinese are recognised only when the text uses none of
+// the letters their neighbours add and carries their marker letters or
+// words; Ukrainian, Persian, Marathi and the like are not identified. The
+// Latin-script languages (English, French, German, Spanish, Italian,
+// Portuguese, Dutch, Catalan, Galician) are told apart by character
+// trigrams scored against profiles built once from sample texts.
+
+// Default confidence a segment must reach to be left untranslated
+#define LANGID_DEFAULT_THRESHOLD 0.95
+
+// Returns the ISO 639-1 code of the language the text is written in and
+// sets *confidence (0 to 1), or returns NULL when it cannot tell (too
+// little text, a language without a profile).
+const char* langid_detect(const char *text, size_t len, double *confidence);
+
+// Maps a target language setting to its ISO 639-1 code: "pt-br" and
+// "Portuguese" give "pt". NULL for languages langid_detect() never returns.
+const char* langid_code(const char *language);
+
+// Whether the text is in `language` (as in config->target_language) with
+// at least `threshold` confidence
+int langid_is_language(const char *text, size_t len, const char *language, double threshold);
+
+#endif // LANGID_H
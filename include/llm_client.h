@@ -0,0 +1,40 @@
+#ifndef LLM_CLIENT_H
+#define LLM_CLIENT_H
+
+#include "common.h"
+#include "arena.h"
+#include "json_lite.h"
+
+// A single chat-completion request (one system + one user message)
+typedef struct {
+    const char *system_prompt;
+    const char *user_content;
+    double temperature;
+    int expected_tokens;    // Rough length of the reply (0 = unknown). Scales the
+                            // timeout; streamed replies far longer than this are cut off.
+    arena_t *arena;         // Allocate the reply here instead of on the heap (may be NULL)
+} llm_request_t;
+
+// Sets up the shared connection state (DNS/TLS caches, connection pool,
+// common headers). Safe to call more than once; llm_chat() calls it lazily.
+int llm_client_init(config_t *config);
+
+// Releases the shared state. Worker threads must have exited before this.
+void llm_client_cleanup(void);
+
+// Sends a chat completion and returns choices[0].message.content.
+// With config->stream the reply is read as server-sent events and the
+// deltas are assembled as they arrive.
+// Each calling thread keeps its own curl handle alive between calls.
+// Caller must free the returned string unless request->arena is set, in
+// which case it lives until the arena is reset. Returns NULL on failure.
+char* llm_chat(config_t *config, const llm_request_t *request);
+
+// Writes the JSON body of a chat completion into `buffer` (after resetting
+// it), as llm_chat() sends it. Returns 0, or -1 when out of memory.
+int llm_write_body(json_buffer_t *buffer, config_t *config, const llm_request_t *request, int stream);
+
+// Path of the chat-completions endpoint, e.g. "/v1/chat/completions"
+const char* llm_endpoint_path(config_t *config);
+
+#endif // LLM_CLIENT_H
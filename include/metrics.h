@@ -0,0 +1,74 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "common.h"
+
+// Process-wide run metrics: request latency histograms, token usage, retry
+// and cache counters, bytes on the wire and time per pipeline stage. All
+// functions are thread-safe. The report is written as JSON to
+// config->metrics_file and in the Prometheus text format to
+// config->metrics_prometheus_file, every config->metrics_interval seconds
+// while the run is going and once more at the end.
+
+// Pipeline stages. Extract, translate and archive are wall time on the main
+// thread; parse and context update are summed over the threads doing them,
+// so they overlap the translate stage.
+typedef enum {
+    STAGE_EXTRACT,      // Opening the input, extraction, OPF parsing
+    STAGE_PARSE,        // XHTML parsing and serialization of chapters
+    STAGE_TRANSLATE,    // From the first dispatched chapter to the last one finished
+    STAGE_CONTEXT,      // Context strategy updates
+    STAGE_ARCHIVE,      // Writing the output archive
+    STAGE_COUNT
+} metrics_stage_t;
+
+typedef enum {
+    COUNTER_RETRIES,            // Attempts after the first
+    COUNTER_CACHE_HITS,
+    COUNTER_CACHE_MISSES,
+    COUNTER_JOURNAL_REPLAYS,    // Segments restored from the resume journal
+    COUNTER_CHAPTERS_DONE,
+    COUNTER_CHAPTERS_FAILED,
+    COUNTER_ARENA_ALLOCATIONS,  // Allocations served by the per-thread arenas
+    COUNTER_ARENA_BYTES,
+    COUNTER_ARENA_HEAP_BLOCKS,  // Heap calls the arenas made to serve them
+    COUNTER_PREFILTERED,        // Texts kept verbatim without a request (numbers, symbols, links)
+    COUNTER_LANGID_SKIPPED,     // Segments already in the target language
+    COUNTER_LANGID_SKIPPED_TOKENS,
+    COUNTER_GLOSSARY_TERMS,     // Glossary terms found in translated segments
+    COUNTER_GLOSSARY_MISSES,    // ... whose forced translation is not in the output
+    COUNTER_COUNT
+} metrics_counter_t;
+
+// One HTTP attempt of an LLM request
+typedef struct {
+    long status;            // HTTP status (0 = transport error)
+    double seconds;         // Total time of the attempt
+    double first_byte;      // Time to the first response byte (0 = none)
+    long bytes_sent;        // Headers and body
+    long bytes_received;
+} metrics_request_t;
+
+// Starts the periodic writer if an output file and interval are configured.
+// Safe to call more than once.
+void metrics_init(config_t *config);
+
+// Stops the periodic writer and writes the final report
+void metrics_shutdown(void);
+
+void metrics_record_request(const metrics_request_t *request);
+
+// Token usage reported by the provider. cached_tokens is the part of the
+// prompt served from the provider's prefix cache.
+void metrics_record_usage(long prompt_tokens, long completion_tokens, long cached_tokens);
+
+void metrics_count(metrics_counter_t counter, long amount);
+void metrics_add_stage_time(metrics_stage_t stage, double seconds);
+
+// Monotonic clock in seconds, for timing stages
+double metrics_now(void);
+
+// Prints a short human-readable summary (stage times, requests, tokens)
+void metrics_print_summary(FILE *out);
+
+#endif // METRICS_H
@@ -0,0 +1,33 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "common.h"
+#include "worker_pool.h"
+
+// Translation of one book: open and parse it, translate the chapters on a
+// worker pool with the context strategies and the resume journal, write
+// the output archive. The LLM client, cache, rate limiter and metrics are
+// process-wide and must be initialised by the caller, so several books can
+// be translated at once on one shared pool.
+
+// Called on the book's thread each time a chapter is finished
+typedef void (*pipeline_progress_fn)(void *arg, int done, int failed, int total);
+
+typedef struct {
+    const char *input;
+    const char *output;         // NULL: translated.epub
+    const char *work_dir;       // Directory mode: where the book is extracted (NULL: build/temp_epub)
+    int resume;                 // Continue an interrupted run from its journal
+    int priority;               // Chapters of higher-priority books are started first on a shared pool
+    pipeline_progress_fn progress;  // May be NULL
+    int (*stop_requested)(void *arg);   // Polled before chapters are dispatched (may be NULL)
+    void *progress_arg;                 // Passed to both callbacks
+} pipeline_book_t;
+
+// Translates a book with `config`. With a NULL pool, one of
+// config->workers threads is created for the book. Returns 0 when the
+// output was written, 1 when stopped early (the journal is kept for
+// --resume), -1 on failure.
+int pipeline_translate_book(config_t *config, worker_pool_t *pool, const pipeline_book_t *book);
+
+#endif // PIPELINE_H
@@ -0,0 +1,23 @@
+#ifndef PREFILTER_H
+#define PREFILTER_H
+
+#include "common.h"
+
+// Classifies text before it is sent to the LLM. Text with nothing to
+// translate (page numbers, Roman numerals, punctuation, symbols, URLs,
+// e-mail addresses) is kept verbatim; indexes and tables of contents are
+// full of such nodes. The scan for letters runs 16 or 32 bytes at a time
+// with SSE2/AVX2 where available.
+typedef enum {
+    PREFILTER_TRANSLATE,    // Contains words
+    PREFILTER_BLANK,        // Whitespace only (including NBSP and U+3000)
+    PREFILTER_VERBATIM      // No words: numbers, numerals, symbols, URLs, e-mails
+} prefilter_class_t;
+
+prefilter_class_t prefilter_classify(const char *text, size_t len);
+
+// Bounds of the text without leading and trailing whitespace:
+// [*start, *end). Both are 0 for blank text.
+void prefilter_trim(const char *text, size_t len, size_t *start, size_t *end);
+
+#endif // PREFILTER_H
@@ -0,0 +1,44 @@
+#ifndef RATE_LIMIT_H
+#define RATE_LIMIT_H
+
+#include "common.h"
+
+// Process-wide limiter shared by all worker threads. Two token buckets,
+// requests per minute and tokens per minute, refill continuously; a request
+// waits until both can cover it. Limits come from the config and are
+// tightened by the x-ratelimit-* headers the provider sends back.
+typedef struct {
+    long limit_requests;        // -1 when the header was absent
+    long limit_tokens;
+    long remaining_requests;
+    long remaining_tokens;
+    double reset_requests;      // Seconds until the request window resets
+    double reset_tokens;
+    double retry_after;         // Seconds from Retry-After (-1 if absent)
+} rate_limit_headers_t;
+
+// Reads config->rpm_limit / config->tpm_limit (0 = learn from headers).
+// Safe to call more than once.
+void rate_limit_init(config_t *config);
+
+// Blocks until one request of about `tokens` tokens may be sent
+void rate_limit_acquire(int tokens);
+
+// Corrects the token bucket once the real usage of a request is known
+void rate_limit_adjust(int estimated_tokens, int actual_tokens);
+
+// Resets `headers` to "nothing seen"
+void rate_limit_headers_clear(rate_limit_headers_t *headers);
+
+// Parses one response header line into `headers` (ignores unrelated ones)
+void rate_limit_parse_header(rate_limit_headers_t *headers, const char *line, size_t len);
+
+// Applies what the provider reported about its limits
+void rate_limit_update(const rate_limit_headers_t *headers);
+
+// Stops every thread from sending for the backoff of a failed attempt
+// (0-based). Exponential with full jitter, at least `retry_after` seconds
+// when the server asked for it. Returns the pause in seconds.
+double rate_limit_backoff(int attempt, double retry_after);
+
+#endif // RATE_LIMIT_H
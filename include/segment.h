@@ -0,0 +1,38 @@
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+#include "common.h"
+
+// Target input size of one request when only context_window is configured.
+// Large enough to amortise the per-request overhead, small enough that
+// replies stream back well within the request timeout.
+#define SEGMENT_TARGET_TOKENS 1024
+
+// Smallest piece a text node is ever split into
+#define SEGMENT_MIN_TOKENS 64
+
+// A request-sized piece of a text. Pieces cover the text without gaps:
+// the next piece starts at start + length + separator.
+typedef struct {
+    size_t start;       // Byte offset in the text
+    size_t length;      // Bytes of the piece itself
+    size_t separator;   // Whitespace bytes after it, kept out of the request
+} text_piece_t;
+
+// Splits text into pieces of at most max_tokens, preferring sentence
+// boundaries, then word boundaries, and never cutting a UTF-8 sequence.
+// Text within the limit (or max_tokens <= 0) yields a single piece.
+// Returns the number of pieces stored in *pieces (caller frees), or -1.
+int segment_text(const char *text, int max_tokens, text_piece_t **pieces);
+
+// Largest input a single request may carry given config->context_window:
+// the window must hold the system prompt, the input and a translation of
+// about the same length. Returns 0 when no window is configured.
+int segment_request_limit(config_t *config, int prompt_tokens);
+
+// Token budget for packing neighbouring segments into one request, or 0
+// to send one request per segment. An explicit "batch_tokens" wins (capped
+// by the window); without it the budget is derived from context_window.
+int segment_batch_budget(config_t *config, int prompt_tokens);
+
+#endif // SEGMENT_H
@@ -0,0 +1,21 @@
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <stddef.h>
+
+// Counts tokens locally, without a network round trip. The text is split
+// the way BPE tokenizers of the GPT family pre-tokenize it (words with
+// their leading space, digit groups, punctuation runs, newlines) and each
+// piece is charged what such vocabularies typically spend on it. The
+// result tracks real token counts closely enough to size requests.
+int count_tokens(const char *text, size_t len);
+
+// Convenience wrapper for NUL-terminated strings (NULL counts as 0)
+int count_tokens_str(const char *text);
+
+// Decodes the UTF-8 sequence at s (at most len bytes). Stores the code
+// point and returns the sequence length; invalid bytes decode as
+// themselves with length 1.
+int utf8_decode(const unsigned char *s, size_t len, unsigned int *cp);
+
+#endif // TOKENIZER_H
@@ -0,0 +1,39 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <pthread.h>
+
+// A unit of work. The caller owns the job and must keep it alive until
+// worker_pool_wait() has returned for it.
+typedef struct worker_job {
+    void (*fn)(void *arg);
+    void *arg;
+    int priority;       // Higher runs first; equal priorities run in submission order
+    int done;
+    struct worker_job *next;
+} worker_job_t;
+
+typedef struct worker_pool {
+    pthread_t *threads;
+    int thread_count;
+    worker_job_t *head;   // Pending jobs by priority, FIFO within a priority
+    worker_job_t *tail;
+    int shutdown;
+    pthread_mutex_t lock;
+    pthread_cond_t job_available;
+    pthread_cond_t job_done;
+} worker_pool_t;
+
+// Creates a pool with `threads` workers (at least 1)
+worker_pool_t* worker_pool_create(int threads);
+
+// Queues a job. Jobs are started by priority, then in submission order.
+void worker_pool_submit(worker_pool_t *pool, worker_job_t *job);
+
+// Blocks until the given job has finished running
+void worker_pool_wait(worker_pool_t *pool, worker_job_t *job);
+
+// Finishes all queued jobs, joins the workers and frees the pool
+void worker_pool_destroy(worker_pool_t *pool);
+
+#endif // WORKER_POOL_H
@@ -0,0 +1,14 @@
+#ifndef XHTML_TEXT_H
+#define XHTML_TEXT_H
+
+#include "common.h"
+
+// Text content of an XHTML document, for prompts that want the prose of a
+// chapter rather than its markup: tags, comments, scripts and styles are
+// removed, entities decoded, whitespace collapsed to single spaces and
+// each paragraph (block element) put on its own line. Only the <body> is
+// read when there is one. Returns the text (caller frees) and stores its
+// length in *len, or NULL if out of memory.
+char* xhtml_text(const char *xhtml, size_t *len);
+
+#endif // XHTML_TEXT_H
@@ -0,0 +1,168 @@
+#include "arena.h"
+#include "metrics.h"
+#include <pthread.h>
+#include <stdalign.h>
+#include <stddef.h>
+
+// Blocks larger than this are returned to the heap on reset instead of
+// being kept for the next chapter
+#define ARENA_MAX_RETAINED (16 * 1024 * 1024)
+
+#define ARENA_ALIGN alignof(max_align_t)
+#define ALIGN_UP(n) (((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+typedef struct arena_block {
+    struct arena_block *next;
+    size_t capacity;
+    size_t used;
+    alignas(max_align_t) unsigned char data[];
+} arena_block_t;
+
+struct arena {
+    arena_block_t *blocks;  // Current block first
+    size_t block_size;
+    void *last;             // Most recent allocation, can grow in place
+
+    // Since the last reset
+    long allocations;
+    long bytes;
+    long heap_blocks;       // Blocks obtained from malloc
+};
+
+static pthread_key_t thread_key;
+static pthread_once_t thread_key_once = PTHREAD_ONCE_INIT;
+
+static arena_block_t* new_block(arena_t *arena, size_t capacity) {
+    arena_block_t *block = malloc(sizeof(arena_block_t) + capacity);
+    if (!block) return NULL;
+    block->capacity = capacity;
+    block->used = 0;
+    block->next = arena->blocks;
+    arena->blocks = block;
+    arena->heap_blocks++;
+    return block;
+}
+
+arena_t* arena_create(size_t block_size) {
+    arena_t *arena = calloc(1, sizeof(arena_t));
+    if (!arena) return NULL;
+    arena->block_size = block_size > 0 ? ALIGN_UP(block_size) : ARENA_BLOCK_SIZE;
+    return arena;
+}
+
+static void free_blocks(arena_t *arena) {
+    arena_block_t *block = arena->blocks;
+    while (block) {
+        arena_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->blocks = NULL;
+}
+
+void arena_destroy(arena_t *arena) {
+    if (!arena) return;
+    free_blocks(arena);
+    free(arena);
+}
+
+void* arena_alloc(arena_t *arena, size_t size) {
+    size = ALIGN_UP(size > 0 ? size : 1);
+    arena_block_t *block = arena->blocks;
+    if (!block || block->capacity - block->used < size) {
+        block = new_block(arena, size > arena->block_size ? size : arena->block_size);
+        if (!block) return NULL;
+    }
+    void *ptr = block->data + block->used;
+    block->used += size;
+    arena->last = ptr;
+    arena->allocations++;
+    arena->bytes += size;
+    return ptr;
+}
+
+void* arena_calloc(arena_t *arena, size_t count, size_t size) {
+    void *ptr = arena_alloc(arena, count * size);
+    if (ptr) memset(ptr, 0, count * size);
+    return ptr;
+}
+
+void* arena_realloc(arena_t *arena, void *ptr, size_t old_size, size_t new_size) {
+    if (!ptr) return arena_alloc(arena, new_size);
+    if (new_size <= old_size) return ptr;
+
+    arena_block_t *block = arena->blocks;
+    if (ptr == arena->last && block) {
+        size_t offset = (unsigned char*)ptr - block->data;
+        size_t needed = ALIGN_UP(new_size);
+        if (block->capacity - offset >= needed) {
+            arena->bytes += needed - (block->used - offset);
+            block->used = offset + needed;
+            return ptr;
+        }
+    }
+
+    void *grown = arena_alloc(arena, new_size);
+    if (grown) memcpy(grown, ptr, old_size);
+    return grown;
+}
+
+char* arena_strndup(arena_t *arena, const char *s, size_t n) {
+    size_t len = strnlen(s, n);
+    char *copy = arena_alloc(arena, len + 1);
+    if (!copy) return NULL;
+    memcpy(copy, s, len);
+    copy[len] = 0;
+    return copy;
+}
+
+char* arena_strdup(arena_t *arena, const char *s) {
+    return arena_strndup(arena, s, strlen(s));
+}
+
+void arena_reset(arena_t *arena) {
+    if (arena->allocations > 0) {
+        metrics_count(COUNTER_ARENA_ALLOCATIONS, arena->allocations);
+        metrics_count(COUNTER_ARENA_BYTES, arena->bytes);
+        metrics_count(COUNTER_ARENA_HEAP_BLOCKS, arena->heap_blocks);
+    }
+    arena->allocations = 0;
+    arena->bytes = 0;
+    arena->heap_blocks = 0;
+    arena->last = NULL;
+
+    // Several blocks mean the chapter outgrew the first one: keep a single
+    // block big enough for all of it
+    size_t total = 0;
+    int count = 0;
+    for (arena_block_t *block = arena->blocks; block; block = block->next) {
+        total += block->capacity;
+        count++;
+    }
+    if (count > 1 || total > ARENA_MAX_RETAINED) {
+        free_blocks(arena);
+        if (total <= ARENA_MAX_RETAINED) {
+            new_block(arena, total);
+        }
+    } else if (arena->blocks) {
+        arena->blocks->used = 0;
+    }
+}
+
+static void destroy_thread_arena(void *ptr) {
+    arena_destroy((arena_t*)ptr);
+}
+
+static void create_thread_key(void) {
+    pthread_key_create(&thread_key, destroy_thread_arena);
+}
+
+arena_t* arena_thread(void) {
+    pthread_once(&thread_key_once, create_thread_key);
+    arena_t *arena = pthread_getspecific(thread_key);
+    if (!arena) {
+        arena = arena_create(ARENA_BLOCK_SIZE);
+        if (arena) pthread_setspecific(thread_key, arena);
+    }
+    return arena;
+}
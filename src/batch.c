@@ -0,0 +1,79 @@
+#include "batch.h"
+#include <ctype.h>
+
+char* batch_build_input(const batch_segment_t *segments, int count, arena_t *arena) {
+    size_t total = 1;
+    for (int i = 0; i < count; i++) {
+        total += strlen(segments[i].text) + 32;
+    }
+
+    char *input = arena ? arena_alloc(arena, total) : malloc(total);
+    if (!input) return NULL;
+
+    size_t pos = 0;
+    for (int i = 0; i < count; i++) {
+        pos += snprintf(input + pos, total - pos, "%s%d%s\n%s\n",
+            BATCH_MARKER_PREFIX, segments[i].id, BATCH_MARKER_SUFFIX, segments[i].text);
+    }
+    input[pos] = 0;
+    return input;
+}
+
+static batch_segment_t* find_segment(batch_segment_t *segments, int count, int id) {
+    for (int i = 0; i < count; i++) {
+        if (segments[i].id == id) return &segments[i];
+    }
+    return NULL;
+}
+
+// Parses "<<<SEG n>>>" at p. On success stores the id and returns the
+// position right after the marker line, otherwise returns NULL.
+static const char* parse_marker(const char *p, int *id) {
+    size_t prefix_len = strlen(BATCH_MARKER_PREFIX);
+    if (strncmp(p, BATCH_MARKER_PREFIX, prefix_len) != 0) return NULL;
+    p += prefix_len;
+    if (!isdigit((unsigned char)*p)) return NULL;
+
+    char *end;
+    long value = strtol(p, &end, 10);
+    size_t suffix_len = strlen(BATCH_MARKER_SUFFIX);
+    if (strncmp(end, BATCH_MARKER_SUFFIX, suffix_len) != 0) return NULL;
+    end += suffix_len;
+
+    // Models sometimes add trailing blanks after the marker
+    while (*end == ' ' || *end == '\t' || *end == '\r') end++;
+    if (*end == '\n') end++;
+
+    *id = (int)value;
+    return end;
+}
+
+int batch_parse_reply(const char *reply, batch_segment_t *segments, int count, arena_t *arena) {
+    if (!reply) return 0;
+
+    int matched = 0;
+    const char *p = strstr(reply, BATCH_MARKER_PREFIX);
+    while (p) {
+        int id;
+        const char *body = parse_marker(p, &id);
+        if (!body) {
+            p = strstr(p + 1, BATCH_MARKER_PREFIX);
+            continue;
+        }
+
+        const char *next = strstr(body, BATCH_MARKER_PREFIX);
+        const char *end = next ? next : body + strlen(body);
+
+        // Drop the newline that separates this body from the next marker
+        while (end > body && (end[-1] == '\n' || end[-1] == '\r')) end--;
+
+        batch_segment_t *segment = find_segment(segments, count, id);
+        if (segment && !segment->translation) {
+            size_t len = end - body;
+            segment->translation = arena ? arena_strndup(arena, body, len) : strndup(body, len);
+            if (segment->translation) matched++;
+        }
+        p = next;
+    }
+    return matched;
+}
@@ -0,0 +1,317 @@
+#include "batch_api.h"
+#include "metrics.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <json-c/json.h>
+
+// Missing requests listed by name in the final report; the rest are counted
+#define MAX_REPORTED 10
+
+// One line of the result file
+typedef struct {
+    char *id;
+    char *content;       // Reply content (NULL when the request failed)
+    char *error;         // Why it failed (NULL on success)
+    long prompt_tokens;
+    long completion_tokens;
+    long cached_tokens;
+    int used;            // Asked for by a request of this run
+} batch_result_t;
+
+static pthread_mutex_t batch_lock = PTHREAD_MUTEX_INITIALIZER;
+static batch_api_mode_t mode = BATCH_API_OFF;
+static char *file_path = NULL;
+static FILE *export_file = NULL;
+static json_buffer_t line = {0};
+static json_buffer_t body = {0};
+static long exported = 0;
+static batch_result_t *results = NULL;
+static int result_count = 0;
+static int *result_index = NULL;    // Open-addressing hash table: id -> result (-1 = empty)
+static int result_index_size = 0;
+static long missing_segments = 0;
+static long missing_requests = 0;
+
+static uint32_t hash_id(const char *id) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char*)id; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static uint64_t hash_text(uint64_t h, const char *text) {
+    for (const unsigned char *p = (const unsigned char*)(text ? text : ""); *p; p++) {
+        h ^= *p;
+        h *= 1099511628211ull;
+    }
+    // Field separator, so "ab"+"c" and "a"+"bc" differ
+    h ^= 0xff;
+    h *= 1099511628211ull;
+    return h;
+}
+
+void batch_api_make_id(char *id, int chapter, int first_segment, config_t *config, const llm_request_t *request) {
+    uint64_t h = 14695981039346656037ull;
+    h = hash_text(h, config->model);
+    h = hash_text(h, request->system_prompt);
+    h = hash_text(h, request->user_content);
+    snprintf(id, BATCH_API_ID_SIZE, "c%d-s%d-%016llx", chapter, first_segment, (unsigned long long)h);
+}
+
+// Builds the id -> result table at a load factor of at most 1/2. A result
+// listed twice keeps its first line.
+static void build_result_index(void) {
+    int size = 16;
+    while (size < result_count * 2) size *= 2;
+    result_index = malloc(size * sizeof(int));
+    if (!result_index) return;
+    result_index_size = size;
+    for (int i = 0; i < size; i++) result_index[i] = -1;
+
+    for (int i = 0; i < result_count; i++) {
+        uint32_t slot = hash_id(results[i].id) & (size - 1);
+        while (result_index[slot] >= 0 && strcmp(results[result_index[slot]].id, results[i].id) != 0) {
+            slot = (slot + 1) & (size - 1);
+        }
+        if (result_index[slot] < 0) {
+            result_index[slot] = i;
+        } else {
+            fprintf(stderr, "Batch results list %s twice, using the first\n", results[i].id);
+        }
+    }
+}
+
+static batch_result_t* find_result(const char *id) {
+    if (!result_index) return NULL;
+    uint32_t slot = hash_id(id) & (result_index_size - 1);
+    while (result_index[slot] >= 0) {
+        batch_result_t *result = &results[result_index[slot]];
+        if (strcmp(result->id, id) == 0) return result;
+        slot = (slot + 1) & (result_index_size - 1);
+    }
+    return NULL;
+}
+
+static const char* error_message(struct json_object *error) {
+    struct json_object *message;
+    if (json_object_is_type(error, json_type_object) && json_object_object_get_ex(error, "message", &message)) {
+        return json_object_get_string(message);
+    }
+    return json_object_get_string(error);
+}
+
+// Reads one result line:
+//   {"custom_id":"...","response":{"status_code":200,"body":{<chat completion>}},"error":null}
+static int parse_result(const char *text, int line_number, batch_result_t *result) {
+    memset(result, 0, sizeof(*result));
+    struct json_object *parsed = json_tokener_parse(text);
+    struct json_object *custom_id, *error, *response, *status, *reply;
+    if (!parsed || !json_object_object_get_ex(parsed, "custom_id", &custom_id)) {
+        fprintf(stderr, "%s:%d: not a batch result\n", file_path, line_number);
+        if (parsed) json_object_put(parsed);
+        return -1;
+    }
+    result->id = strdup(json_object_get_string(custom_id));
+
+    char message[512] = "";
+    if (json_object_object_get_ex(parsed, "error", &error) && !json_object_is_type(error, json_type_null)) {
+        snprintf(message, sizeof(message), "%s", error_message(error));
+    } else if (!json_object_object_get_ex(parsed, "response", &response) ||
+               !json_object_object_get_ex(response, "body", &reply)) {
+        snprintf(message, sizeof(message), "no response");
+    } else {
+        int status_code = json_object_object_get_ex(response, "status_code", &status) ? json_object_get_int(status) : 200;
+        struct json_object *choices, *choice, *reply_message, *content, *usage, *tokens, *details;
+        if (json_object_object_get_ex(reply, "error", &error) && !json_object_is_type(error, json_type_null)) {
+            snprintf(message, sizeof(message), "HTTP %d: %s", status_code, error_message(error));
+        } else if (status_code != 200) {
+            snprintf(message, sizeof(message), "HTTP %d", status_code);
+        } else if (json_object_object_get_ex(reply, "choices", &choices) &&
+                   (choice = json_object_array_get_idx(choices, 0)) &&
+                   json_object_object_get_ex(choice, "message", &reply_message) &&
+                   json_object_object_get_ex(reply_message, "content", &content) &&
+                   json_object_is_type(content, json_type_string)) {
+            result->content = strdup(json_object_get_string(content));
+            result->prompt_tokens = result->completion_tokens = -1;
+            if (json_object_object_get_ex(reply, "usage", &usage)) {
+                if (json_object_object_get_ex(usage, "prompt_tokens", &tokens)) result->prompt_tokens = json_object_get_int64(tokens);
+                if (json_object_object_get_ex(usage, "completion_tokens", &tokens)) result->completion_tokens = json_object_get_int64(tokens);
+                if (json_object_object_get_ex(usage, "prompt_tokens_details", &details) &&
+                    json_object_is_type(details, json_type_object) &&
+                    json_object_object_get_ex(details, "cached_tokens", &tokens)) {
+                    result->cached_tokens = json_object_get_int64(tokens);
+                }
+            }
+        } else {
+            snprintf(message, sizeof(message), "reply without content");
+        }
+    }
+    if (!result->content) result->error = strdup(message[0] ? message : "unknown error");
+    json_object_put(parsed);
+    return 0;
+}
+
+static int load_results(void) {
+    FILE *f = fopen(file_path, "r");
+    if (!f) {
+        perror("Failed to open batch results");
+        return -1;
+    }
+    char *text = NULL;
+    size_t text_size = 0;
+    int capacity = 0, line_number = 0, failed = 0;
+    while (getline(&text, &text_size, f) != -1) {
+        line_number++;
+        if (strspn(text, " \t\r\n") == strlen(text)) continue;
+        if (result_count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            batch_result_t *grown = realloc(results, capacity * sizeof(batch_result_t));
+            if (!grown) break;
+            results = grown;
+        }
+        if (parse_result(text, line_number, &results[result_count]) != 0) continue;
+        if (results[result_count].error) failed++;
+        result_count++;
+    }
+    free(text);
+    fclose(f);
+
+    build_result_index();
+    printf("Batch results: %d requests read from %s (%d failed)\n", result_count, file_path, failed);
+    return 0;
+}
+
+int batch_api_init(config_t *config) {
+    pthread_mutex_lock(&batch_lock);
+    int rc = 0;
+    if (mode == BATCH_API_OFF && config->batch_export_file) {
+        file_path = strdup(config->batch_export_file);
+        export_file = fopen(file_path, "w");
+        if (export_file) {
+            mode = BATCH_API_EXPORT;
+        } else {
+            perror("Failed to create batch request file");
+            rc = -1;
+        }
+    } else if (mode == BATCH_API_OFF && config->batch_import_file) {
+        file_path = strdup(config->batch_import_file);
+        rc = load_results();
+        if (rc == 0) mode = BATCH_API_IMPORT;
+    }
+    pthread_mutex_unlock(&batch_lock);
+    return rc;
+}
+
+void batch_api_cleanup(void) {
+    pthread_mutex_lock(&batch_lock);
+    if (export_file) fclose(export_file);
+    export_file = NULL;
+    for (int i = 0; i < result_count; i++) {
+        free(results[i].id);
+        free(results[i].content);
+        free(results[i].error);
+    }
+    free(results);
+    free(result_index);
+    results = NULL;
+    result_index = NULL;
+    result_count = result_index_size = 0;
+    json_buffer_free(&line);
+    json_buffer_free(&body);
+    free(file_path);
+    file_path = NULL;
+    mode = BATCH_API_OFF;
+    pthread_mutex_unlock(&batch_lock);
+}
+
+batch_api_mode_t batch_api_mode(void) {
+    return mode;
+}
+
+int batch_api_export(const char *id, config_t *config, const llm_request_t *request) {
+    pthread_mutex_lock(&batch_lock);
+    int rc = -1;
+    if (export_file && llm_write_body(&body, config, request, 0) == 0) {
+        json_buffer_reset(&line);
+        rc = json_write_raw(&line, "{\"custom_id\":");
+        rc |= json_write_string(&line, id);
+        rc |= json_write_raw(&line, ",\"method\":\"POST\",\"url\":");
+        rc |= json_write_string(&line, llm_endpoint_path(config));
+        rc |= json_write_raw(&line, ",\"body\":");
+        rc |= json_buffer_append(&line, body.data, body.size);
+        rc |= json_write_raw(&line, "}\n");
+        if (rc == 0 && fwrite(line.data, 1, line.size, export_file) != line.size) rc = -1;
+        if (rc == 0) exported++;
+    }
+    pthread_mutex_unlock(&batch_lock);
+    if (rc != 0) fprintf(stderr, "Failed to write batch request %s\n", id);
+    return rc;
+}
+
+// Remembers a missing request for the report. Called with batch_lock held.
+static void report_missing(const char *id, const char *reason) {
+    if (missing_requests++ < MAX_REPORTED) {
+        fprintf(stderr, "Batch result %s: %s\n", id, reason);
+    }
+}
+
+char* batch_api_result(const char *id, arena_t *arena) {
+    pthread_mutex_lock(&batch_lock);
+    char *content = NULL;
+    batch_result_t *result = find_result(id);
+    if (!result) {
+        report_missing(id, "not in the result file");
+    } else {
+        result->used = 1;
+        if (result->content) {
+            content = arena ? arena_strdup(arena, result->content) : strdup(result->content);
+            if (result->prompt_tokens >= 0 || result->completion_tokens >= 0) {
+                metrics_record_usage(result->prompt_tokens > 0 ? result->prompt_tokens : 0,
+                    result->completion_tokens > 0 ? result->completion_tokens : 0, result->cached_tokens);
+            }
+        } else {
+            report_missing(id, result->error);
+        }
+    }
+    pthread_mutex_unlock(&batch_lock);
+    return content;
+}
+
+void batch_api_missing(const char *id, int segments) {
+    pthread_mutex_lock(&batch_lock);
+    missing_segments += segments;
+    // Absent and failed results were reported by batch_api_result()
+    batch_result_t *result = find_result(id);
+    if (result && result->content) {
+        char reason[64];
+        snprintf(reason, sizeof(reason), "reply left out %d segment%s", segments, segments == 1 ? "" : "s");
+        report_missing(id, reason);
+    }
+    pthread_mutex_unlock(&batch_lock);
+}
+
+long batch_api_finish(void) {
+    pthread_mutex_lock(&batch_lock);
+    long rc;
+    if (mode == BATCH_API_EXPORT) {
+        if (export_file && fflush(export_file) != 0) perror("Failed to write batch requests");
+        rc = exported;
+    } else {
+        if (missing_requests > MAX_REPORTED) {
+            fprintf(stderr, "... and %ld more missing batch results\n", missing_requests - MAX_REPORTED);
+        }
+        int unused = 0;
+        for (int i = 0; i < result_count; i++) {
+            if (!results[i].used) unused++;
+        }
+        if (unused > 0) {
+            fprintf(stderr, "Warning: %d batch results match no request of this book; "
+                "were they exported from another book or with other settings?\n", unused);
+        }
+        rc = missing_segments;
+    }
+    pthread_mutex_unlock(&batch_lock);
+    return rc;
+}
@@ -0,0 +1,335 @@
+#include "cache.h"
+#include "metrics.h"
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+// On-disk format: an append-only sequence of records, each a fixed header
+// followed by the UTF-8 value. Writers append a whole record with a single
+// writev() under flock(LOCK_EX), so several processes can share one file.
+// A record torn by a crash fails its checksum and is truncated on open.
+#define CACHE_RECORD_MAGIC 0x31435445u // "ETC1"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t length;     // Value length in bytes
+    uint64_t key_hi;
+    uint64_t key_lo;
+    uint32_t checksum;   // FNV-1a of the value
+    uint32_t reserved;
+} record_header_t;
+
+typedef struct {
+    cache_key_t key;
+    off_t offset;        // Offset of the value in the file
+    uint32_t length;
+    int used;
+} index_entry_t;
+
+// Keys currently being translated by some thread of this process
+typedef struct pending_key {
+    cache_key_t key;
+    struct pending_key *next;
+} pending_key_t;
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cache_released = PTHREAD_COND_INITIALIZER;
+static int cache_ready = 0;
+static int cache_fd = -1;
+static off_t indexed_end = 0;    // Everything before this offset is indexed
+static index_entry_t *entries = NULL;
+static size_t entry_capacity = 0;
+static size_t entry_count = 0;
+static pending_key_t *pending = NULL;
+
+static uint32_t checksum32(const char *data, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)data[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int key_equal(const cache_key_t *a, const cache_key_t *b) {
+    return a->hi == b->hi && a->lo == b->lo;
+}
+
+static index_entry_t* index_find(const cache_key_t *key) {
+    if (entry_capacity == 0) return NULL;
+    size_t mask = entry_capacity - 1;
+    for (size_t i = key->lo & mask; entries[i].used; i = (i + 1) & mask) {
+        if (key_equal(&entries[i].key, key)) return &entries[i];
+    }
+    return NULL;
+}
+
+static void index_put(const cache_key_t *key, off_t offset, uint32_t length);
+
+static int index_grow(void) {
+    size_t new_capacity = entry_capacity ? entry_capacity * 2 : 1024;
+    index_entry_t *old = entries;
+    size_t old_capacity = entry_capacity;
+
+    entries = calloc(new_capacity, sizeof(index_entry_t));
+    if (!entries) {
+        entries = old;
+        return -1;
+    }
+    entry_capacity = new_capacity;
+    entry_count = 0;
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i].used) index_put(&old[i].key, old[i].offset, old[i].length);
+    }
+    free(old);
+    return 0;
+}
+
+static void index_put(const cache_key_t *key, off_t offset, uint32_t length) {
+    if ((entry_count + 1) * 10 > entry_capacity * 7 && index_grow() != 0) return;
+
+    size_t mask = entry_capacity - 1;
+    size_t i = key->lo & mask;
+    while (entries[i].used && !key_equal(&entries[i].key, key)) i = (i + 1) & mask;
+
+    // Later records win, which lets a corrected translation replace an old one
+    if (!entries[i].used) entry_count++;
+    entries[i].key = *key;
+    entries[i].offset = offset;
+    entries[i].length = length;
+    entries[i].used = 1;
+}
+
+// Indexes records appended since the last scan (by us or other processes).
+// Stops at the first incomplete or corrupt record.
+static void scan_new_records(void) {
+    struct stat st;
+    if (fstat(cache_fd, &st) != 0) return;
+
+    char *value = NULL;
+    size_t value_capacity = 0;
+    while (indexed_end + (off_t)sizeof(record_header_t) <= st.st_size) {
+        record_header_t header;
+        if (pread(cache_fd, &header, sizeof(header), indexed_end) != (ssize_t)sizeof(header)) break;
+        if (header.magic != CACHE_RECORD_MAGIC) break;
+
+        off_t value_offset = indexed_end + sizeof(header);
+        if (value_offset + (off_t)header.length > st.st_size) break;
+
+        if (header.length + 1 > value_capacity) {
+            char *grown = realloc(value, header.length + 1);
+            if (!grown) break;
+            value = grown;
+            value_capacity = header.length + 1;
+        }
+        if (pread(cache_fd, value, header.length, value_offset) != (ssize_t)header.length) break;
+        if (checksum32(value, header.length) != header.checksum) break;
+
+        cache_key_t key = { header.key_hi, header.key_lo };
+        index_put(&key, value_offset, header.length);
+        indexed_end = value_offset + header.length;
+    }
+    free(value);
+}
+
+int cache_init(config_t *config) {
+    pthread_mutex_lock(&cache_lock);
+    if (cache_ready || !config->cache_file) {
+        pthread_mutex_unlock(&cache_lock);
+        return 0;
+    }
+
+    cache_fd = open(config->cache_file, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (cache_fd < 0) {
+        perror("Failed to open translation cache");
+        pthread_mutex_unlock(&cache_lock);
+        return -1;
+    }
+
+    // Drop a record torn by an earlier crash so new appends stay reachable
+    flock(cache_fd, LOCK_EX);
+    scan_new_records();
+    struct stat st;
+    if (fstat(cache_fd, &st) == 0 && st.st_size > indexed_end) {
+        fprintf(stderr, "Warning: Discarding %lld corrupt bytes at the end of %s\n",
+            (long long)(st.st_size - indexed_end), config->cache_file);
+        if (ftruncate(cache_fd, indexed_end) != 0) perror("ftruncate");
+    }
+    flock(cache_fd, LOCK_UN);
+
+    printf("Translation cache: %s (%zu entries)\n", config->cache_file, entry_count);
+    cache_ready = 1;
+    pthread_mutex_unlock(&cache_lock);
+    return 0;
+}
+
+void cache_cleanup(void) {
+    pthread_mutex_lock(&cache_lock);
+    if (cache_fd >= 0) close(cache_fd);
+    cache_fd = -1;
+    free(entries);
+    entries = NULL;
+    entry_capacity = entry_count = 0;
+    indexed_end = 0;
+    while (pending) {
+        pending_key_t *next = pending->next;
+        free(pending);
+        pending = next;
+    }
+    cache_ready = 0;
+    pthread_mutex_unlock(&cache_lock);
+}
+
+// Two independent 64-bit hashes over length-prefixed fields
+static void hash_field(cache_key_t *key, const char *data) {
+    if (!data) data = "";
+    size_t len = strlen(data);
+    uint64_t h1 = key->hi, h2 = key->lo;
+
+    for (size_t i = 0; i < sizeof(len); i++) {
+        unsigned char b = (unsigned char)(len >> (8 * i));
+        h1 = (h1 ^ b) * 0x100000001b3ULL;
+        h2 = (h2 + b) * 0x9e3779b97f4a7c15ULL;
+        h2 ^= h2 >> 29;
+    }
+    for (size_t i = 0; i < len; i++) {
+        unsigned char b = (unsigned char)data[i];
+        h1 = (h1 ^ b) * 0x100000001b3ULL;
+        h2 = (h2 + b) * 0x9e3779b97f4a7c15ULL;
+        h2 ^= h2 >> 29;
+    }
+    key->hi = h1;
+    key->lo = h2;
+}
+
+void cache_make_key(cache_key_t *key, const char *text, config_t *config, const char *context_string) {
+    key->hi = 0xcbf29ce484222325ULL;
+    key->lo = 0x84222325cbf29ce4ULL;
+    hash_field(key, text);
+    hash_field(key, config->target_language);
+    hash_field(key, config->model);
+    hash_field(key, config->prompt_translation);
+    hash_field(key, context_string);
+}
+
+void cache_key_add(cache_key_t *key, const char *data) {
+    hash_field(key, data);
+}
+
+static pending_key_t* find_pending(const cache_key_t *key) {
+    for (pending_key_t *p = pending; p; p = p->next) {
+        if (key_equal(&p->key, key)) return p;
+    }
+    return NULL;
+}
+
+// Reads the value of an indexed entry. Called with cache_lock held.
+static char* read_value(const index_entry_t *entry) {
+    char *value = malloc(entry->length + 1);
+    if (!value) return NULL;
+    if (pread(cache_fd, value, entry->length, entry->offset) != (ssize_t)entry->length) {
+        free(value);
+        return NULL;
+    }
+    value[entry->length] = 0;
+    return value;
+}
+
+int cache_acquire(const cache_key_t *key, char **value, int wait) {
+    *value = NULL;
+    pthread_mutex_lock(&cache_lock);
+    if (!cache_ready) {
+        pthread_mutex_unlock(&cache_lock);
+        return CACHE_OWNER; // Release is a no-op without a cache
+    }
+
+    for (;;) {
+        index_entry_t *entry = index_find(key);
+        if (!entry) {
+            // Another process may have translated it meanwhile
+            flock(cache_fd, LOCK_SH);
+            scan_new_records();
+            flock(cache_fd, LOCK_UN);
+            entry = index_find(key);
+        }
+        if (entry) {
+            *value = read_value(entry);
+            if (*value) {
+                pthread_mutex_unlock(&cache_lock);
+                metrics_count(COUNTER_CACHE_HITS, 1);
+                return CACHE_HIT;
+            }
+        }
+
+        if (!find_pending(key)) break;
+        if (!wait) {
+            pthread_mutex_unlock(&cache_lock);
+            return CACHE_BUSY;
+        }
+        pthread_cond_wait(&cache_released, &cache_lock);
+    }
+
+    pending_key_t *p = calloc(1, sizeof(pending_key_t));
+    if (p) {
+        p->key = *key;
+        p->next = pending;
+        pending = p;
+    }
+    pthread_mutex_unlock(&cache_lock);
+    metrics_count(COUNTER_CACHE_MISSES, 1);
+    return CACHE_OWNER;
+}
+
+static void append_record(const cache_key_t *key, const char *value) {
+    size_t len = strlen(value);
+    record_header_t header = {
+        .magic = CACHE_RECORD_MAGIC,
+        .length = (uint32_t)len,
+        .key_hi = key->hi,
+        .key_lo = key->lo,
+        .checksum = checksum32(value, len),
+        .reserved = 0
+    };
+    struct iovec iov[2] = {
+        { &header, sizeof(header) },
+        { (void*)value, len }
+    };
+
+    flock(cache_fd, LOCK_EX);
+    scan_new_records();
+    off_t offset = lseek(cache_fd, 0, SEEK_END);
+    ssize_t written = writev(cache_fd, iov, 2);
+    if (written == (ssize_t)(sizeof(header) + len)) {
+        index_put(key, offset + sizeof(header), (uint32_t)len);
+        if (indexed_end == offset) indexed_end = offset + written;
+    } else {
+        perror("Failed to append to translation cache");
+    }
+    flock(cache_fd, LOCK_UN);
+}
+
+void cache_release(const cache_key_t *key, const char *value) {
+    pthread_mutex_lock(&cache_lock);
+    if (!cache_ready) {
+        pthread_mutex_unlock(&cache_lock);
+        return;
+    }
+
+    if (value) append_record(key, value);
+
+    pending_key_t **pp = &pending;
+    while (*pp) {
+        if (key_equal(&(*pp)->key, key)) {
+            pending_key_t *p = *pp;
+            *pp = p->next;
+            free(p);
+            break;
+        }
+        pp = &(*pp)->next;
+    }
+    pthread_cond_broadcast(&cache_released);
+    pthread_mutex_unlock(&cache_lock);
+}
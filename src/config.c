@@ -11,12 +11,55 @@ void free_config(config_t *config) {
     free(config->tone);
     free(config->api_endpoint);
     free(config->context_file);
+    free(config->cache_file);
+    free(config->glossary_file);
+    free(config->metrics_file);
+    free(config->metrics_prometheus_file);
+    free(config->daemon_socket);
+    free(config->daemon_spool);
+    free(config->batch_export_file);
+    free(config->batch_import_file);
     free(config->prompt_context_init);
     free(config->prompt_context_update);
+    free(config->prompt_context_part);
     free(config->prompt_translation);
+    free(config->prompt_batch);
+    free(config->prompt_terminology);
     free(config);
 }
 
+static char* copy_string(const char *s) {
+    return s ? strdup(s) : NULL;
+}
+
+config_t* copy_config(const config_t *config) {
+    config_t *copy = malloc(sizeof(config_t));
+    if (!copy) return NULL;
+    *copy = *config;
+    copy->llm_provider = copy_string(config->llm_provider);
+    copy->model = copy_string(config->model);
+    copy->api_key = copy_string(config->api_key);
+    copy->target_language = copy_string(config->target_language);
+    copy->context_strategy = copy_string(config->context_strategy);
+    copy->tone = copy_string(config->tone);
+    copy->api_endpoint = copy_string(config->api_endpoint);
+    copy->context_file = copy_string(config->context_file);
+    copy->cache_file = copy_string(config->cache_file);
+    copy->glossary_file = copy_string(config->glossary_file);
+    copy->metrics_file = copy_string(config->metrics_file);
+    copy->metrics_prometheus_file = copy_string(config->metrics_prometheus_file);
+    copy->daemon_socket = copy_string(config->daemon_socket);
+    copy->daemon_spool = copy_string(config->daemon_spool);
+    copy->batch_export_file = copy_string(config->batch_export_file);
+    copy->batch_import_file = copy_string(config->batch_import_file);
+    copy->prompt_context_init = copy_string(config->prompt_context_init);
+    copy->prompt_context_update = copy_string(config->prompt_context_update);
+    copy->prompt_context_part = copy_string(config->prompt_context_part);
+    copy->prompt_translation = copy_string(config->prompt_translation);
+    copy->prompt_batch = copy_string(config->prompt_batch);
+    copy->prompt_terminology = copy_string(config->prompt_terminology);
+    return copy;
+}
 
 // Helper to read prompt file
 static char* read_prompt(const char *filename) {
@@ -65,6 +108,7 @@ config_t* load_config(const char *path) {
     }
 
     config_t *config = calloc(1, sizeof(config_t));
+    config->context_max_lag = -1;
     
     if (json_object_object_get_ex(parsed_json, "llm_provider", &llm_provider))
         config->llm_provider = strdup(json_object_get_string(llm_provider));
@@ -93,20 +137,110 @@ config_t* load_config(const char *path) {
     if (json_object_object_get_ex(parsed_json, "sliding_window_size", &sliding_window_size))
         config->sliding_window_size = json_object_get_int(sliding_window_size);
 
+    struct json_object *terminology_terms;
+    if (json_object_object_get_ex(parsed_json, "terminology_terms", &terminology_terms))
+        config->terminology_terms = json_object_get_int(terminology_terms);
+
+    struct json_object *workers;
+    if (json_object_object_get_ex(parsed_json, "workers", &workers))
+        config->workers = json_object_get_int(workers);
+
+    struct json_object *in_memory;
+    if (json_object_object_get_ex(parsed_json, "in_memory", &in_memory))
+        config->in_memory = json_object_get_boolean(in_memory);
+
+    struct json_object *skip_nonlinear;
+    if (json_object_object_get_ex(parsed_json, "skip_nonlinear", &skip_nonlinear))
+        config->skip_nonlinear = json_object_get_boolean(skip_nonlinear);
+
+    struct json_object *stream;
+    if (json_object_object_get_ex(parsed_json, "stream", &stream))
+        config->stream = json_object_get_boolean(stream);
+
+    struct json_object *legacy_json;
+    if (json_object_object_get_ex(parsed_json, "legacy_json", &legacy_json))
+        config->legacy_json = json_object_get_boolean(legacy_json);
+
+    struct json_object *stall_timeout;
+    if (json_object_object_get_ex(parsed_json, "stall_timeout", &stall_timeout))
+        config->stall_timeout = json_object_get_int(stall_timeout);
+
+    struct json_object *rpm_limit;
+    if (json_object_object_get_ex(parsed_json, "rpm_limit", &rpm_limit))
+        config->rpm_limit = json_object_get_int(rpm_limit);
+
+    struct json_object *tpm_limit;
+    if (json_object_object_get_ex(parsed_json, "tpm_limit", &tpm_limit))
+        config->tpm_limit = json_object_get_int(tpm_limit);
+
+    struct json_object *max_retries;
+    if (json_object_object_get_ex(parsed_json, "max_retries", &max_retries))
+        config->max_retries = json_object_get_int(max_retries);
+
+    struct json_object *context_max_lag;
+    if (json_object_object_get_ex(parsed_json, "context_max_lag", &context_max_lag))
+        config->context_max_lag = json_object_get_int(context_max_lag);
+
+    struct json_object *batch_tokens;
+    if (json_object_object_get_ex(parsed_json, "batch_tokens", &batch_tokens))
+        config->batch_tokens = json_object_get_int(batch_tokens);
+
+    struct json_object *langid_threshold;
+    if (json_object_object_get_ex(parsed_json, "langid_threshold", &langid_threshold))
+        config->langid_threshold = json_object_get_double(langid_threshold);
+
     struct json_object *context_file;
     if (json_object_object_get_ex(parsed_json, "context_file", &context_file))
         config->context_file = strdup(json_object_get_string(context_file));
 
+    struct json_object *cache_file;
+    if (json_object_object_get_ex(parsed_json, "cache_file", &cache_file))
+        config->cache_file = strdup(json_object_get_string(cache_file));
+
+    struct json_object *glossary_file;
+    if (json_object_object_get_ex(parsed_json, "glossary_file", &glossary_file))
+        config->glossary_file = strdup(json_object_get_string(glossary_file));
+
+    struct json_object *metrics_file;
+    if (json_object_object_get_ex(parsed_json, "metrics_file", &metrics_file))
+        config->metrics_file = strdup(json_object_get_string(metrics_file));
+
+    struct json_object *metrics_prometheus_file;
+    if (json_object_object_get_ex(parsed_json, "metrics_prometheus_file", &metrics_prometheus_file))
+        config->metrics_prometheus_file = strdup(json_object_get_string(metrics_prometheus_file));
+
+    struct json_object *metrics_interval;
+    if (json_object_object_get_ex(parsed_json, "metrics_interval", &metrics_interval))
+        config->metrics_interval = json_object_get_int(metrics_interval);
+
+    struct json_object *daemon_socket;
+    if (json_object_object_get_ex(parsed_json, "daemon_socket", &daemon_socket))
+        config->daemon_socket = strdup(json_object_get_string(daemon_socket));
+
+    struct json_object *daemon_spool;
+    if (json_object_object_get_ex(parsed_json, "daemon_spool", &daemon_spool))
+        config->daemon_spool = strdup(json_object_get_string(daemon_spool));
+
+    struct json_object *daemon_books;
+    if (json_object_object_get_ex(parsed_json, "daemon_books", &daemon_books))
+        config->daemon_books = json_object_get_int(daemon_books);
+
     json_object_put(parsed_json);
 
     config->prompt_context_init = read_prompt("prompt_context_init.md");
     config->prompt_context_update = read_prompt("prompt_context_update.md");
+    config->prompt_context_part = read_prompt("prompt_context_part.md");
     config->prompt_translation = read_prompt("prompt_translation.md");
+    config->prompt_batch = read_prompt("prompt_batch.md");
+    config->prompt_terminology = read_prompt("prompt_terminology.md");
 
     // Defaults if files missing (hardcoded fallbacks)
     if (!config->prompt_context_init) config->prompt_context_init = strdup("You are a literary assistant. Analyze the text and extract: summary, characters, locations, jargon. JSON format.");
     if (!config->prompt_context_update) config->prompt_context_update = strdup("Update the context (summary, characters, locations, jargon) based on new text. Return JSON.");
-    if (!config->prompt_translation) config->prompt_translation = strdup("Translate to %s. Preserve formatting. %s");
+    if (!config->prompt_context_part) config->prompt_context_part = strdup("Summarize this part of a book chapter in at most 150 words, naming every character, location and special term in it. Plain text only.");
+    if (!config->prompt_translation) config->prompt_translation = strdup("Translate to %s. Preserve formatting.");
+    if (!config->prompt_batch) config->prompt_batch = strdup("The text is split into segments, each preceded by a marker line like <<<SEG 1>>>. Translate every segment separately and output each one preceded by its unchanged marker line. Never merge, split, drop or reorder segments.");
+    if (!config->prompt_terminology) config->prompt_terminology = strdup("Translate these names and terms from a book to %s. Answer with one line per term, in the same order: the term, a tab, its translation. Leave names that are not translated unchanged.");
 
     return config;
 }
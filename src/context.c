@@ -1,26 +1,26 @@
 #include "context.h"
+#include "llm_client.h"
+#include "segment.h"
+#include "tokenizer.h"
+#include "worker_pool.h"
+#include "xhtml_text.h"
+#include <stdarg.h>
+#include <limits.h>
 #include <json-c/json.h>
-#include <curl/curl.h>
-
-// Reuse write callback from translate.c or duplicate it here for independence
-// For now, duplicating to avoid complex refactor of translate.c
-static size_t write_callback(void *ptr, size_t size, size_t nmemb, void *userdata) {
-    size_t real_size = size * nmemb;
-    struct {
-        char *response;
-        size_t size;
-    } *mem = userdata;
-
-    char *ptr_realloc = realloc(mem->response, mem->size + real_size + 1);
-    if(ptr_realloc == NULL) return 0;
-
-    mem->response = ptr_realloc;
-    memcpy(&(mem->response[mem->size]), ptr, real_size);
-    mem->size += real_size;
-    mem->response[mem->size] = 0;
-
-    return real_size;
-}
+
+// Largest part of a chapter summarized in one request. Longer chapters are
+// split and their parts summarized in parallel, then the part summaries
+// stand in for the chapter.
+#define CONTEXT_PART_TOKENS 4096
+
+// Times the part summaries may themselves be split and summarized again
+#define CONTEXT_MAX_ROUNDS 3
+
+// Length of the rolling plot summary kept in the context
+#define CONTEXT_SUMMARY_TOKENS 500
+
+// Sentence-sized pieces the summary is trimmed by
+#define CONTEXT_TRIM_TOKENS 64
 
 context_t* create_context() {
     context_t *ctx = calloc(1, sizeof(context_t));
@@ -36,25 +36,55 @@ void free_context(context_t *ctx) {
     free(ctx);
 }
 
-int save_context(const char *filename, context_t *ctx) {
-    if (!filename || !ctx) return -1;
-    
+char* context_to_json(context_t *ctx) {
+    if (!ctx) return NULL;
+
     struct json_object *jobj = json_object_new_object();
     if (ctx->summary) json_object_object_add(jobj, "summary", json_object_new_string(ctx->summary));
     if (ctx->characters) json_object_object_add(jobj, "characters", json_object_new_string(ctx->characters));
     if (ctx->locations) json_object_object_add(jobj, "locations", json_object_new_string(ctx->locations));
     if (ctx->jargon) json_object_object_add(jobj, "jargon", json_object_new_string(ctx->jargon));
-    
-    const char *json_str = json_object_to_json_string_ext(jobj, JSON_C_TO_STRING_PRETTY);
+
+    char *json_str = strdup(json_object_to_json_string_ext(jobj, JSON_C_TO_STRING_PRETTY));
+    json_object_put(jobj);
+    return json_str;
+}
+
+context_t* context_from_json(const char *json) {
+    if (!json) return NULL;
+
+    struct json_object *jobj = json_tokener_parse(json);
+    if (!jobj) return NULL;
+
+    context_t *ctx = create_context();
+    struct json_object *tmp;
+
+    if (json_object_object_get_ex(jobj, "summary", &tmp))
+        ctx->summary = strdup(json_object_get_string(tmp));
+    if (json_object_object_get_ex(jobj, "characters", &tmp))
+        ctx->characters = strdup(json_object_get_string(tmp));
+    if (json_object_object_get_ex(jobj, "locations", &tmp))
+        ctx->locations = strdup(json_object_get_string(tmp));
+    if (json_object_object_get_ex(jobj, "jargon", &tmp))
+        ctx->jargon = strdup(json_object_get_string(tmp));
+
+    json_object_put(jobj);
+    return ctx;
+}
+
+int save_context(const char *filename, context_t *ctx) {
+    if (!filename || !ctx) return -1;
+
+    char *json_str = context_to_json(ctx);
     FILE *fp = fopen(filename, "w");
     if (!fp) {
         perror("Failed to open context file for writing");
-        json_object_put(jobj);
+        free(json_str);
         return -1;
     }
     fprintf(fp, "%s", json_str);
     fclose(fp);
-    json_object_put(jobj);
+    free(json_str);
     return 0;
 }
 
@@ -79,103 +109,161 @@ context_t* load_context(const char *filename) {
     fclose(fp);
     buffer[fsize] = 0;
     
-    struct json_object *jobj = json_tokener_parse(buffer);
+    context_t *ctx = context_from_json(buffer);
     free(buffer);
-    
-    if (!jobj) return NULL;
-    
-    context_t *ctx = create_context();
-    struct json_object *tmp;
-    
-    if (json_object_object_get_ex(jobj, "summary", &tmp))
-        ctx->summary = strdup(json_object_get_string(tmp));
-    if (json_object_object_get_ex(jobj, "characters", &tmp))
-        ctx->characters = strdup(json_object_get_string(tmp));
-    if (json_object_object_get_ex(jobj, "locations", &tmp))
-        ctx->locations = strdup(json_object_get_string(tmp));
-    if (json_object_object_get_ex(jobj, "jargon", &tmp))
-        ctx->jargon = strdup(json_object_get_string(tmp));
-        
-    json_object_put(jobj);
     return ctx;
 }
 
 // Internal helper for LLM calls
 static char* perform_llm_request(const char *system_prompt, const char *user_content, config_t *config) {
-    CURL *curl = curl_easy_init();
-    if (!curl) return NULL;
+    llm_request_t request = {
+        .system_prompt = system_prompt,
+        .user_content = user_content,
+        .temperature = 0.1 // Low temp for extraction
+    };
+    return llm_chat(config, &request);
+}
 
-    struct curl_slist *headers = NULL;
-    char auth_header[256];
-    snprintf(auth_header, sizeof(auth_header), "Authorization: Bearer %s", config->api_key ? config->api_key : "lm-studio");
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-    headers = curl_slist_append(headers, auth_header);
+// snprintf into a buffer of the right size (caller frees)
+static char* format_alloc(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int size = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (size < 0) return NULL;
+    char *out = malloc(size + 1);
+    if (!out) return NULL;
+    va_start(args, format);
+    vsnprintf(out, size + 1, format, args);
+    va_end(args);
+    return out;
+}
 
-    struct json_object *payload = json_object_new_object();
-    json_object_object_add(payload, "model", json_object_new_string(config->model));
-    json_object_object_add(payload, "temperature", json_object_new_double(0.1)); // Low temp for extraction
+typedef struct {
+    worker_job_t job;
+    char *text;
+    char *summary;
+    config_t *config;
+} context_part_t;
 
-    struct json_object *messages = json_object_new_array();
-    
-    struct json_object *sys_msg = json_object_new_object();
-    json_object_object_add(sys_msg, "role", json_object_new_string("system"));
-    json_object_object_add(sys_msg, "content", json_object_new_string(system_prompt));
-    json_object_array_add(messages, sys_msg);
-    
-    struct json_object *usr_msg = json_object_new_object();
-    json_object_object_add(usr_msg, "role", json_object_new_string("user"));
-    json_object_object_add(usr_msg, "content", json_object_new_string(user_content));
-    json_object_array_add(messages, usr_msg);
-    
-    json_object_object_add(payload, "messages", messages);
-    
-    const char *post_fields = json_object_to_json_string(payload);
-    
-    char *response_buffer = calloc(1, 1);
-    struct {
-        char *response;
-        size_t size;
-    } response_data = {response_buffer, 0};
+static void summarize_part(void *arg) {
+    context_part_t *part = (context_part_t*)arg;
+    part->summary = perform_llm_request(part->config->prompt_context_part, part->text, part->config);
+}
 
-    const char *url = config->api_endpoint ? config->api_endpoint : "https://api.openai.com/v1/chat/completions";
-    
-    curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, post_fields);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response_data);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 60L);
-
-    CURLcode res = curl_easy_perform(curl);
-    
-    char *result = NULL;
-    if (res == CURLE_OK) {
-        struct json_object *parsed = json_tokener_parse(response_data.response);
-        if (parsed) {
-            struct json_object *choices, *choice, *message, *content;
-            if (json_object_object_get_ex(parsed, "choices", &choices) &&
-                (choice = json_object_array_get_idx(choices, 0)) &&
-                json_object_object_get_ex(choice, "message", &message) &&
-                json_object_object_get_ex(message, "content", &content)) {
-                result = strdup(json_object_get_string(content));
-            }
-            json_object_put(parsed);
+// Splits text into parts of at most part_tokens, summarizes them in
+// parallel on the pipeline's worker pool (one after the other without one)
+// and returns the summaries in order (caller frees). NULL if a part could
+// not be summarized. Must not run on a worker of that pool.
+static char* summarize_parts(const char *text, int part_tokens, config_t *config) {
+    text_piece_t *pieces;
+    int count = segment_text(text, part_tokens, &pieces);
+    if (count <= 0) return NULL;
+
+    context_part_t *parts = calloc(count, sizeof(context_part_t));
+    if (!parts) {
+        free(pieces);
+        return NULL;
+    }
+    worker_pool_t *pool = config->worker_pool;
+    for (int i = 0; i < count; i++) {
+        parts[i].text = strndup(text + pieces[i].start, pieces[i].length);
+        parts[i].config = config;
+        parts[i].job.fn = summarize_part;
+        parts[i].job.arg = &parts[i];
+        // The next chapters wait for this context, so its parts go first
+        parts[i].job.priority = INT_MAX;
+        if (!parts[i].text) continue;
+        if (pool) worker_pool_submit(pool, &parts[i].job);
+        else summarize_part(&parts[i]);
+    }
+    for (int i = 0; i < count; i++) {
+        if (pool && parts[i].text) worker_pool_wait(pool, &parts[i].job);
+    }
+
+    size_t size = 1;
+    int failed = 0;
+    for (int i = 0; i < count; i++) {
+        if (parts[i].summary) size += strlen(parts[i].summary) + 32;
+        else failed++;
+    }
+    char *summaries = failed ? NULL : malloc(size);
+    if (summaries) {
+        size_t pos = 0;
+        for (int i = 0; i < count; i++) {
+            pos += snprintf(summaries + pos, size - pos, "Part %d of %d:\n%s\n\n", i + 1, count, parts[i].summary);
+        }
+    } else if (failed) {
+        fprintf(stderr, "Context: %d of %d chapter parts could not be summarized\n", failed, count);
+    }
+    for (int i = 0; i < count; i++) {
+        free(parts[i].text);
+        free(parts[i].summary);
+    }
+    free(parts);
+    free(pieces);
+    return summaries;
+}
+
+// The prose of a chapter, cut down to what fits one request next to
+// system_prompt: a chapter too long for that is replaced by summaries of
+// its parts (map), which the caller's request then merges (reduce).
+// Returns NULL on failure (caller frees).
+static char* condense_chapter(const char *xhtml, const char *system_prompt, config_t *config) {
+    size_t len;
+    char *text = xhtml_text(xhtml, &len);
+    if (!text) return NULL;
+
+    int limit = segment_request_limit(config, count_tokens_str(system_prompt));
+    if (limit <= 0 || limit > CONTEXT_PART_TOKENS) limit = CONTEXT_PART_TOKENS;
+    int tokens = count_tokens(text, len);
+    for (int round = 0; tokens > limit; round++) {
+        char *summaries = round < CONTEXT_MAX_ROUNDS ? summarize_parts(text, limit, config) : NULL;
+        free(text);
+        if (!summaries) return NULL;
+        int summary_tokens = count_tokens_str(summaries);
+        if (summary_tokens >= tokens) {
+            fprintf(stderr, "Context: chapter part summaries are no shorter than the chapter\n");
+            free(summaries);
+            return NULL;
         }
-    } else {
-        fprintf(stderr, "Context LLM request failed: %s\n", curl_easy_strerror(res));
+        text = summaries;
+        tokens = summary_tokens;
     }
+    return text;
+}
 
-    free(response_data.response);
-    json_object_put(payload);
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
-    return result;
+// Keeps the last CONTEXT_SUMMARY_TOKENS tokens of the summary, dropping
+// whole sentences from the front: the summary rolls forward with the book
+static void cap_summary(context_t *ctx) {
+    if (!ctx->summary) return;
+    size_t len = strlen(ctx->summary);
+    if (count_tokens(ctx->summary, len) <= CONTEXT_SUMMARY_TOKENS) return;
+
+    text_piece_t *pieces;
+    int count = segment_text(ctx->summary, CONTEXT_TRIM_TOKENS, &pieces);
+    if (count <= 0) return;
+    int first = count, tokens = 0;
+    while (first > 0) {
+        const text_piece_t *piece = &pieces[first - 1];
+        int piece_tokens = count_tokens(ctx->summary + piece->start, piece->length);
+        if (tokens + piece_tokens > CONTEXT_SUMMARY_TOKENS) break;
+        tokens += piece_tokens;
+        first--;
+    }
+    // A single piece is at most CONTEXT_TRIM_TOKENS, so at least one fits
+    size_t start = first < count ? pieces[first].start : len;
+    memmove(ctx->summary, ctx->summary + start, len - start + 1);
+    free(pieces);
 }
 
 int init_context_with_llm(context_t *ctx, const char *initial_text, config_t *config) {
     const char *prompt = config->prompt_context_init;
-        
-    char *json_response = perform_llm_request(prompt, initial_text, config);
+
+    char *text = condense_chapter(initial_text, prompt, config);
+    if (!text) return -1;
+    char *json_response = perform_llm_request(prompt, text, config);
+    free(text);
     if (!json_response) return -1;
     
     // Parse the response
@@ -183,6 +271,7 @@ int init_context_with_llm(context_t *ctx, const char *initial_text, config_t *co
     if (!jobj) {
         // Fallback: simple summary if JSON fails
         ctx->summary = json_response; // Take whatever we got
+        cap_summary(ctx);
         return 0;
     }
     
@@ -191,6 +280,7 @@ int init_context_with_llm(context_t *ctx, const char *initial_text, config_t *co
     if (json_object_object_get_ex(jobj, "characters", &tmp)) ctx->characters = strdup(json_object_get_string(tmp));
     if (json_object_object_get_ex(jobj, "locations", &tmp)) ctx->locations = strdup(json_object_get_string(tmp));
     if (json_object_object_get_ex(jobj, "jargon", &tmp)) ctx->jargon = strdup(json_object_get_string(tmp));
+    cap_summary(ctx);
     
     json_object_put(jobj);
     free(json_response);
@@ -198,16 +288,18 @@ int init_context_with_llm(context_t *ctx, const char *initial_text, config_t *co
 }
 
 int update_context_with_llm(context_t *ctx, const char *new_text, config_t *config) {
-    char system_prompt[8192]; // Increased buffer for template + data
-    snprintf(system_prompt, sizeof(system_prompt),
-        config->prompt_context_update,
+    char *system_prompt = format_alloc(config->prompt_context_update,
         ctx->summary ? ctx->summary : "",
         ctx->characters ? ctx->characters : "",
         ctx->locations ? ctx->locations : "",
         ctx->jargon ? ctx->jargon : ""
     );
-    
-    char *json_response = perform_llm_request(system_prompt, new_text, config);
+    if (!system_prompt) return -1;
+
+    char *text = condense_chapter(new_text, system_prompt, config);
+    char *json_response = text ? perform_llm_request(system_prompt, text, config) : NULL;
+    free(text);
+    free(system_prompt);
     if (!json_response) return -1;
     
     // Parse and replace
@@ -234,6 +326,7 @@ int update_context_with_llm(context_t *ctx, const char *new_text, config_t *conf
         free(ctx->jargon);
         ctx->jargon = strdup(json_object_get_string(tmp));
     }
+    cap_summary(ctx);
     
     json_object_put(jobj);
     free(json_response);
@@ -242,8 +335,7 @@ int update_context_with_llm(context_t *ctx, const char *new_text, config_t *conf
 
 char* format_context_for_prompt(context_t *ctx) {
     if (!ctx) return NULL;
-    char buffer[4096];
-    snprintf(buffer, sizeof(buffer),
+    return format_alloc(
         "--- STORY CONTEXT ---\n"
         "SUMMARY: %s\n"
         "CHARACTERS: %s\n"
@@ -255,5 +347,4 @@ char* format_context_for_prompt(context_t *ctx) {
         ctx->locations ? ctx->locations : "N/A",
         ctx->jargon ? ctx->jargon : "N/A"
     );
-    return strdup(buffer);
 }
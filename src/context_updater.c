@@ -0,0 +1,170 @@
+#include "context_updater.h"
+#include "metrics.h"
+#include <pthread.h>
+
+typedef struct update_item {
+    char *content;
+    chapter_finish_fn finish;
+    void *arg;
+    struct update_item *next;
+} update_item_t;
+
+struct context_updater {
+    ContextStrategy **strategies;
+    int strategy_count;
+    config_t *config;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t item_available;
+    pthread_cond_t item_applied;
+    update_item_t *head;
+    update_item_t *tail;
+    int submitted;
+    int applied;
+    int shutdown;
+    char *prompt;       // Combined context after the last applied chapter
+};
+
+char* build_combined_context(ContextStrategy **strategies, int strategy_count, config_t *config) {
+    char *combined_context = calloc(1, 1);
+    for (int s = 0; s < strategy_count; s++) {
+        char *prompt_chunk = strategies[s]->get_prompt(strategies[s]->state, config);
+        if (prompt_chunk) {
+            size_t new_len = strlen(combined_context) + strlen(prompt_chunk) + 2;
+            combined_context = realloc(combined_context, new_len);
+            strcat(combined_context, prompt_chunk);
+            strcat(combined_context, "\n"); // Separator
+            free(prompt_chunk);
+        }
+    }
+    return combined_context;
+}
+
+static void* updater_main(void *arg) {
+    context_updater_t *u = (context_updater_t*)arg;
+
+    pthread_mutex_lock(&u->lock);
+    for (;;) {
+        while (!u->head && !u->shutdown) {
+            pthread_cond_wait(&u->item_available, &u->lock);
+        }
+        if (!u->head) break; // shutdown and queue drained
+
+        update_item_t *item = u->head;
+        u->head = item->next;
+        if (!u->head) u->tail = NULL;
+        pthread_mutex_unlock(&u->lock);
+
+        // The (slow) LLM calls of the strategies run without the lock held,
+        // dispatch keeps using the previously published prompt meanwhile
+        char *prompt = NULL;
+        if (item->content) {
+            double start = metrics_now();
+            for (int s = 0; s < u->strategy_count; s++) {
+                u->strategies[s]->update(u->strategies[s]->state, item->content, u->config);
+            }
+            prompt = build_combined_context(u->strategies, u->strategy_count, u->config);
+            metrics_add_stage_time(STAGE_CONTEXT, metrics_now() - start);
+        }
+        if (item->finish) item->finish(item->arg);
+        free(item->content);
+        free(item);
+
+        pthread_mutex_lock(&u->lock);
+        if (prompt) {
+            free(u->prompt);
+            u->prompt = prompt;
+        }
+        u->applied++;
+        pthread_cond_broadcast(&u->item_applied);
+    }
+    pthread_mutex_unlock(&u->lock);
+    return NULL;
+}
+
+context_updater_t* context_updater_create(ContextStrategy **strategies, int strategy_count, config_t *config) {
+    context_updater_t *u = calloc(1, sizeof(context_updater_t));
+    if (!u) return NULL;
+    u->strategies = strategies;
+    u->strategy_count = strategy_count;
+    u->config = config;
+    u->prompt = build_combined_context(strategies, strategy_count, config);
+
+    pthread_mutex_init(&u->lock, NULL);
+    pthread_cond_init(&u->item_available, NULL);
+    pthread_cond_init(&u->item_applied, NULL);
+
+    if (pthread_create(&u->thread, NULL, updater_main, u) != 0) {
+        fprintf(stderr, "Failed to start context updater thread\n");
+        pthread_mutex_destroy(&u->lock);
+        pthread_cond_destroy(&u->item_available);
+        pthread_cond_destroy(&u->item_applied);
+        free(u->prompt);
+        free(u);
+        return NULL;
+    }
+    return u;
+}
+
+void context_updater_destroy(context_updater_t *updater) {
+    if (!updater) return;
+
+    pthread_mutex_lock(&updater->lock);
+    updater->shutdown = 1;
+    pthread_cond_broadcast(&updater->item_available);
+    pthread_mutex_unlock(&updater->lock);
+    pthread_join(updater->thread, NULL);
+
+    pthread_mutex_destroy(&updater->lock);
+    pthread_cond_destroy(&updater->item_available);
+    pthread_cond_destroy(&updater->item_applied);
+    free(updater->prompt);
+    free(updater);
+}
+
+void context_updater_submit(context_updater_t *updater, char *content, chapter_finish_fn finish, void *arg) {
+    update_item_t *item = calloc(1, sizeof(update_item_t));
+    if (!item) {
+        // Still finish the chapter in order, only its context is lost
+        fprintf(stderr, "Warning: Out of memory, skipping context update\n");
+        context_updater_wait(updater, updater->submitted);
+        if (finish) finish(arg);
+        free(content);
+        pthread_mutex_lock(&updater->lock);
+        updater->submitted++;
+        updater->applied++;
+        pthread_cond_broadcast(&updater->item_applied);
+        pthread_mutex_unlock(&updater->lock);
+        return;
+    }
+    item->content = content;
+    item->finish = finish;
+    item->arg = arg;
+
+    pthread_mutex_lock(&updater->lock);
+    if (updater->tail) {
+        updater->tail->next = item;
+    } else {
+        updater->head = item;
+    }
+    updater->tail = item;
+    updater->submitted++;
+    pthread_cond_signal(&updater->item_available);
+    pthread_mutex_unlock(&updater->lock);
+}
+
+void context_updater_wait(context_updater_t *updater, int count) {
+    pthread_mutex_lock(&updater->lock);
+    while (updater->applied < count) {
+        pthread_cond_wait(&updater->item_applied, &updater->lock);
+    }
+    pthread_mutex_unlock(&updater->lock);
+}
+
+char* context_updater_prompt(context_updater_t *updater) {
+    pthread_mutex_lock(&updater->lock);
+    char *prompt = strdup(updater->prompt ? updater->prompt : "");
+    pthread_mutex_unlock(&updater->lock);
+    return prompt;
+}
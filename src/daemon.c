@@ -0,0 +1,634 @@
+#define _GNU_SOURCE // struct ucred
+#include "daemon.h"
+#include "pipeline.h"
+#include "worker_pool.h"
+#include <json-c/json.h>
+#include <pthread.h>
+#include <signal.h>
+#include <poll.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define DEFAULT_BOOKS 2
+
+// Largest request accepted over the socket
+#define MAX_REQUEST 65536
+
+// Seconds between scans of the spool directory
+#define SPOOL_INTERVAL 1
+
+typedef enum {
+    JOB_QUEUED,
+    JOB_RUNNING,
+    JOB_DONE,
+    JOB_FAILED,
+    JOB_CANCELLED,
+    JOB_STOPPED     // Interrupted by a shutdown; spool jobs resume on restart
+} job_state_t;
+
+static const char *state_names[] = { "queued", "running", "done", "failed", "cancelled", "stopped" };
+
+typedef struct daemon_job {
+    int id;
+    char *input;
+    char *output;
+    char *language;         // NULL: the configured target language
+    char *spool_name;       // Job file in the spool (NULL: submitted over the socket)
+    int priority;
+    int resume;
+    job_state_t state;
+    int chapters_done;
+    int chapters_failed;
+    int chapters_total;
+    time_t submitted;
+    time_t started;
+    time_t finished;
+    struct daemon_job *next;
+} daemon_job_t;
+
+static pthread_mutex_t daemon_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_queued = PTHREAD_COND_INITIALIZER;
+static daemon_job_t *jobs = NULL;       // In submission order
+static daemon_job_t *jobs_tail = NULL;
+static int next_id = 1;
+static int stopping = 0;
+static config_t *base_config = NULL;
+static worker_pool_t *pool = NULL;
+static volatile sig_atomic_t signalled = 0;
+
+static void on_signal(int sig) {
+    (void)sig;
+    signalled = 1;
+}
+
+static void request_stop(void) {
+    pthread_mutex_lock(&daemon_lock);
+    stopping = 1;
+    pthread_cond_broadcast(&job_queued);
+    pthread_mutex_unlock(&daemon_lock);
+}
+
+
+// Caller holds daemon_lock
+static struct json_object* job_to_json(const daemon_job_t *job) {
+    struct json_object *o = json_object_new_object();
+    json_object_object_add(o, "id", json_object_new_int(job->id));
+    json_object_object_add(o, "state", json_object_new_string(state_names[job->state]));
+    json_object_object_add(o, "input", json_object_new_string(job->input));
+    json_object_object_add(o, "output", json_object_new_string(job->output));
+    json_object_object_add(o, "lang", json_object_new_string(job->language ? job->language : base_config->target_language));
+    json_object_object_add(o, "priority", json_object_new_int(job->priority));
+    json_object_object_add(o, "chapters_done", json_object_new_int(job->chapters_done));
+    json_object_object_add(o, "chapters_failed", json_object_new_int(job->chapters_failed));
+    json_object_object_add(o, "chapters_total", json_object_new_int(job->chapters_total));
+    json_object_object_add(o, "submitted", json_object_new_int64(job->submitted));
+    if (job->started) json_object_object_add(o, "started", json_object_new_int64(job->started));
+    if (job->finished) json_object_object_add(o, "finished", json_object_new_int64(job->finished));
+    if (job->spool_name) json_object_object_add(o, "file", json_object_new_string(job->spool_name));
+    return o;
+}
+
+static void write_json_file(const char *path, struct json_object *o) {
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *fp = fopen(tmp_path, "w");
+    if (!fp) return;
+    fprintf(fp, "%s\n", json_object_to_json_string_ext(o, JSON_C_TO_STRING_PRETTY));
+    if (fclose(fp) == 0) rename(tmp_path, path);
+}
+
+// Rewrites <spool>/status/<name> for spool jobs
+static void write_status(daemon_job_t *job) {
+    if (!base_config->daemon_spool || !job->spool_name) return;
+    pthread_mutex_lock(&daemon_lock);
+    struct json_object *o = job_to_json(job);
+    pthread_mutex_unlock(&daemon_lock);
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/status/%s", base_config->daemon_spool, job->spool_name);
+    write_json_file(path, o);
+    json_object_put(o);
+}
+
+// Moves a spool job file between the state directories
+static void move_job_file(const char *name, const char *from, const char *to) {
+    char src[PATH_MAX], dst[PATH_MAX];
+    snprintf(src, sizeof(src), "%s/%s/%s", base_config->daemon_spool, from, name);
+    snprintf(dst, sizeof(dst), "%s/%s/%s", base_config->daemon_spool, to, name);
+    if (rename(src, dst) != 0) {
+        fprintf(stderr, "Failed to move job %s to %s/: %s\n", name, to, strerror(errno));
+    }
+}
+
+
+static const char* get_string(struct json_object *request, const char *key) {
+    struct json_object *value;
+    if (!json_object_object_get_ex(request, key, &value) || !json_object_is_type(value, json_type_string)) return NULL;
+    return json_object_get_string(value);
+}
+
+// Validates a submit request and queues the job. Returns its id, or -1
+// with a message in `error`.
+static int submit_job(struct json_object *request, const char *spool_name, int resume, char *error, size_t error_size) {
+    const char *input = get_string(request, "input");
+    const char *output = get_string(request, "output");
+    const char *language = get_string(request, "lang");
+    if (!language) language = get_string(request, "target_language");
+    if (!input || !output) {
+        snprintf(error, error_size, "\"input\" and \"output\" are required");
+        return -1;
+    }
+    if (access(input, R_OK) != 0) {
+        snprintf(error, error_size, "cannot read %s: %s", input, strerror(errno));
+        return -1;
+    }
+
+    daemon_job_t *job = calloc(1, sizeof(daemon_job_t));
+    if (!job) {
+        snprintf(error, error_size, "out of memory");
+        return -1;
+    }
+    job->input = strdup(input);
+    job->output = strdup(output);
+    job->language = language ? strdup(language) : NULL;
+    job->spool_name = spool_name ? strdup(spool_name) : NULL;
+    struct json_object *value;
+    if (json_object_object_get_ex(request, "priority", &value)) job->priority = json_object_get_int(value);
+    if (json_object_object_get_ex(request, "resume", &value)) resume |= json_object_get_boolean(value);
+    job->resume = resume;
+    job->state = JOB_QUEUED;
+    job->submitted = time(NULL);
+
+    pthread_mutex_lock(&daemon_lock);
+    job->id = next_id++;
+    pthread_mutex_unlock(&daemon_lock);
+
+    // Reported before a runner can see the job, so this status never
+    // overwrites a newer one
+    printf("Job %d queued: %s -> %s (priority %d)\n", job->id, job->input, job->output, job->priority);
+    write_status(job);
+
+    pthread_mutex_lock(&daemon_lock);
+    if (jobs_tail) {
+        jobs_tail->next = job;
+    } else {
+        jobs = job;
+    }
+    jobs_tail = job;
+    pthread_cond_signal(&job_queued);
+    pthread_mutex_unlock(&daemon_lock);
+    return job->id;
+}
+
+// Highest priority first, then the oldest. Caller holds daemon_lock.
+static daemon_job_t* next_job(void) {
+    daemon_job_t *best = NULL;
+    for (daemon_job_t *job = jobs; job; job = job->next) {
+        if (job->state == JOB_QUEUED && (!best || job->priority > best->priority)) best = job;
+    }
+    return best;
+}
+
+static daemon_job_t* find_job(int id) {
+    for (daemon_job_t *job = jobs; job; job = job->next) {
+        if (job->id == id) return job;
+    }
+    return NULL;
+}
+
+
+static void job_progress(void *arg, int done, int failed, int total) {
+    daemon_job_t *job = arg;
+    pthread_mutex_lock(&daemon_lock);
+    job->chapters_done = done;
+    job->chapters_failed = failed;
+    job->chapters_total = total;
+    pthread_mutex_unlock(&daemon_lock);
+    write_status(job);
+}
+
+static int job_stop_requested(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&daemon_lock);
+    int stop = stopping;
+    pthread_mutex_unlock(&daemon_lock);
+    return stop;
+}
+
+static int run_job(daemon_job_t *job) {
+    // Each book gets its own settings: target language, and no shared
+    // working directory or context history file
+    config_t *config = copy_config(base_config);
+    if (!config) return -1;
+    if (job->language) {
+        free(config->target_language);
+        config->target_language = strdup(job->language);
+    }
+    // In memory, a resumed book rebuilds its completed chapters from the
+    // journal and its strategies start from the state saved with them
+    config->in_memory = 1;
+    if (config->context_file) {
+        free(config->context_file);
+        size_t size = strlen(job->output) + sizeof(".context");
+        config->context_file = malloc(size);
+        if (config->context_file) snprintf(config->context_file, size, "%s.context", job->output);
+    }
+
+    pipeline_book_t book = {
+        .input = job->input,
+        .output = job->output,
+        .resume = job->resume,
+        .priority = job->priority,
+        .progress = job_progress,
+        .stop_requested = job_stop_requested,
+        .progress_arg = job
+    };
+    int rc = pipeline_translate_book(config, pool, &book);
+    free_config(config);
+    return rc;
+}
+
+static void* runner_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&daemon_lock);
+    for (;;) {
+        daemon_job_t *job = NULL;
+        while (!stopping && !(job = next_job())) {
+            pthread_cond_wait(&job_queued, &daemon_lock);
+        }
+        if (stopping) break;
+        job->state = JOB_RUNNING;
+        job->started = time(NULL);
+        pthread_mutex_unlock(&daemon_lock);
+
+        printf("Job %d started: %s\n", job->id, job->input);
+        write_status(job);
+        int rc = run_job(job);
+
+        pthread_mutex_lock(&daemon_lock);
+        job->state = rc == 0 ? JOB_DONE : rc > 0 ? JOB_STOPPED : JOB_FAILED;
+        job->finished = time(NULL);
+        pthread_mutex_unlock(&daemon_lock);
+        printf("Job %d %s: %s\n", job->id, state_names[job->state], job->output);
+        write_status(job);
+        if (job->spool_name && job->state != JOB_STOPPED) {
+            move_job_file(job->spool_name, "cur", job->state == JOB_DONE ? "done" : "failed");
+        }
+        pthread_mutex_lock(&daemon_lock);
+    }
+    pthread_mutex_unlock(&daemon_lock);
+    return NULL;
+}
+
+
+static void send_reply(int fd, struct json_object *reply) {
+    const char *text = json_object_to_json_string_ext(reply, JSON_C_TO_STRING_PLAIN);
+    size_t len = strlen(text), sent = 0;
+    while (sent < len) {
+        ssize_t n = write(fd, text + sent, len - sent);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        sent += n;
+    }
+    if (write(fd, "\n", 1) < 0) return;
+}
+
+static struct json_object* error_reply(const char *message) {
+    struct json_object *reply = json_object_new_object();
+    json_object_object_add(reply, "ok", json_object_new_boolean(0));
+    json_object_object_add(reply, "error", json_object_new_string(message));
+    return reply;
+}
+
+static struct json_object* handle_request(struct json_object *request) {
+    const char *cmd = get_string(request, "cmd");
+    if (!cmd) return error_reply("missing \"cmd\"");
+
+    struct json_object *reply = json_object_new_object();
+    json_object_object_add(reply, "ok", json_object_new_boolean(1));
+    struct json_object *id_value;
+    int has_id = json_object_object_get_ex(request, "id", &id_value);
+    int id = has_id ? json_object_get_int(id_value) : 0;
+
+    if (strcmp(cmd, "submit") == 0) {
+        char error[PATH_MAX + 64];
+        int job_id = submit_job(request, NULL, 0, error, sizeof(error));
+        if (job_id < 0) {
+            json_object_put(reply);
+            return error_reply(error);
+        }
+        json_object_object_add(reply, "id", json_object_new_int(job_id));
+    } else if (strcmp(cmd, "status") == 0) {
+        pthread_mutex_lock(&daemon_lock);
+        if (has_id) {
+            daemon_job_t *job = find_job(id);
+            if (job) json_object_object_add(reply, "job", job_to_json(job));
+            pthread_mutex_unlock(&daemon_lock);
+            if (!job) {
+                json_object_put(reply);
+                return error_reply("no such job");
+            }
+        } else {
+            struct json_object *list = json_object_new_array();
+            for (daemon_job_t *job = jobs; job; job = job->next) {
+                json_object_array_add(list, job_to_json(job));
+            }
+            pthread_mutex_unlock(&daemon_lock);
+            json_object_object_add(reply, "jobs", list);
+        }
+    } else if (strcmp(cmd, "cancel") == 0) {
+        // Only queued jobs; a running book stops with the daemon
+        pthread_mutex_lock(&daemon_lock);
+        daemon_job_t *job = has_id ? find_job(id) : NULL;
+        int cancelled = job && job->state == JOB_QUEUED;
+        if (cancelled) {
+            job->state = JOB_CANCELLED;
+            job->finished = time(NULL);
+        }
+        pthread_mutex_unlock(&daemon_lock);
+        if (!cancelled) {
+            json_object_put(reply);
+            return error_reply(job ? "job is not queued" : "no such job");
+        }
+        write_status(job);
+        if (job->spool_name) move_job_file(job->spool_name, "cur", "failed");
+    } else if (strcmp(cmd, "shutdown") == 0) {
+        request_stop();
+    } else {
+        json_object_put(reply);
+        return error_reply("unknown command");
+    }
+    return reply;
+}
+
+static void serve_client(int fd) {
+    // A client that connects and sends nothing must not hang the daemon
+    struct timeval timeout = { .tv_sec = 5 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    char *buffer = malloc(MAX_REQUEST + 1);
+    if (!buffer) return;
+    size_t len = 0;
+    while (len < MAX_REQUEST) {
+        ssize_t n = read(fd, buffer + len, MAX_REQUEST - len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        len += n;
+        if (memchr(buffer + len - n, '\n', n)) break;
+    }
+    buffer[len] = 0;
+
+    struct json_object *request = json_tokener_parse(buffer);
+    free(buffer);
+    struct json_object *reply = request && json_object_is_type(request, json_type_object)
+        ? handle_request(request) : error_reply("request is not a JSON object");
+    send_reply(fd, reply);
+    json_object_put(reply);
+    json_object_put(request);
+}
+
+static int open_socket(const char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    unlink(path); // Left behind by a daemon that did not shut down cleanly
+    // Only the daemon's own user may connect: the socket submits and
+    // cancels jobs that read and write files as that user
+    mode_t old_mask = umask(077);
+    int bound = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+    umask(old_mask);
+    if (bound != 0 || listen(fd, 16) != 0) {
+        fprintf(stderr, "Failed to listen on %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Whether the client runs as the daemon's user (or root), in case the
+// socket was made reachable to others after it was created
+static int peer_allowed(int fd) {
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) {
+        perror("getsockopt");
+        return 0;
+    }
+    return cred.uid == getuid() || cred.uid == 0;
+}
+
+
+static int make_spool_dirs(const char *spool) {
+    static const char *subdirs[] = { "", "/new", "/cur", "/done", "/failed", "/status" };
+    for (size_t i = 0; i < sizeof(subdirs) / sizeof(subdirs[0]); i++) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s%s", spool, subdirs[i]);
+        if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+            fprintf(stderr, "Failed to create %s: %s\n", path, strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int is_job_file(const struct dirent *entry) {
+    size_t len = strlen(entry->d_name);
+    return entry->d_name[0] != '.' && len > 5 && strcmp(entry->d_name + len - 5, ".json") == 0;
+}
+
+// Queues the job files of <spool>/<dir>, in name order. New jobs are
+// moved to cur/ first; jobs found in cur/ at startup are resumed.
+static void scan_spool(const char *dir, int resume) {
+    const char *spool = base_config->daemon_spool;
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", spool, dir);
+    struct dirent **entries = NULL;
+    int count = scandir(path, &entries, is_job_file, alphasort);
+    for (int i = 0; i < count; i++) {
+        const char *name = entries[i]->d_name;
+        char file[PATH_MAX + 256];
+        snprintf(file, sizeof(file), "%s/%s", path, name);
+        struct json_object *request = json_object_from_file(file);
+
+        char error[PATH_MAX + 64] = "job file is not a JSON object";
+        int queued = -1;
+        if (request && json_object_is_type(request, json_type_object)) {
+            if (!resume) move_job_file(name, "new", "cur");
+            queued = submit_job(request, name, resume, error, sizeof(error));
+            if (queued < 0) move_job_file(name, "cur", "failed");
+        } else {
+            move_job_file(name, dir, "failed");
+        }
+        if (queued < 0) {
+            fprintf(stderr, "Rejected job %s: %s\n", name, error);
+            struct json_object *status = error_reply(error);
+            json_object_object_add(status, "state", json_object_new_string("failed"));
+            char status_path[PATH_MAX];
+            snprintf(status_path, sizeof(status_path), "%s/status/%s", spool, name);
+            write_json_file(status_path, status);
+            json_object_put(status);
+        }
+        json_object_put(request);
+        free(entries[i]);
+    }
+    free(entries);
+}
+
+
+int daemon_run(config_t *config) {
+    if (!config->daemon_socket && !config->daemon_spool) {
+        fprintf(stderr, "Daemon mode needs a socket (--socket) or a spool directory (--spool)\n");
+        return -1;
+    }
+    base_config = config;
+    if (config->daemon_spool && make_spool_dirs(config->daemon_spool) != 0) return -1;
+
+    int listen_fd = -1;
+    if (config->daemon_socket) {
+        listen_fd = open_socket(config->daemon_socket);
+        if (listen_fd < 0) return -1;
+    }
+
+    pool = worker_pool_create(config->workers);
+    int runner_count = config->daemon_books > 0 ? config->daemon_books : DEFAULT_BOOKS;
+    pthread_t *runners = calloc(runner_count, sizeof(pthread_t));
+    if (!pool || !runners) {
+        fprintf(stderr, "Failed to start worker pool\n");
+        worker_pool_destroy(pool);
+        free(runners);
+        if (listen_fd >= 0) close(listen_fd);
+        return -1;
+    }
+    int started = 0;
+    for (; started < runner_count; started++) {
+        if (pthread_create(&runners[started], NULL, runner_main, NULL) != 0) break;
+    }
+
+    struct sigaction action = { .sa_handler = on_signal };
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("Daemon ready: %d books at a time on %d workers%s%s%s%s\n", started, config->workers,
+        config->daemon_socket ? ", socket " : "", config->daemon_socket ? config->daemon_socket : "",
+        config->daemon_spool ? ", spool " : "", config->daemon_spool ? config->daemon_spool : "");
+    if (config->daemon_spool) scan_spool("cur", 1);
+
+    time_t last_scan = 0;
+    for (;;) {
+        if (signalled) request_stop();
+        pthread_mutex_lock(&daemon_lock);
+        int stop = stopping;
+        pthread_mutex_unlock(&daemon_lock);
+        if (stop) break;
+
+        if (config->daemon_spool && time(NULL) - last_scan >= SPOOL_INTERVAL) {
+            scan_spool("new", 0);
+            last_scan = time(NULL);
+        }
+
+        struct pollfd pfd = { .fd = listen_fd, .events = POLLIN };
+        if (poll(&pfd, listen_fd >= 0 ? 1 : 0, SPOOL_INTERVAL * 1000) > 0 && (pfd.revents & POLLIN)) {
+            int client = accept(listen_fd, NULL, NULL);
+            if (client >= 0) {
+                if (peer_allowed(client)) {
+                    serve_client(client);
+                } else {
+                    fprintf(stderr, "Refused a connection from another user\n");
+                    struct json_object *reply = error_reply("permission denied");
+                    send_reply(client, reply);
+                    json_object_put(reply);
+                }
+                close(client);
+            }
+        }
+    }
+
+    printf("Shutting down: waiting for the chapters in flight\n");
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        unlink(config->daemon_socket);
+    }
+    for (int i = 0; i < started; i++) pthread_join(runners[i], NULL);
+    free(runners);
+    worker_pool_destroy(pool);
+    pool = NULL;
+
+    pthread_mutex_lock(&daemon_lock);
+    while (jobs) {
+        daemon_job_t *next = jobs->next;
+        free(jobs->input);
+        free(jobs->output);
+        free(jobs->language);
+        free(jobs->spool_name);
+        free(jobs);
+        jobs = next;
+    }
+    jobs_tail = NULL;
+    pthread_mutex_unlock(&daemon_lock);
+    return 0;
+}
+
+
+int daemon_request(const char *socket_path, const char *request, FILE *out) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socket_path);
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "Cannot reach the daemon at %s: %s\n", socket_path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    size_t len = strlen(request);
+    if (write(fd, request, len) != (ssize_t)len || write(fd, "\n", 1) != 1) {
+        perror("Failed to send request");
+        close(fd);
+        return -1;
+    }
+
+    // Status replies grow with the number of jobs
+    size_t size = 0, capacity = 4096;
+    char *reply = malloc(capacity);
+    ssize_t n;
+    while (reply && (n = read(fd, reply + size, capacity - 1 - size)) > 0) {
+        size += n;
+        if (size == capacity - 1) {
+            char *grown = realloc(reply, capacity * 2);
+            if (!grown) break;
+            reply = grown;
+            capacity *= 2;
+        }
+    }
+    close(fd);
+    if (!reply) return -1;
+    reply[size] = 0;
+
+    fputs(reply, out);
+    struct json_object *parsed = json_tokener_parse(reply);
+    struct json_object *ok;
+    int rc = parsed && json_object_object_get_ex(parsed, "ok", &ok) && json_object_get_boolean(ok) ? 0 : -1;
+    json_object_put(parsed);
+    free(reply);
+    return rc;
+}
@@ -1,57 +1,172 @@
 #include "epub.h"
-#include <dirent.h>
+#include "worker_pool.h"
+#include <zlib.h>
 
-static int add_dir_to_zip(struct zip *z, const char *dir_path, const char *base_path) {
-    DIR *dir = opendir(dir_path);
-    if (!dir) return -1;
+// A rewritten entry deflated ahead of time on a worker thread
+typedef struct {
+    worker_job_t job;
+    const epub_entry_t *entry;
+    unsigned char *data;         // Raw deflate stream
+    size_t size;
+    uint32_t crc;
+    int ok;
+} deflate_job_t;
 
-    struct dirent *entry;
-    while ((entry = readdir(dir))) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
-            continue;
-        
-        // Skip mimetype as it's added manually with specific compression rules
-        if (strcmp(entry->d_name, "mimetype") == 0)
-            continue;
+// Serves already-deflated bytes to libzip. Its stat reports DEFLATE with
+// sizes and CRC, so zip_close() copies the data as-is instead of
+// compressing it again on the writing thread.
+typedef struct {
+    const deflate_job_t *deflated;
+    zip_uint64_t offset;
+    zip_error_t error;
+} deflated_source_t;
 
-        char full_path[1024];
-        char zip_path[1024];
-        snprintf(full_path, sizeof(full_path), "%s/%s", dir_path, entry->d_name);
-        
-        if (base_path && strlen(base_path) > 0)
-            snprintf(zip_path, sizeof(zip_path), "%s/%s", base_path, entry->d_name);
-        else
-            snprintf(zip_path, sizeof(zip_path), "%s", entry->d_name);
-
-        if (entry->d_type == DT_DIR) {
-            zip_dir_add(z, zip_path, ZIP_FL_ENC_UTF_8);
-            add_dir_to_zip(z, full_path, zip_path);
-        } else {
-            struct zip_source *s = zip_source_file(z, full_path, 0, 0);
-            if (s) {
-                zip_file_add(z, zip_path, s, ZIP_FL_OVERWRITE | ZIP_FL_ENC_UTF_8);
-            }
+static void run_deflate_job(void *arg) {
+    deflate_job_t *dj = (deflate_job_t*)arg;
+    const epub_entry_t *entry = dj->entry;
+
+    dj->crc = crc32(crc32(0L, Z_NULL, 0), (const Bytef*)entry->data, entry->size);
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // Negative window bits: raw deflate, as stored inside ZIP entries
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) return;
+
+    size_t bound = deflateBound(&zs, entry->size);
+    dj->data = malloc(bound);
+    if (dj->data) {
+        zs.next_in = (Bytef*)entry->data;
+        zs.avail_in = entry->size;
+        zs.next_out = dj->data;
+        zs.avail_out = bound;
+        if (deflate(&zs, Z_FINISH) == Z_STREAM_END) {
+            dj->size = zs.total_out;
+            dj->ok = 1;
         }
     }
-    closedir(dir);
-    return 0;
+    deflateEnd(&zs);
+}
+
+static zip_int64_t deflated_source_cb(void *userdata, void *data, zip_uint64_t len, zip_source_cmd_t cmd) {
+    deflated_source_t *src = (deflated_source_t*)userdata;
+    const deflate_job_t *dj = src->deflated;
+
+    switch (cmd) {
+        case ZIP_SOURCE_OPEN:
+            src->offset = 0;
+            return 0;
+        case ZIP_SOURCE_READ: {
+            zip_uint64_t n = dj->size - src->offset;
+            if (n > len) n = len;
+            memcpy(data, dj->data + src->offset, n);
+            src->offset += n;
+            return (zip_int64_t)n;
+        }
+        case ZIP_SOURCE_CLOSE:
+            return 0;
+        case ZIP_SOURCE_STAT: {
+            if (len < sizeof(zip_stat_t)) return -1;
+            zip_stat_t *st = (zip_stat_t*)data;
+            zip_stat_init(st);
+            st->size = dj->entry->size;
+            st->comp_size = dj->size;
+            st->comp_method = ZIP_CM_DEFLATE;
+            st->crc = dj->crc;
+            st->encryption_method = ZIP_EM_NONE;
+            st->valid = ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE | ZIP_STAT_COMP_METHOD | ZIP_STAT_CRC | ZIP_STAT_ENCRYPTION_METHOD;
+            return sizeof(zip_stat_t);
+        }
+        case ZIP_SOURCE_ERROR:
+            return zip_error_to_data(&src->error, data, len);
+        case ZIP_SOURCE_FREE:
+            free(src);
+            return 0;
+        case ZIP_SOURCE_SUPPORTS:
+            return zip_source_make_command_bitmap(ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE,
+                                                  ZIP_SOURCE_STAT, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, -1);
+        default:
+            zip_error_set(&src->error, ZIP_ER_OPNOTSUPP, 0);
+            return -1;
+    }
+}
+
+static zip_source_t* source_for_entry(zip_t *out, epub_book_t *book, const epub_entry_t *entry, const deflate_job_t *dj) {
+    if (!entry->data) {
+        // Untouched: copy the compressed bytes from the source archive
+        return zip_source_zip(out, book->zip, entry->index, ZIP_FL_COMPRESSED, 0, -1);
+    }
+    if (dj && dj->ok) {
+        deflated_source_t *src = calloc(1, sizeof(deflated_source_t));
+        if (!src) return NULL;
+        src->deflated = dj;
+        zip_source_t *s = zip_source_function(out, deflated_source_cb, src);
+        if (!s) free(src);
+        return s;
+    }
+    // Deflating failed up front; let libzip compress it
+    return zip_source_buffer(out, entry->data, entry->size, 0);
 }
 
-int archive_epub(const char *dest_path, const char *src_dir) {
+int epub_book_write(epub_book_t *book, const char *dest_path, int threads) {
     int err = 0;
-    struct zip *z = zip_open(dest_path, ZIP_CREATE | ZIP_TRUNCATE, &err);
-    if (!z) return -1;
+    zip_t *out = zip_open(dest_path, ZIP_CREATE | ZIP_TRUNCATE, &err);
+    if (!out) {
+        fprintf(stderr, "Error creating %s: %d\n", dest_path, err);
+        return -1;
+    }
+
+    pthread_mutex_lock(&book->lock);
+
+    // Deflate all rewritten entries in parallel before the (serial) write
+    deflate_job_t *jobs = calloc(book->entry_count > 0 ? book->entry_count : 1, sizeof(deflate_job_t));
+    worker_pool_t *pool = worker_pool_create(threads);
+    for (int i = 0; i < book->entry_count; i++) {
+        jobs[i].entry = &book->entries[i];
+        if (!book->entries[i].data) continue;
+        jobs[i].job.fn = run_deflate_job;
+        jobs[i].job.arg = &jobs[i];
+        if (pool) {
+            worker_pool_submit(pool, &jobs[i].job);
+        } else {
+            run_deflate_job(&jobs[i]);
+        }
+    }
+    worker_pool_destroy(pool); // Waits for every queued job
 
     // EPUB requirement: 'mimetype' must be first and uncompressed
-    struct zip_source *s = zip_source_buffer(z, "application/epub+zip", 20, 0);
-    zip_int64_t index = zip_file_add(z, "mimetype", s, ZIP_FL_OVERWRITE);
+    zip_source_t *s = zip_source_buffer(out, "application/epub+zip", 20, 0);
+    zip_int64_t index = zip_file_add(out, "mimetype", s, ZIP_FL_OVERWRITE);
     if (index >= 0) {
-        zip_set_file_compression(z, index, ZIP_CM_STORE, 0);
+        zip_set_file_compression(out, index, ZIP_CM_STORE, 0);
     }
-    // Note: In real production code, we'd ensure compression is disabled for mimetype
 
-    add_dir_to_zip(z, src_dir, "");
+    // Everything else follows in source archive order
+    for (int i = 0; i < book->entry_count; i++) {
+        epub_entry_t *entry = &book->entries[i];
+        if (strcmp(entry->name, "mimetype") == 0) continue;
+
+        size_t name_len = strlen(entry->name);
+        if (name_len > 0 && entry->name[name_len - 1] == '/') {
+            zip_dir_add(out, entry->name, ZIP_FL_ENC_UTF_8);
+            continue;
+        }
+
+        s = source_for_entry(out, book, entry, &jobs[i]);
+        if (!s || zip_file_add(out, entry->name, s, ZIP_FL_OVERWRITE | ZIP_FL_ENC_UTF_8) < 0) {
+            fprintf(stderr, "Warning: Could not add %s: %s\n", entry->name, zip_strerror(out));
+            if (s) zip_source_free(s);
+        }
+    }
+
+    // Sources read from the deflated buffers and the book until here
+    int rc = zip_close(out);
+    if (rc != 0) {
+        fprintf(stderr, "Error writing %s: %s\n", dest_path, zip_strerror(out));
+        zip_discard(out);
+    }
+    pthread_mutex_unlock(&book->lock);
 
-    zip_close(z);
-    return 0;
+    for (int i = 0; i < book->entry_count; i++) free(jobs[i].data);
+    free(jobs);
+    return rc == 0 ? 0 : -1;
 }
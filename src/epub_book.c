@@ -0,0 +1,113 @@
+#include "epub.h"
+
+epub_book_t* epub_book_open(const char *path) {
+    int err = 0;
+    zip_t *z = zip_open(path, ZIP_RDONLY, &err);
+    if (!z) {
+        fprintf(stderr, "Error opening zip file %s: %d\n", path, err);
+        return NULL;
+    }
+
+    epub_book_t *book = calloc(1, sizeof(epub_book_t));
+    book->zip = z;
+    pthread_mutex_init(&book->lock, NULL);
+
+    zip_int64_t num_entries = zip_get_num_entries(z, 0);
+    book->entries = calloc(num_entries > 0 ? num_entries : 1, sizeof(epub_entry_t));
+    for (zip_int64_t i = 0; i < num_entries; i++) {
+        const char *name = zip_get_name(z, i, 0);
+        if (!name) continue;
+
+        // Same ZIP Slip rule as extract_epub(): never carry ".." entries over
+        if (strstr(name, "..")) {
+            fprintf(stderr, "Warning: Skipping potentially unsafe zip entry: %s\n", name);
+            continue;
+        }
+
+        epub_entry_t *entry = &book->entries[book->entry_count++];
+        entry->name = strdup(name);
+        entry->index = i;
+    }
+    return book;
+}
+
+void epub_book_close(epub_book_t *book) {
+    if (!book) return;
+    for (int i = 0; i < book->entry_count; i++) {
+        free(book->entries[i].name);
+        free(book->entries[i].data);
+    }
+    free(book->entries);
+    if (book->zip) zip_discard(book->zip); // Opened read-only, nothing to save
+    pthread_mutex_destroy(&book->lock);
+    free(book);
+}
+
+static epub_entry_t* find_entry(epub_book_t *book, const char *name) {
+    for (int i = 0; i < book->entry_count; i++) {
+        if (strcmp(book->entries[i].name, name) == 0) return &book->entries[i];
+    }
+    return NULL;
+}
+
+static char* copy_buffer(const char *data, size_t size) {
+    char *copy = malloc(size + 1);
+    if (!copy) return NULL;
+    memcpy(copy, data, size);
+    copy[size] = 0;
+    return copy;
+}
+
+char* epub_book_read(epub_book_t *book, const char *name, size_t *size) {
+    pthread_mutex_lock(&book->lock);
+    epub_entry_t *entry = find_entry(book, name);
+    if (!entry) {
+        pthread_mutex_unlock(&book->lock);
+        return NULL;
+    }
+
+    if (entry->data) {
+        char *copy = copy_buffer(entry->data, entry->size);
+        if (copy && size) *size = entry->size;
+        pthread_mutex_unlock(&book->lock);
+        return copy;
+    }
+
+    struct zip_stat st;
+    zip_stat_init(&st);
+    zip_file_t *f = NULL;
+    char *buf = NULL;
+    if (zip_stat_index(book->zip, entry->index, 0, &st) == 0 && (f = zip_fopen_index(book->zip, entry->index, 0))) {
+        buf = malloc(st.size + 1);
+        zip_int64_t total = 0, n;
+        while (buf && (zip_uint64_t)total < st.size &&
+               (n = zip_fread(f, buf + total, st.size - total)) > 0) {
+            total += n;
+        }
+        zip_fclose(f);
+        if (buf && (zip_uint64_t)total == st.size) {
+            buf[total] = 0;
+            if (size) *size = total;
+        } else {
+            free(buf);
+            buf = NULL;
+        }
+    }
+    pthread_mutex_unlock(&book->lock);
+    return buf;
+}
+
+int epub_book_replace(epub_book_t *book, const char *name, char *data, size_t size) {
+    pthread_mutex_lock(&book->lock);
+    epub_entry_t *entry = find_entry(book, name);
+    if (!entry) {
+        pthread_mutex_unlock(&book->lock);
+        free(data);
+        return -1;
+    }
+    free(entry->data);
+    entry->data = data;
+    entry->size = size;
+    pthread_mutex_unlock(&book->lock);
+    return 0;
+}
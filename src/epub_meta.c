@@ -1,57 +1,178 @@
 #include "epub.h"
-#include <libxml/xpath.h>
-#include <libxml/xpathInternals.h>
+#include <libxml/xmlreader.h>
 
 #include <limits.h>
+#include <stdint.h>
 
-epub_metadata_t* parse_epub_metadata(const char *root_dir) {
-    char container_path[PATH_MAX];
-    snprintf(container_path, sizeof(container_path), "%s/META-INF/container.xml", root_dir);
+#define NS_CONTAINER "urn:oasis:names:tc:opendocument:xmlns:container"
+#define NS_OPF "http://www.idpf.org/2007/opf"
+#define NS_DC "http://purl.org/dc/elements/1.1/"
+
+// Opens a streaming reader on an XML document by its path relative to the
+// EPUB root. *buffer receives memory the reader reads from (may be NULL);
+// free it after xmlFreeTextReader.
+typedef xmlTextReaderPtr (*xml_loader_fn)(void *source, const char *rel_path, char **buffer);
+
+static xmlTextReaderPtr load_from_dir(void *source, const char *rel_path, char **buffer) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", (const char*)source, rel_path);
+    *buffer = NULL;
+    return xmlReaderForFile(path, NULL, 0);
+}
+
+static xmlTextReaderPtr load_from_book(void *source, const char *rel_path, char **buffer) {
+    size_t size = 0;
+    *buffer = epub_book_read((epub_book_t*)source, rel_path, &size);
+    if (!*buffer) return NULL;
+    return xmlReaderForMemory(*buffer, (int)size, rel_path, NULL, 0);
+}
+
+// Element start in namespace `ns` with local name `name`
+static int is_element(xmlTextReaderPtr reader, const char *ns, const char *name) {
+    if (xmlTextReaderNodeType(reader) != XML_READER_TYPE_ELEMENT) return 0;
+    const xmlChar *uri = xmlTextReaderConstNamespaceUri(reader);
+    return uri && strcmp((const char*)uri, ns) == 0 &&
+           strcmp((const char*)xmlTextReaderConstLocalName(reader), name) == 0;
+}
+
+static int is_end_element(xmlTextReaderPtr reader, const char *name) {
+    return xmlTextReaderNodeType(reader) == XML_READER_TYPE_END_ELEMENT &&
+           strcmp((const char*)xmlTextReaderConstLocalName(reader), name) == 0;
+}
+
+static char* get_attribute(xmlTextReaderPtr reader, const char *name) {
+    return (char*)xmlTextReaderGetAttribute(reader, (const xmlChar*)name);
+}
 
-    xmlDocPtr doc = xmlReadFile(container_path, NULL, 0);
-    if (!doc) {
-        fprintf(stderr, "Error parsing container.xml\n");
+// Path of the OPF package from the first <rootfile> of container.xml
+static char* find_rootfile(void *source, xml_loader_fn load) {
+    char *buffer = NULL;
+    xmlTextReaderPtr reader = load(source, "META-INF/container.xml", &buffer);
+    if (!reader) {
+        free(buffer);
         return NULL;
     }
+    char *path = NULL;
+    while (!path && xmlTextReaderRead(reader) == 1) {
+        if (is_element(reader, NS_CONTAINER, "rootfile")) {
+            path = get_attribute(reader, "full-path");
+        }
+    }
+    xmlFreeTextReader(reader);
+    free(buffer);
+    return path;
+}
 
-    xmlXPathContextPtr xpathCtx = xmlXPathNewContext(doc);
-    xmlXPathRegisterNs(xpathCtx, (const xmlChar*)"ns", (const xmlChar*)"urn:oasis:names:tc:opendocument:xmlns:container");
-    
-    xmlXPathObjectPtr xpathObj = xmlXPathEvalExpression((const xmlChar*)"//ns:rootfile/@full-path", xpathCtx);
-    if (xmlXPathNodeSetIsEmpty(xpathObj->nodesetval)) {
-        fprintf(stderr, "No rootfile found in container.xml\n");
-        xmlXPathFreeObject(xpathObj);
-        xmlXPathFreeContext(xpathCtx);
-        xmlFreeDoc(doc);
-        return NULL;
+static uint32_t hash_id(const char *id) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char*)id; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
     }
+    return h;
+}
 
-    char *opf_rel_path = (char*)xmlNodeListGetString(doc, xpathObj->nodesetval->nodeTab[0]->xmlChildrenNode, 1);
-    char opf_path[PATH_MAX];
-    snprintf(opf_path, sizeof(opf_path), "%s/%s", root_dir, opf_rel_path);
+// Builds the id -> item table at a load factor of at most 1/2. The first
+// item wins if an id is used twice.
+static void build_manifest_index(epub_metadata_t *meta) {
+    int size = 16;
+    while (size < meta->manifest_count * 2) size *= 2;
+    meta->manifest_index = malloc(size * sizeof(int));
+    meta->manifest_index_size = size;
+    for (int i = 0; i < size; i++) meta->manifest_index[i] = -1;
 
-    xmlXPathFreeObject(xpathObj);
-    xmlXPathFreeContext(xpathCtx);
-    xmlFreeDoc(doc);
+    for (int i = 0; i < meta->manifest_count; i++) {
+        const char *id = meta->manifest[i].name;
+        if (!id) continue;
+        uint32_t slot = hash_id(id) & (size - 1);
+        while (meta->manifest_index[slot] >= 0 && strcmp(meta->manifest[meta->manifest_index[slot]].name, id) != 0) {
+            slot = (slot + 1) & (size - 1);
+        }
+        if (meta->manifest_index[slot] < 0) meta->manifest_index[slot] = i;
+    }
+}
 
-    // Parsing OPF
-    xmlDocPtr opf_doc = xmlReadFile(opf_path, NULL, 0);
-    if (!opf_doc) {
-        fprintf(stderr, "Error parsing OPF file: %s\n", opf_path);
-        xmlFree(opf_rel_path);
+epub_item_t* epub_find_item(const epub_metadata_t *meta, const char *id) {
+    if (!id || !meta->manifest_index) return NULL;
+    int size = meta->manifest_index_size;
+    uint32_t slot = hash_id(id) & (size - 1);
+    while (meta->manifest_index[slot] >= 0) {
+        epub_item_t *item = &meta->manifest[meta->manifest_index[slot]];
+        if (strcmp(item->name, id) == 0) return item;
+        slot = (slot + 1) & (size - 1);
+    }
+    return NULL;
+}
+
+// Reads <dc:title>, <dc:creator>, <manifest> and <spine> in one pass over
+// the package document, without building a DOM
+static void read_package(xmlTextReaderPtr reader, epub_metadata_t *meta) {
+    int manifest_capacity = 0, spine_capacity = 0;
+    int in_manifest = 0, in_spine = 0;
+
+    while (xmlTextReaderRead(reader) == 1) {
+        if (is_element(reader, NS_OPF, "manifest")) {
+            in_manifest = !xmlTextReaderIsEmptyElement(reader);
+        } else if (is_element(reader, NS_OPF, "spine")) {
+            in_spine = !xmlTextReaderIsEmptyElement(reader);
+        } else if (is_end_element(reader, "manifest")) {
+            in_manifest = 0;
+        } else if (is_end_element(reader, "spine")) {
+            in_spine = 0;
+        } else if (in_manifest && is_element(reader, NS_OPF, "item")) {
+            char *id = get_attribute(reader, "id");
+            if (!id) continue;
+            if (meta->manifest_count == manifest_capacity) {
+                manifest_capacity = manifest_capacity ? manifest_capacity * 2 : 64;
+                meta->manifest = realloc(meta->manifest, manifest_capacity * sizeof(epub_item_t));
+            }
+            epub_item_t *item = &meta->manifest[meta->manifest_count++];
+            item->name = id;
+            item->href = get_attribute(reader, "href");
+            item->media_type = get_attribute(reader, "media-type");
+            item->properties = get_attribute(reader, "properties");
+        } else if (in_spine && is_element(reader, NS_OPF, "itemref")) {
+            char *idref = get_attribute(reader, "idref");
+            if (!idref) continue;
+            if (meta->spine_count == spine_capacity) {
+                spine_capacity = spine_capacity ? spine_capacity * 2 : 64;
+                meta->spine = realloc(meta->spine, spine_capacity * sizeof(epub_spine_item_t));
+            }
+            epub_spine_item_t *ref = &meta->spine[meta->spine_count++];
+            ref->idref = idref;
+            ref->item = -1;
+            char *linear = get_attribute(reader, "linear");
+            ref->linear = !(linear && strcmp(linear, "no") == 0);
+            free(linear);
+            ref->properties = get_attribute(reader, "properties");
+        } else if (!meta->title && is_element(reader, NS_DC, "title")) {
+            meta->title = (char*)xmlTextReaderReadString(reader);
+        } else if (!meta->author && is_element(reader, NS_DC, "creator")) {
+            meta->author = (char*)xmlTextReaderReadString(reader);
+        }
+    }
+}
+
+static epub_metadata_t* parse_metadata(void *source, xml_loader_fn load) {
+    char *opf_rel_path = find_rootfile(source, load);
+    if (!opf_rel_path) {
+        fprintf(stderr, "No rootfile found in container.xml\n");
         return NULL;
     }
 
-    epub_metadata_t *meta = calloc(1, sizeof(epub_metadata_t));
-    xmlXPathContextPtr opfXpathCtx = xmlXPathNewContext(opf_doc);
-    xmlXPathRegisterNs(opfXpathCtx, (const xmlChar*)"opf", (const xmlChar*)"http://www.idpf.org/2007/opf");
-    xmlXPathRegisterNs(opfXpathCtx, (const xmlChar*)"dc", (const xmlChar*)"http://purl.org/dc/elements/1.1/");
+    char *buffer = NULL;
+    xmlTextReaderPtr reader = load(source, opf_rel_path, &buffer);
+    if (!reader) {
+        fprintf(stderr, "Error parsing OPF file: %s\n", opf_rel_path);
+        free(buffer);
+        free(opf_rel_path);
+        return NULL;
+    }
 
-    // Title
-    xmlXPathObjectPtr titleObj = xmlXPathEvalExpression((const xmlChar*)"//dc:title/text()", opfXpathCtx);
-    if (!xmlXPathNodeSetIsEmpty(titleObj->nodesetval))
-        meta->title = strdup((char*)titleObj->nodesetval->nodeTab[0]->content);
-    xmlXPathFreeObject(titleObj);
+    epub_metadata_t *meta = calloc(1, sizeof(epub_metadata_t));
+    read_package(reader, meta);
+    xmlFreeTextReader(reader);
+    free(buffer);
 
     // Set base path from OPF path
     // path is like "OEBPS/content.opf" or "content.opf"
@@ -64,52 +185,45 @@ epub_metadata_t* parse_epub_metadata(const char *root_dir) {
     } else {
         meta->base_dir = strdup("");
     }
+    free(opf_rel_path);
 
-    // Manifest
-    xmlXPathObjectPtr manifestObj = xmlXPathEvalExpression((const xmlChar*)"//opf:manifest/opf:item", opfXpathCtx);
-    if (!xmlXPathNodeSetIsEmpty(manifestObj->nodesetval)) {
-        meta->manifest_count = manifestObj->nodesetval->nodeNr;
-        meta->manifest = calloc(meta->manifest_count, sizeof(epub_item_t));
-        for (int i = 0; i < meta->manifest_count; i++) {
-            xmlNodePtr node = manifestObj->nodesetval->nodeTab[i];
-            meta->manifest[i].name = (char*)xmlGetProp(node, (const xmlChar*)"id");
-            meta->manifest[i].href = (char*)xmlGetProp(node, (const xmlChar*)"href");
-            meta->manifest[i].media_type = (char*)xmlGetProp(node, (const xmlChar*)"media-type");
-        }
-    }
-    xmlXPathFreeObject(manifestObj);
-
-    // Spine
-    xmlXPathObjectPtr spineObj = xmlXPathEvalExpression((const xmlChar*)"//opf:spine/opf:itemref", opfXpathCtx);
-    if (!xmlXPathNodeSetIsEmpty(spineObj->nodesetval)) {
-        meta->spine_count = spineObj->nodesetval->nodeNr;
-        meta->spine = calloc(meta->spine_count, sizeof(char*));
-        for (int i = 0; i < meta->spine_count; i++) {
-            meta->spine[i] = (char*)xmlGetProp(spineObj->nodesetval->nodeTab[i], (const xmlChar*)"idref");
-        }
+    // Resolve the spine up front, so callers never search the manifest
+    build_manifest_index(meta);
+    for (int i = 0; i < meta->spine_count; i++) {
+        epub_item_t *item = epub_find_item(meta, meta->spine[i].idref);
+        meta->spine[i].item = item ? (int)(item - meta->manifest) : -1;
+        if (!item) fprintf(stderr, "Warning: Spine item '%s' is not in the manifest\n", meta->spine[i].idref);
     }
-    xmlXPathFreeObject(spineObj);
 
     printf("Parsed EPUB: %s (Items: %d)\n", meta->title ? meta->title : "Unknown", meta->manifest_count);
-
-    xmlXPathFreeContext(opfXpathCtx);
-    xmlFree(opf_rel_path);
-    xmlFreeDoc(opf_doc);
     return meta;
 }
 
+epub_metadata_t* parse_epub_metadata(const char *root_dir) {
+    return parse_metadata((void*)root_dir, load_from_dir);
+}
+
+epub_metadata_t* parse_epub_metadata_from_book(epub_book_t *book) {
+    return parse_metadata(book, load_from_book);
+}
+
 void free_epub_metadata(epub_metadata_t *meta) {
     if (!meta) return;
     free(meta->title);
     free(meta->author);
     free(meta->base_dir);
-    for (int i = 0; i < meta->spine_count; i++) free(meta->spine[i]);
+    for (int i = 0; i < meta->spine_count; i++) {
+        free(meta->spine[i].idref);
+        free(meta->spine[i].properties);
+    }
     free(meta->spine);
     for (int i = 0; i < meta->manifest_count; i++) {
         free(meta->manifest[i].name);
         free(meta->manifest[i].href);
         free(meta->manifest[i].media_type);
+        free(meta->manifest[i].properties);
     }
     free(meta->manifest);
+    free(meta->manifest_index);
     free(meta);
 }
@@ -0,0 +1,312 @@
+#include "glossary.h"
+#include <pthread.h>
+#include <ctype.h>
+
+// Header of the prompt section
+#define GLOSSARY_HEADER "Glossary: translate these terms exactly as given."
+
+typedef struct {
+    char *source;
+    char *target;
+} glossary_entry_t;
+
+// Trie node of the automaton. While building, children are a sibling list
+// (the root has a direct table). Scanning uses the dense transition table.
+typedef struct {
+    int child;          // First child (-1 = none)
+    int sibling;        // Next child of the parent (-1 = none)
+    int fail;           // Longest proper suffix that is also in the trie
+    int output;         // Nearest node on the fail chain ending an entry (-1 = none)
+    int entry;          // Entry ending here (-1 = none)
+    int depth;          // Bytes from the root
+    unsigned char byte; // Label of the edge from the parent
+} glossary_node_t;
+
+static pthread_mutex_t glossary_lock = PTHREAD_MUTEX_INITIALIZER;
+static int glossary_ready = 0;
+static glossary_entry_t *entries = NULL;
+static int entry_count = 0;
+static glossary_node_t *nodes = NULL;
+static int node_count = 0;
+static int node_capacity = 0;
+static int root_next[256];
+
+// Complete transition function, one row of class_count states per node.
+// Bytes that occur in no term share class 0, which keeps the rows short.
+static int *transitions = NULL;
+static unsigned char byte_class[256];
+static int class_count = 0;
+
+static unsigned char fold(unsigned char c) {
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+static int add_node(unsigned char byte, int depth) {
+    if (node_count == node_capacity) {
+        int capacity = node_capacity ? node_capacity * 2 : 1024;
+        glossary_node_t *grown = realloc(nodes, capacity * sizeof(glossary_node_t));
+        if (!grown) return -1;
+        nodes = grown;
+        node_capacity = capacity;
+    }
+    glossary_node_t *node = &nodes[node_count];
+    node->child = node->sibling = node->output = node->entry = -1;
+    node->fail = 0;
+    node->depth = depth;
+    node->byte = byte;
+    return node_count++;
+}
+
+static int find_child(int node, unsigned char byte) {
+    if (node == 0) return root_next[byte];
+    for (int c = nodes[node].child; c >= 0; c = nodes[c].sibling) {
+        if (nodes[c].byte == byte) return c;
+    }
+    return -1;
+}
+
+static int insert_term(const char *term, int entry) {
+    int node = 0;
+    for (const unsigned char *p = (const unsigned char*)term; *p; p++) {
+        unsigned char byte = fold(*p);
+        int next = find_child(node, byte);
+        if (next < 0) {
+            next = add_node(byte, nodes[node].depth + 1);
+            if (next < 0) return -1;
+            if (node == 0) {
+                root_next[byte] = next;
+            } else {
+                nodes[next].sibling = nodes[node].child;
+                nodes[node].child = next;
+            }
+        }
+        node = next;
+    }
+    if (nodes[node].entry >= 0) {
+        fprintf(stderr, "Glossary lists \"%s\" twice, using the first\n", term);
+    } else {
+        nodes[node].entry = entry;
+    }
+    return 0;
+}
+
+// Breadth-first, so the fail target of a node is always finished before
+// it. A node's row is its fail target's row with its own children on top.
+static int link_failures(void) {
+    int *queue = malloc(node_count * sizeof(int));
+    transitions = calloc((size_t)node_count * class_count, sizeof(int));
+    if (!queue || !transitions) {
+        free(queue);
+        return -1;
+    }
+    int head = 0, tail = 0;
+    for (int b = 0; b < 256; b++) {
+        if (root_next[b] >= 0) {
+            queue[tail++] = root_next[b];
+            transitions[byte_class[b]] = root_next[b];
+        }
+    }
+    while (head < tail) {
+        int node = queue[head++];
+        int *row = &transitions[(size_t)node * class_count];
+        memcpy(row, &transitions[(size_t)nodes[node].fail * class_count], class_count * sizeof(int));
+        for (int c = nodes[node].child; c >= 0; c = nodes[c].sibling) {
+            int f = nodes[node].fail, next;
+            while ((next = find_child(f, nodes[c].byte)) < 0 && f != 0) f = nodes[f].fail;
+            nodes[c].fail = next >= 0 ? next : 0;
+            int fail = nodes[c].fail;
+            nodes[c].output = nodes[fail].entry >= 0 ? fail : nodes[fail].output;
+            row[byte_class[nodes[c].byte]] = c;
+            queue[tail++] = c;
+        }
+    }
+    free(queue);
+    return 0;
+}
+
+static void assign_classes(void) {
+    memset(byte_class, 0, sizeof(byte_class));
+    class_count = 1;
+    for (int i = 0; i < entry_count; i++) {
+        for (const unsigned char *p = (const unsigned char*)entries[i].source; *p; p++) {
+            unsigned char byte = fold(*p);
+            if (!byte_class[byte]) byte_class[byte] = class_count++;
+        }
+    }
+    // Both cases of a letter scan the same
+    for (int c = 'A'; c <= 'Z'; c++) byte_class[c] = byte_class[c + ('a' - 'A')];
+}
+
+static char* trim(char *s) {
+    while (*s == ' ' || *s == '\t') s++;
+    char *end = s + strlen(s);
+    while (end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n')) end--;
+    *end = 0;
+    return s;
+}
+
+static int load_entries(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror("Failed to open glossary");
+        return -1;
+    }
+    char *line = NULL;
+    size_t line_size = 0;
+    int capacity = 0, line_number = 0;
+    while (getline(&line, &line_size, f) != -1) {
+        line_number++;
+        char *text = trim(line);
+        if (!*text || *text == '#') continue;
+        char *tab = strchr(text, '\t');
+        if (!tab) {
+            fprintf(stderr, "%s:%d: expected \"term<TAB>translation\"\n", path, line_number);
+            continue;
+        }
+        *tab = 0;
+        char *source = trim(text), *target = trim(tab + 1);
+        if (!*source || !*target) continue;
+
+        if (entry_count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            glossary_entry_t *grown = realloc(entries, capacity * sizeof(glossary_entry_t));
+            if (!grown) break;
+            entries = grown;
+        }
+        entries[entry_count].source = strdup(source);
+        entries[entry_count].target = strdup(target);
+        entry_count++;
+    }
+    free(line);
+    fclose(f);
+    return 0;
+}
+
+int glossary_init(config_t *config) {
+    pthread_mutex_lock(&glossary_lock);
+    if (glossary_ready || !config->glossary_file) {
+        pthread_mutex_unlock(&glossary_lock);
+        return 0;
+    }
+    for (int b = 0; b < 256; b++) root_next[b] = -1;
+    int rc = load_entries(config->glossary_file);
+    if (rc == 0 && add_node(0, 0) < 0) rc = -1;
+    for (int i = 0; rc == 0 && i < entry_count; i++) rc = insert_term(entries[i].source, i);
+    if (rc == 0) {
+        assign_classes();
+        rc = link_failures();
+    }
+    if (rc == 0) {
+        glossary_ready = 1;
+        printf("Glossary: %d terms from %s\n", entry_count, config->glossary_file);
+    }
+    pthread_mutex_unlock(&glossary_lock);
+    if (rc != 0) glossary_cleanup();
+    return rc;
+}
+
+void glossary_cleanup(void) {
+    pthread_mutex_lock(&glossary_lock);
+    for (int i = 0; i < entry_count; i++) {
+        free(entries[i].source);
+        free(entries[i].target);
+    }
+    free(entries);
+    free(nodes);
+    free(transitions);
+    entries = NULL;
+    nodes = NULL;
+    transitions = NULL;
+    entry_count = node_count = node_capacity = 0;
+    glossary_ready = 0;
+    pthread_mutex_unlock(&glossary_lock);
+}
+
+// Letters and digits count as word characters; punctuation and spaces
+// (including typographic quotes and dashes) do not. Neither do CJK and
+// Hangul, whose words are not delimited by spaces.
+static int is_word_char(const unsigned char *p) {
+    if (*p < 0x80) return isalnum(*p);
+    unsigned int cp;
+    if (!p[1] || ((*p & 0xF0) == 0xE0 && !p[2])) return 1;   // Cut off
+    if ((*p & 0xE0) == 0xC0) {
+        cp = ((p[0] & 0x1F) << 6) | (p[1] & 0x3F);
+    } else if ((*p & 0xF0) == 0xE0) {
+        cp = ((p[0] & 0x0F) << 12) | ((p[1] & 0x3F) << 6) | (p[2] & 0x3F);
+    } else {
+        return 1;
+    }
+    if (cp < 0xC0 || cp == 0xD7 || cp == 0xF7) return 0;
+    if (cp >= 0x2000 && cp < 0x2C00) return 0;   // Punctuation, symbols, arrows
+    if (cp >= 0x3000 && cp < 0xA000) return 0;   // CJK punctuation, kana, ideographs
+    if (cp >= 0xAC00 && cp < 0xD7B0) return 0;   // Hangul
+    return 1;
+}
+
+// Whether text[start, end) is a whole word. Only checked on the sides where
+// the term itself starts or ends with a letter or digit.
+static int is_whole_word(const char *text, size_t len, size_t start, size_t end) {
+    const unsigned char *t = (const unsigned char*)text;
+    if (start > 0 && is_word_char(t + start)) {
+        size_t prev = start - 1;
+        while (prev > 0 && (t[prev] & 0xC0) == 0x80) prev--;
+        if (is_word_char(t + prev)) return 0;
+    }
+    if (end < len) {
+        size_t last = end - 1;
+        while (last > start && (t[last] & 0xC0) == 0x80) last--;
+        if (is_word_char(t + last) && is_word_char(t + end)) return 0;
+    }
+    return 1;
+}
+
+int glossary_find(const char *text, size_t len, int *found, int count, int max) {
+    if (!glossary_ready || !text) return count;
+    const unsigned char *t = (const unsigned char*)text;
+    int state = 0;
+    for (size_t i = 0; i < len && count < max; i++) {
+        state = transitions[(size_t)state * class_count + byte_class[t[i]]];
+        for (int n = nodes[state].entry >= 0 ? state : nodes[state].output; n >= 0; n = nodes[n].output) {
+            size_t start = i + 1 - nodes[n].depth;
+            if (!is_whole_word(text, len, start, i + 1)) continue;
+            int entry = nodes[n].entry, seen = 0;
+            for (int k = 0; k < count && !seen; k++) seen = found[k] == entry;
+            if (!seen && count < max) found[count++] = entry;
+        }
+    }
+    return count;
+}
+
+char* glossary_prompt(const int *found, int count, arena_t *arena) {
+    if (count == 0) return NULL;
+    size_t size = strlen(GLOSSARY_HEADER) + 2;
+    for (int k = 0; k < count; k++) {
+        size += strlen(entries[found[k]].source) + strlen(entries[found[k]].target) + 8;
+    }
+    char *prompt = arena ? arena_alloc(arena, size) : malloc(size);
+    if (!prompt) return NULL;
+    size_t pos = snprintf(prompt, size, "%s\n", GLOSSARY_HEADER);
+    for (int k = 0; k < count; k++) {
+        pos += snprintf(prompt + pos, size - pos, "%s => %s\n", entries[found[k]].source, entries[found[k]].target);
+    }
+    return prompt;
+}
+
+int glossary_followed(int entry, const char *translation) {
+    const char *target = entries[entry].target;
+    size_t target_len = strlen(target);
+    for (const char *p = translation; *p; p++) {
+        size_t k = 0;
+        while (k < target_len && p[k] && fold((unsigned char)p[k]) == fold((unsigned char)target[k])) k++;
+        if (k == target_len) return 1;
+    }
+    return 0;
+}
+
+const char* glossary_source(int entry) {
+    return entries[entry].source;
+}
+
+const char* glossary_target(int entry) {
+    return entries[entry].target;
+}
@@ -0,0 +1,319 @@
+#include "journal.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Record layout:
+//   @<type> <chapter> <segment> <length> <checksum>\n<payload>\n
+// Types: R = run header, S = translated segment, C = completed chapter.
+#define RECORD_MAX_HEADER 96
+
+typedef struct {
+    int chapter;
+    int id;
+    char *text;
+    int used;
+} segment_entry_t;
+
+typedef struct {
+    int chapter;
+    char *state;
+} chapter_entry_t;
+
+struct journal {
+    int fd;
+    pthread_mutex_t lock;
+    segment_entry_t *segments;     // Open-addressing map (chapter, id) -> text
+    size_t segment_capacity;
+    size_t segment_count;
+    chapter_entry_t *chapters;
+    int chapter_count;
+};
+
+static uint32_t checksum32(const char *data, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)data[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+int journal_input_identity(const char *path, char *id, size_t size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    uint64_t h = 14695981039346656037ULL;
+    long long length = 0;
+    unsigned char buf[65536];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        for (ssize_t i = 0; i < n; i++) {
+            h ^= buf[i];
+            h *= 1099511628211ULL;
+        }
+        length += n;
+    }
+    close(fd);
+    if (n < 0) return -1;
+    snprintf(id, size, "size=%lld fnv=%016llx", length, (unsigned long long)h);
+    return 0;
+}
+
+static size_t segment_slot(int chapter, int id, size_t capacity) {
+    uint64_t h = ((uint64_t)(uint32_t)chapter << 32) | (uint32_t)id;
+    h *= 0x9e3779b97f4a7c15ULL;
+    return (size_t)(h >> 17) & (capacity - 1);
+}
+
+static void put_segment(journal_t *j, int chapter, int id, char *text);
+
+static void grow_segments(journal_t *j) {
+    segment_entry_t *old = j->segments;
+    size_t old_capacity = j->segment_capacity;
+    j->segment_capacity = old_capacity ? old_capacity * 2 : 256;
+    j->segments = calloc(j->segment_capacity, sizeof(segment_entry_t));
+    j->segment_count = 0;
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i].used) put_segment(j, old[i].chapter, old[i].id, old[i].text);
+    }
+    free(old);
+}
+
+// Takes ownership of text
+static void put_segment(journal_t *j, int chapter, int id, char *text) {
+    if ((j->segment_count + 1) * 10 > j->segment_capacity * 7) grow_segments(j);
+
+    size_t mask = j->segment_capacity - 1;
+    size_t i = segment_slot(chapter, id, j->segment_capacity);
+    while (j->segments[i].used) {
+        if (j->segments[i].chapter == chapter && j->segments[i].id == id) {
+            free(j->segments[i].text);
+            j->segments[i].text = text;
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+    j->segments[i].chapter = chapter;
+    j->segments[i].id = id;
+    j->segments[i].text = text;
+    j->segments[i].used = 1;
+    j->segment_count++;
+}
+
+static void put_chapter(journal_t *j, int chapter, char *state) {
+    for (int i = 0; i < j->chapter_count; i++) {
+        if (j->chapters[i].chapter == chapter) {
+            free(j->chapters[i].state);
+            j->chapters[i].state = state;
+            return;
+        }
+    }
+    j->chapters = realloc(j->chapters, (j->chapter_count + 1) * sizeof(chapter_entry_t));
+    j->chapters[j->chapter_count].chapter = chapter;
+    j->chapters[j->chapter_count].state = state;
+    j->chapter_count++;
+}
+
+// Appends one record to buf (grown as needed)
+static int format_record(char **buf, size_t *len, size_t *capacity,
+                         char type, int chapter, int id, const char *payload) {
+    size_t payload_len = strlen(payload);
+    size_t needed = *len + RECORD_MAX_HEADER + payload_len + 2;
+    if (needed > *capacity) {
+        size_t new_capacity = *capacity ? *capacity : 1024;
+        while (new_capacity < needed) new_capacity *= 2;
+        char *grown = realloc(*buf, new_capacity);
+        if (!grown) return -1;
+        *buf = grown;
+        *capacity = new_capacity;
+    }
+    *len += snprintf(*buf + *len, RECORD_MAX_HEADER, "@%c %d %d %zu %u\n",
+        type, chapter, id, payload_len, checksum32(payload, payload_len));
+    memcpy(*buf + *len, payload, payload_len);
+    *len += payload_len;
+    (*buf)[(*len)++] = '\n';
+    return 0;
+}
+
+static int append_durable(journal_t *j, const char *buf, size_t len) {
+    pthread_mutex_lock(&j->lock);
+    ssize_t written = write(j->fd, buf, len);
+    int rc = (written == (ssize_t)len && fsync(j->fd) == 0) ? 0 : -1;
+    pthread_mutex_unlock(&j->lock);
+    if (rc != 0) perror("Failed to append to journal");
+    return rc;
+}
+
+static char* read_all(int fd, size_t *size) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) return NULL;
+    char *data = malloc(st.st_size + 1);
+    if (!data) return NULL;
+    size_t total = 0;
+    while (total < (size_t)st.st_size) {
+        ssize_t n = pread(fd, data + total, st.st_size - total, total);
+        if (n <= 0) break;
+        total += n;
+    }
+    data[total] = 0;
+    *size = total;
+    return data;
+}
+
+// Loads every intact record. Returns the offset just past the last good
+// record and stores the run id found in the header (if any).
+static size_t load_records(journal_t *j, const char *data, size_t size, char **run_id) {
+    size_t pos = 0;
+    while (pos < size) {
+        const char *nl = memchr(data + pos, '\n', size - pos);
+        if (!nl || data[pos] != '@') break;
+
+        char type;
+        int chapter, id;
+        size_t payload_len;
+        unsigned int checksum;
+        if (sscanf(data + pos, "@%c %d %d %zu %u", &type, &chapter, &id, &payload_len, &checksum) != 5) break;
+
+        size_t payload_start = nl - data + 1;
+        if (payload_start + payload_len + 1 > size) break;
+        if (data[payload_start + payload_len] != '\n') break;
+        if (checksum32(data + payload_start, payload_len) != checksum) break;
+
+        char *payload = malloc(payload_len + 1);
+        memcpy(payload, data + payload_start, payload_len);
+        payload[payload_len] = 0;
+
+        if (type == 'R') {
+            free(*run_id);
+            *run_id = payload;
+        } else if (type == 'S') {
+            put_segment(j, chapter, id, payload);
+        } else if (type == 'C') {
+            put_chapter(j, chapter, payload);
+        } else {
+            free(payload);
+        }
+        pos = payload_start + payload_len + 1;
+    }
+    return pos;
+}
+
+journal_t* journal_open(const char *path, const char *run_id, int resume) {
+    journal_t *j = calloc(1, sizeof(journal_t));
+    if (!j) return NULL;
+    pthread_mutex_init(&j->lock, NULL);
+
+    int flags = O_RDWR | O_CREAT | O_APPEND | (resume ? 0 : O_TRUNC);
+    j->fd = open(path, flags, 0644);
+    if (j->fd < 0) {
+        perror("Failed to open journal");
+        journal_close(j);
+        return NULL;
+    }
+
+    size_t size = 0;
+    char *data = resume ? read_all(j->fd, &size) : NULL;
+    if (data && size > 0) {
+        char *found_run = NULL;
+        size_t good = load_records(j, data, size, &found_run);
+        free(data);
+
+        if (!found_run || strcmp(found_run, run_id) != 0) {
+            fprintf(stderr, "Journal %s belongs to a different run; remove it or run without --resume\n", path);
+            free(found_run);
+            journal_close(j);
+            return NULL;
+        }
+        free(found_run);
+
+        // Cut off a record torn by the crash so new appends stay readable
+        if (good < size) {
+            fprintf(stderr, "Warning: Discarding %zu bytes of incomplete journal records\n", size - good);
+            if (ftruncate(j->fd, good) != 0) perror("ftruncate");
+        }
+        printf("Resuming: %d chapters and %zu segments already translated\n", j->chapter_count, j->segment_count);
+        return j;
+    }
+    free(data);
+
+    char *buf = NULL;
+    size_t len = 0, capacity = 0;
+    if (format_record(&buf, &len, &capacity, 'R', 0, 0, run_id) != 0 || append_durable(j, buf, len) != 0) {
+        free(buf);
+        journal_close(j);
+        return NULL;
+    }
+    free(buf);
+    return j;
+}
+
+void journal_close(journal_t *journal) {
+    if (!journal) return;
+    if (journal->fd >= 0) close(journal->fd);
+    for (size_t i = 0; i < journal->segment_capacity; i++) {
+        if (journal->segments[i].used) free(journal->segments[i].text);
+    }
+    free(journal->segments);
+    for (int i = 0; i < journal->chapter_count; i++) free(journal->chapters[i].state);
+    free(journal->chapters);
+    pthread_mutex_destroy(&journal->lock);
+    free(journal);
+}
+
+int journal_record_segments(journal_t *journal, int chapter, const int *ids, const char **texts, int count) {
+    if (!journal || count <= 0) return 0;
+
+    char *buf = NULL;
+    size_t len = 0, capacity = 0;
+    for (int i = 0; i < count; i++) {
+        if (!texts[i]) continue;
+        if (format_record(&buf, &len, &capacity, 'S', chapter, ids[i], texts[i]) != 0) {
+            free(buf);
+            return -1;
+        }
+    }
+    int rc = len > 0 ? append_durable(journal, buf, len) : 0;
+    free(buf);
+    return rc;
+}
+
+const char* journal_lookup_segment(journal_t *journal, int chapter, int id) {
+    // Only records loaded at open are consulted, so no locking is needed
+    if (!journal || journal->segment_capacity == 0) return NULL;
+    size_t mask = journal->segment_capacity - 1;
+    for (size_t i = segment_slot(chapter, id, journal->segment_capacity); journal->segments[i].used; i = (i + 1) & mask) {
+        if (journal->segments[i].chapter == chapter && journal->segments[i].id == id) {
+            return journal->segments[i].text;
+        }
+    }
+    return NULL;
+}
+
+int journal_record_chapter(journal_t *journal, int chapter, const char *state) {
+    if (!journal) return 0;
+
+    char *buf = NULL;
+    size_t len = 0, capacity = 0;
+    int rc = format_record(&buf, &len, &capacity, 'C', chapter, 0, state ? state : "");
+    if (rc == 0) rc = append_durable(journal, buf, len);
+    free(buf);
+    return rc;
+}
+
+int journal_chapter_done(journal_t *journal, int chapter) {
+    if (!journal) return 0;
+    for (int i = 0; i < journal->chapter_count; i++) {
+        if (journal->chapters[i].chapter == chapter) return 1;
+    }
+    return 0;
+}
+
+const char* journal_chapter_state(journal_t *journal, int chapter) {
+    if (!journal) return NULL;
+    for (int i = 0; i < journal->chapter_count; i++) {
+        if (journal->chapters[i].chapter == chapter) return journal->chapters[i].state;
+    }
+    return NULL;
+}
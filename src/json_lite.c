@@ -0,0 +1,413 @@
+#include "json_lite.h"
+
+// Nesting deeper than this is rejected rather than recursed into
+#define MAX_DEPTH 64
+
+int json_buffer_reserve(json_buffer_t *buffer, size_t extra) {
+    size_t needed = buffer->size + extra + 1;
+    if (needed <= buffer->capacity) return 0;
+    size_t new_capacity = buffer->capacity ? buffer->capacity : 4096;
+    while (new_capacity < needed) new_capacity *= 2;
+    char *data = realloc(buffer->data, new_capacity);
+    if (!data) return -1;
+    buffer->data = data;
+    buffer->capacity = new_capacity;
+    return 0;
+}
+
+int json_buffer_append(json_buffer_t *buffer, const char *data, size_t len) {
+    if (json_buffer_reserve(buffer, len) != 0) return -1;
+    memcpy(buffer->data + buffer->size, data, len);
+    buffer->size += len;
+    buffer->data[buffer->size] = 0;
+    return 0;
+}
+
+void json_buffer_reset(json_buffer_t *buffer) {
+    buffer->size = 0;
+    if (buffer->data) buffer->data[0] = 0;
+}
+
+void json_buffer_free(json_buffer_t *buffer) {
+    free(buffer->data);
+    memset(buffer, 0, sizeof(*buffer));
+}
+
+int json_write_raw(json_buffer_t *buffer, const char *text) {
+    return json_buffer_append(buffer, text, strlen(text));
+}
+
+// Bytes that can be copied into a JSON string as they are
+static inline int is_plain(unsigned char c) {
+    return c >= 0x20 && c != '"' && c != '\\';
+}
+
+int json_write_string(json_buffer_t *buffer, const char *text) {
+    if (!text) return json_write_raw(buffer, "null");
+
+    size_t len = strlen(text);
+    // Room for the common case (nothing to escape) in one go
+    if (json_buffer_reserve(buffer, len + 2) != 0) return -1;
+    buffer->data[buffer->size++] = '"';
+
+    static const char hex[] = "0123456789abcdef";
+    const unsigned char *p = (const unsigned char*)text;
+    const unsigned char *end = p + len;
+    while (p < end) {
+        const unsigned char *run = p;
+        while (p < end && is_plain(*p)) p++;
+        if (p > run) {
+            memcpy(buffer->data + buffer->size, run, p - run);
+            buffer->size += p - run;
+        }
+        if (p == end) break;
+
+        // The plain bytes were reserved above; an escape needs up to 5 more
+        if (json_buffer_reserve(buffer, (end - p) + 6) != 0) return -1;
+        char *out = buffer->data + buffer->size;
+        char short_escape = 0;
+        switch (*p) {
+            case '"':  short_escape = '"'; break;
+            case '\\': short_escape = '\\'; break;
+            case '\n': short_escape = 'n'; break;
+            case '\r': short_escape = 'r'; break;
+            case '\t': short_escape = 't'; break;
+            case '\b': short_escape = 'b'; break;
+            case '\f': short_escape = 'f'; break;
+        }
+        out[0] = '\\';
+        if (short_escape) {
+            out[1] = short_escape;
+            buffer->size += 2;
+        } else {
+            memcpy(out + 1, "u00", 3);
+            out[4] = hex[*p >> 4];
+            out[5] = hex[*p & 0xF];
+            buffer->size += 6;
+        }
+        p++;
+    }
+    buffer->data[buffer->size++] = '"';
+    buffer->data[buffer->size] = 0;
+    return 0;
+}
+
+int json_write_double(json_buffer_t *buffer, double value) {
+    char number[32];
+    snprintf(number, sizeof(number), "%.6g", value);
+    return json_write_raw(buffer, number);
+}
+
+// --- Extractor ---
+
+typedef struct {
+    const char *p;
+    const char *end;
+    int depth;
+} cursor_t;
+
+static void skip_ws(cursor_t *c) {
+    while (c->p < c->end && (*c->p == ' ' || *c->p == '\t' || *c->p == '\n' || *c->p == '\r')) c->p++;
+}
+
+static int peek(cursor_t *c) {
+    skip_ws(c);
+    return c->p < c->end ? (unsigned char)*c->p : -1;
+}
+
+static int hex4(const char *p, unsigned int *value) {
+    *value = 0;
+    for (int i = 0; i < 4; i++) {
+        char ch = p[i];
+        *value <<= 4;
+        if (ch >= '0' && ch <= '9') *value |= ch - '0';
+        else if (ch >= 'a' && ch <= 'f') *value |= ch - 'a' + 10;
+        else if (ch >= 'A' && ch <= 'F') *value |= ch - 'A' + 10;
+        else return -1;
+    }
+    return 0;
+}
+
+static int append_utf8(json_buffer_t *out, unsigned int cp) {
+    char bytes[4];
+    size_t n;
+    if (cp < 0x80) { bytes[0] = (char)cp; n = 1; }
+    else if (cp < 0x800) { bytes[0] = (char)(0xC0 | (cp >> 6)); bytes[1] = (char)(0x80 | (cp & 0x3F)); n = 2; }
+    else if (cp < 0x10000) {
+        bytes[0] = (char)(0xE0 | (cp >> 12)); bytes[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        bytes[2] = (char)(0x80 | (cp & 0x3F)); n = 3;
+    } else {
+        bytes[0] = (char)(0xF0 | (cp >> 18)); bytes[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        bytes[2] = (char)(0x80 | ((cp >> 6) & 0x3F)); bytes[3] = (char)(0x80 | (cp & 0x3F)); n = 4;
+    }
+    return json_buffer_append(out, bytes, n);
+}
+
+// Reads the string at the cursor. With `out`, appends its unescaped bytes.
+static int parse_string(cursor_t *c, json_buffer_t *out) {
+    if (peek(c) != '"') return -1;
+    c->p++;
+    for (;;) {
+        const char *run = c->p;
+        while (c->p < c->end && *c->p != '"' && *c->p != '\\') c->p++;
+        if (out && c->p > run && json_buffer_append(out, run, c->p - run) != 0) return -1;
+        if (c->p >= c->end) return -1;
+        if (*c->p == '"') {
+            c->p++;
+            return 0;
+        }
+
+        // Escape sequence
+        if (c->end - c->p < 2) return -1;
+        char ch = c->p[1];
+        c->p += 2;
+        char plain;
+        switch (ch) {
+            case '"': plain = '"'; break;
+            case '\\': plain = '\\'; break;
+            case '/': plain = '/'; break;
+            case 'b': plain = '\b'; break;
+            case 'f': plain = '\f'; break;
+            case 'n': plain = '\n'; break;
+            case 'r': plain = '\r'; break;
+            case 't': plain = '\t'; break;
+            case 'u': {
+                unsigned int cp;
+                if (c->end - c->p < 4 || hex4(c->p, &cp) != 0) return -1;
+                c->p += 4;
+                // A high surrogate followed by a low one encodes one code point
+                if (cp >= 0xD800 && cp <= 0xDBFF && c->end - c->p >= 6 && c->p[0] == '\\' && c->p[1] == 'u') {
+                    unsigned int low;
+                    if (hex4(c->p + 2, &low) == 0 && low >= 0xDC00 && low <= 0xDFFF) {
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                        c->p += 6;
+                    }
+                }
+                if (cp >= 0xD800 && cp <= 0xDFFF) cp = 0xFFFD; // Lone surrogate
+                if (out && append_utf8(out, cp) != 0) return -1;
+                continue;
+            }
+            default: return -1;
+        }
+        if (out && json_buffer_append(out, &plain, 1) != 0) return -1;
+    }
+}
+
+// Reads an object key into `key` (truncated) and consumes the colon
+static int parse_key(cursor_t *c, char *key, size_t size) {
+    skip_ws(c);
+    const char *start = c->p;
+    if (parse_string(c, NULL) != 0) return -1;
+    // Keys are short and escape-free in practice; compare them raw
+    size_t len = (c->p - start) - 2;
+    if (len >= size) len = size - 1;
+    memcpy(key, start + 1, len);
+    key[len] = 0;
+    if (peek(c) != ':') return -1;
+    c->p++;
+    return 0;
+}
+
+static int parse_number(cursor_t *c, double *value) {
+    skip_ws(c);
+    const char *start = c->p;
+    while (c->p < c->end && *c->p && strchr("+-0123456789.eE", *c->p)) c->p++;
+    if (c->p == start || c->p - start > 63) return -1;
+    char number[64];
+    memcpy(number, start, c->p - start);
+    number[c->p - start] = 0;
+    char *end;
+    *value = strtod(number, &end);
+    return *end == 0 ? 0 : -1;
+}
+
+// Iterates an object: returns 1 with the next key read, 0 at the end
+static int object_next(cursor_t *c, char *key, size_t size, int *first) {
+    int ch = peek(c);
+    if (*first) {
+        if (ch != '{') return -1;
+        c->p++;
+        *first = 0;
+        if (peek(c) == '}') { c->p++; return 0; }
+    } else if (ch == ',') {
+        c->p++;
+    } else if (ch == '}') {
+        c->p++;
+        return 0;
+    } else {
+        return -1;
+    }
+    return parse_key(c, key, size) == 0 ? 1 : -1;
+}
+
+// Iterates an array: returns 1 positioned on the next element, 0 at the end
+static int array_next(cursor_t *c, int *first) {
+    int ch = peek(c);
+    if (*first) {
+        if (ch != '[') return -1;
+        c->p++;
+        *first = 0;
+        if (peek(c) == ']') { c->p++; return 0; }
+        return 1;
+    }
+    if (ch == ',') { c->p++; return 1; }
+    if (ch == ']') { c->p++; return 0; }
+    return -1;
+}
+
+static int skip_literal(cursor_t *c, const char *word) {
+    size_t len = strlen(word);
+    if ((size_t)(c->end - c->p) < len || strncmp(c->p, word, len) != 0) return -1;
+    c->p += len;
+    return 0;
+}
+
+static int skip_value(cursor_t *c) {
+    int ch = peek(c);
+    int rc = 0, first = 1;
+    char key[8];
+    switch (ch) {
+        case '"': return parse_string(c, NULL);
+        case 't': return skip_literal(c, "true");
+        case 'f': return skip_literal(c, "false");
+        case 'n': return skip_literal(c, "null");
+        case '{':
+        case '[':
+            if (++c->depth > MAX_DEPTH) return -1;
+            if (ch == '{') {
+                while ((rc = object_next(c, key, sizeof(key), &first)) == 1) {
+                    if (skip_value(c) != 0) return -1;
+                }
+            } else {
+                while ((rc = array_next(c, &first)) == 1) {
+                    if (skip_value(c) != 0) return -1;
+                }
+            }
+            c->depth--;
+            return rc;
+        default: {
+            double ignored;
+            return parse_number(c, &ignored);
+        }
+    }
+}
+
+// {"content": "...", ...} of choices[0].message or choices[0].delta
+static int read_message(cursor_t *c, json_reply_t *reply, json_buffer_t *content) {
+    char key[32];
+    int first = 1, rc;
+    while ((rc = object_next(c, key, sizeof(key), &first)) == 1) {
+        if (strcmp(key, "content") == 0 && peek(c) == '"') {
+            if (parse_string(c, content) != 0) return -1;
+            reply->has_content = 1;
+        } else if (skip_value(c) != 0) {
+            return -1;
+        }
+    }
+    return rc;
+}
+
+static int read_choices(cursor_t *c, json_reply_t *reply, json_buffer_t *content) {
+    int first = 1, rc, index = 0;
+    while ((rc = array_next(c, &first)) == 1) {
+        if (index++ == 0 && peek(c) == '{') {
+            char key[32];
+            int first_key = 1, krc;
+            while ((krc = object_next(c, key, sizeof(key), &first_key)) == 1) {
+                if ((strcmp(key, "message") == 0 || strcmp(key, "delta") == 0) && peek(c) == '{') {
+                    if (read_message(c, reply, content) != 0) return -1;
+                } else if (skip_value(c) != 0) {
+                    return -1;
+                }
+            }
+            if (krc != 0) return -1;
+        } else if (skip_value(c) != 0) {
+            return -1;
+        }
+    }
+    return rc;
+}
+
+// Cached prompt tokens are reported as usage.prompt_tokens_details.cached_tokens
+// (OpenAI), usage.prompt_cache_hit_tokens (DeepSeek) or
+// usage.cache_read_input_tokens (Anthropic-compatible servers)
+static int read_usage(cursor_t *c, json_reply_t *reply) {
+    char key[32];
+    int first = 1, rc;
+    while ((rc = object_next(c, key, sizeof(key), &first)) == 1) {
+        long *field = NULL;
+        if (strcmp(key, "prompt_tokens") == 0) field = &reply->prompt_tokens;
+        else if (strcmp(key, "completion_tokens") == 0) field = &reply->completion_tokens;
+        else if (strcmp(key, "total_tokens") == 0) field = &reply->total_tokens;
+        else if (strcmp(key, "cached_tokens") == 0) field = &reply->cached_tokens;
+        else if (strcmp(key, "prompt_cache_hit_tokens") == 0) field = &reply->cached_tokens;
+        else if (strcmp(key, "cache_read_input_tokens") == 0) field = &reply->cached_tokens;
+
+        int ch = peek(c);
+        if (strcmp(key, "prompt_tokens_details") == 0 && ch == '{') {
+            if (++c->depth > MAX_DEPTH || read_usage(c, reply) != 0) return -1;
+            c->depth--;
+        } else if (field && (ch == '-' || (ch >= '0' && ch <= '9'))) {
+            double value;
+            if (parse_number(c, &value) != 0) return -1;
+            *field = (long)value;
+        } else if (skip_value(c) != 0) {
+            return -1;
+        }
+    }
+    return rc;
+}
+
+static int copy_error(cursor_t *c, json_reply_t *reply) {
+    json_buffer_t text = {0};
+    int rc = parse_string(c, &text);
+    if (rc == 0 && text.data) snprintf(reply->error, sizeof(reply->error), "%s", text.data);
+    json_buffer_free(&text);
+    return rc;
+}
+
+// "error": "text" or {"message": "text", ...}
+static int read_error(cursor_t *c, json_reply_t *reply) {
+    reply->has_error = 1;
+    int ch = peek(c);
+    if (ch == '"') return copy_error(c, reply);
+    if (ch != '{') return skip_value(c);
+
+    char key[32];
+    int first = 1, rc;
+    while ((rc = object_next(c, key, sizeof(key), &first)) == 1) {
+        if (strcmp(key, "message") == 0 && peek(c) == '"') {
+            if (copy_error(c, reply) != 0) return -1;
+        } else if (skip_value(c) != 0) {
+            return -1;
+        }
+    }
+    return rc;
+}
+
+int json_extract_reply(const char *json, size_t len, json_reply_t *reply, json_buffer_t *content) {
+    memset(reply, 0, sizeof(*reply));
+    reply->prompt_tokens = reply->completion_tokens = reply->total_tokens = reply->cached_tokens = -1;
+    size_t content_start = content->size;
+
+    cursor_t c = { json, json + len, 0 };
+    char key[32];
+    int first = 1, rc;
+    while ((rc = object_next(&c, key, sizeof(key), &first)) == 1) {
+        int ch = peek(&c);
+        if (strcmp(key, "choices") == 0 && ch == '[') rc = read_choices(&c, reply, content);
+        else if (strcmp(key, "usage") == 0 && ch == '{') rc = read_usage(&c, reply);
+        else if (strcmp(key, "error") == 0 && ch != 'n') rc = read_error(&c, reply);
+        else rc = skip_value(&c);
+        if (rc != 0) break;
+    }
+    if (rc == 0 && peek(&c) != -1) rc = -1; // Trailing garbage
+
+    if (rc != 0) {
+        // Leave the caller's buffer as it was
+        content->size = content_start;
+        if (content->data) content->data[content_start] = 0;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,495 @@
+#include "langid.h"
+#include "tokenizer.h"
+#include <ctype.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+
+// Fewer letters than this are not enough evidence to call a language
+#define MIN_LETTERS 20
+#define MIN_IDEOGRAPHS 4
+
+// The naive-Bayes scores of a long text overstate the certainty because
+// trigrams are far from independent; beyond this many trigrams the
+// evidence is scaled down
+#define MAX_EVIDENCE 32
+
+// Part of the text's trigrams the winning profile must know, otherwise
+// the text is in a Latin-script language without a profile. Prose in a
+// profiled language covers 0.55 and more; Occitan, Swedish or Danish reach
+// about 0.50 against their nearest profile.
+#define MIN_COVERAGE 0.50
+
+// Latin-script languages identified by trigrams. The samples are ordinary
+// prose heavy in function words, which is what tells these languages
+// apart; adding a language means adding a sample here. Catalan and
+// Galician are mostly here so their text is not taken for Spanish or
+// Portuguese.
+typedef struct {
+    const char *code;
+    const char *sample;
+} latin_profile_t;
+
+static const latin_profile_t profiles[] = {
+    { "en",
+      "It was late in the evening when the old man came back to the house. He had walked all the way from "
+      "the village, and his coat was wet with the rain that had not stopped since the morning. Nobody "
+      "expected him. The children were already asleep, and their mother was sitting by the fire with a "
+      "book she had been trying to finish for weeks. She looked up when she heard the door, but she did not "
+      "say anything at first. There was something in his face that made her wait. What happened, she asked "
+      "at last. He told her that the bridge over the river had fallen, and that the people on the other "
+      "side would have to find another way to the market. It is the only road they have, he said, and it "
+      "will take months before anyone thinks of building a new one. They talked for a long time about what "
+      "this would mean for the farm, for the school and for the families who lived near the water. In the "
+      "end they agreed that they should write to the council, although neither of them believed that "
+      "anything would change. The night was quiet except for the wind, and the fire was slowly going out." },
+    { "fr",
+      "Il était tard dans la soirée quand le vieil homme est revenu à la maison. Il avait marché depuis le "
+      "village, et son manteau était trempé par la pluie qui n'avait pas cessé depuis le matin. Personne ne "
+      "l'attendait. Les enfants dormaient déjà, et leur mère était assise près du feu avec un livre qu'elle "
+      "essayait de terminer depuis des semaines. Elle a levé les yeux en entendant la porte, mais elle n'a "
+      "rien dit tout de suite. Il y avait quelque chose dans son visage qui l'obligeait à attendre. Que "
+      "s'est-il passé, a-t-elle enfin demandé. Il lui a dit que le pont sur la rivière s'était effondré et "
+      "que les gens de l'autre côté devraient trouver un autre chemin pour aller au marché. C'est la seule "
+      "route qu'ils ont, a-t-il dit, et il faudra des mois avant que quelqu'un pense à en construire une "
+      "nouvelle. Ils ont parlé longtemps de ce que cela signifierait pour la ferme, pour l'école et pour "
+      "les familles qui vivaient près de l'eau. À la fin, ils ont décidé d'écrire au conseil, même si aucun "
+      "des deux ne croyait que les choses allaient changer. La nuit était calme, à part le vent." },
+    { "de",
+      "Es war spät am Abend, als der alte Mann zum Haus zurückkam. Er war den ganzen Weg vom Dorf zu Fuß "
+      "gegangen, und sein Mantel war nass von dem Regen, der seit dem Morgen nicht aufgehört hatte. Niemand "
+      "hatte ihn erwartet. Die Kinder schliefen schon, und ihre Mutter saß am Feuer mit einem Buch, das sie "
+      "seit Wochen zu Ende lesen wollte. Sie schaute auf, als sie die Tür hörte, aber zuerst sagte sie "
+      "nichts. In seinem Gesicht lag etwas, das sie warten ließ. Was ist passiert, fragte sie schließlich. "
+      "Er erzählte ihr, dass die Brücke über den Fluss eingestürzt sei und dass die Leute auf der anderen "
+      "Seite einen anderen Weg zum Markt finden müssten. Es ist die einzige Straße, die sie haben, sagte er, "
+      "und es wird Monate dauern, bis jemand daran denkt, eine neue zu bauen. Sie sprachen lange darüber, "
+      "was das für den Hof, für die Schule und für die Familien bedeuten würde, die nahe am Wasser wohnten. "
+      "Am Ende waren sie sich einig, dass sie dem Gemeinderat schreiben sollten, obwohl keiner von beiden "
+      "glaubte, dass sich etwas ändern würde. Die Nacht war still, nur der Wind war zu hören." },
+    { "es",
+      "Era tarde por la noche cuando el viejo volvió a la casa. Había caminado todo el camino desde el "
+      "pueblo, y su abrigo estaba mojado por la lluvia que no había parado desde la mañana. Nadie lo "
+      "esperaba. Los niños ya estaban dormidos, y su madre estaba sentada junto al fuego con un libro que "
+      "llevaba semanas intentando terminar. Levantó la vista cuando oyó la puerta, pero al principio no dijo "
+      "nada. Había algo en su cara que la hizo esperar. ¿Qué ha pasado?, preguntó por fin. Él le contó que "
+      "el puente sobre el río se había caído y que la gente del otro lado tendría que buscar otro camino "
+      "para llegar al mercado. Es la única carretera que tienen, dijo, y pasarán meses antes de que alguien "
+      "piense en construir uno nuevo. Hablaron durante mucho tiempo de lo que eso significaría para la "
+      "granja, para la escuela y para las familias que vivían cerca del agua. Al final estuvieron de "
+      "acuerdo en que debían escribir al ayuntamiento, aunque ninguno de los dos creía que algo fuera a "
+      "cambiar. La noche estaba tranquila, salvo por el viento, y el fuego se apagaba despacio." },
+    { "it",
+      "Era tardi quella sera quando il vecchio tornò a casa. Aveva camminato per tutta la strada dal "
+      "paese, e il suo cappotto era bagnato dalla pioggia che non aveva smesso di cadere dalla mattina. "
+      "Nessuno lo aspettava. I bambini dormivano già, e la loro madre era seduta vicino al fuoco con un "
+      "libro che cercava di finire da settimane. Alzò gli occhi quando sentì la porta, ma all'inizio non "
+      "disse niente. C'era qualcosa nel suo viso che la fece aspettare. Che cosa è successo, chiese alla "
+      "fine. Lui le raccontò che il ponte sul fiume era crollato e che la gente dall'altra parte avrebbe "
+      "dovuto trovare un'altra strada per andare al mercato. È l'unica strada che hanno, disse, e ci "
+      "vorranno mesi prima che qualcuno pensi di costruirne uno nuovo. Parlarono a lungo di cosa avrebbe "
+      "significato per la fattoria, per la scuola e per le famiglie che vivevano vicino all'acqua. Alla "
+      "fine si misero d'accordo di scrivere al comune, anche se nessuno dei due credeva che qualcosa "
+      "sarebbe cambiato. La notte era silenziosa, tranne il vento, e il fuoco si spegneva piano." },
+    { "pt",
+      "Era tarde da noite quando o velho voltou para casa. Tinha caminhado todo o caminho desde a aldeia, "
+      "e o seu casaco estava molhado da chuva que não tinha parado desde a manhã. Ninguém o esperava. As "
+      "crianças já estavam dormindo, e a mãe delas estava sentada perto do fogo com um livro que tentava "
+      "terminar havia semanas. Ela levantou os olhos quando ouviu a porta, mas no começo não disse nada. "
+      "Havia alguma coisa no rosto dele que a fez esperar. O que aconteceu, perguntou ela por fim. Ele "
+      "contou que a ponte sobre o rio tinha caído e que as pessoas do outro lado teriam de encontrar outro "
+      "caminho para chegar ao mercado. É a única estrada que eles têm, disse ele, e vão passar meses antes "
+      "que alguém pense em construir uma nova. Conversaram muito tempo sobre o que isso significaria para "
+      "a fazenda, para a escola e para as famílias que moravam perto da água. No fim concordaram que "
+      "deviam escrever à câmara, embora nenhum dos dois acreditasse que alguma coisa fosse mudar. A noite "
+      "estava calma, a não ser pelo vento, e o fogo ia se apagando devagar. Não havia mais nada a fazer." },
+    { "nl",
+      "Het was laat op de avond toen de oude man terugkwam bij het huis. Hij had de hele weg vanaf het "
+      "dorp gelopen, en zijn jas was nat van de regen die sinds de ochtend niet was opgehouden. Niemand "
+      "verwachtte hem. De kinderen sliepen al, en hun moeder zat bij het vuur met een boek dat ze al weken "
+      "probeerde uit te lezen. Ze keek op toen ze de deur hoorde, maar eerst zei ze niets. Er was iets in "
+      "zijn gezicht waardoor ze wachtte. Wat is er gebeurd, vroeg ze ten slotte. Hij vertelde haar dat de "
+      "brug over de rivier was ingestort en dat de mensen aan de andere kant een andere weg naar de markt "
+      "zouden moeten zoeken. Het is de enige weg die ze hebben, zei hij, en het zal maanden duren voordat "
+      "iemand eraan denkt om een nieuwe te bouwen. Ze praatten lang over wat dat zou betekenen voor de "
+      "boerderij, voor de school en voor de gezinnen die dicht bij het water woonden. Uiteindelijk waren "
+      "ze het erover eens dat ze de gemeente moesten schrijven, hoewel geen van beiden geloofde dat er "
+      "iets zou veranderen. De nacht was stil, behalve de wind, en het vuur ging langzaam uit." },
+    { "ca",
+      "Era tard al vespre quan el vell va tornar a casa. Havia caminat tot el camí des del poble, i el seu "
+      "abric estava mullat per la pluja que no havia parat des del matí. Ningú no l'esperava. Els nens ja "
+      "dormien, i la seva mare estava asseguda al costat del foc amb un llibre que feia setmanes que "
+      "intentava acabar. Va aixecar la vista quan va sentir la porta, però al principi no va dir res. Hi "
+      "havia alguna cosa a la seva cara que la va fer esperar. Què ha passat, va preguntar per fi. Ell li "
+      "va explicar que el pont sobre el riu havia caigut i que la gent de l'altra banda hauria de buscar un "
+      "altre camí per anar al mercat. És l'única carretera que tenen, va dir, i passaran mesos abans que "
+      "algú pensi a construir-ne un de nou. Van parlar molta estona del que això significaria per a la "
+      "masia, per a l'escola i per a les famílies que vivien a prop de l'aigua. Al final van estar d'acord "
+      "que havien d'escriure a l'ajuntament, tot i que cap dels dos no creia que res hagués de canviar. La "
+      "nit era tranquil·la, tret del vent, i el foc s'apagava a poc a poc. No sé si demà podré venir amb "
+      "tu, li va dir ella a la seva germana. Hi ha molta feina a casa i els nois encara no saben fer res "
+      "sols. Doncs jo tampoc no hi vull anar sola, va respondre l'altra, perquè la gent del poble sempre "
+      "parla massa. Aleshores hi anirem totes dues juntes després de dinar, i si plou ens quedarem aquí." },
+    { "gl",
+      "Era tarde pola noite cando o vello volveu á casa. Camiñara todo o camiño dende a aldea, e o seu "
+      "abrigo estaba mollado pola chuvia que non parara dende a mañá. Ninguén o agardaba. Os nenos xa "
+      "estaban durmidos, e a súa nai estaba sentada xunto ao lume cun libro que levaba semanas tentando "
+      "rematar. Ergueu a vista cando oíu a porta, pero ao principio non dixo nada. Había algo na súa cara "
+      "que a fixo agardar. Que pasou, preguntou por fin. El contoulle que a ponte sobre o río caera e que "
+      "a xente do outro lado tería que buscar outro camiño para chegar ao mercado. É a única estrada que "
+      "teñen, dixo, e pasarán meses antes de que alguén pense en construír unha nova. Falaron moito tempo "
+      "do que iso significaría para a granxa, para a escola e para as familias que vivían preto da auga. "
+      "Ao final estiveron de acordo en que debían escribirlle ao concello, aínda que ningún dos dous cría "
+      "que algo fose cambiar. A noite estaba tranquila, agás polo vento, e o lume apagábase amodo. Non sei "
+      "se mañá poderei ir contigo, díxolle ela á súa irmá. Hai moito traballo na casa e os rapaces aínda "
+      "non saben facer nada sós. Pois eu tampouco quero ir soa, respondeu a outra, porque a xente da vila "
+      "sempre fala de máis. Entón imos as dúas xuntas despois do xantar, e se chove quedamos aquí." },
+};
+
+#define PROFILE_COUNT (int)(sizeof(profiles) / sizeof(profiles[0]))
+
+typedef struct {
+    uint64_t key;               // Three folded code points, 0 = empty slot
+    float logp[PROFILE_COUNT];  // Smoothed log probability per profile
+    unsigned int present;       // Bit per profile that saw the trigram
+} trigram_t;
+
+static trigram_t *table;
+static size_t table_size;       // Power of two
+static pthread_once_t table_once = PTHREAD_ONCE_INIT;
+
+typedef enum {
+    SCRIPT_NONE,
+    SCRIPT_LATIN,
+    SCRIPT_GREEK,
+    SCRIPT_CYRILLIC,
+    SCRIPT_HEBREW,
+    SCRIPT_ARABIC,
+    SCRIPT_DEVANAGARI,
+    SCRIPT_THAI,
+    SCRIPT_HANGUL,
+    SCRIPT_KANA,
+    SCRIPT_HAN,
+    SCRIPT_COUNT
+} script_t;
+
+// Scripts written by one language only, which the script alone identifies
+static const char *script_languages[SCRIPT_COUNT] = {
+    [SCRIPT_GREEK] = "el", [SCRIPT_HEBREW] = "he", [SCRIPT_THAI] = "th", [SCRIPT_HANGUL] = "ko",
+    [SCRIPT_KANA] = "ja"
+};
+
+// A language recognised in a script it shares with others. The text must
+// use only the letters of its alphabet (the other languages add letters of
+// their own) and carry `min_markers` of its marker letters or words, and
+// none of the words that give away a neighbour.
+typedef struct {
+    script_t script;
+    const char *code;
+    unsigned int alphabet[3][2];    // Code point ranges
+    const char *markers;            // Space-separated
+    const char *foreign;            // Space-separated words, or NULL
+    int words;                      // Markers are whole words, not letters
+    int min_markers;
+} shared_script_t;
+
+static const shared_script_t shared_scripts[] = {
+    // Ukrainian, Belarusian, Serbian, Macedonian, Kazakh or Tatar use
+    // letters Russian lacks; Bulgarian has neither ы nor э
+    { SCRIPT_CYRILLIC, "ru", { { 0x401, 0x401 }, { 0x410, 0x44F }, { 0x451, 0x451 } },
+      "ы э Ы Э", NULL, 0, 1 },
+    // Persian, Urdu, Pashto or Kurdish add letters (پ گ ک ی ے...) and
+    // write ي, ى and ك with letters of their own
+    { SCRIPT_ARABIC, "ar", { { 0x621, 0x64A } },
+      "ة ى ي ك", NULL, 0, 1 },
+    // Marathi (which also has ळ) and Nepali share the letters; their
+    // function words differ
+    { SCRIPT_DEVANAGARI, "hi", { { 0x900, 0x932 }, { 0x934, 0x963 } },
+      "है हैं में और की नहीं था थी थे", "आहे आहेत आणि नाही छ छन् पनि लाई र मा", 1, 2 },
+    // Japanese written in kanji alone lacks the Chinese particles and
+    // pronouns
+    { SCRIPT_HAN, "zh", { { 0x3400, 0x4DBF }, { 0x4E00, 0x9FFF } },
+      "的 了 们 們 这 這 说 說 吗 嗎 呢 个 個 没 沒 她", NULL, 0, 2 },
+};
+
+static script_t script_of(unsigned int cp) {
+    if (cp < 0x80) return ((cp | 0x20) >= 'a' && (cp | 0x20) <= 'z') ? SCRIPT_LATIN : SCRIPT_NONE;
+    if (cp >= 0xC0 && cp <= 0x24F) return (cp == 0xD7 || cp == 0xF7) ? SCRIPT_NONE : SCRIPT_LATIN;
+    if (cp >= 0x1E00 && cp <= 0x1EFF) return SCRIPT_LATIN;
+    if (cp >= 0x370 && cp <= 0x3FF) return SCRIPT_GREEK;
+    if (cp >= 0x1F00 && cp <= 0x1FFF) return SCRIPT_GREEK;
+    if (cp >= 0x400 && cp <= 0x52F) return SCRIPT_CYRILLIC;
+    if (cp >= 0x5D0 && cp <= 0x5EA) return SCRIPT_HEBREW;
+    if (cp >= 0x620 && cp <= 0x64A) return SCRIPT_ARABIC;
+    if (cp >= 0x671 && cp <= 0x6D3) return SCRIPT_ARABIC;
+    if ((cp >= 0x900 && cp <= 0x963) || (cp >= 0x971 && cp <= 0x97F)) return SCRIPT_DEVANAGARI;
+    if (cp >= 0xE01 && cp <= 0xE5B) return SCRIPT_THAI;
+    if ((cp >= 0xAC00 && cp <= 0xD7AF) || (cp >= 0x1100 && cp <= 0x11FF)) return SCRIPT_HANGUL;
+    if (cp >= 0x3041 && cp <= 0x30FF) return SCRIPT_KANA;
+    if ((cp >= 0x4E00 && cp <= 0x9FFF) || (cp >= 0x3400 && cp <= 0x4DBF)) return SCRIPT_HAN;
+    return SCRIPT_NONE;
+}
+
+// Lower case for the Latin letters; everything else is left as it is
+static unsigned int fold(unsigned int cp) {
+    if (cp >= 'A' && cp <= 'Z') return cp | 0x20;
+    if (cp >= 0xC0 && cp <= 0xDE && cp != 0xD7) return cp + 0x20;
+    if (cp >= 0x100 && cp <= 0x17F && !(cp & 1)) return cp + 1;
+    return cp;
+}
+
+static uint64_t hash_key(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return key;
+}
+
+static trigram_t* find_slot(uint64_t key) {
+    size_t mask = table_size - 1;
+    for (size_t i = hash_key(key) & mask;; i = (i + 1) & mask) {
+        if (table[i].key == key || table[i].key == 0) return &table[i];
+    }
+}
+
+typedef void (*trigram_fn)(uint64_t key, void *user);
+
+// Calls fn for every trigram of the Latin letters of the text, with words
+// padded by one space at each end ("the" gives " th", "the", "he ").
+// Returns the number of trigrams.
+static int each_trigram(const unsigned char *s, size_t len, trigram_fn fn, void *user) {
+    unsigned int prev2 = ' ', prev1 = ' ';
+    int count = 0;
+    size_t i = 0;
+    while (i <= len) {
+        unsigned int cp = ' ';
+        if (i < len) {
+            i += utf8_decode(s + i, len - i, &cp);
+            cp = script_of(cp) == SCRIPT_LATIN ? fold(cp) : ' ';
+        } else {
+            i++;
+        }
+        if (cp == ' ' && prev1 == ' ') continue;
+        if (prev1 != ' ' || prev2 != ' ') {
+            fn(((uint64_t)prev2 << 42) | ((uint64_t)prev1 << 21) | cp, user);
+            count++;
+        }
+        prev2 = prev1;
+        prev1 = cp;
+    }
+    return count;
+}
+
+typedef struct {
+    int profile;
+    int *distinct;
+    long total;
+} build_ctx_t;
+
+// Counts are kept in logp[] until every sample has been read
+static void count_trigram(uint64_t key, void *user) {
+    build_ctx_t *ctx = user;
+    trigram_t *slot = find_slot(key);
+    if (slot->key == 0) {
+        slot->key = key;
+        (*ctx->distinct)++;
+    }
+    slot->logp[ctx->profile] += 1;
+    slot->present |= 1u << ctx->profile;
+    ctx->total++;
+}
+
+static void build_table(void) {
+    size_t sample_bytes = 0;
+    for (int p = 0; p < PROFILE_COUNT; p++) sample_bytes += strlen(profiles[p].sample);
+    table_size = 1;
+    while (table_size < sample_bytes * 2) table_size *= 2;
+    table = calloc(table_size, sizeof(trigram_t));
+    if (!table) {
+        fprintf(stderr, "Out of memory for language profiles\n");
+        table_size = 0;
+        return;
+    }
+
+    int distinct = 0;
+    long totals[PROFILE_COUNT];
+    for (int p = 0; p < PROFILE_COUNT; p++) {
+        build_ctx_t ctx = { .profile = p, .distinct = &distinct };
+        each_trigram((const unsigned char*)profiles[p].sample, strlen(profiles[p].sample), count_trigram, &ctx);
+        totals[p] = ctx.total;
+    }
+
+    // Add-half smoothing over the trigrams any sample has seen
+    for (size_t i = 0; i < table_size; i++) {
+        if (!table[i].key) continue;
+        for (int p = 0; p < PROFILE_COUNT; p++) {
+            table[i].logp[p] = logf((table[i].logp[p] + 0.5f) / (totals[p] + 0.5f * distinct));
+        }
+    }
+}
+
+typedef struct {
+    double scores[PROFILE_COUNT];
+    int hits[PROFILE_COUNT];    // Trigrams the profile has seen
+} score_ctx_t;
+
+static void score_trigram(uint64_t key, void *user) {
+    score_ctx_t *ctx = user;
+    trigram_t *slot = find_slot(key);
+    // Trigrams no sample contains say nothing about the language
+    if (slot->key == 0) return;
+    for (int p = 0; p < PROFILE_COUNT; p++) {
+        ctx->scores[p] += slot->logp[p];
+        if (slot->present & (1u << p)) ctx->hits[p]++;
+    }
+}
+
+// Best trigram profile and its posterior probability among the profiles
+static int detect_latin(const unsigned char *s, size_t len, double *confidence) {
+    pthread_once(&table_once, build_table);
+    if (!table) return -1;
+
+    score_ctx_t ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    int count = each_trigram(s, len, score_trigram, &ctx);
+    if (count == 0) return -1;
+
+    int best = 0;
+    for (int p = 1; p < PROFILE_COUNT; p++) {
+        if (ctx.scores[p] > ctx.scores[best]) best = p;
+    }
+    if (ctx.hits[best] < MIN_COVERAGE * count) return -1;
+
+    double scale = count > MAX_EVIDENCE ? (double)MAX_EVIDENCE / count : 1.0;
+    double sum = 0;
+    for (int p = 0; p < PROFILE_COUNT; p++) {
+        sum += exp((ctx.scores[p] - ctx.scores[best]) * scale);
+    }
+    *confidence = 1.0 / sum;
+    return best;
+}
+
+// Whether s[0, len) is one of the space-separated items of list
+static int in_list(const char *list, const unsigned char *s, size_t len) {
+    while (list && *list) {
+        size_t n = strcspn(list, " ");
+        if (n == len && memcmp(list, s, len) == 0) return 1;
+        list += n;
+        list += strspn(list, " ");
+    }
+    return 0;
+}
+
+// Applies the checks of a shared script: 1 if the text is in the language
+static int shared_script_match(const shared_script_t *shared, const unsigned char *s, size_t len) {
+    int markers = 0;
+    size_t word = 0;    // Start of the current word of the script
+    int in_word = 0;
+    for (size_t i = 0; i <= len;) {
+        unsigned int cp = 0;
+        size_t n = 1;
+        if (i < len) n = utf8_decode(s + i, len - i, &cp);
+        int letter = i < len && script_of(cp) == shared->script;
+        if (letter) {
+            int known = 0;
+            for (int r = 0; r < 3 && shared->alphabet[r][1]; r++) {
+                known |= cp >= shared->alphabet[r][0] && cp <= shared->alphabet[r][1];
+            }
+            if (!known) return 0;
+            if (!shared->words && in_list(shared->markers, s + i, n)) markers++;
+            if (!in_word) word = i;
+            in_word = 1;
+        } else if (in_word) {
+            if (shared->words && in_list(shared->markers, s + word, i - word)) markers++;
+            if (in_list(shared->foreign, s + word, i - word)) return 0;
+            in_word = 0;
+        }
+        i += n;
+    }
+    return markers >= shared->min_markers;
+}
+
+const char* langid_detect(const char *text, size_t len, double *confidence) {
+    const unsigned char *s = (const unsigned char*)text;
+    int scripts[SCRIPT_COUNT] = {0};
+    int letters = 0;
+    for (size_t i = 0; i < len;) {
+        unsigned int cp;
+        i += utf8_decode(s + i, len - i, &cp);
+        script_t script = script_of(cp);
+        if (script == SCRIPT_NONE) continue;
+        scripts[script]++;
+        letters++;
+    }
+    *confidence = 0;
+    if (letters == 0) return NULL;
+
+    // Japanese mixes kana with kanji; Han alone may be Chinese
+    if (scripts[SCRIPT_KANA] > 0) {
+        scripts[SCRIPT_KANA] += scripts[SCRIPT_HAN];
+        scripts[SCRIPT_HAN] = 0;
+    }
+    script_t dominant = SCRIPT_LATIN;
+    for (int k = 1; k < SCRIPT_COUNT; k++) {
+        if (scripts[k] > scripts[dominant]) dominant = k;
+    }
+    double share = (double)scripts[dominant] / letters;
+
+    if (dominant == SCRIPT_LATIN) {
+        if (letters < MIN_LETTERS) return NULL;
+        double posterior;
+        int best = detect_latin(s, len, &posterior);
+        if (best < 0) return NULL;
+        *confidence = posterior * share;
+        return profiles[best].code;
+    }
+
+    int ideographic = dominant == SCRIPT_HAN || dominant == SCRIPT_KANA || dominant == SCRIPT_HANGUL;
+    if (scripts[dominant] < (ideographic ? MIN_IDEOGRAPHS : MIN_LETTERS)) return NULL;
+    const char *code = script_languages[dominant];
+    for (size_t k = 0; !code && k < sizeof(shared_scripts) / sizeof(shared_scripts[0]); k++) {
+        if (shared_scripts[k].script == dominant && shared_script_match(&shared_scripts[k], s, len)) {
+            code = shared_scripts[k].code;
+        }
+    }
+    if (code) *confidence = share;
+    return code;
+}
+
+static const struct {
+    const char *code;
+    const char *name;
+} languages[] = {
+    { "en", "english" }, { "fr", "french" }, { "de", "german" }, { "es", "spanish" },
+    { "it", "italian" }, { "pt", "portuguese" }, { "nl", "dutch" }, { "ru", "russian" },
+    { "el", "greek" }, { "he", "hebrew" }, { "ar", "arabic" }, { "hi", "hindi" },
+    { "th", "thai" }, { "zh", "chinese" }, { "ja", "japanese" }, { "ko", "korean" },
+    { "ca", "catalan" }, { "gl", "galician" },
+};
+
+const char* langid_code(const char *language) {
+    if (!language) return NULL;
+    char lower[64];
+    size_t n = 0;
+    for (; language[n] && n < sizeof(lower) - 1; n++) lower[n] = (char)tolower((unsigned char)language[n]);
+    lower[n] = 0;
+
+    // A language tag: the primary subtag before "-" or "_"
+    size_t primary = strcspn(lower, "-_");
+    for (size_t i = 0; i < sizeof(languages) / sizeof(languages[0]); i++) {
+        if (primary == 2 && strncmp(lower, languages[i].code, 2) == 0) return languages[i].code;
+    }
+    // A name, possibly qualified ("Brazilian Portuguese")
+    for (size_t i = 0; i < sizeof(languages) / sizeof(languages[0]); i++) {
+        if (strstr(lower, languages[i].name)) return languages[i].code;
+    }
+    return NULL;
+}
+
+int langid_is_language(const char *text, size_t len, const char *language, double threshold) {
+    const char *code = langid_code(language);
+    if (!code) return 0;
+    double confidence;
+    const char *detected = langid_detect(text, len, &confidence);
+    return detected && strcmp(detected, code) == 0 && confidence >= threshold;
+}
@@ -0,0 +1,551 @@
+#include "llm_client.h"
+#include "tokenizer.h"
+#include "rate_limit.h"
+#include "metrics.h"
+#include "json_lite.h"
+#include <curl/curl.h>
+#include <json-c/json.h>
+#include <pthread.h>
+
+#define DEFAULT_ENDPOINT "https://api.openai.com/v1/chat/completions"
+
+// Deadline of a request: a fixed allowance for queueing and the first
+// token plus the time the expected reply takes at a slow generation rate
+#define BASE_TIMEOUT_SECONDS 60
+#define MIN_TOKENS_PER_SECOND 10
+
+// Streams are abandoned after this long without a byte (config default)
+#define DEFAULT_STALL_TIMEOUT 30
+
+// A streamed reply is cut off once it exceeds this many times the expected
+// length (plus some slack for very short segments)
+#define RUNAWAY_RATIO 3
+#define RUNAWAY_SLACK_TOKENS 256
+
+// Attempts after the first for throttled, failed or timed-out requests
+#define DEFAULT_MAX_RETRIES 5
+
+// Per-thread connection: the easy handle keeps its connection alive between
+// requests and the buffers are reused instead of reallocated.
+typedef struct {
+    CURL *curl;
+    char *response;         // Whole body, or the unparsed tail of an event stream
+    size_t size;
+    size_t capacity;
+
+    json_buffer_t payload;  // Request body, rebuilt in place for every request
+    int legacy_json;        // Use json-c for requests and replies (config->legacy_json)
+
+    // Streaming state
+    int plain;              // Server answered with a regular JSON body
+    json_buffer_t content;  // Deltas assembled so far
+    int content_tokens;
+    int max_tokens;         // Runaway cutoff (0 = none)
+    int events;
+    int cut_off;
+    int usage_tokens;       // usage.total_tokens reported by the server (0 = none)
+    int prompt_tokens;      // usage.prompt_tokens / completion_tokens
+    int completion_tokens;
+    int cached_tokens;      // Prompt tokens the provider served from its prefix cache
+
+    rate_limit_headers_t limits;
+} llm_handle_t;
+
+static pthread_mutex_t client_lock = PTHREAD_MUTEX_INITIALIZER;
+static int client_ready = 0;
+static CURLSH *share = NULL;
+static pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST];
+static struct curl_slist *headers = NULL;
+static char *endpoint = NULL;
+static pthread_key_t handle_key;
+
+static void share_lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr) {
+    (void)handle; (void)access; (void)userptr;
+    pthread_mutex_lock(&share_locks[data]);
+}
+
+static void share_unlock(CURL *handle, curl_lock_data data, void *userptr) {
+    (void)handle; (void)userptr;
+    pthread_mutex_unlock(&share_locks[data]);
+}
+
+static void free_handle(void *ptr) {
+    llm_handle_t *handle = (llm_handle_t*)ptr;
+    if (!handle) return;
+    curl_easy_cleanup(handle->curl);
+    free(handle->response);
+    json_buffer_free(&handle->payload);
+    json_buffer_free(&handle->content);
+    free(handle);
+}
+
+static int buffer_append(char **data, size_t *size, size_t *capacity, const char *src, size_t len) {
+    if (*size + len + 1 > *capacity) {
+        size_t new_capacity = *capacity ? *capacity : 4096;
+        while (new_capacity < *size + len + 1) new_capacity *= 2;
+        char *ptr_realloc = realloc(*data, new_capacity);
+        if (ptr_realloc == NULL) return -1; // Out of memory
+        *data = ptr_realloc;
+        *capacity = new_capacity;
+    }
+    memcpy(*data + *size, src, len);
+    *size += len;
+    (*data)[*size] = 0;
+    return 0;
+}
+
+static size_t write_callback(void *ptr, size_t size, size_t nmemb, void *userdata) {
+    size_t real_size = size * nmemb;
+    llm_handle_t *handle = (llm_handle_t*)userdata;
+    if (buffer_append(&handle->response, &handle->size, &handle->capacity, ptr, real_size) != 0) return 0;
+    return real_size;
+}
+
+// Stores the usage block of a response or of the last stream chunk
+static void read_usage(struct json_object *obj, llm_handle_t *handle) {
+    struct json_object *usage, *value;
+    if (!json_object_object_get_ex(obj, "usage", &usage) || !json_object_is_type(usage, json_type_object)) return;
+    if (json_object_object_get_ex(usage, "prompt_tokens", &value)) handle->prompt_tokens = json_object_get_int(value);
+    if (json_object_object_get_ex(usage, "completion_tokens", &value)) handle->completion_tokens = json_object_get_int(value);
+    if (json_object_object_get_ex(usage, "total_tokens", &value)) handle->usage_tokens = json_object_get_int(value);
+    if (json_object_object_get_ex(usage, "prompt_cache_hit_tokens", &value) ||
+        json_object_object_get_ex(usage, "cache_read_input_tokens", &value) ||
+        (json_object_object_get_ex(usage, "prompt_tokens_details", &value) &&
+         json_object_is_type(value, json_type_object) &&
+         json_object_object_get_ex(value, "cached_tokens", &value))) {
+        handle->cached_tokens = json_object_get_int(value);
+    }
+    if (handle->usage_tokens == 0) handle->usage_tokens = handle->prompt_tokens + handle->completion_tokens;
+}
+
+// Copies what the single-pass extractor found into the handle
+static void apply_reply(llm_handle_t *handle, const json_reply_t *reply) {
+    if (reply->prompt_tokens >= 0) handle->prompt_tokens = (int)reply->prompt_tokens;
+    if (reply->completion_tokens >= 0) handle->completion_tokens = (int)reply->completion_tokens;
+    if (reply->cached_tokens >= 0) handle->cached_tokens = (int)reply->cached_tokens;
+    if (reply->total_tokens >= 0) handle->usage_tokens = (int)reply->total_tokens;
+    else if (reply->prompt_tokens >= 0 || reply->completion_tokens >= 0) {
+        handle->usage_tokens = handle->prompt_tokens + handle->completion_tokens;
+    }
+}
+
+// Handles one line of an event stream: "data: {...}" carries a chunk whose
+// choices[0].delta.content is appended to the reply. Comments, "event:" and
+// "id:" lines are ignored.
+static void handle_event_line(llm_handle_t *handle, const char *line) {
+    if (strncmp(line, "data:", 5) != 0) return;
+    const char *data = line + 5;
+    while (*data == ' ') data++;
+    if (strcmp(data, "[DONE]") == 0) return;
+
+    if (!handle->legacy_json) {
+        json_reply_t reply;
+        size_t before = handle->content.size;
+        if (json_extract_reply(data, strlen(data), &reply, &handle->content) == 0) {
+            handle->events++;
+            if (handle->content.size > before) {
+                handle->content_tokens += count_tokens(handle->content.data + before, handle->content.size - before);
+            }
+            if (reply.has_error && !reply.has_content) fprintf(stderr, "LLM stream error: %s\n", reply.error);
+            apply_reply(handle, &reply);
+            return;
+        }
+        // Not well-formed: let json-c have a go
+    }
+
+    struct json_object *event = json_tokener_parse(data);
+    if (!event) return;
+    handle->events++;
+
+    struct json_object *choices, *choice, *delta, *content;
+    if (json_object_object_get_ex(event, "choices", &choices) &&
+        (choice = json_object_array_get_idx(choices, 0)) &&
+        json_object_object_get_ex(choice, "delta", &delta) &&
+        json_object_object_get_ex(delta, "content", &content) &&
+        json_object_is_type(content, json_type_string)) {
+        const char *text = json_object_get_string(content);
+        size_t len = json_object_get_string_len(content);
+        if (json_buffer_append(&handle->content, text, len) == 0) {
+            handle->content_tokens += count_tokens(text, len);
+        }
+    } else if (json_object_object_get_ex(event, "error", &content)) {
+        fprintf(stderr, "LLM stream error: %s\n", json_object_to_json_string(content));
+    }
+
+    read_usage(event, handle);
+    json_object_put(event);
+}
+
+// Parses complete lines as they arrive; only the unfinished last line is
+// kept in the response buffer.
+static size_t stream_callback(void *ptr, size_t size, size_t nmemb, void *userdata) {
+    size_t real_size = size * nmemb;
+    llm_handle_t *handle = (llm_handle_t*)userdata;
+
+    // A regular JSON body (usually an error) is buffered as a whole
+    if (handle->size == 0 && handle->events == 0 && !handle->plain && real_size > 0) {
+        const char *p = (const char*)ptr;
+        size_t i = 0;
+        while (i < real_size && (p[i] == ' ' || p[i] == '\r' || p[i] == '\n')) i++;
+        handle->plain = i < real_size && p[i] == '{';
+    }
+    if (buffer_append(&handle->response, &handle->size, &handle->capacity, ptr, real_size) != 0) return 0;
+    if (handle->plain) return real_size;
+
+    char *line = handle->response;
+    char *nl;
+    while ((nl = memchr(line, '\n', handle->size - (line - handle->response))) != NULL) {
+        *nl = 0;
+        if (nl > line && nl[-1] == '\r') nl[-1] = 0;
+        handle_event_line(handle, line);
+        line = nl + 1;
+    }
+    handle->size -= line - handle->response;
+    memmove(handle->response, line, handle->size);
+    handle->response[handle->size] = 0;
+
+    if (handle->max_tokens > 0 && handle->content_tokens > handle->max_tokens) {
+        handle->cut_off = 1;
+        return 0; // Aborts the transfer
+    }
+    return real_size;
+}
+
+static size_t header_callback(char *buffer, size_t size, size_t nitems, void *userdata) {
+    llm_handle_t *handle = (llm_handle_t*)userdata;
+    rate_limit_parse_header(&handle->limits, buffer, size * nitems);
+    return size * nitems;
+}
+
+int llm_client_init(config_t *config) {
+    pthread_mutex_lock(&client_lock);
+    if (client_ready) {
+        pthread_mutex_unlock(&client_lock);
+        return 0;
+    }
+
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        pthread_mutex_init(&share_locks[i], NULL);
+    }
+
+    // DNS results, TLS sessions and open connections are shared by every
+    // thread's handle, so a worker never pays for a handshake another
+    // worker has already done.
+    share = curl_share_init();
+    if (share) {
+        curl_share_setopt(share, CURLSHOPT_LOCKFUNC, share_lock);
+        curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    }
+
+    // Use configured API KEY or empty string if not provided (some local LLMs don't need it)
+    char auth_header[256];
+    snprintf(auth_header, sizeof(auth_header), "Authorization: Bearer %s", config->api_key ? config->api_key : "lm-studio");
+    headers = curl_slist_append(headers, "Content-Type: application/json");
+    headers = curl_slist_append(headers, auth_header);
+
+    // Use configured endpoint or default to OpenAI
+    endpoint = strdup(config->api_endpoint ? config->api_endpoint : DEFAULT_ENDPOINT);
+
+    rate_limit_init(config);
+
+    pthread_key_create(&handle_key, free_handle);
+    client_ready = 1;
+    pthread_mutex_unlock(&client_lock);
+    return 0;
+}
+
+void llm_client_cleanup(void) {
+    pthread_mutex_lock(&client_lock);
+    if (!client_ready) {
+        pthread_mutex_unlock(&client_lock);
+        return;
+    }
+
+    // The calling thread's handle is not covered by the key destructor
+    free_handle(pthread_getspecific(handle_key));
+    pthread_setspecific(handle_key, NULL);
+    pthread_key_delete(handle_key);
+
+    if (share) curl_share_cleanup(share);
+    share = NULL;
+    curl_slist_free_all(headers);
+    headers = NULL;
+    free(endpoint);
+    endpoint = NULL;
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        pthread_mutex_destroy(&share_locks[i]);
+    }
+    client_ready = 0;
+    pthread_mutex_unlock(&client_lock);
+}
+
+// Returns the calling thread's handle, creating it on first use.
+// Options that do not change between requests are set only here.
+static llm_handle_t* get_handle(void) {
+    llm_handle_t *handle = pthread_getspecific(handle_key);
+    if (handle) return handle;
+
+    handle = calloc(1, sizeof(llm_handle_t));
+    if (!handle) return NULL;
+    handle->curl = curl_easy_init();
+    if (!handle->curl) {
+        free(handle);
+        return NULL;
+    }
+
+    CURL *curl = handle->curl;
+    curl_easy_setopt(curl, CURLOPT_URL, endpoint);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    if (share) curl_easy_setopt(curl, CURLOPT_SHARE, share);
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+    // No CURLOPT_PIPEWAIT: with blocking handles sharing one connection
+    // cache, a handle waiting to multiplex on a busy HTTP/1.1 connection
+    // never gets it and the request hangs.
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L); // Required with multiple threads
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, handle);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, handle);
+
+    pthread_setspecific(handle_key, handle);
+    return handle;
+}
+
+// Extracts choices[0].message.content from a chat-completion response
+// and stores its usage in the handle
+static char* parse_content(const char *response, llm_handle_t *handle, arena_t *arena) {
+    if (!handle->legacy_json) {
+        json_reply_t reply;
+        json_buffer_reset(&handle->content);
+        if (json_extract_reply(response, strlen(response), &reply, &handle->content) == 0) {
+            apply_reply(handle, &reply);
+            if (reply.has_content) {
+                return arena ? arena_strdup(arena, handle->content.data) : strdup(handle->content.data);
+            }
+            fprintf(stderr, "Unexpected LLM response: %s\n", response);
+            return NULL;
+        }
+        // Not well-formed: json-c reports the error below
+    }
+
+    char *content_text = NULL;
+    struct json_object *parsed = json_tokener_parse(response);
+    if (!parsed) {
+        fprintf(stderr, "Failed to parse JSON response: %s\n", response);
+        return NULL;
+    }
+
+    read_usage(parsed, handle);
+
+    struct json_object *choices, *choice, *message, *content;
+    if (json_object_object_get_ex(parsed, "choices", &choices) &&
+        (choice = json_object_array_get_idx(choices, 0)) &&
+        json_object_object_get_ex(choice, "message", &message) &&
+        json_object_object_get_ex(message, "content", &content)) {
+        const char *text = json_object_get_string(content);
+        content_text = arena ? arena_strdup(arena, text) : strdup(text);
+    } else {
+        fprintf(stderr, "Unexpected LLM response: %s\n", response);
+    }
+    json_object_put(parsed);
+    return content_text;
+}
+
+// Transport errors worth another attempt
+static int is_transient(CURLcode res) {
+    switch (res) {
+        case CURLE_COULDNT_RESOLVE_HOST:
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_OPERATION_TIMEDOUT:
+        case CURLE_SEND_ERROR:
+        case CURLE_RECV_ERROR:
+        case CURLE_GOT_NOTHING:
+        case CURLE_PARTIAL_FILE:
+        case CURLE_HTTP2:
+        case CURLE_HTTP2_STREAM:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// Feeds timing and transfer sizes of the finished attempt to the metrics
+static void record_attempt(CURL *curl, long status) {
+    metrics_request_t m = { .status = status };
+    curl_off_t total = 0, first_byte = 0, uploaded = 0, downloaded = 0;
+    long request_size = 0, header_size = 0;
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+    curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &first_byte);
+    curl_easy_getinfo(curl, CURLINFO_SIZE_UPLOAD_T, &uploaded);
+    curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &downloaded);
+    curl_easy_getinfo(curl, CURLINFO_REQUEST_SIZE, &request_size);
+    curl_easy_getinfo(curl, CURLINFO_HEADER_SIZE, &header_size);
+    m.seconds = total / 1e6;
+    m.first_byte = first_byte / 1e6;
+    m.bytes_sent = request_size + (long)uploaded;
+    m.bytes_received = header_size + (long)downloaded;
+    metrics_record_request(&m);
+}
+
+int llm_write_body(json_buffer_t *b, config_t *config, const llm_request_t *request, int stream) {
+    json_buffer_reset(b);
+    int rc = json_write_raw(b, "{\"model\":");
+    rc |= json_write_string(b, config->model);
+    rc |= json_write_raw(b, ",\"messages\":[{\"role\":\"system\",\"content\":");
+    rc |= json_write_string(b, request->system_prompt);
+    rc |= json_write_raw(b, "},{\"role\":\"user\",\"content\":");
+    rc |= json_write_string(b, request->user_content);
+    rc |= json_write_raw(b, "}],\"temperature\":");
+    rc |= json_write_double(b, request->temperature);
+    if (stream) {
+        // Without stream_options, streams carry no usage block
+        rc |= json_write_raw(b, ",\"stream\":true,\"stream_options\":{\"include_usage\":true}");
+    }
+    rc |= json_write_raw(b, "}");
+    return rc ? -1 : 0;
+}
+
+const char* llm_endpoint_path(config_t *config) {
+    const char *url = config->api_endpoint ? config->api_endpoint : DEFAULT_ENDPOINT;
+    const char *host = strstr(url, "://");
+    const char *path = host ? strchr(host + 3, '/') : NULL;
+    return path ? path : "/v1/chat/completions";
+}
+
+// The same body built with json-c (config->legacy_json)
+static struct json_object* build_legacy_payload(config_t *config, const llm_request_t *request) {
+    struct json_object *payload = json_object_new_object();
+    json_object_object_add(payload, "model", json_object_new_string(config->model));
+
+    struct json_object *messages = json_object_new_array();
+
+    struct json_object *sys_msg = json_object_new_object();
+    json_object_object_add(sys_msg, "role", json_object_new_string("system"));
+    json_object_object_add(sys_msg, "content", json_object_new_string(request->system_prompt));
+    json_object_array_add(messages, sys_msg);
+
+    struct json_object *usr_msg = json_object_new_object();
+    json_object_object_add(usr_msg, "role", json_object_new_string("user"));
+    json_object_object_add(usr_msg, "content", json_object_new_string(request->user_content));
+    json_object_array_add(messages, usr_msg);
+
+    json_object_object_add(payload, "messages", messages);
+    json_object_object_add(payload, "temperature", json_object_new_double(request->temperature));
+
+    if (config->stream) {
+        json_object_object_add(payload, "stream", json_object_new_boolean(1));
+        // Without this, streams carry no usage block
+        struct json_object *stream_options = json_object_new_object();
+        json_object_object_add(stream_options, "include_usage", json_object_new_boolean(1));
+        json_object_object_add(payload, "stream_options", stream_options);
+    }
+    return payload;
+}
+
+char* llm_chat(config_t *config, const llm_request_t *request) {
+    if (llm_client_init(config) != 0) return NULL;
+
+    llm_handle_t *handle = get_handle();
+    if (!handle) return NULL;
+
+    handle->legacy_json = config->legacy_json;
+    struct json_object *legacy_payload = NULL;
+    const char *post_fields;
+    size_t post_size;
+    if (handle->legacy_json) {
+        legacy_payload = build_legacy_payload(config, request);
+        post_fields = json_object_to_json_string(legacy_payload);
+        post_size = strlen(post_fields);
+    } else {
+        if (llm_write_body(&handle->payload, config, request, config->stream) != 0) {
+            fprintf(stderr, "Out of memory building LLM request\n");
+            return NULL;
+        }
+        post_fields = handle->payload.data;
+        post_size = handle->payload.size;
+    }
+
+    // The deadline grows with the expected reply instead of a flat limit.
+    // Streams additionally fail fast when the server goes quiet.
+    int expected = request->expected_tokens > 0 ? request->expected_tokens : count_tokens_str(request->user_content);
+    long timeout = BASE_TIMEOUT_SECONDS + expected / MIN_TOKENS_PER_SECOND;
+    long stall = config->stall_timeout > 0 ? config->stall_timeout : DEFAULT_STALL_TIMEOUT;
+    curl_easy_setopt(handle->curl, CURLOPT_TIMEOUT, timeout);
+    curl_easy_setopt(handle->curl, CURLOPT_LOW_SPEED_LIMIT, config->stream ? 1L : 0L);
+    curl_easy_setopt(handle->curl, CURLOPT_LOW_SPEED_TIME, config->stream ? stall : 0L);
+    curl_easy_setopt(handle->curl, CURLOPT_WRITEFUNCTION, config->stream ? stream_callback : write_callback);
+    curl_easy_setopt(handle->curl, CURLOPT_POSTFIELDS, post_fields);
+    curl_easy_setopt(handle->curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)post_size);
+
+    // Providers count the prompt and the reply against the token limit
+    int estimate = count_tokens_str(request->system_prompt) + count_tokens_str(request->user_content) + expected;
+    int max_retries = config->max_retries > 0 ? config->max_retries : DEFAULT_MAX_RETRIES;
+
+    char *result = NULL;
+    for (int attempt = 0; ; attempt++) {
+        rate_limit_acquire(estimate);
+
+        handle->size = 0;
+        if (handle->response) handle->response[0] = 0;
+        handle->plain = 0;
+        json_buffer_reset(&handle->content);
+        handle->content_tokens = 0;
+        handle->events = 0;
+        handle->cut_off = 0;
+        handle->usage_tokens = 0;
+        handle->prompt_tokens = 0;
+        handle->completion_tokens = 0;
+        handle->cached_tokens = 0;
+        handle->max_tokens = request->expected_tokens > 0 ? request->expected_tokens * RUNAWAY_RATIO + RUNAWAY_SLACK_TOKENS : 0;
+        rate_limit_headers_clear(&handle->limits);
+
+        CURLcode res = curl_easy_perform(handle->curl);
+        long status = 0;
+        curl_easy_getinfo(handle->curl, CURLINFO_RESPONSE_CODE, &status);
+        rate_limit_update(&handle->limits);
+        record_attempt(handle->curl, res == CURLE_OK ? status : 0);
+
+        int retry = 0;
+        if (handle->cut_off) {
+            fprintf(stderr, "Stopped a runaway reply after %d tokens (expected about %d)\n",
+                handle->content_tokens, request->expected_tokens);
+            break;
+        } else if (res != CURLE_OK) {
+            fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
+            retry = is_transient(res);
+        } else if (status == 429 || status == 408 || status >= 500) {
+            fprintf(stderr, "LLM request throttled or failed with HTTP %ld\n", status);
+            retry = 1;
+        } else if (status >= 400) {
+            fprintf(stderr, "LLM request rejected with HTTP %ld: %s\n", status, handle->response ? handle->response : "");
+            break;
+        } else {
+            if (config->stream && !handle->plain) {
+                if (handle->content.size > 0) {
+                    result = request->arena ? arena_strdup(request->arena, handle->content.data) : strdup(handle->content.data);
+                } else {
+                    fprintf(stderr, "Unexpected LLM stream: %s\n", handle->response ? handle->response : "");
+                }
+            } else if (handle->response) {
+                result = parse_content(handle->response, handle, request->arena);
+            }
+            if (handle->usage_tokens > 0) rate_limit_adjust(estimate, handle->usage_tokens);
+            metrics_record_usage(handle->prompt_tokens, handle->completion_tokens, handle->cached_tokens);
+            break;
+        }
+
+        if (!retry || attempt >= max_retries) {
+            if (retry) fprintf(stderr, "Giving up after %d attempts\n", attempt + 1);
+            break;
+        }
+        metrics_count(COUNTER_RETRIES, 1);
+        double delay = rate_limit_backoff(attempt, handle->limits.retry_after);
+        fprintf(stderr, "Retrying in %.1f s (attempt %d of %d)\n", delay, attempt + 2, max_retries + 1);
+    }
+
+    if (legacy_payload) json_object_put(legacy_payload);
+    return result;
+}
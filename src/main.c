@@ -2,36 +2,90 @@
 #include <stdlib.h>
 #include <string.h>
 #include "common.h"
-#include "epub.h"
-#include "context.h"
-#include "context_strategy.h"
+#include "pipeline.h"
+#include "llm_client.h"
+#include "cache.h"
+#include "metrics.h"
+#include "daemon.h"
+#include "batch_api.h"
+#include "glossary.h"
+#include <json-c/json.h>
+#include <sys/stat.h>
 #include <getopt.h>
+#include <unistd.h>
+#include <limits.h>
+#include <curl/curl.h>
+#include <libxml/parser.h>
 
-#define MAX_STRATEGIES 5
+// Long options without a short form
+enum {
+    OPT_CACHE = 256,
+    OPT_RESUME,
+    OPT_IN_MEMORY,
+    OPT_METRICS,
+    OPT_DAEMON,
+    OPT_SOCKET,
+    OPT_SPOOL,
+    OPT_SUBMIT,
+    OPT_STATUS,
+    OPT_PRIORITY,
+    OPT_BATCH_EXPORT,
+    OPT_BATCH_IMPORT,
+    OPT_GLOSSARY
+};
 
 void print_usage(const char *progname) {
     printf("Usage: %s [options] <input.epub> [output.epub]\n", progname);
+    printf("       %s [options] --daemon [--socket <path>] [--spool <dir>]\n", progname);
+    printf("       %s --socket <path> --submit [--priority <n>] [-l <code>] <input.epub> <output.epub>\n", progname);
+    printf("       %s --socket <path> --status\n", progname);
     printf("Options:\n");
     printf("  -c, --config <file>    Path to config.json (default: ./conf/config.json)\n");
     printf("  -l, --lang <code>      Target language code (overrides config)\n");
     printf("  -m, --model <name>     LLM model name (overrides config)\n");
     printf("  -C, --context <file>   Context file path (overrides config)\n");
+    printf("  -j, --jobs <n>         Number of chapters translated in parallel (overrides config)\n");
+    printf("      --cache <file>     Persistent translation cache file (overrides config)\n");
+    printf("      --glossary <file>  Forced translations, one \"term<TAB>translation\" per line (overrides config)\n");
+    printf("      --resume           Continue an interrupted run from its journal\n");
+    printf("      --in-memory        Translate straight from the input archive, without a temp directory\n");
+    printf("      --metrics <file>   Write a JSON metrics report (overrides config)\n");
+    printf("      --daemon           Keep running and translate the books submitted as jobs\n");
+    printf("      --socket <path>    Daemon socket (overrides config)\n");
+    printf("      --spool <dir>      Daemon spool directory (overrides config)\n");
+    printf("      --submit           Queue a book on a running daemon\n");
+    printf("      --status           Print the jobs of a running daemon\n");
+    printf("      --priority <n>     Priority of a submitted book (higher runs first, default 0)\n");
+    printf("      --batch-export <file>  Write the requests as JSONL for the provider's batch API\n");
+    printf("      --batch-import <file>  Build the output from a batch API result JSONL\n");
     printf("  -h, --help             Show this help message\n");
 }
 
-// Helper to read file content for context analysis
-char* read_file_content(const char *path) {
-    FILE *fp = fopen(path, "r");
-    if (!fp) return NULL;
-    fseek(fp, 0, SEEK_END);
-    long size = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
-    if (size <= 0) { fclose(fp); return NULL; }
-    char *buf = malloc(size + 1);
-    fread(buf, 1, size, fp);
-    buf[size] = 0;
-    fclose(fp);
-    return buf;
+// The daemon runs in another directory: paths are sent absolute
+static char* absolute_path(const char *path) {
+    if (path[0] == '/') return strdup(path);
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) return strdup(path);
+    size_t size = strlen(cwd) + strlen(path) + 2;
+    char *result = malloc(size);
+    if (result) snprintf(result, size, "%s/%s", cwd, path);
+    return result;
+}
+
+static char* build_submit_request(const char *input, const char *output, const char *lang, int priority) {
+    char *input_path = absolute_path(input);
+    char *output_path = absolute_path(output);
+    struct json_object *request = json_object_new_object();
+    json_object_object_add(request, "cmd", json_object_new_string("submit"));
+    json_object_object_add(request, "input", json_object_new_string(input_path ? input_path : input));
+    json_object_object_add(request, "output", json_object_new_string(output_path ? output_path : output));
+    if (lang) json_object_object_add(request, "lang", json_object_new_string(lang));
+    json_object_object_add(request, "priority", json_object_new_int(priority));
+    char *text = strdup(json_object_to_json_string_ext(request, JSON_C_TO_STRING_PLAIN));
+    json_object_put(request);
+    free(input_path);
+    free(output_path);
+    return text;
 }
 
 int main(int argc, char *argv[]) {
@@ -39,6 +93,17 @@ int main(int argc, char *argv[]) {
     char *target_lang = NULL;
     char *model_name = NULL;
     char *context_file_arg = NULL;
+    int jobs_arg = 0;
+    char *cache_file_arg = NULL;
+    char *glossary_arg = NULL;
+    int resume = 0;
+    int in_memory = 0;
+    char *metrics_file_arg = NULL;
+    int daemon_mode = 0, submit = 0, status = 0, priority = 0;
+    char *socket_arg = NULL;
+    char *spool_arg = NULL;
+    char *batch_export_arg = NULL;
+    char *batch_import_arg = NULL;
     char *input_file = NULL;
     char *output_file = NULL;
 
@@ -47,17 +112,45 @@ int main(int argc, char *argv[]) {
         {"lang",   required_argument, 0, 'l'},
         {"model",  required_argument, 0, 'm'},
         {"context",required_argument, 0, 'C'},
+        {"jobs",   required_argument, 0, 'j'},
+        {"cache",  required_argument, 0, OPT_CACHE},
+        {"glossary", required_argument, 0, OPT_GLOSSARY},
+        {"resume", no_argument,       0, OPT_RESUME},
+        {"in-memory", no_argument,    0, OPT_IN_MEMORY},
+        {"metrics", required_argument, 0, OPT_METRICS},
+        {"daemon", no_argument,       0, OPT_DAEMON},
+        {"socket", required_argument, 0, OPT_SOCKET},
+        {"spool",  required_argument, 0, OPT_SPOOL},
+        {"submit", no_argument,       0, OPT_SUBMIT},
+        {"status", no_argument,       0, OPT_STATUS},
+        {"priority", required_argument, 0, OPT_PRIORITY},
+        {"batch-export", required_argument, 0, OPT_BATCH_EXPORT},
+        {"batch-import", required_argument, 0, OPT_BATCH_IMPORT},
         {"help",   no_argument,       0, 'h'},
         {0, 0, 0, 0}
     };
 
     int opt;
-    while ((opt = getopt_long(argc, argv, "c:l:m:C:h", long_options, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "c:l:m:C:j:h", long_options, NULL)) != -1) {
         switch (opt) {
             case 'c': config_path = optarg; break;
             case 'l': target_lang = optarg; break;
             case 'm': model_name = optarg; break;
             case 'C': context_file_arg = optarg; break;
+            case 'j': jobs_arg = atoi(optarg); break;
+            case OPT_CACHE: cache_file_arg = optarg; break;
+            case OPT_GLOSSARY: glossary_arg = optarg; break;
+            case OPT_RESUME: resume = 1; break;
+            case OPT_IN_MEMORY: in_memory = 1; break;
+            case OPT_METRICS: metrics_file_arg = optarg; break;
+            case OPT_DAEMON: daemon_mode = 1; break;
+            case OPT_SOCKET: socket_arg = optarg; break;
+            case OPT_SPOOL: spool_arg = optarg; break;
+            case OPT_SUBMIT: submit = 1; break;
+            case OPT_STATUS: status = 1; break;
+            case OPT_PRIORITY: priority = atoi(optarg); break;
+            case OPT_BATCH_EXPORT: batch_export_arg = optarg; break;
+            case OPT_BATCH_IMPORT: batch_import_arg = optarg; break;
             case 'h': print_usage(argv[0]); return 0;
             default: print_usage(argv[0]); return 1;
         }
@@ -70,22 +163,50 @@ int main(int argc, char *argv[]) {
         output_file = argv[optind++];
     }
 
-#include <unistd.h>
-#include <limits.h>
-
-// ... (keep print_usage and start of main)
-
-    if (!input_file) {
+    if (!input_file && !daemon_mode && !status) {
         fprintf(stderr, "Error: Input EPUB file is required.\n");
         print_usage(argv[0]);
         return 1;
     }
+    if (submit && !output_file) {
+        fprintf(stderr, "Error: --submit needs an output file.\n");
+        return 1;
+    }
+
+    if (batch_export_arg && batch_import_arg) {
+        fprintf(stderr, "Error: --batch-export and --batch-import are separate runs.\n");
+        return 1;
+    }
+    if ((batch_export_arg || batch_import_arg) && (daemon_mode || submit || status)) {
+        fprintf(stderr, "Error: The batch API options translate a single book.\n");
+        return 1;
+    }
 
-    if (access(input_file, F_OK) == -1) {
+    if (input_file && access(input_file, F_OK) == -1) {
         fprintf(stderr, "Error: Input file '%s' does not exist.\n", input_file);
         return 1;
     }
 
+    // Client of a running daemon: no config or LLM setup needed
+    if (submit || status) {
+        char *socket_path = socket_arg;
+        config_t *client_config = NULL;
+        if (!socket_path) {
+            client_config = load_config(config_path);
+            socket_path = client_config ? client_config->daemon_socket : NULL;
+        }
+        if (!socket_path) {
+            fprintf(stderr, "Error: No daemon socket (--socket or \"daemon_socket\").\n");
+            free_config(client_config);
+            return 1;
+        }
+        char *request = status ? strdup("{\"cmd\":\"status\"}") : build_submit_request(input_file, output_file, target_lang, priority);
+        int rc = request ? daemon_request(socket_path, request, stdout) : -1;
+        free(request);
+        free_config(client_config);
+        return rc == 0 ? 0 : 1;
+    }
+
     // 1. Try CLI argument (already handled by getopt)
     
     // 2. Try default local path
@@ -96,10 +217,15 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    // Both libraries must be initialised before any worker thread uses them
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    xmlInitParser();
+
     config_t *config = load_config(config_path);
     if (!config) {
         fprintf(stderr, "Warning: Could not load config from '%s'. Using default values.\n", config_path);
         config = calloc(1, sizeof(config_t));
+        config->context_max_lag = -1;
     }
 
     // Apply CLI overrides
@@ -115,127 +241,85 @@ int main(int argc, char *argv[]) {
         free(config->context_file);
         config->context_file = strdup(context_file_arg);
     }
+    if (cache_file_arg) {
+        free(config->cache_file);
+        config->cache_file = strdup(cache_file_arg);
+    }
+    if (glossary_arg) {
+        free(config->glossary_file);
+        config->glossary_file = strdup(glossary_arg);
+    }
+    if (jobs_arg > 0) {
+        config->workers = jobs_arg;
+    }
+    if (in_memory) {
+        config->in_memory = 1;
+    }
+    if (metrics_file_arg) {
+        free(config->metrics_file);
+        config->metrics_file = strdup(metrics_file_arg);
+    }
+    if (socket_arg) {
+        free(config->daemon_socket);
+        config->daemon_socket = strdup(socket_arg);
+    }
+    if (spool_arg) {
+        free(config->daemon_spool);
+        config->daemon_spool = strdup(spool_arg);
+    }
+    if (batch_export_arg) config->batch_export_file = strdup(batch_export_arg);
+    if (batch_import_arg) config->batch_import_file = strdup(batch_import_arg);
 
     if (!config->target_language) config->target_language = strdup("en");
     if (!config->model) config->model = strdup("gpt-4o");
+    if (config->workers < 1) config->workers = 1;
+    if (config->context_max_lag < 0) config->context_max_lag = config->workers > 1 ? config->workers - 1 : 1;
 
-    printf("--- Session Configuration ---\n");
-    printf("Input:      %s\n", input_file);
-    printf("Output:     %s\n", output_file ? output_file : "translated.epub");
-    printf("Provider:   %s\n", config->llm_provider ? config->llm_provider : "unknown");
-    printf("Model:      %s\n", config->model);
-    printf("Target:     %s\n", config->target_language);
-    printf("----------------------------\n");
-
-    const char *temp_dir = "build/temp_epub";
-    if (extract_epub(input_file, temp_dir) != 0) {
-        fprintf(stderr, "Failed to extract EPUB\n");
+    metrics_init(config);
+    llm_client_init(config);
+    cache_init(config);
+    if (batch_api_init(config) != 0 || glossary_init(config) != 0) {
+        batch_api_cleanup();
+        metrics_shutdown();
+        llm_client_cleanup();
+        cache_cleanup();
         free_config(config);
+        xmlCleanupParser();
+        curl_global_cleanup();
         return 1;
     }
 
-    epub_metadata_t *meta = parse_epub_metadata(temp_dir);
-    if (!meta) {
-        fprintf(stderr, "Failed to parse EPUB metadata\n");
-        free_config(config);
-        return 1;
-    }
-
-    // Initialize Strategies
-    ContextStrategy *strategies[MAX_STRATEGIES];
-    int strategy_count = 0;
-
-    // 1. History Strategy
-    if (config->context_file) {
-        ContextStrategy *hist = create_history_strategy();
-        hist->state = hist->init(config);
-        if (hist->state) {
-            strategies[strategy_count++] = hist;
-            printf("Strategy Enabled: %s\n", hist->name);
-        } else {
-            free(hist);
-        }
-    }
-
-    // 2. Sliding Window Strategy
-    if (config->sliding_window_size > 0) {
-        ContextStrategy *win = create_sliding_window_strategy();
-        win->state = win->init(config);
-        if (win->state) {
-            strategies[strategy_count++] = win;
-            printf("Strategy Enabled: %s\n", win->name);
-        } else {
-            free(win);
-        }
-    }
-
-    // Iterate spine and translate each XHTML file
-    for (int i = 0; i < meta->spine_count; i++) {
-        char *idref = meta->spine[i];
-        for (int j = 0; j < meta->manifest_count; j++) {
-            if (strcmp(meta->manifest[j].name, idref) == 0) {
-                char xhtml_path[PATH_MAX];
-                if (meta->base_dir && strlen(meta->base_dir) > 0) {
-                    snprintf(xhtml_path, sizeof(xhtml_path), "%s/%s/%s", temp_dir, meta->base_dir, meta->manifest[j].href);
-                } else {
-                    snprintf(xhtml_path, sizeof(xhtml_path), "%s/%s", temp_dir, meta->manifest[j].href);
-                }
-                
-                printf("Processing chapter %d/%d: %s...\n", i+1, meta->spine_count, idref);
-
-                // Prepare context string from ALL strategies
-                // We'll concatenate them
-                char *combined_context = calloc(1, 1);
-                for (int s = 0; s < strategy_count; s++) {
-                    char *prompt_chunk = strategies[s]->get_prompt(strategies[s]->state, config);
-                    if (prompt_chunk) {
-                        size_t new_len = strlen(combined_context) + strlen(prompt_chunk) + 2;
-                        combined_context = realloc(combined_context, new_len);
-                        strcat(combined_context, prompt_chunk);
-                        strcat(combined_context, "\n"); // Separator
-                        free(prompt_chunk);
-                    }
-                }
-
-                // Translate
-                if (translate_xhtml(xhtml_path, config, combined_context) != 0) {
-                    fprintf(stderr, "Failed to translate %s\n", xhtml_path);
-                }
-                free(combined_context);
-
-                // Update Strategies
-                // We read the translated file? Or original? 
-                // Currently context.c uses original for summary, but sliding window might want translated...
-                // The current implementation of translate_xhtml replaces content IN PLACE.
-                // So reading xhtml_path NOW gives us TRANSLATED content (mostly).
-                // Actually, translate_xhtml writes to the file.
-                
-                char *content = read_file_content(xhtml_path); 
-                if (content) {
-                    for (int s = 0; s < strategy_count; s++) {
-                        strategies[s]->update(strategies[s]->state, content, config);
-                    }
-                    free(content);
-                }
-                break;
-            }
-        }
-    }
-
-    // Cleanup Strategies
-    for (int s = 0; s < strategy_count; s++) {
-        strategies[s]->cleanup(strategies[s]->state);
-        free(strategies[s]);
+    printf("--- Session Configuration ---\n");
+    if (!daemon_mode) {
+        printf("Input:      %s\n", input_file);
+        printf("Output:     %s\n", output_file ? output_file : "translated.epub");
     }
+    printf("Provider:   %s\n", config->llm_provider ? config->llm_provider : "unknown");
+    printf("Model:      %s\n", config->model);
+    printf("Target:     %s\n", config->target_language);
+    printf("Workers:    %d\n", config->workers);
+    printf("----------------------------\n");
 
-    const char *final_output = output_file ? output_file : "translated.epub";
-    if (archive_epub(final_output, temp_dir) != 0) {
-        fprintf(stderr, "Failed to create output EPUB\n");
+    int rc;
+    if (daemon_mode) {
+        rc = daemon_run(config);
     } else {
-        printf("Success! Translated EPUB saved to %s\n", final_output);
+        pipeline_book_t book = {
+            .input = input_file,
+            .output = output_file,
+            .resume = resume
+        };
+        rc = pipeline_translate_book(config, NULL, &book);
     }
+    metrics_print_summary(stdout);
+    metrics_shutdown();
 
-    free_epub_metadata(meta);
+    llm_client_cleanup();
+    cache_cleanup();
+    batch_api_cleanup();
+    glossary_cleanup();
     free_config(config);
-    return 0;
+    xmlCleanupParser();
+    curl_global_cleanup();
+    return rc == 0 ? 0 : 1;
 }
@@ -0,0 +1,355 @@
+#include "metrics.h"
+#include <json-c/json.h>
+#include <pthread.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+
+// Seconds between periodic reports (config default)
+#define DEFAULT_METRICS_INTERVAL 10
+
+// Upper bounds of the latency histogram buckets, in seconds. The last
+// bucket (+Inf) is implicit.
+static const double bucket_bounds[] = { 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 20, 30, 60, 120, 300 };
+#define BUCKET_COUNT (sizeof(bucket_bounds) / sizeof(bucket_bounds[0]) + 1)
+
+typedef struct {
+    long buckets[BUCKET_COUNT];   // Not cumulative
+    long count;
+    double sum;
+    double max;
+} histogram_t;
+
+typedef struct {
+    histogram_t latency;
+    histogram_t first_byte;
+    long requests_ok;
+    long requests_throttled;      // HTTP 429
+    long requests_failed;         // Other HTTP errors and transport errors
+    long prompt_tokens;
+    long completion_tokens;
+    long cached_tokens;
+    long bytes_sent;
+    long bytes_received;
+    long counters[COUNTER_COUNT];
+    double stages[STAGE_COUNT];
+} metrics_t;
+
+static const char *stage_names[STAGE_COUNT] = { "extract", "parse", "translate", "context_update", "archive" };
+static const char *counter_names[COUNTER_COUNT] = {
+    "retries", "cache_hits", "cache_misses", "journal_replays", "chapters_done", "chapters_failed",
+    "arena_allocations", "arena_bytes", "arena_heap_blocks", "prefiltered",
+    "langid_skipped", "langid_skipped_tokens", "glossary_terms", "glossary_misses"
+};
+
+static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t metrics_wake = PTHREAD_COND_INITIALIZER;
+static metrics_t metrics;
+static int metrics_ready = 0;
+static double start_time = 0;
+static char *json_path = NULL;
+static char *prometheus_path = NULL;
+static int interval = 0;
+static pthread_t writer_thread;
+static int writer_running = 0;
+static int writer_stop = 0;
+
+double metrics_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void histogram_add(histogram_t *h, double value) {
+    size_t i = 0;
+    while (i < BUCKET_COUNT - 1 && value > bucket_bounds[i]) i++;
+    h->buckets[i]++;
+    h->count++;
+    h->sum += value;
+    if (value > h->max) h->max = value;
+}
+
+// Estimates a quantile by interpolating inside the bucket that holds it
+static double histogram_quantile(const histogram_t *h, double q) {
+    if (h->count == 0) return 0;
+    double rank = q * h->count;
+    long seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; i++) {
+        if (h->buckets[i] == 0 || seen + h->buckets[i] < rank) {
+            seen += h->buckets[i];
+            continue;
+        }
+        double lower = i > 0 ? bucket_bounds[i - 1] : 0;
+        double upper = i < BUCKET_COUNT - 1 ? bucket_bounds[i] : h->max;
+        if (upper > h->max) upper = h->max;
+        if (lower > upper) lower = upper;
+        return lower + (upper - lower) * (rank - seen) / h->buckets[i];
+    }
+    return h->max;
+}
+
+void metrics_record_request(const metrics_request_t *request) {
+    pthread_mutex_lock(&metrics_lock);
+    histogram_add(&metrics.latency, request->seconds);
+    if (request->first_byte > 0) histogram_add(&metrics.first_byte, request->first_byte);
+    if (request->status == 429) metrics.requests_throttled++;
+    else if (request->status >= 200 && request->status < 300) metrics.requests_ok++;
+    else metrics.requests_failed++;
+    metrics.bytes_sent += request->bytes_sent;
+    metrics.bytes_received += request->bytes_received;
+    pthread_mutex_unlock(&metrics_lock);
+}
+
+void metrics_record_usage(long prompt_tokens, long completion_tokens, long cached_tokens) {
+    pthread_mutex_lock(&metrics_lock);
+    metrics.prompt_tokens += prompt_tokens;
+    metrics.completion_tokens += completion_tokens;
+    metrics.cached_tokens += cached_tokens;
+    pthread_mutex_unlock(&metrics_lock);
+}
+
+void metrics_count(metrics_counter_t counter, long amount) {
+    pthread_mutex_lock(&metrics_lock);
+    metrics.counters[counter] += amount;
+    pthread_mutex_unlock(&metrics_lock);
+}
+
+void metrics_add_stage_time(metrics_stage_t stage, double seconds) {
+    pthread_mutex_lock(&metrics_lock);
+    metrics.stages[stage] += seconds;
+    pthread_mutex_unlock(&metrics_lock);
+}
+
+static void snapshot(metrics_t *out, double *elapsed) {
+    pthread_mutex_lock(&metrics_lock);
+    *out = metrics;
+    *elapsed = metrics_now() - start_time;
+    pthread_mutex_unlock(&metrics_lock);
+}
+
+static struct json_object* histogram_json(const histogram_t *h) {
+    struct json_object *obj = json_object_new_object();
+    json_object_object_add(obj, "count", json_object_new_int64(h->count));
+    json_object_object_add(obj, "sum_seconds", json_object_new_double(h->sum));
+    json_object_object_add(obj, "p50_seconds", json_object_new_double(histogram_quantile(h, 0.50)));
+    json_object_object_add(obj, "p90_seconds", json_object_new_double(histogram_quantile(h, 0.90)));
+    json_object_object_add(obj, "p99_seconds", json_object_new_double(histogram_quantile(h, 0.99)));
+    json_object_object_add(obj, "max_seconds", json_object_new_double(h->max));
+
+    struct json_object *buckets = json_object_new_array();
+    long cumulative = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; i++) {
+        cumulative += h->buckets[i];
+        struct json_object *bucket = json_object_new_object();
+        if (i < BUCKET_COUNT - 1) {
+            json_object_object_add(bucket, "le", json_object_new_double(bucket_bounds[i]));
+        } else {
+            json_object_object_add(bucket, "le", json_object_new_string("+Inf"));
+        }
+        json_object_object_add(bucket, "count", json_object_new_int64(cumulative));
+        json_object_array_add(buckets, bucket);
+    }
+    json_object_object_add(obj, "buckets", buckets);
+    return obj;
+}
+
+static char* format_json(const metrics_t *m, double elapsed) {
+    struct json_object *root = json_object_new_object();
+    json_object_object_add(root, "elapsed_seconds", json_object_new_double(elapsed));
+
+    struct json_object *requests = json_object_new_object();
+    json_object_object_add(requests, "ok", json_object_new_int64(m->requests_ok));
+    json_object_object_add(requests, "throttled", json_object_new_int64(m->requests_throttled));
+    json_object_object_add(requests, "failed", json_object_new_int64(m->requests_failed));
+    json_object_object_add(requests, "latency", histogram_json(&m->latency));
+    json_object_object_add(requests, "time_to_first_byte", histogram_json(&m->first_byte));
+    json_object_object_add(root, "requests", requests);
+
+    struct json_object *tokens = json_object_new_object();
+    json_object_object_add(tokens, "prompt", json_object_new_int64(m->prompt_tokens));
+    json_object_object_add(tokens, "completion", json_object_new_int64(m->completion_tokens));
+    json_object_object_add(tokens, "cached_prompt", json_object_new_int64(m->cached_tokens));
+    json_object_object_add(root, "tokens", tokens);
+
+    struct json_object *bytes = json_object_new_object();
+    json_object_object_add(bytes, "sent", json_object_new_int64(m->bytes_sent));
+    json_object_object_add(bytes, "received", json_object_new_int64(m->bytes_received));
+    json_object_object_add(root, "bytes", bytes);
+
+    for (int c = 0; c < COUNTER_COUNT; c++) {
+        json_object_object_add(root, counter_names[c], json_object_new_int64(m->counters[c]));
+    }
+
+    struct json_object *stages = json_object_new_object();
+    for (int s = 0; s < STAGE_COUNT; s++) {
+        json_object_object_add(stages, stage_names[s], json_object_new_double(m->stages[s]));
+    }
+    json_object_object_add(root, "stage_seconds", stages);
+
+    char *text = strdup(json_object_to_json_string_ext(root, JSON_C_TO_STRING_PRETTY));
+    json_object_put(root);
+    return text;
+}
+
+static void write_histogram(FILE *fp, const char *name, const char *help, const histogram_t *h) {
+    fprintf(fp, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    long cumulative = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; i++) {
+        cumulative += h->buckets[i];
+        if (i < BUCKET_COUNT - 1) {
+            fprintf(fp, "%s_bucket{le=\"%g\"} %ld\n", name, bucket_bounds[i], cumulative);
+        } else {
+            fprintf(fp, "%s_bucket{le=\"+Inf\"} %ld\n", name, cumulative);
+        }
+    }
+    fprintf(fp, "%s_sum %f\n%s_count %ld\n", name, h->sum, name, h->count);
+}
+
+static void write_counter(FILE *fp, const char *name, const char *help, long value) {
+    fprintf(fp, "# HELP %s %s\n# TYPE %s counter\n%s %ld\n", name, help, name, name, value);
+}
+
+static void write_prometheus(FILE *fp, const metrics_t *m, double elapsed) {
+    fprintf(fp, "# HELP epubtrans_elapsed_seconds Time since the run started.\n"
+                "# TYPE epubtrans_elapsed_seconds gauge\nepubtrans_elapsed_seconds %f\n", elapsed);
+    write_histogram(fp, "epubtrans_request_duration_seconds", "Duration of LLM request attempts.", &m->latency);
+    write_histogram(fp, "epubtrans_time_to_first_byte_seconds", "Time to the first response byte.", &m->first_byte);
+
+    fprintf(fp, "# HELP epubtrans_requests_total LLM request attempts by outcome.\n# TYPE epubtrans_requests_total counter\n");
+    fprintf(fp, "epubtrans_requests_total{outcome=\"ok\"} %ld\n", m->requests_ok);
+    fprintf(fp, "epubtrans_requests_total{outcome=\"throttled\"} %ld\n", m->requests_throttled);
+    fprintf(fp, "epubtrans_requests_total{outcome=\"failed\"} %ld\n", m->requests_failed);
+
+    write_counter(fp, "epubtrans_prompt_tokens_total", "Prompt tokens reported by the provider.", m->prompt_tokens);
+    write_counter(fp, "epubtrans_completion_tokens_total", "Completion tokens reported by the provider.", m->completion_tokens);
+    write_counter(fp, "epubtrans_cached_prompt_tokens_total", "Prompt tokens served from the provider's prefix cache.", m->cached_tokens);
+    write_counter(fp, "epubtrans_sent_bytes_total", "Bytes sent to the LLM endpoint.", m->bytes_sent);
+    write_counter(fp, "epubtrans_received_bytes_total", "Bytes received from the LLM endpoint.", m->bytes_received);
+    for (int c = 0; c < COUNTER_COUNT; c++) {
+        char name[64];
+        snprintf(name, sizeof(name), "epubtrans_%s_total", counter_names[c]);
+        write_counter(fp, name, counter_names[c], m->counters[c]);
+    }
+
+    fprintf(fp, "# HELP epubtrans_stage_seconds Time spent per pipeline stage.\n# TYPE epubtrans_stage_seconds gauge\n");
+    for (int s = 0; s < STAGE_COUNT; s++) {
+        fprintf(fp, "epubtrans_stage_seconds{stage=\"%s\"} %f\n", stage_names[s], m->stages[s]);
+    }
+}
+
+// Writes through a temporary file and renames it, so readers (and the
+// Prometheus textfile collector) never see a partial report
+static int write_report(const char *path, const metrics_t *m, double elapsed, int prometheus) {
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *fp = fopen(tmp_path, "w");
+    if (!fp) {
+        fprintf(stderr, "Failed to write metrics to %s\n", tmp_path);
+        return -1;
+    }
+    if (prometheus) {
+        write_prometheus(fp, m, elapsed);
+    } else {
+        char *text = format_json(m, elapsed);
+        fprintf(fp, "%s\n", text);
+        free(text);
+    }
+    if (fclose(fp) != 0 || rename(tmp_path, path) != 0) {
+        fprintf(stderr, "Failed to write metrics to %s\n", path);
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+static void write_reports(void) {
+    metrics_t m;
+    double elapsed;
+    snapshot(&m, &elapsed);
+    if (json_path) write_report(json_path, &m, elapsed, 0);
+    if (prometheus_path) write_report(prometheus_path, &m, elapsed, 1);
+}
+
+static void* writer_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&metrics_lock);
+    while (!writer_stop) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += interval;
+        pthread_cond_timedwait(&metrics_wake, &metrics_lock, &deadline);
+        if (writer_stop) break;
+        pthread_mutex_unlock(&metrics_lock);
+        write_reports();
+        pthread_mutex_lock(&metrics_lock);
+    }
+    pthread_mutex_unlock(&metrics_lock);
+    return NULL;
+}
+
+void metrics_init(config_t *config) {
+    pthread_mutex_lock(&metrics_lock);
+    if (metrics_ready) {
+        pthread_mutex_unlock(&metrics_lock);
+        return;
+    }
+    start_time = metrics_now();
+    json_path = config->metrics_file ? strdup(config->metrics_file) : NULL;
+    prometheus_path = config->metrics_prometheus_file ? strdup(config->metrics_prometheus_file) : NULL;
+    interval = config->metrics_interval != 0 ? config->metrics_interval : DEFAULT_METRICS_INTERVAL;
+    metrics_ready = 1;
+
+    if ((json_path || prometheus_path) && interval > 0) {
+        writer_stop = 0;
+        writer_running = pthread_create(&writer_thread, NULL, writer_main, NULL) == 0;
+    }
+    pthread_mutex_unlock(&metrics_lock);
+}
+
+void metrics_shutdown(void) {
+    pthread_mutex_lock(&metrics_lock);
+    if (!metrics_ready) {
+        pthread_mutex_unlock(&metrics_lock);
+        return;
+    }
+    writer_stop = 1;
+    pthread_cond_broadcast(&metrics_wake);
+    pthread_mutex_unlock(&metrics_lock);
+    if (writer_running) pthread_join(writer_thread, NULL);
+    writer_running = 0;
+
+    write_reports();
+
+    pthread_mutex_lock(&metrics_lock);
+    free(json_path);
+    json_path = NULL;
+    free(prometheus_path);
+    prometheus_path = NULL;
+    metrics_ready = 0;
+    pthread_mutex_unlock(&metrics_lock);
+}
+
+void metrics_print_summary(FILE *out) {
+    metrics_t m;
+    double elapsed;
+    snapshot(&m, &elapsed);
+
+    long requests = m.requests_ok + m.requests_throttled + m.requests_failed;
+    fprintf(out, "Stage times: extract %.2f s, parse %.2f s, translate %.2f s, context update %.2f s, archive %.2f s\n",
+        m.stages[STAGE_EXTRACT], m.stages[STAGE_PARSE], m.stages[STAGE_TRANSLATE],
+        m.stages[STAGE_CONTEXT], m.stages[STAGE_ARCHIVE]);
+    fprintf(out, "Requests: %ld (%ld throttled, %ld failed, %ld retries), latency p50 %.2f s, p99 %.2f s\n",
+        requests, m.requests_throttled, m.requests_failed, m.counters[COUNTER_RETRIES],
+        histogram_quantile(&m.latency, 0.50), histogram_quantile(&m.latency, 0.99));
+    fprintf(out, "Tokens: %ld prompt (%ld cached by the provider, %.0f%%), %ld completion; cache: %ld hits, %ld misses\n",
+        m.prompt_tokens, m.cached_tokens, m.prompt_tokens > 0 ? 100.0 * m.cached_tokens / m.prompt_tokens : 0.0,
+        m.completion_tokens, m.counters[COUNTER_CACHE_HITS], m.counters[COUNTER_CACHE_MISSES]);
+    fprintf(out, "Skipped: %ld texts without words, %ld segments (%ld tokens) already in the target language\n",
+        m.counters[COUNTER_PREFILTERED], m.counters[COUNTER_LANGID_SKIPPED], m.counters[COUNTER_LANGID_SKIPPED_TOKENS]);
+    if (m.counters[COUNTER_GLOSSARY_TERMS] > 0) {
+        fprintf(out, "Glossary: %ld terms in translated text, %ld without their forced translation\n",
+            m.counters[COUNTER_GLOSSARY_TERMS], m.counters[COUNTER_GLOSSARY_MISSES]);
+    }
+    fprintf(out, "Arena: %ld allocations (%ld KiB) served from %ld heap blocks\n",
+        m.counters[COUNTER_ARENA_ALLOCATIONS], m.counters[COUNTER_ARENA_BYTES] / 1024, m.counters[COUNTER_ARENA_HEAP_BLOCKS]);
+}
@@ -0,0 +1,500 @@
+#include "pipeline.h"
+#include "epub.h"
+#include "context_strategy.h"
+#include "journal.h"
+#include "context_updater.h"
+#include "metrics.h"
+#include "batch_api.h"
+#include <unistd.h>
+#include <limits.h>
+
+#define MAX_STRATEGIES 5
+
+// Helper to read file content for context analysis
+static char* read_file_content(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) return NULL;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (size <= 0) { fclose(fp); return NULL; }
+    char *buf = malloc(size + 1);
+    fread(buf, 1, size, fp);
+    buf[size] = 0;
+    fclose(fp);
+    return buf;
+}
+
+// Names the book a working directory was extracted from: the input path
+// and its journal_input_identity(), kept in the directory as INPUT_ID_FILE
+#define INPUT_ID_FILE ".epubtrans-input"
+
+// Whether work_dir holds an extraction of input_file made by an earlier run
+static int work_dir_matches(const char *work_dir, const char *input_file, const char *input_id) {
+    char path[PATH_MAX], id[PATH_MAX + 64];
+    snprintf(path, sizeof(path), "%s/META-INF/container.xml", work_dir);
+    if (access(path, F_OK) != 0) return 0;
+    snprintf(id, sizeof(id), "%s\n%s\n", input_file, input_id);
+    snprintf(path, sizeof(path), "%s/" INPUT_ID_FILE, work_dir);
+    char *stored = read_file_content(path);
+    int matches = stored && strcmp(stored, id) == 0;
+    free(stored);
+    return matches;
+}
+
+static void mark_work_dir(const char *work_dir, const char *input_file, const char *input_id) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/" INPUT_ID_FILE, work_dir);
+    FILE *fp = fopen(path, "w");
+    if (!fp) return;
+    fprintf(fp, "%s\n%s\n", input_file, input_id);
+    fclose(fp);
+}
+
+// Snapshot of all strategies for the journal. Format, per strategy:
+//   <name>\n<length>\n<data>
+static char* snapshot_strategies(ContextStrategy **strategies, int strategy_count) {
+    size_t len = 0;
+    char *snapshot = calloc(1, 1);
+    for (int s = 0; s < strategy_count; s++) {
+        if (!strategies[s]->save_state) continue;
+        char *data = strategies[s]->save_state(strategies[s]->state);
+        if (!data) continue;
+
+        size_t data_len = strlen(data);
+        size_t needed = len + strlen(strategies[s]->name) + data_len + 32;
+        snapshot = realloc(snapshot, needed);
+        len += snprintf(snapshot + len, needed - len, "%s\n%zu\n%s", strategies[s]->name, data_len, data);
+        free(data);
+    }
+    return snapshot;
+}
+
+static void restore_strategies(ContextStrategy **strategies, int strategy_count, const char *snapshot) {
+    const char *p = snapshot;
+    while (p && *p) {
+        const char *name_end = strchr(p, '\n');
+        if (!name_end) break;
+        char *len_end;
+        size_t data_len = strtoul(name_end + 1, &len_end, 10);
+        if (*len_end != '\n' || strlen(len_end + 1) < data_len) break;
+
+        char *data = strndup(len_end + 1, data_len);
+        for (int s = 0; s < strategy_count; s++) {
+            const char *name = strategies[s]->name;
+            if (strategies[s]->load_state && strlen(name) == (size_t)(name_end - p) && strncmp(name, p, name_end - p) == 0) {
+                strategies[s]->load_state(strategies[s]->state, data);
+            }
+        }
+        free(data);
+        p = len_end + 1 + data_len;
+    }
+}
+
+// One spine item scheduled on the worker pool
+typedef struct {
+    worker_job_t job;
+    char entry[PATH_MAX];    // Archive entry name of the chapter
+    char path[PATH_MAX];     // Directory mode: file in the temp dir
+    char out_path[PATH_MAX]; // Directory mode: translation is written here, then renamed over path
+    epub_book_t *book;       // In-memory mode: source of the chapter
+    char *output;            // In-memory mode: translated chapter
+    size_t output_size;
+    const char *idref;
+    int spine_index;
+    int skip;           // Already completed by an interrupted run
+    int replay;         // Completed by an interrupted run, rebuilt from the journal
+    char *context;      // Strategy context captured when the chapter was dispatched
+    config_t *config;
+    journal_t *journal;
+    ContextStrategy **strategies; // Snapshotted into the journal when the chapter is finished
+    int strategy_count;
+    int result;
+} chapter_job_t;
+
+// Hands the source of the chapters still to translate to the strategies
+// that look at the whole book first. Counted as context time.
+static void prescan_chapters(ContextStrategy **strategies, int strategy_count, chapter_job_t *chapters, int chapter_count) {
+    int wanted = 0;
+    for (int s = 0; s < strategy_count; s++) wanted |= strategies[s]->prescan != NULL;
+    if (!wanted || chapter_count == 0) return;
+
+    double start = metrics_now();
+    char **sources = calloc(chapter_count, sizeof(char*));
+    if (!sources) return;
+    for (int c = 0; c < chapter_count; c++) {
+        chapter_job_t *chapter = &chapters[c];
+        if (chapter->skip || chapter->replay) continue;
+        if (chapter->book) {
+            size_t size = 0;
+            sources[c] = epub_book_read(chapter->book, chapter->entry, &size);
+        } else {
+            sources[c] = read_file_content(chapter->path);
+        }
+    }
+    for (int s = 0; s < strategy_count; s++) {
+        if (strategies[s]->prescan) strategies[s]->prescan(strategies[s]->state, sources, chapter_count, chapters[0].config);
+    }
+    for (int c = 0; c < chapter_count; c++) free(sources[c]);
+    free(sources);
+    metrics_add_stage_time(STAGE_CONTEXT, metrics_now() - start);
+}
+
+static void run_chapter_job(void *arg) {
+    chapter_job_t *chapter = (chapter_job_t*)arg;
+    chapter_ctx_t ctx = {
+        .context_string = chapter->context,
+        .journal = chapter->journal,
+        .chapter = chapter->spine_index
+    };
+    if (chapter->book) {
+        size_t size = 0;
+        char *data = epub_book_read(chapter->book, chapter->entry, &size);
+        chapter->result = data ? translate_xhtml_buffer(data, size, &chapter->output, &chapter->output_size, chapter->config, &ctx) : -1;
+        free(data);
+    } else {
+        chapter->result = translate_xhtml(chapter->path, chapter->out_path, chapter->config, &ctx);
+    }
+}
+
+// Puts the translation in place of the source chapter
+static void publish_chapter(void *arg) {
+    chapter_job_t *chapter = (chapter_job_t*)arg;
+    if (chapter->book) {
+        epub_book_replace(chapter->book, chapter->entry, chapter->output, chapter->output_size);
+        chapter->output = NULL;
+    } else if (rename(chapter->out_path, chapter->path) != 0) {
+        perror("Failed to replace chapter with its translation");
+    }
+}
+
+// Runs on the context updater thread once the strategies have seen the
+// chapter. Journal first, then publish: a crash in between is repaired on
+// resume.
+static void finish_chapter(void *arg) {
+    chapter_job_t *chapter = (chapter_job_t*)arg;
+    char *snapshot = snapshot_strategies(chapter->strategies, chapter->strategy_count);
+    journal_record_chapter(chapter->journal, chapter->spine_index, snapshot);
+    free(snapshot);
+    publish_chapter(chapter);
+}
+
+int pipeline_translate_book(config_t *config, worker_pool_t *shared_pool, const pipeline_book_t *job) {
+    // The journal lives next to the output so separate books never share one
+    const char *input_file = job->input;
+    const char *final_output = job->output ? job->output : "translated.epub";
+    int resume = job->resume;
+    char journal_path[PATH_MAX];
+    snprintf(journal_path, sizeof(journal_path), "%s.journal", final_output);
+    // Segment ids depend on how text nodes are cut, so the settings that
+    // size segments are part of the run identity. So is the content of the
+    // input: a book edited or replaced under the same path starts over.
+    char input_id[64];
+    if (journal_input_identity(input_file, input_id, sizeof(input_id)) != 0) {
+        fprintf(stderr, "Failed to read %s\n", input_file);
+        return -1;
+    }
+    char run_id[PATH_MAX + 256];
+    snprintf(run_id, sizeof(run_id), "input=%s %s lang=%s model=%s window=%d batch=%d", input_file, input_id,
+        config->target_language, config->model, config->context_window, config->batch_tokens);
+
+    // Batch API runs make no requests of their own, so there is nothing to
+    // resume, and the strategies would see no translations to learn from
+    batch_api_mode_t batch_mode = batch_api_mode();
+    journal_t *journal = batch_mode == BATCH_API_OFF ? journal_open(journal_path, run_id, resume) : NULL;
+    if (!journal && batch_mode == BATCH_API_OFF) {
+        if (resume) return -1;
+        fprintf(stderr, "Warning: Running without a resume journal\n");
+    }
+
+    // The input archive is always opened: it is the source of the entries
+    // copied unchanged into the output. In-memory mode also reads the
+    // chapters straight from it, so nothing touches the disk. Otherwise
+    // the book is extracted to a working directory. On resume that
+    // directory already holds the chapters completed earlier, so it is
+    // only extracted again if it is gone or holds another book (or another
+    // version of this one).
+    double stage_start = metrics_now();
+    const char *temp_dir = job->work_dir ? job->work_dir : "build/temp_epub";
+    int reuse_temp_dir = 0;
+    epub_metadata_t *meta = NULL;
+    epub_book_t *book = epub_book_open(input_file);
+    if (!book) {
+        fprintf(stderr, "Failed to open EPUB\n");
+        journal_close(journal);
+        return -1;
+    }
+    if (config->in_memory) {
+        meta = parse_epub_metadata_from_book(book);
+    } else {
+        reuse_temp_dir = resume && work_dir_matches(temp_dir, input_file, input_id);
+        if (!reuse_temp_dir) {
+            if (extract_epub(input_file, temp_dir) != 0) {
+                fprintf(stderr, "Failed to extract EPUB\n");
+                epub_book_close(book);
+                journal_close(journal);
+                return -1;
+            }
+            mark_work_dir(temp_dir, input_file, input_id);
+        }
+        meta = parse_epub_metadata(temp_dir);
+    }
+
+    if (!meta) {
+        fprintf(stderr, "Failed to parse EPUB metadata\n");
+        epub_book_close(book);
+        journal_close(journal);
+        return -1;
+    }
+
+    metrics_add_stage_time(STAGE_EXTRACT, metrics_now() - stage_start);
+
+    // Initialize Strategies
+    ContextStrategy *strategies[MAX_STRATEGIES];
+    int strategy_count = 0;
+
+    // 1. History Strategy
+    if (config->context_file && batch_mode == BATCH_API_OFF) {
+        ContextStrategy *hist = create_history_strategy();
+        hist->state = hist->init(config);
+        if (hist->state) {
+            strategies[strategy_count++] = hist;
+            printf("Strategy Enabled: %s\n", hist->name);
+        } else {
+            free(hist);
+        }
+    }
+
+    // 2. Sliding Window Strategy
+    if (config->sliding_window_size > 0 && batch_mode == BATCH_API_OFF) {
+        ContextStrategy *win = create_sliding_window_strategy();
+        win->state = win->init(config);
+        if (win->state) {
+            strategies[strategy_count++] = win;
+            printf("Strategy Enabled: %s\n", win->name);
+        } else {
+            free(win);
+        }
+    }
+
+    // 3. Terminology Strategy
+    if (config->terminology_terms > 0 && batch_mode == BATCH_API_OFF) {
+        ContextStrategy *terms = create_terminology_strategy();
+        terms->state = terms->init(config);
+        if (terms->state) {
+            strategies[strategy_count++] = terms;
+            printf("Strategy Enabled: %s\n", terms->name);
+        } else {
+            free(terms);
+        }
+    }
+
+    // The parser already resolved spine items to manifest entries
+    chapter_job_t *chapters = calloc(meta->spine_count > 0 ? meta->spine_count : 1, sizeof(chapter_job_t));
+    int *scheduled = calloc(meta->manifest_count > 0 ? meta->manifest_count : 1, sizeof(int));
+    int chapter_count = 0;
+    for (int i = 0; i < meta->spine_count; i++) {
+        const epub_spine_item_t *ref = &meta->spine[i];
+        if (ref->item < 0 || !meta->manifest[ref->item].href) continue;
+        if (!ref->linear && config->skip_nonlinear) {
+            printf("Skipping non-linear item %s\n", ref->idref);
+            continue;
+        }
+        // A file referenced twice in the spine is translated once;
+        // two workers must never rewrite the same file.
+        if (scheduled[ref->item]) continue;
+        scheduled[ref->item] = 1;
+
+        chapter_job_t *chapter = &chapters[chapter_count];
+        const char *href = meta->manifest[ref->item].href;
+        if (meta->base_dir && strlen(meta->base_dir) > 0) {
+            snprintf(chapter->entry, sizeof(chapter->entry), "%s/%s", meta->base_dir, href);
+        } else {
+            snprintf(chapter->entry, sizeof(chapter->entry), "%s", href);
+        }
+        snprintf(chapter->path, sizeof(chapter->path), "%s/%s", temp_dir, chapter->entry);
+        snprintf(chapter->out_path, sizeof(chapter->out_path), "%s.done", chapter->path);
+        chapter->book = config->in_memory ? book : NULL;
+        chapter->idref = ref->idref;
+        chapter->spine_index = i;
+        chapter->config = config;
+        chapter->journal = journal;
+        chapter->strategies = strategies;
+        chapter->strategy_count = strategy_count;
+        chapter->job.fn = run_chapter_job;
+        chapter->job.arg = chapter;
+        chapter->job.priority = job->priority;
+        chapter_count++;
+    }
+    free(scheduled);
+
+    // Skip what an interrupted run already finished. A chapter is complete
+    // once its journal record exists; if the crash came before the rename,
+    // finish it now. Without the old working directory (or in in-memory
+    // mode) the completed chapters are rebuilt from their journaled
+    // segments instead. Either way the strategies continue from the state
+    // saved with the last completed chapter and do not see those chapters
+    // again.
+    const char *resume_state = NULL;
+    for (int c = 0; c < chapter_count; c++) {
+        chapter_job_t *chapter = &chapters[c];
+        int completed = journal_chapter_done(journal, chapter->spine_index);
+        if (completed) resume_state = journal_chapter_state(journal, chapter->spine_index);
+        if (completed && reuse_temp_dir) {
+            if (access(chapter->out_path, F_OK) == 0 && rename(chapter->out_path, chapter->path) != 0) {
+                perror("Failed to finish interrupted chapter");
+            }
+            chapter->skip = 1;
+            continue;
+        }
+        chapter->replay = completed;
+        if (!config->in_memory) {
+            unlink(chapter->out_path); // Partial output of an interrupted run
+        }
+    }
+    if (resume_state) {
+        restore_strategies(strategies, strategy_count, resume_state);
+    }
+    prescan_chapters(strategies, strategy_count, chapters, chapter_count);
+
+    // Translate chapters on the worker pool. At most `workers` chapters are in
+    // flight. Completed chapters are handed to the context updater in spine
+    // order; it runs the strategies (and their LLM calls) in the background
+    // while the next chapters translate. A chapter is only dispatched once
+    // the context covers all but the last `context_max_lag` chapters before
+    // it, so with a lag of 0 the behaviour is fully sequential.
+    int lag = strategy_count > 0 ? config->context_max_lag : config->workers;
+    stage_start = metrics_now();
+    worker_pool_t *pool = shared_pool ? shared_pool : worker_pool_create(config->workers);
+    // The History strategy summarizes long chapters in parts on this pool
+    config->worker_pool = pool;
+    context_updater_t *updater = pool ? context_updater_create(strategies, strategy_count, config) : NULL;
+    if (!pool || !updater) {
+        config->worker_pool = NULL;
+        fprintf(stderr, "Failed to start worker pool\n");
+        if (pool != shared_pool) worker_pool_destroy(pool);
+        free(chapters);
+        free_epub_metadata(meta);
+        epub_book_close(book);
+        journal_close(journal);
+        return -1;
+    }
+
+    int next_dispatch = 0, done = 0, failed = 0, stopped = 0;
+    for (int next_done = 0; next_done < chapter_count; next_done++) {
+        // Once asked to stop, only the chapters in flight are finished
+        if (!stopped && job->stop_requested && job->stop_requested(job->progress_arg)) stopped = 1;
+        while (!stopped && next_dispatch < chapter_count && next_dispatch - next_done < config->workers &&
+               next_dispatch - next_done <= lag) {
+            int index = next_dispatch++;
+            chapter_job_t *chapter = &chapters[index];
+            if (chapter->skip) {
+                chapter->job.done = 1;
+                continue;
+            }
+            // Chapters before index - lag were all submitted (next_done is
+            // past them); wait until the updater has applied them
+            context_updater_wait(updater, index - lag);
+            printf("Processing chapter %d/%d: %s...\n", chapter->spine_index + 1, meta->spine_count, chapter->idref);
+            chapter->context = context_updater_prompt(updater);
+            worker_pool_submit(pool, &chapter->job);
+        }
+
+        if (next_done == next_dispatch) break; // Stopped, nothing left in flight
+        chapter_job_t *chapter = &chapters[next_done];
+        worker_pool_wait(pool, &chapter->job);
+        free(chapter->context);
+        chapter->context = NULL;
+
+        if (chapter->skip) {
+            context_updater_submit(updater, NULL, NULL, NULL);
+            done++;
+            if (job->progress) job->progress(job->progress_arg, done, failed, chapter_count);
+            continue;
+        }
+        if (chapter->result != 0) {
+            fprintf(stderr, "Failed to translate %s\n", chapter->entry);
+            metrics_count(COUNTER_CHAPTERS_FAILED, 1);
+            context_updater_submit(updater, NULL, NULL, NULL);
+            failed++;
+            if (job->progress) job->progress(job->progress_arg, done, failed, chapter_count);
+            continue;
+        }
+
+        // Rebuilt chapters are already in the journal and the restored state
+        if (chapter->replay) {
+            context_updater_submit(updater, NULL, publish_chapter, chapter);
+            done++;
+            if (job->progress) job->progress(job->progress_arg, done, failed, chapter_count);
+            continue;
+        }
+
+        // Strategies learn from the TRANSLATED content
+        char *content = NULL;
+        if (strategy_count > 0) {
+            content = config->in_memory ? strdup(chapter->output) : read_file_content(chapter->out_path);
+        }
+        context_updater_submit(updater, content, finish_chapter, chapter);
+        metrics_count(COUNTER_CHAPTERS_DONE, 1);
+        done++;
+        if (job->progress) job->progress(job->progress_arg, done, failed, chapter_count);
+    }
+
+    context_updater_destroy(updater); // Applies the pending updates
+    config->worker_pool = NULL;
+    if (pool != shared_pool) worker_pool_destroy(pool);
+    metrics_add_stage_time(STAGE_TRANSLATE, metrics_now() - stage_start);
+    stage_start = metrics_now();
+
+    if (stopped) {
+        // The journal has every finished chapter; --resume picks up from there
+        printf("Stopped after %d of %d chapters of %s\n", done + failed, chapter_count, input_file);
+        for (int s = 0; s < strategy_count; s++) {
+            strategies[s]->cleanup(strategies[s]->state);
+            free(strategies[s]);
+        }
+        free(chapters);
+        journal_close(journal);
+        free_epub_metadata(meta);
+        epub_book_close(book);
+        return 1;
+    }
+
+    // Directory mode: hand the rewritten chapters to the book so that only
+    // they are recompressed and everything else is copied as-is
+    if (!config->in_memory) {
+        for (int c = 0; c < chapter_count; c++) {
+            char *content = read_file_content(chapters[c].path);
+            if (content) {
+                epub_book_replace(book, chapters[c].entry, content, strlen(content));
+            }
+        }
+    }
+    free(chapters);
+
+    // Cleanup Strategies
+    for (int s = 0; s < strategy_count; s++) {
+        strategies[s]->cleanup(strategies[s]->state);
+        free(strategies[s]);
+    }
+
+    int rc = -1;
+    long batch_count = batch_mode != BATCH_API_OFF ? batch_api_finish() : 0;
+    if (batch_mode == BATCH_API_EXPORT) {
+        rc = failed > 0 ? -1 : 0;
+        printf("Exported %ld requests of %s for the batch API\n", batch_count, input_file);
+    } else if (batch_mode == BATCH_API_IMPORT && batch_count > 0) {
+        fprintf(stderr, "Batch results are missing %ld segments; not writing %s\n", batch_count, final_output);
+    } else if (epub_book_write(book, final_output, config->workers) != 0) {
+        fprintf(stderr, "Failed to create output EPUB\n");
+    } else {
+        rc = 0;
+        printf("Success! Translated EPUB saved to %s\n", final_output);
+        unlink(journal_path); // Nothing left to resume
+    }
+    metrics_add_stage_time(STAGE_ARCHIVE, metrics_now() - stage_start);
+    journal_close(journal);
+    free_epub_metadata(meta);
+    epub_book_close(book);
+    return rc;
+}
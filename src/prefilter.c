@@ -0,0 +1,264 @@
+#include "prefilter.h"
+#include "tokenizer.h"
+#include <pthread.h>
+#include <ctype.h>
+#include <strings.h>
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define PREFILTER_SSE2 1
+#include <immintrin.h>
+#if defined(__GNUC__)
+#define PREFILTER_AVX2 1
+#endif
+#endif
+
+// Offset of the first byte that may start a word: an ASCII letter or any
+// byte of a multi-byte UTF-8 sequence. Returns len if there is none.
+static size_t find_word_byte_scalar(const unsigned char *s, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        unsigned char lower = s[i] | 0x20;
+        if (s[i] >= 0x80 || (lower >= 'a' && lower <= 'z')) return i;
+    }
+    return len;
+}
+
+#ifdef PREFILTER_SSE2
+static size_t find_word_byte_sse2(const unsigned char *s, size_t len) {
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    const __m128i before_a = _mm_set1_epi8('a' - 1);
+    const __m128i after_z = _mm_set1_epi8('z' + 1);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(s + i));
+        // Folding case maps A-Z onto a-z; bytes >= 0x80 are negative as
+        // signed chars and show up through their sign bit instead
+        __m128i lower = _mm_or_si128(bytes, case_bit);
+        __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(lower, before_a), _mm_cmplt_epi8(lower, after_z));
+        int mask = _mm_movemask_epi8(_mm_or_si128(letter, bytes));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    return i + find_word_byte_scalar(s + i, len - i);
+}
+#endif
+
+#ifdef PREFILTER_AVX2
+__attribute__((target("avx2")))
+static size_t find_word_byte_avx2(const unsigned char *s, size_t len) {
+    const __m256i case_bit = _mm256_set1_epi8(0x20);
+    const __m256i before_a = _mm256_set1_epi8('a' - 1);
+    const __m256i after_z = _mm256_set1_epi8('z' + 1);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i*)(s + i));
+        __m256i lower = _mm256_or_si256(bytes, case_bit);
+        __m256i letter = _mm256_and_si256(_mm256_cmpgt_epi8(lower, before_a), _mm256_cmpgt_epi8(after_z, lower));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_or_si256(letter, bytes));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    return i + find_word_byte_sse2(s + i, len - i);
+}
+#endif
+
+static size_t (*find_word_byte)(const unsigned char *s, size_t len) = find_word_byte_scalar;
+static pthread_once_t dispatch_once = PTHREAD_ONCE_INIT;
+
+static void select_implementation(void) {
+#ifdef PREFILTER_SSE2
+    find_word_byte = find_word_byte_sse2;
+#endif
+#ifdef PREFILTER_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) find_word_byte = find_word_byte_avx2;
+#endif
+}
+
+// Code points that carry no words: Latin-1 punctuation and signs, general
+// punctuation, currency, letterlike and number forms, arrows, maths,
+// technical and geometric symbols, dingbats, CJK punctuation, full-width
+// and small-form punctuation, private-use icons and emoji
+static int is_symbol(unsigned int cp) {
+    if (cp < 0x80) return !((cp | 0x20) >= 'a' && (cp | 0x20) <= 'z');
+    if (cp <= 0xBF) return cp != 0xAA && cp != 0xB5 && cp != 0xBA;    // ª µ º are letters
+    if (cp == 0xD7 || cp == 0xF7) return 1;                           // × ÷
+    if (cp >= 0x2000 && cp <= 0x27FF) return 1;
+    if (cp >= 0x2900 && cp <= 0x2BFF) return 1;                       // Skipping braille
+    if (cp >= 0x3000 && cp <= 0x303F && cp != 0x3005) return 1;       // Except 々
+    if (cp >= 0xE000 && cp <= 0xF8FF) return 1;
+    if (cp >= 0xFE00 && cp <= 0xFE0F) return 1;                       // Variation selectors
+    if (cp >= 0xFE10 && cp <= 0xFE6F) return 1;
+    if (cp >= 0xFF01 && cp <= 0xFF20) return 1;                       // ！ to ＠, digits included
+    if ((cp >= 0xFF3B && cp <= 0xFF40) || (cp >= 0xFF5B && cp <= 0xFF65)) return 1;
+    if (cp >= 0xFFF0 && cp <= 0xFFFF) return 1;
+    if (cp >= 0x1F000 && cp <= 0x1FAFF) return 1;
+    return 0;
+}
+
+// Whitespace at the start of s: ASCII, NBSP, the U+2000 spaces, U+202F,
+// U+205F, U+3000 and a stray BOM
+static size_t space_length(const unsigned char *s, size_t len) {
+    if (s[0] == ' ' || (s[0] >= '\t' && s[0] <= '\r')) return 1;
+    if (len >= 2 && s[0] == 0xC2 && s[1] == 0xA0) return 2;
+    if (len < 3) return 0;
+    if (s[0] == 0xE2 && s[1] == 0x80 && (s[2] <= 0x8B || s[2] == 0xAF)) return 3;
+    if (s[0] == 0xE2 && s[1] == 0x81 && s[2] == 0x9F) return 3;
+    if (s[0] == 0xE3 && s[1] == 0x80 && s[2] == 0x80) return 3;
+    if (s[0] == 0xEF && s[1] == 0xBB && s[2] == 0xBF) return 3;
+    return 0;
+}
+
+// Whitespace ending at s[len - 1]
+static size_t trailing_space_length(const unsigned char *s, size_t len) {
+    if (space_length(s + len - 1, 1) == 1) return 1;
+    if (len >= 2 && space_length(s + len - 2, 2) == 2) return 2;
+    if (len >= 3 && space_length(s + len - 3, 3) == 3) return 3;
+    return 0;
+}
+
+void prefilter_trim(const char *text, size_t len, size_t *start, size_t *end) {
+    const unsigned char *s = (const unsigned char*)text;
+    size_t a = 0, b = len, n;
+    while (a < b && (n = space_length(s + a, b - a)) > 0) a += n;
+    while (b > a && (n = trailing_space_length(s + a, b - a)) > 0) b -= n;
+    if (a == b) a = b = 0;
+    *start = a;
+    *end = b;
+}
+
+// Matches one decimal place of a Roman numeral (e.g. I, V, X for units):
+// one{0,3}, one five, five one{0,3} or one ten. Returns the bytes used.
+static size_t match_place(const unsigned char *s, size_t len, char one, char five, char ten) {
+    size_t i = 0;
+    if (len >= 2 && (s[0] | 0x20) == one && ((s[1] | 0x20) == five || (s[1] | 0x20) == ten)) return 2;
+    if (i < len && (s[i] | 0x20) == five) i++;
+    for (int k = 0; k < 3 && i < len && (s[i] | 0x20) == one; k++) i++;
+    return i;
+}
+
+// A well-formed numeral from I to MMMCMXCIX, all upper or all lower case.
+// Lower-case numerals are page numbers of front matter and never reach d
+// or m, which keeps words like "mix" or "dim" translatable. Short runs
+// that are also words ("I", "vi", "li") are left to is_numerals().
+static int is_roman_numeral(const unsigned char *s, size_t len) {
+    int lower = s[0] >= 'a';
+    for (size_t i = 0; i < len; i++) {
+        if ((s[i] >= 'a') != lower) return 0;
+        if (lower && (s[i] == 'd' || s[i] == 'm')) return 0;
+    }
+
+    size_t i = 0;
+    for (int k = 0; k < 3 && i < len && (s[i] | 0x20) == 'm'; k++) i++;
+    i += match_place(s + i, len - i, 'c', 'd', 'm');
+    i += match_place(s + i, len - i, 'x', 'l', 'c');
+    i += match_place(s + i, len - i, 'i', 'v', 'x');
+    return i == len;
+}
+
+// A numeral that is also a word: "I", or one or two lower-case letters
+// ("i", "vi", "xi", "li", "ci")
+static int is_word_like(const unsigned char *s, size_t len) {
+    return (len == 1 && s[0] == 'I') || (len <= 2 && s[0] >= 'a');
+}
+
+// Every word in the text is a Roman numeral ("XIV", "xii–xiv, 23").
+// Numerals that are also words only count as such when punctuation marks
+// them ("I.", "(ii)", "vi)") or they stand in a list of numbers or
+// numerals ("i, ii, iii", "vi–x", "xi, 24"); on their own they are words.
+static int is_numerals(const unsigned char *s, size_t len) {
+    int numbers = 0, unmarked = 0;
+    size_t i = 0;
+    while (i < len) {
+        if (s[i] >= 0x80) {
+            unsigned int cp;
+            int n = utf8_decode(s + i, len - i, &cp);
+            if (!is_symbol(cp)) return 0;
+            i += n;
+            continue;
+        }
+        if (s[i] >= '0' && s[i] <= '9') {
+            numbers++;
+            while (i < len && s[i] >= '0' && s[i] <= '9') i++;
+            continue;
+        }
+        size_t run = i;
+        while (i < len && s[i] < 0x80 && !is_symbol(s[i])) i++;
+        if (i == run) {
+            i++;
+            continue;
+        }
+        if (!is_roman_numeral(s + run, i - run)) return 0;
+        numbers++;
+        int marked = (i < len && (s[i] == '.' || s[i] == ')')) || (run > 0 && s[run - 1] == '(');
+        if (is_word_like(s + run, i - run) && !marked) unmarked++;
+    }
+    return unmarked == 0 || numbers > 1;
+}
+
+// Drops brackets and sentence punctuation around a link or address
+static void strip_punctuation(const unsigned char **s, size_t *len) {
+    while (*len > 0 && strchr("([<\"'", **s)) { (*s)++; (*len)--; }
+    while (*len > 0 && strchr(".,;:!?)]>\"'", (*s)[*len - 1])) (*len)--;
+}
+
+static int has_space(const unsigned char *s, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] == ' ' || (s[i] >= '\t' && s[i] <= '\r')) return 1;
+    }
+    return 0;
+}
+
+static int is_url(const unsigned char *s, size_t len) {
+    static const char *prefixes[] = { "http://", "https://", "ftp://", "mailto:", "www." };
+    strip_punctuation(&s, &len);
+    if (has_space(s, len)) return 0;
+    for (size_t p = 0; p < sizeof(prefixes) / sizeof(prefixes[0]); p++) {
+        size_t n = strlen(prefixes[p]);
+        if (len > n && strncasecmp((const char*)s, prefixes[p], n) == 0) return 1;
+    }
+    return 0;
+}
+
+static int is_email(const unsigned char *s, size_t len) {
+    strip_punctuation(&s, &len);
+    const unsigned char *at = memchr(s, '@', len);
+    if (!at || at == s) return 0;
+    for (const unsigned char *p = s; p < at; p++) {
+        if (!isalnum(*p) && !strchr("._%+-", *p)) return 0;
+    }
+    const unsigned char *domain = at + 1, *end = s + len;
+    int dot = 0;
+    for (const unsigned char *p = domain; p < end; p++) {
+        if (*p == '.') {
+            if (p == domain || p + 1 == end) return 0;
+            dot = 1;
+        } else if (!isalnum(*p) && *p != '-') {
+            return 0;
+        }
+    }
+    return dot;
+}
+
+prefilter_class_t prefilter_classify(const char *text, size_t len) {
+    pthread_once(&dispatch_once, select_implementation);
+
+    size_t start, end;
+    prefilter_trim(text, len, &start, &end);
+    if (start == end) return PREFILTER_BLANK;
+    const unsigned char *s = (const unsigned char*)text + start;
+    size_t n = end - start;
+
+    // Most of the text is skipped in vector-sized strides; only multi-byte
+    // characters are decoded
+    size_t i = find_word_byte(s, n);
+    while (i < n && s[i] >= 0x80) {
+        unsigned int cp;
+        int k = utf8_decode(s + i, n - i, &cp);
+        if (!is_symbol(cp)) return PREFILTER_TRANSLATE;
+        i += k;
+        i += find_word_byte(s + i, n - i);
+    }
+    if (i == n) return PREFILTER_VERBATIM;
+
+    // There are ASCII letters: only numerals, links and addresses are left
+    if (is_numerals(s, n) || is_url(s, n) || is_email(s, n)) return PREFILTER_VERBATIM;
+    return PREFILTER_TRANSLATE;
+}
@@ -0,0 +1,211 @@
+#include "rate_limit.h"
+#include <pthread.h>
+#include <strings.h>
+#include <time.h>
+
+#define BACKOFF_BASE_SECONDS 1.0
+#define BACKOFF_MAX_SECONDS 60.0
+
+// Longest single sleep while waiting, so limit changes are picked up
+#define MAX_SLEEP_SECONDS 1.0
+
+typedef struct {
+    long limit;         // Per minute (0 = unlimited)
+    long configured;    // Limit from the config (0 = none)
+    double level;       // Available now; may go negative after a correction
+} bucket_t;
+
+static pthread_mutex_t limiter_lock = PTHREAD_MUTEX_INITIALIZER;
+static int limiter_ready = 0;
+static bucket_t requests;
+static bucket_t tokens;
+static double last_refill = 0;
+static double paused_until = 0;
+static unsigned int jitter_seed = 0;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sleep_seconds(double seconds) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)seconds;
+    ts.tv_nsec = (long)((seconds - ts.tv_sec) * 1e9);
+    nanosleep(&ts, NULL);
+}
+
+static void set_limit(bucket_t *bucket, long limit) {
+    if (bucket->limit == 0) bucket->level = limit; // Start with a full bucket
+    bucket->limit = limit;
+    if (bucket->level > limit) bucket->level = limit;
+}
+
+static void refill(double now) {
+    double elapsed = now - last_refill;
+    last_refill = now;
+    if (elapsed <= 0) return;
+
+    bucket_t *buckets[2] = { &requests, &tokens };
+    for (int i = 0; i < 2; i++) {
+        bucket_t *b = buckets[i];
+        if (b->limit <= 0) continue;
+        b->level += elapsed * b->limit / 60.0;
+        if (b->level > b->limit) b->level = b->limit;
+    }
+}
+
+// Seconds until the bucket holds `amount`
+static double time_until(const bucket_t *bucket, double amount) {
+    if (bucket->limit <= 0 || bucket->level >= amount) return 0;
+    return (amount - bucket->level) * 60.0 / bucket->limit;
+}
+
+void rate_limit_init(config_t *config) {
+    pthread_mutex_lock(&limiter_lock);
+    if (!limiter_ready) {
+        requests.configured = config->rpm_limit > 0 ? config->rpm_limit : 0;
+        tokens.configured = config->tpm_limit > 0 ? config->tpm_limit : 0;
+        if (requests.configured) set_limit(&requests, requests.configured);
+        if (tokens.configured) set_limit(&tokens, tokens.configured);
+        last_refill = now_seconds();
+        jitter_seed = (unsigned int)time(NULL);
+        limiter_ready = 1;
+    }
+    pthread_mutex_unlock(&limiter_lock);
+}
+
+void rate_limit_acquire(int amount) {
+    for (;;) {
+        pthread_mutex_lock(&limiter_lock);
+        double now = now_seconds();
+        refill(now);
+
+        double wait = paused_until - now;
+        if (wait <= 0) {
+            // A request larger than the whole bucket goes once it is full
+            double needed = amount;
+            if (tokens.limit > 0 && needed > tokens.limit) needed = tokens.limit;
+            wait = time_until(&requests, 1.0);
+            double token_wait = time_until(&tokens, needed);
+            if (token_wait > wait) wait = token_wait;
+
+            if (wait <= 0) {
+                if (requests.limit > 0) requests.level -= 1.0;
+                if (tokens.limit > 0) tokens.level -= amount;
+                pthread_mutex_unlock(&limiter_lock);
+                return;
+            }
+        }
+        pthread_mutex_unlock(&limiter_lock);
+        sleep_seconds(wait < MAX_SLEEP_SECONDS ? wait : MAX_SLEEP_SECONDS);
+    }
+}
+
+void rate_limit_adjust(int estimated_tokens, int actual_tokens) {
+    pthread_mutex_lock(&limiter_lock);
+    if (tokens.limit > 0) tokens.level += estimated_tokens - actual_tokens;
+    pthread_mutex_unlock(&limiter_lock);
+}
+
+void rate_limit_headers_clear(rate_limit_headers_t *headers) {
+    headers->limit_requests = -1;
+    headers->limit_tokens = -1;
+    headers->remaining_requests = -1;
+    headers->remaining_tokens = -1;
+    headers->reset_requests = -1;
+    headers->reset_tokens = -1;
+    headers->retry_after = -1;
+}
+
+// Parses durations such as "20ms", "1s", "0.5s" or "6m0s"
+static double parse_duration(const char *p) {
+    double total = 0;
+    while (*p) {
+        char *end;
+        double value = strtod(p, &end);
+        if (end == p) break;
+        if (strncmp(end, "ms", 2) == 0) { total += value / 1000.0; end += 2; }
+        else if (*end == 'h') { total += value * 3600.0; end++; }
+        else if (*end == 'm') { total += value * 60.0; end++; }
+        else { total += value; if (*end == 's') end++; }
+        p = end;
+    }
+    return total;
+}
+
+void rate_limit_parse_header(rate_limit_headers_t *headers, const char *line, size_t len) {
+    const char *colon = memchr(line, ':', len);
+    if (!colon) return;
+    size_t name_len = colon - line;
+
+    char value[64];
+    const char *v = colon + 1;
+    while (v < line + len && *v == ' ') v++;
+    size_t value_len = line + len - v;
+    while (value_len > 0 && (v[value_len - 1] == '\r' || v[value_len - 1] == '\n' || v[value_len - 1] == ' ')) value_len--;
+    if (value_len >= sizeof(value)) return;
+    memcpy(value, v, value_len);
+    value[value_len] = 0;
+
+#define HEADER_IS(name) (name_len == strlen(name) && strncasecmp(line, name, name_len) == 0)
+    if (HEADER_IS("retry-after-ms")) {
+        headers->retry_after = atof(value) / 1000.0;
+    } else if (HEADER_IS("retry-after")) {
+        // Only the delay-seconds form; an HTTP date falls back to backoff
+        char *end;
+        double seconds = strtod(value, &end);
+        if (end != value && *end == 0 && headers->retry_after < 0) headers->retry_after = seconds;
+    } else if (HEADER_IS("x-ratelimit-limit-requests")) {
+        headers->limit_requests = atol(value);
+    } else if (HEADER_IS("x-ratelimit-limit-tokens")) {
+        headers->limit_tokens = atol(value);
+    } else if (HEADER_IS("x-ratelimit-remaining-requests")) {
+        headers->remaining_requests = atol(value);
+    } else if (HEADER_IS("x-ratelimit-remaining-tokens")) {
+        headers->remaining_tokens = atol(value);
+    } else if (HEADER_IS("x-ratelimit-reset-requests")) {
+        headers->reset_requests = parse_duration(value);
+    } else if (HEADER_IS("x-ratelimit-reset-tokens")) {
+        headers->reset_tokens = parse_duration(value);
+    }
+#undef HEADER_IS
+}
+
+static void apply_headers(bucket_t *bucket, long limit, long remaining, double reset, double now) {
+    if (limit > 0) {
+        // A configured limit below the provider's ceiling keeps priority
+        set_limit(bucket, bucket->configured > 0 && bucket->configured < limit ? bucket->configured : limit);
+    }
+    if (remaining >= 0 && bucket->limit > 0 && bucket->level > remaining) {
+        bucket->level = remaining;
+    }
+    if (remaining == 0 && reset > 0 && now + reset > paused_until) {
+        paused_until = now + reset;
+    }
+}
+
+void rate_limit_update(const rate_limit_headers_t *headers) {
+    pthread_mutex_lock(&limiter_lock);
+    double now = now_seconds();
+    refill(now);
+    apply_headers(&requests, headers->limit_requests, headers->remaining_requests, headers->reset_requests, now);
+    apply_headers(&tokens, headers->limit_tokens, headers->remaining_tokens, headers->reset_tokens, now);
+    pthread_mutex_unlock(&limiter_lock);
+}
+
+double rate_limit_backoff(int attempt, double retry_after) {
+    double cap = BACKOFF_BASE_SECONDS;
+    for (int i = 0; i < attempt && cap < BACKOFF_MAX_SECONDS; i++) cap *= 2;
+    if (cap > BACKOFF_MAX_SECONDS) cap = BACKOFF_MAX_SECONDS;
+
+    pthread_mutex_lock(&limiter_lock);
+    // Full jitter: threads throttled together do not retry together
+    double delay = cap * rand_r(&jitter_seed) / (double)RAND_MAX;
+    if (retry_after > delay) delay = retry_after;
+    double now = now_seconds();
+    if (now + delay > paused_until) paused_until = now + delay;
+    pthread_mutex_unlock(&limiter_lock);
+    return delay;
+}
@@ -0,0 +1,179 @@
+#include "segment.h"
+#include "tokenizer.h"
+
+typedef struct {
+    text_piece_t *items;
+    int count;
+    int capacity;
+} piece_list_t;
+
+// Levels at which a text is cut, from the most to the least natural
+enum { CUT_SENTENCE, CUT_WORD, CUT_CODEPOINT };
+
+static int is_space(unsigned char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static int append_piece(piece_list_t *list, const char *text, size_t start, size_t end) {
+    size_t length = end - start;
+    while (length > 0 && is_space((unsigned char)text[start + length - 1])) length--;
+
+    // Pure whitespace joins the separator of the previous piece
+    if (length == 0 && list->count > 0) {
+        list->items[list->count - 1].separator += end - start;
+        return 0;
+    }
+
+    if (list->count == list->capacity) {
+        int new_capacity = list->capacity ? list->capacity * 2 : 8;
+        text_piece_t *items = realloc(list->items, new_capacity * sizeof(text_piece_t));
+        if (!items) return -1;
+        list->items = items;
+        list->capacity = new_capacity;
+    }
+    list->items[list->count].start = start;
+    list->items[list->count].length = length;
+    list->items[list->count].separator = end - start - length;
+    list->count++;
+    return 0;
+}
+
+// Sentence terminators, ASCII and the common CJK full-width ones
+static size_t terminator_length(const unsigned char *s, size_t len, int *needs_space) {
+    *needs_space = 1;
+    if (s[0] == '.' || s[0] == '!' || s[0] == '?') return 1;
+    if (len >= 3 && s[0] == 0xE2 && s[1] == 0x80 && s[2] == 0xA6) return 3; // …
+    *needs_space = 0;
+    if (len >= 3 && s[0] == 0xE3 && s[1] == 0x80 && s[2] == 0x82) return 3; // 。
+    if (len >= 3 && s[0] == 0xEF && s[1] == 0xBC && (s[2] == 0x81 || s[2] == 0x9F)) return 3; // ！？
+    return 0;
+}
+
+// Closing quotes and brackets that belong to the sentence they end
+static size_t closer_length(const unsigned char *s, size_t len) {
+    if (s[0] == '"' || s[0] == '\'' || s[0] == ')' || s[0] == ']') return 1;
+    if (len >= 2 && s[0] == 0xC2 && s[1] == 0xBB) return 2; // »
+    if (len >= 3 && s[0] == 0xE2 && s[1] == 0x80 && (s[2] == 0x99 || s[2] == 0x9D)) return 3; // ’ ”
+    if (len >= 3 && s[0] == 0xE3 && s[1] == 0x80 && (s[2] == 0x8D || s[2] == 0x8F)) return 3; // 」 』
+    return 0;
+}
+
+// End of the unit starting at pos, including the whitespace after it
+static size_t next_boundary(const char *text, size_t pos, size_t end, int level) {
+    const unsigned char *s = (const unsigned char*)text;
+
+    if (level == CUT_CODEPOINT) {
+        unsigned int cp;
+        return pos + utf8_decode(s + pos, end - pos, &cp);
+    }
+
+    size_t i = pos;
+    if (level == CUT_WORD) {
+        while (i < end && !is_space(s[i])) i++;
+        while (i < end && is_space(s[i])) i++;
+        return i;
+    }
+
+    while (i < end) {
+        if (s[i] == '\n') {
+            // Line breaks inside a text node end a sentence too
+            while (i < end && is_space(s[i])) i++;
+            return i;
+        }
+        int needs_space;
+        size_t n = terminator_length(s + i, end - i, &needs_space);
+        if (n == 0) {
+            i++;
+            continue;
+        }
+        size_t j = i + n;
+        // "?!", "..." and closing quotes stay with the sentence
+        while (j < end) {
+            int unused;
+            size_t m = terminator_length(s + j, end - j, &unused);
+            if (m == 0) m = closer_length(s + j, end - j);
+            if (m == 0) break;
+            j += m;
+        }
+        if (j >= end) return end;
+        if (!needs_space || is_space(s[j])) {
+            while (j < end && is_space(s[j])) j++;
+            return j;
+        }
+        i = j; // "3.14", "e.g.x": not a boundary
+    }
+    return end;
+}
+
+static int split_range(const char *text, size_t start, size_t end, int max_tokens, int level, piece_list_t *list) {
+    size_t piece_start = start;
+    size_t pos = start;
+    int piece_tokens = 0;
+
+    while (pos < end) {
+        size_t unit_end = next_boundary(text, pos, end, level);
+        // The space after a unit is absorbed by the next word, don't charge it
+        size_t word_end = unit_end;
+        while (word_end > pos && is_space((unsigned char)text[word_end - 1])) word_end--;
+        int tokens = count_tokens(text + pos, word_end - pos);
+
+        if (piece_tokens > 0 && piece_tokens + tokens > max_tokens) {
+            if (append_piece(list, text, piece_start, pos) != 0) return -1;
+            piece_start = pos;
+            piece_tokens = 0;
+        }
+
+        if (tokens > max_tokens && level < CUT_CODEPOINT) {
+            // A single sentence (or word) over the limit: cut it finer
+            if (split_range(text, piece_start, unit_end, max_tokens, level + 1, list) != 0) return -1;
+            piece_start = unit_end;
+        } else {
+            piece_tokens += tokens;
+        }
+        pos = unit_end;
+    }
+
+    if (piece_start < end) return append_piece(list, text, piece_start, end);
+    return 0;
+}
+
+int segment_text(const char *text, int max_tokens, text_piece_t **pieces) {
+    size_t len = strlen(text);
+    piece_list_t list = {0};
+
+    if (max_tokens <= 0 || count_tokens(text, len) <= max_tokens) {
+        // Sent as is, whitespace included
+        list.items = malloc(sizeof(text_piece_t));
+        if (!list.items) return -1;
+        list.items[0].start = 0;
+        list.items[0].length = len;
+        list.items[0].separator = 0;
+        *pieces = list.items;
+        return 1;
+    }
+
+    if (split_range(text, 0, len, max_tokens, CUT_SENTENCE, &list) != 0) {
+        free(list.items);
+        return -1;
+    }
+    *pieces = list.items;
+    return list.count;
+}
+
+int segment_request_limit(config_t *config, int prompt_tokens) {
+    if (config->context_window <= 0) return 0;
+    int limit = (config->context_window - prompt_tokens) / 2;
+    return limit < SEGMENT_MIN_TOKENS ? SEGMENT_MIN_TOKENS : limit;
+}
+
+int segment_batch_budget(config_t *config, int prompt_tokens) {
+    if (config->batch_tokens < 0) return 0;
+
+    int limit = segment_request_limit(config, prompt_tokens);
+    int budget = config->batch_tokens;
+    if (budget == 0) {
+        if (limit == 0) return 0; // Neither configured: one request per text node
+        budget = SEGMENT_TARGET_TOKENS;
+    }
+    return (limit > 0 && budget > limit) ? limit : budget;
+}
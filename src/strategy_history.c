@@ -47,6 +47,21 @@ static void history_update(void *state_ptr, const char *text, config_t *config)
     save_context(config->context_file, state->ctx);
 }
 
+static char* history_save_state(void *state_ptr) {
+    HistoryState *state = (HistoryState*)state_ptr;
+    if (!state || !state->ctx) return NULL;
+    return context_to_json(state->ctx);
+}
+
+static void history_load_state(void *state_ptr, const char *snapshot) {
+    HistoryState *state = (HistoryState*)state_ptr;
+    if (!state) return;
+    context_t *ctx = context_from_json(snapshot);
+    if (!ctx) return;
+    free_context(state->ctx);
+    state->ctx = ctx;
+}
+
 static void history_cleanup(void *state_ptr) {
     HistoryState *state = (HistoryState*)state_ptr;
     if (!state) return;
@@ -61,5 +76,7 @@ ContextStrategy* create_history_strategy() {
     strategy->get_prompt = history_get_prompt;
     strategy->update = history_update;
     strategy->cleanup = history_cleanup;
+    strategy->save_state = history_save_state;
+    strategy->load_state = history_load_state;
     return strategy;
 }
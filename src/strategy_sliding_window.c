@@ -1,68 +1,236 @@
 #include "context_strategy.h"
+#include "tokenizer.h"
+#include "xhtml_text.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+// Keeps the last config->sliding_window_size tokens of translated prose.
+// Chapters arrive as XHTML; only their text is kept, with paragraphs on
+// their own lines. The text is held in a ring of bytes, cut into pieces
+// (a word with the space before it, or a code-point aligned slice of a
+// long word or of unspaced CJK text) whose token counts are known, so
+// sliding the window forward drops whole pieces from the front without
+// moving the rest.
+
+// Longest piece in bytes; bounds how coarse the window is for text without spaces
+#define MAX_PIECE_BYTES 48
+
+typedef struct {
+    size_t bytes;
+    int tokens;
+} SlidingPiece;
+
 typedef struct {
-    char *buffer;
-    size_t size;
-    size_t capacity;
+    char *text;              // Byte ring
+    size_t text_capacity;
+    size_t text_start;
+    size_t text_size;
+    SlidingPiece *pieces;    // Piece ring, in text order
+    int piece_capacity;
+    int piece_start;
+    int piece_count;
+    int tokens;              // Sum over the pieces
+    int max_tokens;
 } SlidingState;
 
 static void* sliding_init(config_t *config) {
     if (config->sliding_window_size <= 0) return NULL;
-    
+
     SlidingState *state = calloc(1, sizeof(SlidingState));
-    state->capacity = config->sliding_window_size;
-    state->buffer = calloc(1, state->capacity + 1);
-    state->size = 0;
-    
-    printf("Initialized Sliding Window context (size: %zu)\n", state->capacity);
+    if (!state) return NULL;
+    state->max_tokens = config->sliding_window_size;
+    // Room for typical prose; the rings grow if the text is denser
+    state->text_capacity = (size_t)state->max_tokens * 8;
+    state->piece_capacity = state->max_tokens;
+    state->text = malloc(state->text_capacity);
+    state->pieces = malloc(state->piece_capacity * sizeof(SlidingPiece));
+    if (!state->text || !state->pieces) {
+        free(state->text);
+        free(state->pieces);
+        free(state);
+        return NULL;
+    }
+
+    printf("Initialized Sliding Window context (size: %d tokens)\n", state->max_tokens);
     return state;
 }
 
+// Copies the window text, in order, to out (text_size bytes)
+static void copy_window(const SlidingState *state, char *out) {
+    size_t first = state->text_capacity - state->text_start;
+    if (first >= state->text_size) {
+        memcpy(out, state->text + state->text_start, state->text_size);
+    } else {
+        memcpy(out, state->text + state->text_start, first);
+        memcpy(out + first, state->text, state->text_size - first);
+    }
+}
+
+// NUL-terminated window text without the separator in front of it
+static char* window_text(const SlidingState *state) {
+    char *out = malloc(state->text_size + 1);
+    if (!out) return NULL;
+    copy_window(state, out);
+    out[state->text_size] = 0;
+    size_t skip = strspn(out, " \n");
+    if (skip) memmove(out, out + skip, state->text_size - skip + 1);
+    return out;
+}
+
+static void drop_first_piece(SlidingState *state) {
+    SlidingPiece *piece = &state->pieces[state->piece_start];
+    state->text_start = (state->text_start + piece->bytes) % state->text_capacity;
+    state->text_size -= piece->bytes;
+    state->tokens -= piece->tokens;
+    state->piece_start = (state->piece_start + 1) % state->piece_capacity;
+    state->piece_count--;
+}
+
+// Grows the rings, unrolling them so they start at 0 again
+static int grow_text(SlidingState *state, size_t needed) {
+    size_t capacity = state->text_capacity * 2;
+    while (capacity < needed) capacity *= 2;
+    char *text = malloc(capacity);
+    if (!text) return -1;
+    copy_window(state, text);
+    free(state->text);
+    state->text = text;
+    state->text_capacity = capacity;
+    state->text_start = 0;
+    return 0;
+}
+
+static int grow_pieces(SlidingState *state) {
+    int capacity = state->piece_capacity * 2;
+    SlidingPiece *pieces = malloc(capacity * sizeof(SlidingPiece));
+    if (!pieces) return -1;
+    for (int i = 0; i < state->piece_count; i++) {
+        pieces[i] = state->pieces[(state->piece_start + i) % state->piece_capacity];
+    }
+    free(state->pieces);
+    state->pieces = pieces;
+    state->piece_capacity = capacity;
+    state->piece_start = 0;
+    return 0;
+}
+
+static void push_piece(SlidingState *state, const char *bytes, size_t len) {
+    int tokens = count_tokens(bytes, len);
+    if (tokens > state->max_tokens) return;
+    while (state->piece_count > 0 && state->tokens + tokens > state->max_tokens) {
+        drop_first_piece(state);
+    }
+    if (state->text_size + len > state->text_capacity && grow_text(state, state->text_size + len) != 0) return;
+    if (state->piece_count == state->piece_capacity && grow_pieces(state) != 0) return;
+
+    size_t end = (state->text_start + state->text_size) % state->text_capacity;
+    size_t first = state->text_capacity - end;
+    if (first >= len) {
+        memcpy(state->text + end, bytes, len);
+    } else {
+        memcpy(state->text + end, bytes, first);
+        memcpy(state->text, bytes + first, len - first);
+    }
+    state->text_size += len;
+    state->pieces[(state->piece_start + state->piece_count) % state->piece_capacity] =
+        (SlidingPiece){ len, tokens };
+    state->piece_count++;
+    state->tokens += tokens;
+}
+
+static int is_separator(char c) {
+    return c == ' ' || c == '\n';
+}
+
+// End of the piece starting at `start`: the next separator, or a
+// code-point boundary at most MAX_PIECE_BYTES on
+static size_t piece_end(const char *text, size_t len, size_t start) {
+    size_t end = start + 1;
+    while (end < len && !is_separator(text[end]) && end - start < MAX_PIECE_BYTES) end++;
+    if (end < len && !is_separator(text[end])) {
+        size_t cut = end;
+        while (cut > start + 1 && ((unsigned char)text[cut] & 0xC0) == 0x80) cut--;
+        if (cut > start + 1) end = cut;
+    }
+    return end;
+}
+
+// Start of the piece ending at `end`, mirroring piece_end()
+static size_t piece_start(const char *text, size_t end) {
+    size_t start = end - 1;
+    while (start > 0 && !is_separator(text[start]) && end - start < MAX_PIECE_BYTES) start--;
+    if (!is_separator(text[start])) {
+        while (start < end - 1 && ((unsigned char)text[start] & 0xC0) == 0x80) start++;
+    }
+    return start;
+}
+
+// Appends plain text whose words are separated by single spaces and
+// paragraphs by newlines. Only the tail that can stay in the window is
+// cut into pieces and counted.
+static void push_text(SlidingState *state, const char *text, size_t len) {
+    size_t from = len;
+    int tokens = 0;
+    while (from > 0 && tokens <= state->max_tokens) {
+        size_t start = piece_start(text, from);
+        tokens += count_tokens(text + start, from - start);
+        from = start;
+    }
+    while (from < len) {
+        size_t end = piece_end(text, len, from);
+        push_piece(state, text + from, end - from);
+        from = end;
+    }
+}
+
 static char* sliding_get_prompt(void *state_ptr, config_t *config) {
+    (void)config;
     SlidingState *state = (SlidingState*)state_ptr;
-    if (!state || state->size == 0) return NULL;
-    
-    char *out = malloc(state->size + 100);
-    snprintf(out, state->size + 100, "\n--- PREVIOUS TEXT ---\n%s\n---------------------\n", state->buffer);
+    if (!state || state->piece_count == 0) return NULL;
+
+    char *text = window_text(state);
+    if (!text) return NULL;
+    size_t size = strlen(text) + 100;
+    char *out = malloc(size);
+    if (out) snprintf(out, size, "\n--- PREVIOUS TEXT ---\n%s\n---------------------\n", text);
+    free(text);
     return out;
 }
 
 static void sliding_update(void *state_ptr, const char *text, config_t *config) {
+    (void)config;
     SlidingState *state = (SlidingState*)state_ptr;
     if (!state || !text) return;
-    
-    size_t text_len = strlen(text);
-    
-    // If new text is larger than capacity, take just the end
-    if (text_len >= state->capacity) {
-        memcpy(state->buffer, text + (text_len - state->capacity), state->capacity);
-        state->buffer[state->capacity] = 0;
-        state->size = state->capacity;
-    } else {
-        // Shift existing content to make room
-        size_t available = state->capacity - state->size;
-        
-        if (available >= text_len) {
-            // Append
-            strcat(state->buffer, text);
-            state->size += text_len;
-        } else {
-            // Shift left
-            size_t shift = text_len - available;
-            memmove(state->buffer, state->buffer + shift, state->size - shift);
-            strcat(state->buffer, text);
-            state->size = state->capacity; // Should be full now
-        }
-    }
+
+    size_t len;
+    char *plain = xhtml_text(text, &len);
+    if (!plain) return;
+    // The newline in front keeps the chapter from running into the last one
+    if (state->piece_count > 0) push_piece(state, "\n", 1);
+    push_text(state, plain, len);
+    free(plain);
+}
+
+static char* sliding_save_state(void *state_ptr) {
+    SlidingState *state = (SlidingState*)state_ptr;
+    if (!state) return NULL;
+    return window_text(state);
+}
+
+// The snapshot is plain text already; it is not run through xhtml_text()
+static void sliding_load_state(void *state_ptr, const char *snapshot) {
+    SlidingState *state = (SlidingState*)state_ptr;
+    if (!state || !snapshot) return;
+    while (state->piece_count > 0) drop_first_piece(state);
+    push_text(state, snapshot, strlen(snapshot));
 }
 
 static void sliding_cleanup(void *state_ptr) {
     SlidingState *state = (SlidingState*)state_ptr;
     if (!state) return;
-    free(state->buffer);
+    free(state->text);
+    free(state->pieces);
     free(state);
 }
 
@@ -73,5 +241,7 @@ ContextStrategy* create_sliding_window_strategy() {
     strategy->get_prompt = sliding_get_prompt;
     strategy->update = sliding_update;
     strategy->cleanup = sliding_cleanup;
+    strategy->save_state = sliding_save_state;
+    strategy->load_state = sliding_load_state;
     return strategy;
 }
@@ -0,0 +1,528 @@
+#include "context_strategy.h"
+#include "llm_client.h"
+#include "tokenizer.h"
+#include "worker_pool.h"
+#include "xhtml_text.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <strings.h>
+#include <unistd.h>
+
+// Builds a fixed terminology table before the first chapter is translated.
+// Every chapter is scanned locally, in parallel, for capitalized words and
+// runs of up to TERM_MAX_WORDS capitalized words (names, places, titles).
+// The ones that recur and are rarely seen in lower case are ranked by
+// frequency, and a single LLM call translates the best
+// config->terminology_terms of them. The table then goes into every prompt
+// of the run unchanged, so it costs one context call per book instead of
+// one per chapter. Scripts without capital letters yield no candidates.
+
+#define TERM_MAX_WORDS 3
+
+// Occurrences a single word needs to be a candidate; runs need 2
+#define TERM_MIN_WORD_COUNT 3
+
+// Capitalized words that are no names, and never start a run
+static const char *stop_words[] = {
+    "I", "I'm", "I'll", "I've", "I'd", "Mr", "Mrs", "Ms", "Dr", "St", "OK", "The", "A", "An", NULL
+};
+
+// Counts of one candidate (or, with `lower`, of a lower-case word)
+typedef struct {
+    char *text;
+    int mid;        // Capitalized within a sentence
+    int initial;    // Capitalized at the start of a sentence, where that proves nothing
+    int lower;      // Seen in lower case
+    int words;
+    int covered;    // Nearly always part of a longer candidate
+} term_count_t;
+
+typedef struct {
+    term_count_t *items;
+    int count;
+    int capacity;
+    int *index;     // Open-addressing hash table: text -> item (-1 = empty)
+    int index_size;
+} term_table_t;
+
+typedef struct {
+    worker_job_t job;
+    const char *xhtml;
+    term_table_t table;
+} term_scan_t;
+
+typedef struct {
+    int max_terms;
+    char *table;    // "source => translation" lines, NULL until built
+} TerminologyState;
+
+static uint32_t hash_text(const char *text, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)text[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int grow_index(term_table_t *table) {
+    int size = table->index_size ? table->index_size * 2 : 1024;
+    int *index = malloc(size * sizeof(int));
+    if (!index) return -1;
+    for (int i = 0; i < size; i++) index[i] = -1;
+    for (int i = 0; i < table->count; i++) {
+        uint32_t slot = hash_text(table->items[i].text, strlen(table->items[i].text)) & (size - 1);
+        while (index[slot] >= 0) slot = (slot + 1) & (size - 1);
+        index[slot] = i;
+    }
+    free(table->index);
+    table->index = index;
+    table->index_size = size;
+    return 0;
+}
+
+static term_count_t* find_term(const term_table_t *table, const char *text, size_t len) {
+    if (!table->index) return NULL;
+    uint32_t slot = hash_text(text, len) & (table->index_size - 1);
+    while (table->index[slot] >= 0) {
+        term_count_t *item = &table->items[table->index[slot]];
+        if (strncmp(item->text, text, len) == 0 && item->text[len] == 0) return item;
+        slot = (slot + 1) & (table->index_size - 1);
+    }
+    return NULL;
+}
+
+// The counts of text, added to the table if it is new. NULL when out of memory.
+static term_count_t* get_term(term_table_t *table, const char *text, size_t len, int words) {
+    term_count_t *item = find_term(table, text, len);
+    if (item) return item;
+    if (table->count * 2 >= table->index_size && grow_index(table) != 0) return NULL;
+    if (table->count == table->capacity) {
+        int capacity = table->capacity ? table->capacity * 2 : 512;
+        term_count_t *grown = realloc(table->items, capacity * sizeof(term_count_t));
+        if (!grown) return NULL;
+        table->items = grown;
+        table->capacity = capacity;
+    }
+    item = &table->items[table->count];
+    memset(item, 0, sizeof(*item));
+    item->text = strndup(text, len);
+    if (!item->text) return NULL;
+    item->words = words;
+
+    uint32_t slot = hash_text(text, len) & (table->index_size - 1);
+    while (table->index[slot] >= 0) slot = (slot + 1) & (table->index_size - 1);
+    table->index[slot] = table->count++;
+    return item;
+}
+
+static void free_table(term_table_t *table) {
+    for (int i = 0; i < table->count; i++) free(table->items[i].text);
+    free(table->items);
+    free(table->index);
+    memset(table, 0, sizeof(*table));
+}
+
+static int is_letter(unsigned int cp) {
+    if (cp < 0x80) return (cp | 0x20) >= 'a' && (cp | 0x20) <= 'z';
+    if (cp < 0xC0 || cp == 0xD7 || cp == 0xF7) return 0;
+    if (cp >= 0x2000 && cp < 0x2C00) return 0;   // Punctuation, symbols, arrows
+    if (cp >= 0x3000 && cp < 0x3040) return 0;   // CJK punctuation
+    return 1;
+}
+
+// Letters of the alphabets with a case: Latin, Greek and Cyrillic
+static int is_cased(unsigned int cp) {
+    return cp < 0x250 || (cp >= 0x370 && cp < 0x530);
+}
+
+// Upper-case letters of those alphabets
+static int is_upper(unsigned int cp) {
+    if (cp < 0x80) return cp >= 'A' && cp <= 'Z';
+    if (cp >= 0xC0 && cp <= 0xDE) return cp != 0xD7;
+    // Latin Extended-A alternates upper and lower case, shifting parity twice
+    if ((cp >= 0x100 && cp < 0x138) || (cp >= 0x14A && cp < 0x178)) return !(cp & 1);
+    if ((cp >= 0x139 && cp < 0x149) || (cp >= 0x179 && cp < 0x17F)) return cp & 1;
+    if (cp == 0x178) return 1;
+    if (cp >= 0x391 && cp <= 0x3A9) return 1;
+    if (cp >= 0x400 && cp <= 0x42F) return 1;
+    return 0;
+}
+
+static int is_stop_word(const char *text, size_t len) {
+    for (int i = 0; stop_words[i]; i++) {
+        if (strlen(stop_words[i]) == len && strncmp(stop_words[i], text, len) == 0) return 1;
+    }
+    return 0;
+}
+
+// End of the word starting at text[i]: letters, with apostrophes and
+// hyphens between them
+static size_t word_end(const char *text, size_t len, size_t i) {
+    const unsigned char *t = (const unsigned char*)text;
+    unsigned int cp;
+    while (i < len) {
+        int n = utf8_decode(t + i, len - i, &cp);
+        if (is_letter(cp)) {
+            i += n;
+            continue;
+        }
+        // ' ’ - joining two letters
+        unsigned int next = 0;
+        if ((cp == '\'' || cp == 0x2019 || cp == '-') && i + n < len) utf8_decode(t + i + n, len - i - n, &next);
+        if (!is_letter(next)) break;
+        i += n;
+    }
+    return i;
+}
+
+// Counts capitalized words and runs, and lower-case words, in plain text
+static void scan_text(term_table_t *table, const char *text, size_t len) {
+    const unsigned char *t = (const unsigned char*)text;
+    size_t run_start[TERM_MAX_WORDS];
+    int run_initial[TERM_MAX_WORDS];
+    int run = 0, sentence_start = 1;
+    size_t i = 0;
+    while (i < len) {
+        unsigned int cp;
+        int n = utf8_decode(t + i, len - i, &cp);
+        if (!is_letter(cp)) {
+            if (cp == '.' || cp == '!' || cp == '?' || cp == 0x2026 || cp == '\n') sentence_start = 1;
+            // Only a single space continues a run of capitalized words
+            if (cp != ' ') run = 0;
+            i += n;
+            continue;
+        }
+        size_t end = word_end(text, len, i);
+        if (is_upper(cp) && !is_stop_word(text + i, end - i)) {
+            if (run == TERM_MAX_WORDS) {
+                memmove(run_start, run_start + 1, (TERM_MAX_WORDS - 1) * sizeof(size_t));
+                memmove(run_initial, run_initial + 1, (TERM_MAX_WORDS - 1) * sizeof(int));
+                run--;
+            }
+            run_start[run] = i;
+            run_initial[run] = sentence_start;
+            run++;
+            // Every run ending at this word: "Tirith", "Minas Tirith", ...
+            for (int k = run - 1; k >= 0; k--) {
+                term_count_t *item = get_term(table, text + run_start[k], end - run_start[k], run - k);
+                if (!item) return;
+                if (run_initial[k]) item->initial++;
+                else item->mid++;
+            }
+        } else {
+            run = 0;
+            if (!is_upper(cp) && is_cased(cp)) {
+                term_count_t *item = get_term(table, text + i, end - i, 1);
+                if (!item) return;
+                item->lower++;
+            }
+        }
+        sentence_start = 0;
+        i = end;
+    }
+}
+
+static void scan_chapter(void *arg) {
+    term_scan_t *scan = (term_scan_t*)arg;
+    size_t len;
+    char *text = xhtml_text(scan->xhtml, &len);
+    if (!text) return;
+    scan_text(&scan->table, text, len);
+    free(text);
+}
+
+// Lower-case form of a capitalized word: its first letter folded
+static size_t fold_first(const char *word, char *out, size_t size) {
+    size_t len = strlen(word);
+    if (len + 1 > size) return 0;
+    memcpy(out, word, len + 1);
+    unsigned char c = (unsigned char)out[0];
+    if (c >= 'A' && c <= 'Z') out[0] = (char)(c + 32);
+    else if (c == 0xC3 && (unsigned char)out[1] >= 0x80 && (unsigned char)out[1] <= 0x9E) out[1] = (char)(out[1] + 32);
+    return len;
+}
+
+static int candidate_count(const term_count_t *item) {
+    return item->mid + item->initial;
+}
+
+// Whether the counts make a name or term rather than an ordinary word
+static int is_candidate(const term_table_t *table, const term_count_t *item) {
+    int total = candidate_count(item);
+    if (total == 0 || item->covered || item->mid == 0) return 0;
+    if (item->words > 1) return total >= 2;
+    if (total < TERM_MIN_WORD_COUNT || strlen(item->text) < 2) return 0;
+    char lower[256];
+    size_t len = fold_first(item->text, lower, sizeof(lower));
+    const term_count_t *seen = len ? find_term(table, lower, len) : NULL;
+    return !seen || seen->lower * 4 <= total;
+}
+
+// A shorter candidate that nearly always occurs inside a longer one
+// ("Minas" in "Minas Tirith") adds nothing of its own
+static void mark_covered(term_table_t *table) {
+    for (int i = 0; i < table->count; i++) {
+        term_count_t *item = &table->items[i];
+        // Only a run that is a candidate itself hides its parts
+        if (item->words < 2 || candidate_count(item) < 2 || item->mid == 0) continue;
+        const char *text = item->text;
+        size_t len = strlen(text);
+        // Every sub-run: starts and ends at word boundaries
+        for (size_t start = 0; start < len; start++) {
+            if (start > 0 && text[start - 1] != ' ') continue;
+            for (size_t end = start + 1; end <= len; end++) {
+                if ((end < len && text[end] != ' ') || (start == 0 && end == len)) continue;
+                term_count_t *part = find_term(table, text + start, end - start);
+                if (part && candidate_count(item) * 5 >= candidate_count(part) * 4) part->covered = 1;
+            }
+        }
+    }
+}
+
+static int compare_by_score(const void *a, const void *b) {
+    const term_count_t *x = *(term_count_t* const*)a, *y = *(term_count_t* const*)b;
+    int sx = candidate_count(x) * x->words, sy = candidate_count(y) * y->words;
+    if (sx != sy) return sy - sx;
+    return strcmp(x->text, y->text);
+}
+
+static const char* skip_list_marker(const char *line) {
+    while (*line == ' ' || *line == '-' || *line == '*') line++;
+    const char *p = line;
+    while (*p >= '0' && *p <= '9') p++;
+    if (p > line && (*p == '.' || *p == ')') && p[1] == ' ') return p + 2;
+    return line;
+}
+
+// Table lines "source => translation" for the candidates the reply
+// translated, in candidate order. Reply lines are "term<TAB>translation";
+// "term => translation" and "term -> translation" are accepted too.
+static char* parse_translations(const char *reply, term_count_t **terms, int count) {
+    char **translations = calloc(count, sizeof(char*));
+    if (!translations) return NULL;
+    char *copy = strdup(reply);
+    char *save = NULL;
+    for (char *line = copy ? strtok_r(copy, "\n", &save) : NULL; line; line = strtok_r(NULL, "\n", &save)) {
+        char *source = (char*)skip_list_marker(line), *target = NULL, *sep;
+        if ((sep = strchr(source, '\t'))) target = sep + 1;
+        else if ((sep = strstr(source, "=>")) || (sep = strstr(source, "->"))) target = sep + 2;
+        if (!target) continue;
+        *sep = 0;
+        while (sep > source && (sep[-1] == ' ' || sep[-1] == '\t')) *--sep = 0;
+        while (*target == ' ' || *target == '\t') target++;
+        size_t target_len = strcspn(target, "\r");
+        while (target_len > 0 && target[target_len - 1] == ' ') target_len--;
+        target[target_len] = 0;
+        if (!*target) continue;
+        for (int k = 0; k < count; k++) {
+            if (!translations[k] && strcasecmp(terms[k]->text, source) == 0) {
+                translations[k] = strdup(target);
+                break;
+            }
+        }
+    }
+    free(copy);
+
+    size_t size = 1;
+    for (int k = 0; k < count; k++) {
+        if (translations[k]) size += strlen(terms[k]->text) + strlen(translations[k]) + 5;
+    }
+    char *table = malloc(size);
+    size_t pos = 0;
+    if (table) table[0] = 0;
+    for (int k = 0; k < count; k++) {
+        if (table && translations[k]) {
+            pos += snprintf(table + pos, size - pos, "%s => %s\n", terms[k]->text, translations[k]);
+        }
+        free(translations[k]);
+    }
+    free(translations);
+    if (table && pos == 0) {
+        free(table);
+        table = NULL;
+    }
+    return table;
+}
+
+// The terms one per line, as they are sent to the LLM (caller frees)
+static char* term_list(term_count_t **terms, int count, size_t *len) {
+    size_t size = 1;
+    for (int k = 0; k < count; k++) size += strlen(terms[k]->text) + 1;
+    char *list = malloc(size);
+    if (!list) return NULL;
+    size_t pos = 0;
+    list[0] = 0;
+    for (int k = 0; k < count; k++) pos += snprintf(list + pos, size - pos, "%s\n", terms[k]->text);
+    *len = pos;
+    return list;
+}
+
+static char* translate_terms(term_count_t **terms, int count, config_t *config) {
+    size_t pos;
+    char *list = term_list(terms, count, &pos);
+    if (!list) return NULL;
+
+    size_t prompt_size = strlen(config->prompt_terminology) + strlen(config->target_language) + 1;
+    char *prompt = malloc(prompt_size);
+    char *reply = NULL;
+    if (prompt) {
+        snprintf(prompt, prompt_size, config->prompt_terminology, config->target_language);
+        llm_request_t request = {
+            .system_prompt = prompt,
+            .user_content = list,
+            .temperature = 0.1,
+            .expected_tokens = count_tokens(list, pos) * 3
+        };
+        reply = llm_chat(config, &request);
+    }
+    char *table = reply ? parse_translations(reply, terms, count) : NULL;
+    free(reply);
+    free(prompt);
+    free(list);
+    return table;
+}
+
+static void* terminology_init(config_t *config) {
+    if (config->terminology_terms <= 0) return NULL;
+    TerminologyState *state = calloc(1, sizeof(TerminologyState));
+    if (!state) return NULL;
+    state->max_terms = config->terminology_terms;
+    printf("Initialized Terminology context (up to %d terms)\n", state->max_terms);
+    return state;
+}
+
+// Scans the chapters in parallel and ranks what they have in common into
+// `book`. Returns its best `max` candidates, best first, with their count
+// in *found, or NULL on failure (caller frees the array and the table).
+static term_count_t** find_candidates(term_table_t *book, char **chapters, int count, int max, int *found) {
+    *found = 0;
+    if (count <= 0) return NULL;
+    term_scan_t *scans = calloc(count, sizeof(term_scan_t));
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = cpus > 0 && cpus < count ? (int)cpus : count;
+    worker_pool_t *pool = scans ? worker_pool_create(threads) : NULL;
+    if (!pool) {
+        free(scans);
+        return NULL;
+    }
+    for (int c = 0; c < count; c++) {
+        scans[c].xhtml = chapters[c];
+        scans[c].job.fn = scan_chapter;
+        scans[c].job.arg = &scans[c];
+        if (chapters[c]) worker_pool_submit(pool, &scans[c].job);
+    }
+    worker_pool_destroy(pool);
+
+    for (int c = 0; c < count; c++) {
+        for (int i = 0; i < scans[c].table.count; i++) {
+            const term_count_t *item = &scans[c].table.items[i];
+            term_count_t *total = get_term(book, item->text, strlen(item->text), item->words);
+            if (!total) break;
+            total->mid += item->mid;
+            total->initial += item->initial;
+            total->lower += item->lower;
+        }
+        free_table(&scans[c].table);
+    }
+    free(scans);
+
+    mark_covered(book);
+    term_count_t **terms = malloc((book->count ? book->count : 1) * sizeof(term_count_t*));
+    if (!terms) return NULL;
+    int term_count = 0;
+    for (int i = 0; i < book->count; i++) {
+        if (is_candidate(book, &book->items[i])) terms[term_count++] = &book->items[i];
+    }
+    qsort(terms, term_count, sizeof(term_count_t*), compare_by_score);
+    *found = term_count < max ? term_count : max;
+    return terms;
+}
+
+char* terminology_candidates(char **chapters, int count, int max) {
+    term_table_t book = {0};
+    int found;
+    term_count_t **terms = find_candidates(&book, chapters, count, max, &found);
+    size_t len;
+    char *list = found > 0 ? term_list(terms, found, &len) : NULL;
+    free(terms);
+    free_table(&book);
+    return list;
+}
+
+static void terminology_prescan(void *state_ptr, char **chapters, int count, config_t *config) {
+    TerminologyState *state = (TerminologyState*)state_ptr;
+    // A resumed run has its table from the journal
+    if (!state || state->table || count <= 0) return;
+
+    term_table_t book = {0};
+    int term_count;
+    term_count_t **terms = find_candidates(&book, chapters, count, state->max_terms, &term_count);
+    if (!terms) {
+        free_table(&book);
+        return;
+    }
+    if (term_count > 0) {
+        state->table = translate_terms(terms, term_count, config);
+        if (state->table) {
+            int translated = 0;
+            for (const char *p = state->table; *p; p++) translated += *p == '\n';
+            printf("Terminology: %d of %d candidate terms translated\n", translated, term_count);
+        } else {
+            fprintf(stderr, "Terminology: the candidate terms could not be translated\n");
+        }
+    } else {
+        printf("Terminology: no recurring names or terms found\n");
+    }
+    free(terms);
+    free_table(&book);
+}
+
+static char* terminology_get_prompt(void *state_ptr, config_t *config) {
+    (void)config;
+    TerminologyState *state = (TerminologyState*)state_ptr;
+    if (!state || !state->table) return NULL;
+
+    size_t size = strlen(state->table) + 100;
+    char *out = malloc(size);
+    if (out) snprintf(out, size, "--- TERMINOLOGY ---\n%s---------------------\n", state->table);
+    return out;
+}
+
+// The table is fixed for the run
+static void terminology_update(void *state_ptr, const char *text, config_t *config) {
+    (void)state_ptr; (void)text; (void)config;
+}
+
+static char* terminology_save_state(void *state_ptr) {
+    TerminologyState *state = (TerminologyState*)state_ptr;
+    if (!state || !state->table) return NULL;
+    return strdup(state->table);
+}
+
+static void terminology_load_state(void *state_ptr, const char *snapshot) {
+    TerminologyState *state = (TerminologyState*)state_ptr;
+    if (!state || !snapshot || !*snapshot) return;
+    free(state->table);
+    state->table = strdup(snapshot);
+}
+
+static void terminology_cleanup(void *state_ptr) {
+    TerminologyState *state = (TerminologyState*)state_ptr;
+    if (!state) return;
+    free(state->table);
+    free(state);
+}
+
+ContextStrategy* create_terminology_strategy() {
+    ContextStrategy *strategy = calloc(1, sizeof(ContextStrategy));
+    strategy->name = "Terminology";
+    strategy->init = terminology_init;
+    strategy->get_prompt = terminology_get_prompt;
+    strategy->update = terminology_update;
+    strategy->cleanup = terminology_cleanup;
+    strategy->save_state = terminology_save_state;
+    strategy->load_state = terminology_load_state;
+    strategy->prescan = terminology_prescan;
+    return strategy;
+}
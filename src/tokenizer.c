@@ -0,0 +1,127 @@
+#include "tokenizer.h"
+#include <string.h>
+
+int utf8_decode(const unsigned char *s, size_t len, unsigned int *cp) {
+    unsigned char c = s[0];
+    int n;
+    if (c < 0x80) { *cp = c; return 1; }
+    else if ((c & 0xE0) == 0xC0) { n = 2; *cp = c & 0x1F; }
+    else if ((c & 0xF0) == 0xE0) { n = 3; *cp = c & 0x0F; }
+    else if ((c & 0xF8) == 0xF0) { n = 4; *cp = c & 0x07; }
+    else { *cp = c; return 1; }
+
+    if ((size_t)n > len) { *cp = c; return 1; }
+    for (int i = 1; i < n; i++) {
+        if ((s[i] & 0xC0) != 0x80) { *cp = c; return 1; }
+        *cp = (*cp << 6) | (s[i] & 0x3F);
+    }
+    return n;
+}
+
+typedef enum {
+    CLASS_SPACE,
+    CLASS_NEWLINE,
+    CLASS_LATIN,     // ASCII and Latin-script letters (incl. accents)
+    CLASS_ALPHABET,  // Other alphabets (Cyrillic, Greek, Arabic, Hebrew, Indic...)
+    CLASS_IDEOGRAPH, // CJK, kana, hangul: roughly one token per character
+    CLASS_DIGIT,
+    CLASS_OTHER      // Punctuation and symbols
+} char_class_t;
+
+static char_class_t classify(unsigned int cp) {
+    if (cp == '\n' || cp == '\r') return CLASS_NEWLINE;
+    if (cp == ' ' || cp == '\t' || cp == 0xA0 || cp == 0x3000) return CLASS_SPACE;
+    if (cp >= '0' && cp <= '9') return CLASS_DIGIT;
+    if ((cp >= 'a' && cp <= 'z') || (cp >= 'A' && cp <= 'Z')) return CLASS_LATIN;
+    if (cp < 0x80) return CLASS_OTHER;
+    if (cp >= 0xC0 && cp <= 0x24F && cp != 0xD7 && cp != 0xF7) return CLASS_LATIN;
+    if (cp >= 0x1E00 && cp <= 0x1EFF) return CLASS_LATIN;
+    if ((cp >= 0x3040 && cp <= 0x30FF) || (cp >= 0x3400 && cp <= 0x9FFF) ||
+        (cp >= 0xAC00 && cp <= 0xD7AF) || (cp >= 0xF900 && cp <= 0xFAFF) ||
+        (cp >= 0x20000 && cp <= 0x2FFFF)) return CLASS_IDEOGRAPH;
+    if ((cp >= 0x370 && cp <= 0x1FFF) || (cp >= 0xA640 && cp <= 0xA69F)) return CLASS_ALPHABET;
+    return CLASS_OTHER;
+}
+
+// Cost of a run of `chars` characters of one class
+static int run_cost(char_class_t cls, int chars, int bytes) {
+    switch (cls) {
+        case CLASS_LATIN:
+            // Frequent words are single tokens; longer ones split into
+            // pieces of ~4 characters. Accented letters cost extra bytes.
+            if (chars <= 6 && bytes == chars) return 1;
+            return 1 + (chars - 3 + (bytes - chars) / 2) / 4;
+        case CLASS_ALPHABET:
+            return 1 + chars / 3;
+        case CLASS_IDEOGRAPH:
+            return chars;
+        case CLASS_DIGIT:
+            return (chars + 2) / 3; // Digits are grouped by three
+        case CLASS_NEWLINE:
+            return 1;
+        case CLASS_OTHER:
+            return chars <= 2 ? 1 : (chars + 1) / 2;
+        case CLASS_SPACE:
+        default:
+            return 0;
+    }
+}
+
+int count_tokens(const char *text, size_t len) {
+    if (!text) return 0;
+
+    const unsigned char *s = (const unsigned char*)text;
+    int tokens = 0;
+    size_t i = 0;
+    int pending_spaces = 0; // Spaces not absorbed by a following word
+
+    while (i < len) {
+        unsigned int cp;
+        int n = utf8_decode(s + i, len - i, &cp);
+        char_class_t cls = classify(cp);
+
+        if (cls == CLASS_SPACE) {
+            pending_spaces++;
+            i += n;
+            continue;
+        }
+
+        // Collect the run of this class
+        int chars = 0, bytes = 0;
+        size_t j = i;
+        while (j < len) {
+            unsigned int next_cp;
+            int m = utf8_decode(s + j, len - j, &next_cp);
+            char_class_t next_cls = classify(next_cp);
+            if (next_cls != cls) {
+                // English contractions ("'s", "'ll") stay with the word
+                if (cls == CLASS_LATIN && next_cp == '\'' && j + 1 < len &&
+                    classify(s[j + 1]) == CLASS_LATIN) {
+                    tokens++;
+                    j += m;
+                    continue;
+                }
+                break;
+            }
+            chars++;
+            bytes += m;
+            j += m;
+            // Ideographs are not merged into runs by the pre-tokenizer
+            if (cls == CLASS_IDEOGRAPH) break;
+        }
+
+        // One space is absorbed by the word that follows it; longer runs
+        // of spaces become a token of their own
+        if (pending_spaces > 1) tokens++;
+        pending_spaces = 0;
+
+        tokens += run_cost(cls, chars, bytes);
+        i = j;
+    }
+    if (pending_spaces > 0) tokens++;
+    return tokens;
+}
+
+int count_tokens_str(const char *text) {
+    return text ? count_tokens(text, strlen(text)) : 0;
+}
@@ -1,176 +1,504 @@
 #include "common.h"
+#include "llm_client.h"
+#include "batch.h"
+#include "cache.h"
+#include "journal.h"
+#include "segment.h"
+#include "tokenizer.h"
+#include "metrics.h"
+#include "arena.h"
+#include "prefilter.h"
+#include "langid.h"
+#include "batch_api.h"
+#include "glossary.h"
 #include <libxml/HTMLparser.h>
-#include <curl/curl.h>
-#include <json-c/json.h>
-#include <ctype.h>
-
-// Simple callback for curl write
-// Dynamic write callback
-size_t write_callback_dynamic(void *ptr, size_t size, size_t nmemb, void *userdata) {
-    size_t real_size = size * nmemb;
-    struct {
-        char *response;
-        size_t size;
-    } *mem = userdata;
-
-    char *ptr_realloc = realloc(mem->response, mem->size + real_size + 1);
-    if(ptr_realloc == NULL) return 0; // Out of memory
-
-    mem->response = ptr_realloc;
-    memcpy(&(mem->response[mem->size]), ptr, real_size);
-    mem->size += real_size;
-    mem->response[mem->size] = 0;
-
-    return real_size;
-}
-
-char* llm_translate(const char *text, config_t *config, const char *context_string) {
-    if (!text || strlen(text) < 1) return NULL;
-
-    // Skip whitespace-only strings (including NBSP 0xC2 0xA0)
-    int is_empty = 1;
-    size_t len = strlen(text);
-    for (size_t i = 0; i < len; i++) {
-        unsigned char c = (unsigned char)text[i];
-        if (isspace(c)) continue;
-        // Check for NBSP in UTF-8 (0xC2 0xA0)
-        if (c == 0xC2 && i + 1 < len && (unsigned char)text[i+1] == 0xA0) {
-            i++; // Skip the next byte too
+#include <limits.h>
+
+// Whether text has words to translate. Text kept verbatim is counted.
+static int needs_translation(const char *text, size_t len) {
+    prefilter_class_t class = prefilter_classify(text, len);
+    if (class == PREFILTER_VERBATIM) metrics_count(COUNTER_PREFILTERED, 1);
+    return class == PREFILTER_TRANSLATE;
+}
+
+// Whether a segment is already written in the target language, e.g. a
+// quotation or a partly translated source. Such segments are counted.
+static int in_target_language(const char *text, config_t *config) {
+    double threshold = config->langid_threshold != 0 ? config->langid_threshold : LANGID_DEFAULT_THRESHOLD;
+    if (threshold < 0 || !langid_is_language(text, strlen(text), config->target_language, threshold)) return 0;
+    metrics_count(COUNTER_LANGID_SKIPPED, 1);
+    metrics_count(COUNTER_LANGID_SKIPPED_TOKENS, count_tokens_str(text));
+    return 1;
+}
+
+// All glossary entries occurring in the segments, without duplicates, in
+// *found (allocated in `arena`, or on the heap if it is NULL). Returns the
+// count, or -1 when out of memory.
+static int find_glossary_entries(const batch_segment_t *segments, int count, int **found, arena_t *arena) {
+    int capacity = GLOSSARY_MAX_MATCHES, found_count = 0;
+    *found = arena ? arena_alloc(arena, capacity * sizeof(int)) : malloc(capacity * sizeof(int));
+    for (int i = 0; *found && i < count; i++) {
+        size_t len = strlen(segments[i].text);
+        // A full array may have cut the scan short; grow it and scan again
+        while ((found_count = glossary_find(segments[i].text, len, *found, found_count, capacity)) == capacity) {
+            size_t size = capacity * sizeof(int);
+            int *grown = arena ? arena_realloc(arena, *found, size, 2 * size) : realloc(*found, 2 * size);
+            if (!grown) {
+                if (!arena) free(*found);
+                *found = NULL;
+                break;
+            }
+            *found = grown;
+            capacity *= 2;
+        }
+    }
+    return *found ? found_count : -1;
+}
+
+// Glossary entries occurring in the segments, as a prompt section. NULL
+// when there are none; allocated like glossary_prompt() does.
+static char* glossary_hint(const batch_segment_t *segments, int count, arena_t *arena) {
+    int *found;
+    int found_count = find_glossary_entries(segments, count, &found, arena);
+    char *hint = found_count > 0 ? glossary_prompt(found, found_count, arena) : NULL;
+    if (!arena) free(found);
+    return hint;
+}
+
+static size_t section_size(const char *separator, const char *text) {
+    return text && *text ? strlen(separator) + strlen(text) : 0;
+}
+
+static void append_section(char *buf, size_t *pos, const char *separator, const char *text) {
+    if (!text || !*text) return;
+    size_t separator_len = strlen(separator), len = strlen(text);
+    memcpy(buf + *pos, separator, separator_len);
+    memcpy(buf + *pos + separator_len, text, len);
+    *pos += separator_len + len;
+}
+
+// The system prompt puts the parts that change least first, so that the
+// provider's prefix cache can reuse them from one request to the next:
+//   instructions   the same for the whole run
+//   batch rules    the same for every request carrying marked segments
+//   context        the same for every request of a chapter
+//   glossary       the terms of this request
+// The text itself is the user message. The prompt is sized to fit all of
+// it and allocated in `arena`, or on the heap (caller frees) if it is NULL.
+static char* format_system_prompt(config_t *config, const char *context_string, const char *glossary,
+                                  int batched, arena_t *arena) {
+    // Older templates have a second %s for the context; it is left empty
+    int head = snprintf(NULL, 0, config->prompt_translation, config->target_language, "");
+    if (head < 0) return NULL;
+    const char *batch_rules = batched ? config->prompt_batch : NULL;
+    size_t size = head + section_size("\n", batch_rules) + section_size("\n\n", context_string) +
+                  section_size("\n\n", glossary) + 1;
+    char *prompt = arena ? arena_alloc(arena, size) : malloc(size);
+    if (!prompt) return NULL;
+
+    snprintf(prompt, size, config->prompt_translation, config->target_language, "");
+    size_t pos = head;
+    append_section(prompt, &pos, "\n", batch_rules);
+    append_section(prompt, &pos, "\n\n", context_string);
+    append_section(prompt, &pos, "\n\n", glossary);
+    prompt[pos] = 0;
+    return prompt;
+}
+
+// One request for one text, bypassing the cache. The reply is allocated in
+// `arena` (NULL: on the heap).
+static char* request_translation(const char *text, config_t *config, const char *context_string, arena_t *arena) {
+    batch_segment_t segment = { .text = text };
+    char *glossary = glossary_hint(&segment, 1, arena);
+    char *system_prompt = format_system_prompt(config, context_string, glossary, 0, arena);
+    if (!arena) free(glossary);
+    if (!system_prompt) return NULL;
+
+    llm_request_t request = {
+        .system_prompt = system_prompt,
+        .user_content = text,
+        .temperature = 0.3, // Low temperature to be deterministic if possible
+        .expected_tokens = count_tokens_str(text),
+        .arena = arena
+    };
+    char *reply = llm_chat(config, &request);
+    if (!arena) free(system_prompt);
+    return reply;
+}
+
+
+// Text nodes of a document, in document order
+typedef struct {
+    xmlNode **items;
+    int count;
+    int capacity;
+    arena_t *arena;
+} node_list_t;
+
+static void collect_text_nodes(xmlNode *node, node_list_t *list) {
+    for (xmlNode *cur = node; cur; cur = cur->next) {
+        if (cur->type == XML_TEXT_NODE && cur->content &&
+            needs_translation((const char*)cur->content, strlen((const char*)cur->content))) {
+            if (list->count == list->capacity) {
+                int new_capacity = list->capacity ? list->capacity * 2 : 64;
+                xmlNode **items = arena_realloc(list->arena, list->items,
+                    list->capacity * sizeof(xmlNode*), new_capacity * sizeof(xmlNode*));
+                if (!items) return;
+                list->items = items;
+                list->capacity = new_capacity;
+            }
+            list->items[list->count++] = cur;
+        }
+        collect_text_nodes(cur->children, list);
+    }
+}
+
+// Request-sized pieces of the text nodes, in document order. Segment ids
+// are the index in this list, which is stable across runs with the same
+// segmentation settings because the source file is not modified until the
+// chapter is complete. Everything lives in the chapter's arena.
+typedef struct {
+    batch_segment_t *segments;  // Source texts and translations
+    int *nodes;                 // Text node each segment was cut from
+    char **separators;          // Whitespace that followed it in the node
+    int count;
+    int capacity;
+    arena_t *arena;
+} segment_list_t;
+
+static int add_segment(segment_list_t *list, int node, const char *text, size_t length, const char *separator, size_t separator_length) {
+    if (list->count == list->capacity) {
+        int old_capacity = list->capacity;
+        int new_capacity = old_capacity ? old_capacity * 2 : 64;
+        batch_segment_t *segments = arena_realloc(list->arena, list->segments,
+            old_capacity * sizeof(batch_segment_t), new_capacity * sizeof(batch_segment_t));
+        if (!segments) return -1;
+        list->segments = segments;
+        int *nodes = arena_realloc(list->arena, list->nodes, old_capacity * sizeof(int), new_capacity * sizeof(int));
+        if (!nodes) return -1;
+        list->nodes = nodes;
+        char **separators = arena_realloc(list->arena, list->separators,
+            old_capacity * sizeof(char*), new_capacity * sizeof(char*));
+        if (!separators) return -1;
+        list->separators = separators;
+        list->capacity = new_capacity;
+    }
+    int i = list->count++;
+    list->segments[i].id = i;
+    list->segments[i].text = arena_strndup(list->arena, text, length);
+    list->segments[i].translation = NULL;
+    list->nodes[i] = node;
+    list->separators[i] = arena_strndup(list->arena, separator, separator_length);
+    return 0;
+}
+
+// Copies the node texts without their leading and trailing whitespace,
+// cutting the ones over max_tokens into pieces. The trailing whitespace
+// becomes the separator of the last piece; apply_translations() puts the
+// leading whitespace back.
+static void split_nodes(const node_list_t *nodes, int max_tokens, segment_list_t *list) {
+    for (int n = 0; n < nodes->count; n++) {
+        const char *content = (const char*)nodes->items[n]->content;
+        size_t length = strlen(content), start, end;
+        prefilter_trim(content, length, &start, &end);
+        const char *tail = content + end;
+        char *core = arena_strndup(list->arena, content + start, end - start);
+        if (!core) continue;
+
+        text_piece_t *pieces = NULL;
+        int count = segment_text(core, max_tokens, &pieces);
+        if (count <= 0) {
+            add_segment(list, n, core, end - start, tail, length - end);
             continue;
         }
-        is_empty = 0;
-        break;
-    }
-    if (is_empty) return NULL;
-
-    // printf("DEBUG: Translating '%s'\n", text);
-
-    CURL *curl = curl_easy_init();
-    if (!curl) return NULL;
-
-    struct curl_slist *headers = NULL;
-    char auth_header[256];
-    
-    // Use configured API KEY or empty string if not provided (some local LLMs don't need it)
-    snprintf(auth_header, sizeof(auth_header), "Authorization: Bearer %s", config->api_key ? config->api_key : "lm-studio");
-    
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-    headers = curl_slist_append(headers, auth_header);
-
-    // Prepare JSON payload
-    struct json_object *payload = json_object_new_object();
-    json_object_object_add(payload, "model", json_object_new_string(config->model));
-    
-    struct json_object *messages = json_object_new_array();
-    
-    struct json_object *system_msg = json_object_new_object();
-    json_object_object_add(system_msg, "role", json_object_new_string("system"));
-    char system_prompt[8192]; // Increased buffer
-    
-    // Use the template from config
-    snprintf(system_prompt, sizeof(system_prompt), 
-        config->prompt_translation,
-        config->target_language,
-        (context_string && strlen(context_string) > 0) ? context_string : ""
-    );
-    json_object_object_add(system_msg, "content", json_object_new_string(system_prompt));
-    json_object_array_add(messages, system_msg);
-
-    struct json_object *user_msg = json_object_new_object();
-    json_object_object_add(user_msg, "role", json_object_new_string("user"));
-    json_object_object_add(user_msg, "content", json_object_new_string(text));
-    json_object_array_add(messages, user_msg);
-
-    json_object_object_add(payload, "messages", messages);
-    // Add temperature to be deterministic if possible
-    json_object_object_add(payload, "temperature", json_object_new_double(0.3));
-
-    const char *post_fields = json_object_to_json_string(payload);
-
-    // Dynamic buffer for response
-    char *response_buffer = calloc(1, 1);
-    size_t response_size = 0;
-
-    // Use configured endpoint or default to OpenAI
-    const char *url = config->api_endpoint ? config->api_endpoint : "https://api.openai.com/v1/chat/completions";
-
-    // printf("DEBUG: Sending request to %s\n", url);
-    // printf("DEBUG: Payload: %s\n", post_fields); // Less noise
-
-    curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, post_fields);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 60L); // 60 seconds timeout
-    
-    // Improved write callback with dynamic resizing
-    struct {
-        char *response;
-        size_t size;
-    } response_data = {response_buffer, response_size};
-
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback_dynamic);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response_data);
-
-    CURLcode res = curl_easy_perform(curl);
-    
-    char *translated_text = NULL;
-
-    if (res != CURLE_OK) {
-        fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-    } else {
-        // Parse JSON response
-        struct json_object *parsed_response = json_tokener_parse(response_data.response);
-        if (parsed_response) {
-            struct json_object *choices;
-            if (json_object_object_get_ex(parsed_response, "choices", &choices)) {
-                struct json_object *first_choice = json_object_array_get_idx(choices, 0);
-                if (first_choice) {
-                    struct json_object *message;
-                    if (json_object_object_get_ex(first_choice, "message", &message)) {
-                        struct json_object *content;
-                        if (json_object_object_get_ex(message, "content", &content)) {
-                            translated_text = strdup(json_object_get_string(content));
-                        }
-                    }
-                }
+        for (int p = 0; p < count; p++) {
+            const char *piece = core + pieces[p].start;
+            if (p == count - 1) {
+                add_segment(list, n, piece, pieces[p].length, tail, length - end);
+            } else {
+                add_segment(list, n, piece, pieces[p].length, piece + pieces[p].length, pieces[p].separator);
             }
-            json_object_put(parsed_response);
+        }
+        free(pieces);
+    }
+}
+
+// Moves a heap string (from the cache) into the arena
+static char* adopt_string(arena_t *arena, char *value) {
+    if (!value) return NULL;
+    char *copy = arena_strdup(arena, value);
+    free(value);
+    return copy;
+}
+
+// Sends one request for segments [0, count) and fills in their translations.
+// Segments missing from the reply are retried one by one.
+static void request_batch(batch_segment_t *segments, int count,
+                          config_t *config, const char *context_string, arena_t *arena) {
+    if (count == 1) {
+        segments[0].translation = request_translation(segments[0].text, config, context_string, arena);
+        return;
+    }
+
+    char *system_prompt = format_system_prompt(config, context_string, glossary_hint(segments, count, arena), 1, arena);
+    char *input = batch_build_input(segments, count, arena);
+    if (system_prompt && input) {
+        llm_request_t request = {
+            .system_prompt = system_prompt,
+            .user_content = input,
+            .temperature = 0.3,
+            .expected_tokens = count_tokens_str(input),
+            .arena = arena
+        };
+        char *reply = llm_chat(config, &request);
+        int matched = batch_parse_reply(reply, segments, count, arena);
+        if (reply && matched < count) {
+            fprintf(stderr, "Batch reply covered %d of %d segments, retrying the rest individually\n", matched, count);
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (!segments[i].translation) {
+            segments[i].translation = request_translation(segments[i].text, config, context_string, arena);
+        }
+    }
+}
+
+// Packs segments[ids[start]], segments[ids[start + 1]], ... into one request
+// of at most `budget` tokens (budget 0: one segment). Returns the end of the
+// group in `ids`.
+static int pack_group(const batch_segment_t *segments, const int *ids, int start, int count, int budget) {
+    int used = count_tokens_str(segments[ids[start]].text);
+    int end = start + 1;
+    while (budget > 0 && end < count) {
+        int cost = count_tokens_str(segments[ids[end]].text) + BATCH_MARKER_TOKENS;
+        if (used + cost > budget) break;
+        used += cost;
+        end++;
+    }
+    return end;
+}
+
+// Translates every segment. Journaled and cached segments are filled in
+// directly; the rest are packed into requests of at most `budget` tokens
+// (budget 0: one request per segment).
+static void translate_segments(segment_list_t *list, int budget, config_t *config, const chapter_ctx_t *chapter) {
+    const char *context_string = chapter->context_string;
+    batch_segment_t *segments = list->segments;
+    int count = list->count;
+    arena_t *arena = list->arena;
+
+    cache_key_t *keys = arena_calloc(arena, count, sizeof(cache_key_t));
+    int *owned = arena_calloc(arena, count, sizeof(int));   // Misses this thread must translate
+    int *busy = arena_calloc(arena, count, sizeof(int));    // Keys in flight on another thread
+    int owned_count = 0, busy_count = 0;
+
+    for (int i = 0; i < count; i++) {
+        const char *recorded = journal_lookup_segment(chapter->journal, chapter->chapter, i);
+        if (recorded) {
+            segments[i].translation = arena_strdup(arena, recorded);
+            metrics_count(COUNTER_JOURNAL_REPLAYS, 1);
+            continue;
+        }
+        if (!needs_translation(segments[i].text, strlen(segments[i].text))) continue;
+        if (in_target_language(segments[i].text, config)) continue;
+
+        cache_make_key(&keys[i], segments[i].text, config, context_string);
+        char *glossary = glossary_hint(&segments[i], 1, arena);
+        if (glossary) cache_key_add(&keys[i], glossary);
+        char *cached = NULL;
+        int state = cache_acquire(&keys[i], &cached, 0);
+        if (state == CACHE_HIT) {
+            segments[i].translation = adopt_string(arena, cached);
+        } else if (state == CACHE_OWNER) {
+            owned[owned_count++] = i;
+        } else if (state == CACHE_BUSY) {
+            busy[busy_count++] = i;
+        }
+    }
+
+    batch_segment_t *group = arena_calloc(arena, owned_count > 0 ? owned_count : 1, sizeof(batch_segment_t));
+    int *group_ids = arena_calloc(arena, owned_count > 0 ? owned_count : 1, sizeof(int));
+    const char **group_texts = arena_calloc(arena, owned_count > 0 ? owned_count : 1, sizeof(char*));
+    int start = 0;
+    while (start < owned_count) {
+        int end = pack_group(segments, owned, start, owned_count, budget);
+        int n = end - start;
+        for (int k = 0; k < n; k++) group[k] = segments[owned[start + k]];
+        request_batch(group, n, config, context_string, arena);
+
+        for (int k = 0; k < n; k++) {
+            group_ids[k] = group[k].id;
+            group_texts[k] = group[k].translation;
+        }
+        journal_record_segments(chapter->journal, chapter->chapter, group_ids, group_texts, n);
+
+        for (int k = 0; k < n; k++) {
+            int i = owned[start + k];
+            cache_release(&keys[i], group[k].translation);
+            segments[i].translation = group[k].translation;
+        }
+        start = end;
+    }
+
+    // Wait for texts another worker was translating; we hold no keys now
+    for (int k = 0; k < busy_count; k++) {
+        int i = busy[k];
+        char *translated = NULL;
+        if (cache_acquire(&keys[i], &translated, 1) == CACHE_HIT) {
+            translated = adopt_string(arena, translated);
         } else {
-             fprintf(stderr, "Failed to parse JSON response: %s\n", response_data.response);
+            translated = request_translation(segments[i].text, config, context_string, arena);
+            cache_release(&keys[i], translated);
         }
+        if (translated) {
+            const char *texts[1] = { translated };
+            journal_record_segments(chapter->journal, chapter->chapter, &i, texts, 1);
+        }
+        segments[i].translation = translated;
+    }
+}
+
+// Batch API mode: the chapter's requests go to the export file, or their
+// replies come from the imported results. Cache and journal are left out,
+// so both runs pack exactly the same requests.
+static void exchange_segments(segment_list_t *list, int budget, config_t *config, const chapter_ctx_t *chapter) {
+    batch_segment_t *segments = list->segments;
+    arena_t *arena = list->arena;
+    int *pending = arena_calloc(arena, list->count > 0 ? list->count : 1, sizeof(int));
+    batch_segment_t *group = arena_calloc(arena, list->count > 0 ? list->count : 1, sizeof(batch_segment_t));
+    if (!pending || !group) return;
+    int pending_count = 0;
+    for (int i = 0; i < list->count; i++) {
+        if (!needs_translation(segments[i].text, strlen(segments[i].text))) continue;
+        if (in_target_language(segments[i].text, config)) continue;
+        pending[pending_count++] = i;
     }
 
-    // Cleanup
-    free(response_data.response);
-    json_object_put(payload);
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
+    int start = 0;
+    while (start < pending_count) {
+        int end = pack_group(segments, pending, start, pending_count, budget);
+        int n = end - start;
+        for (int k = 0; k < n; k++) group[k] = segments[pending[start + k]];
+        start = end;
 
-    return translated_text;
+        // The same messages request_batch() would send
+        char *glossary = glossary_hint(group, n, arena);
+        char *system_prompt = format_system_prompt(config, chapter->context_string, glossary, n > 1, arena);
+        const char *input = n > 1 ? batch_build_input(group, n, arena) : group[0].text;
+        if (!system_prompt || !input) continue;
+        llm_request_t request = {
+            .system_prompt = system_prompt,
+            .user_content = input,
+            .temperature = 0.3
+        };
+        char id[BATCH_API_ID_SIZE];
+        batch_api_make_id(id, chapter->chapter, group[0].id, config, &request);
+
+        if (batch_api_mode() == BATCH_API_EXPORT) {
+            batch_api_export(id, config, &request);
+            continue;
+        }
+        char *reply = batch_api_result(id, arena);
+        int matched = 0;
+        if (n == 1) {
+            group[0].translation = reply;
+            matched = reply != NULL;
+        } else {
+            matched = batch_parse_reply(reply, group, n, arena);
+        }
+        if (matched < n) batch_api_missing(id, n - matched);
+        for (int k = 0; k < n; k++) segments[group[k].id].translation = group[k].translation;
+    }
 }
 
-void translate_nodes(xmlNode *node, config_t *config, const char *context_string) {
-    xmlNode *cur = NULL;
-    for (cur = node; cur; cur = cur->next) {
-        if (cur->type == XML_TEXT_NODE) {
-            char *translated = llm_translate((char*)cur->content, config, context_string);
-            if (translated) {
-                xmlNodeSetContent(cur, (const xmlChar*)translated);
-                free(translated);
+// Counts the glossary terms of each translated segment whose forced
+// translation did not make it into the output
+static void check_glossary(const segment_list_t *list, const chapter_ctx_t *chapter) {
+    for (int i = 0; i < list->count; i++) {
+        const batch_segment_t *s = &list->segments[i];
+        if (!s->translation) continue;
+        // The same entries glossary_hint() put into the prompt
+        int *found;
+        int count = find_glossary_entries(s, 1, &found, list->arena);
+        for (int k = 0; k < count; k++) {
+            metrics_count(COUNTER_GLOSSARY_TERMS, 1);
+            if (glossary_followed(found[k], s->translation)) continue;
+            metrics_count(COUNTER_GLOSSARY_MISSES, 1);
+            fprintf(stderr, "Glossary: \"%s\" not translated as \"%s\" in chapter %d: %.80s\n",
+                glossary_source(found[k]), glossary_target(found[k]), chapter->chapter + 1, s->translation);
+        }
+    }
+}
+
+// Writes the translated pieces back into their text nodes. Pieces without
+// a translation keep their source text; untouched nodes are left alone.
+static void apply_translations(const node_list_t *nodes, const segment_list_t *list) {
+    arena_t *arena = list->arena;
+    int i = 0;
+    while (i < list->count) {
+        int node = list->nodes[i];
+        const char *source = (const char*)nodes->items[node]->content;
+        size_t leading, core_end;
+        prefilter_trim(source, strlen(source), &leading, &core_end);
+        int end = i, translated = 0;
+        size_t size = leading + 1;
+        for (; end < list->count && list->nodes[end] == node; end++) {
+            const batch_segment_t *s = &list->segments[end];
+            if (s->translation) translated = 1;
+            size += strlen(s->translation ? s->translation : s->text) + strlen(list->separators[end]);
+        }
+
+        char *content = translated ? arena_alloc(arena, size) : NULL;
+        if (content) {
+            size_t pos = snprintf(content, size, "%.*s", (int)leading, source);
+            for (int k = i; k < end; k++) {
+                const batch_segment_t *s = &list->segments[k];
+                pos += snprintf(content + pos, size - pos, "%s%s",
+                    s->translation ? s->translation : s->text, list->separators[k]);
             }
+            xmlNodeSetContent(nodes->items[node], (const xmlChar*)content);
         }
-        translate_nodes(cur->children, config, context_string);
+        i = end;
     }
 }
 
-int translate_xhtml(const char *path, config_t *config, const char *context_string) {
-    xmlDocPtr doc = htmlReadFile(path, "UTF-8", HTML_PARSE_RECOVER | HTML_PARSE_NOERROR | HTML_PARSE_NOWARNING);
-    if (!doc) return -1;
+// Everything allocated here goes to the worker's arena, which is reset
+// once the chapter is done
+static void translate_nodes(xmlNode *root, config_t *config, const chapter_ctx_t *chapter, arena_t *arena) {
+    node_list_t nodes = { .arena = arena };
+    collect_text_nodes(root, &nodes);
+    if (nodes.count == 0) return;
 
-    translate_nodes(xmlDocGetRootElement(doc), config, context_string);
+    // Size requests so prompt, input and reply fit the model's window
+    char *system_prompt = format_system_prompt(config, chapter->context_string, NULL, 0, arena);
+    int prompt_tokens = system_prompt ? count_tokens_str(system_prompt) : 0;
+    int budget = segment_batch_budget(config, prompt_tokens + count_tokens_str(config->prompt_batch));
+    int max_tokens = budget > 0 ? budget : segment_request_limit(config, prompt_tokens);
+
+    segment_list_t list = { .arena = arena };
+    split_nodes(&nodes, max_tokens, &list);
+    if (batch_api_mode() != BATCH_API_OFF) {
+        exchange_segments(&list, budget, config, chapter);
+    } else {
+        translate_segments(&list, budget, config, chapter);
+    }
+    check_glossary(&list, chapter);
+    apply_translations(&nodes, &list);
+}
+
+// Translates all text of a parsed chapter and prepares it for saving
+static void translate_doc(xmlDocPtr doc, config_t *config, const chapter_ctx_t *chapter) {
+    arena_t *arena = arena_thread();
+    if (!arena) {
+        fprintf(stderr, "Out of memory for chapter arena\n");
+        return;
+    }
+    translate_nodes(xmlDocGetRootElement(doc), config, chapter, arena);
+    arena_reset(arena);
 
     // Remove any existing XML declaration nodes (PIs) to avoid duplication
-    // because xmlSaveFormatFileEnc adds its own.
+    // because the serializer adds its own.
     xmlNodePtr cur = doc->children;
     while (cur) {
         xmlNodePtr next = cur->next;
@@ -180,8 +508,57 @@ int translate_xhtml(const char *path, config_t *config, const char *context_stri
         }
         cur = next;
     }
+}
+
+int translate_xhtml(const char *path, const char *out_path, config_t *config, const chapter_ctx_t *chapter) {
+    double start = metrics_now();
+    xmlDocPtr doc = htmlReadFile(path, "UTF-8", HTML_PARSE_RECOVER | HTML_PARSE_NOERROR | HTML_PARSE_NOWARNING);
+    metrics_add_stage_time(STAGE_PARSE, metrics_now() - start);
+    if (!doc) return -1;
+
+    translate_doc(doc, config, chapter);
+
+    // Write next to the target and rename, so a crash never leaves a
+    // half-written chapter behind
+    start = metrics_now();
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", out_path);
+    int rc = xmlSaveFormatFileEnc(tmp_path, doc, "UTF-8", 1) < 0 ? -1 : 0;
+    xmlFreeDoc(doc);
+    metrics_add_stage_time(STAGE_PARSE, metrics_now() - start);
+    if (rc == 0 && rename(tmp_path, out_path) != 0) {
+        perror("Failed to replace translated chapter");
+        rc = -1;
+    }
+    return rc;
+}
 
-    xmlSaveFormatFileEnc(path, doc, "UTF-8", 1);
+int translate_xhtml_buffer(const char *data, size_t size, char **out, size_t *out_size,
+                           config_t *config, const chapter_ctx_t *chapter) {
+    *out = NULL;
+    *out_size = 0;
+    double start = metrics_now();
+    xmlDocPtr doc = htmlReadMemory(data, (int)size, NULL, "UTF-8", HTML_PARSE_RECOVER | HTML_PARSE_NOERROR | HTML_PARSE_NOWARNING);
+    metrics_add_stage_time(STAGE_PARSE, metrics_now() - start);
+    if (!doc) return -1;
+
+    translate_doc(doc, config, chapter);
+
+    start = metrics_now();
+    xmlChar *dump = NULL;
+    int dump_size = 0;
+    xmlDocDumpFormatMemoryEnc(doc, &dump, &dump_size, "UTF-8", 1);
     xmlFreeDoc(doc);
-    return 0;
+    metrics_add_stage_time(STAGE_PARSE, metrics_now() - start);
+    if (!dump) return -1;
+
+    // Hand out a malloc'd copy so callers never need xmlFree
+    *out = malloc(dump_size + 1);
+    if (*out) {
+        memcpy(*out, dump, dump_size);
+        (*out)[dump_size] = 0;
+        *out_size = dump_size;
+    }
+    xmlFree(dump);
+    return *out ? 0 : -1;
 }
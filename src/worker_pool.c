@@ -0,0 +1,109 @@
+#include "worker_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static void* worker_main(void *arg) {
+    worker_pool_t *pool = (worker_pool_t*)arg;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->head && !pool->shutdown) {
+            pthread_cond_wait(&pool->job_available, &pool->lock);
+        }
+        if (!pool->head) break; // shutdown and queue drained
+
+        worker_job_t *job = pool->head;
+        pool->head = job->next;
+        if (!pool->head) pool->tail = NULL;
+        pthread_mutex_unlock(&pool->lock);
+
+        job->fn(job->arg);
+
+        pthread_mutex_lock(&pool->lock);
+        job->done = 1;
+        pthread_cond_broadcast(&pool->job_done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+worker_pool_t* worker_pool_create(int threads) {
+    if (threads < 1) threads = 1;
+
+    worker_pool_t *pool = calloc(1, sizeof(worker_pool_t));
+    if (!pool) return NULL;
+    pool->threads = calloc(threads, sizeof(pthread_t));
+    if (!pool->threads) {
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->job_available, NULL);
+    pthread_cond_init(&pool->job_done, NULL);
+
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0) {
+            fprintf(stderr, "Warning: Could only start %d of %d worker threads\n", i, threads);
+            break;
+        }
+        pool->thread_count++;
+    }
+
+    if (pool->thread_count == 0) {
+        worker_pool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void worker_pool_submit(worker_pool_t *pool, worker_job_t *job) {
+    job->done = 0;
+    job->next = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    if (!pool->tail || pool->tail->priority >= job->priority) {
+        // The common case: append
+        if (pool->tail) {
+            pool->tail->next = job;
+        } else {
+            pool->head = job;
+        }
+        pool->tail = job;
+    } else {
+        // Behind the last job of at least the same priority
+        worker_job_t **link = &pool->head;
+        while (*link && (*link)->priority >= job->priority) link = &(*link)->next;
+        job->next = *link;
+        *link = job;
+    }
+    pthread_cond_signal(&pool->job_available);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void worker_pool_wait(worker_pool_t *pool, worker_job_t *job) {
+    pthread_mutex_lock(&pool->lock);
+    while (!job->done) {
+        pthread_cond_wait(&pool->job_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void worker_pool_destroy(worker_pool_t *pool) {
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->job_available);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->job_available);
+    pthread_cond_destroy(&pool->job_done);
+    free(pool->threads);
+    free(pool);
+}
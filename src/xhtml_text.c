@@ -0,0 +1,127 @@
+#include "xhtml_text.h"
+#include <strings.h>
+
+// Elements whose end starts a new paragraph
+static int is_block(const char *name, size_t len) {
+    static const char *blocks[] = {
+        "p", "div", "br", "li", "dt", "dd", "tr", "hr", "pre", "blockquote", "section", "article",
+        "aside", "header", "footer", "figcaption", "h1", "h2", "h3", "h4", "h5", "h6", "title", NULL
+    };
+    for (int i = 0; blocks[i]; i++) {
+        if (strlen(blocks[i]) == len && strncasecmp(blocks[i], name, len) == 0) return 1;
+    }
+    return 0;
+}
+
+// Writes the code point as UTF-8, returns its length (0 if invalid)
+static int encode_utf8(unsigned int cp, char *out) {
+    if (cp == 0 || cp > 0x10FFFF || (cp >= 0xD800 && cp < 0xE000)) return 0;
+    if (cp < 0x80) { out[0] = (char)cp; return 1; }
+    if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+// Decodes the entity at s ('&'), writing it to out. Returns the bytes
+// consumed, or 0 if it is not one this knows (it is then kept verbatim).
+static size_t decode_entity(const char *s, char *out, int *written) {
+    static const struct { const char *name; const char *text; } named[] = {
+        { "amp;", "&" }, { "lt;", "<" }, { "gt;", ">" }, { "quot;", "\"" }, { "apos;", "'" },
+        { "nbsp;", " " }, { NULL, NULL }
+    };
+    if (s[1] == '#') {
+        char *end;
+        unsigned long cp = (s[2] == 'x' || s[2] == 'X') ? strtoul(s + 3, &end, 16) : strtoul(s + 2, &end, 10);
+        if (*end != ';' || end == s + 2) return 0;
+        *written = encode_utf8((unsigned int)cp, out);
+        return *written ? (size_t)(end - s) + 1 : 0;
+    }
+    for (int i = 0; named[i].name; i++) {
+        size_t len = strlen(named[i].name);
+        if (strncmp(s + 1, named[i].name, len) == 0) {
+            *written = (int)strlen(named[i].text);
+            memcpy(out, named[i].text, *written);
+            return len + 1;
+        }
+    }
+    return 0;
+}
+
+char* xhtml_text(const char *xhtml, size_t *out_len) {
+    const char *p = xhtml;
+    const char *body = strstr(xhtml, "<body");
+    if (body) p = body;
+    // Decoded text is never longer than its source
+    char *out = malloc(strlen(p) + 1);
+    if (!out) return NULL;
+    size_t len = 0;
+    char pending = 0;
+
+    while (*p) {
+        if (*p == '<') {
+            if (strncmp(p, "<!--", 4) == 0) {
+                const char *end = strstr(p + 4, "-->");
+                p = end ? end + 3 : p + strlen(p);
+                continue;
+            }
+            const char *name = p + 1 + (p[1] == '/');
+            size_t name_len = strcspn(name, " \t\r\n/>");
+            const char *end = strchr(p, '>');
+            if (!end) break;
+            p = end + 1;
+            if ((name_len == 6 && strncasecmp(name, "script", 6) == 0) ||
+                (name_len == 5 && strncasecmp(name, "style", 5) == 0)) {
+                if (name[-1] != '/' && end[-1] != '/') {
+                    while (*p && !(p[0] == '<' && p[1] == '/' && strncasecmp(p + 2, name, name_len) == 0)) p++;
+                }
+                continue;
+            }
+            if (is_block(name, name_len)) {
+                pending = '\n';
+            }
+            continue;
+        }
+
+        char decoded[8];
+        int decoded_len = 1;
+        size_t consumed = 1;
+        decoded[0] = *p;
+        if (*p == '&') {
+            size_t n = decode_entity(p, decoded, &decoded_len);
+            if (n) consumed = n;
+            else decoded_len = 1;
+        }
+        p += consumed;
+
+        if (decoded_len == 1 && (decoded[0] == ' ' || decoded[0] == '\t' || decoded[0] == '\r' || decoded[0] == '\n')) {
+            if (!pending) pending = ' ';
+            continue;
+        }
+        // A decoded &nbsp; spans two bytes and counts as a space too
+        if (decoded_len == 2 && (unsigned char)decoded[0] == 0xC2 && (unsigned char)decoded[1] == 0xA0) {
+            if (!pending) pending = ' ';
+            continue;
+        }
+        // No separator before the first word
+        if (pending && len > 0) out[len++] = pending;
+        pending = 0;
+        memcpy(out + len, decoded, decoded_len);
+        len += decoded_len;
+    }
+    out[len] = 0;
+    *out_len = len;
+    return out;
+}
@@ -0,0 +1,55 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Minimal checks for the unit tests in this directory. A failed check is
+// reported with its location and the test keeps going; test_finish() gives
+// the exit status. Each test_*.c is its own program, run by "make test".
+
+static int test_checks = 0;
+static int test_failures = 0;
+
+#define CHECK(cond) do { \
+    test_checks++; \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        test_failures++; \
+    } \
+} while (0)
+
+#define CHECK_STR(actual, expected) do { \
+    const char *a_ = (actual), *e_ = (expected); \
+    test_checks++; \
+    if (!a_ || strcmp(a_, e_) != 0) { \
+        fprintf(stderr, "%s:%d: %s is \"%s\", expected \"%s\"\n", \
+            __FILE__, __LINE__, #actual, a_ ? a_ : "(null)", e_); \
+        test_failures++; \
+    } \
+} while (0)
+
+static inline int test_finish(const char *name) {
+    if (test_failures) {
+        fprintf(stderr, "%s: %d of %d checks failed\n", name, test_failures, test_checks);
+        return 1;
+    }
+    printf("%s: %d checks passed\n", name, test_checks);
+    return 0;
+}
+
+// Creates a temporary file holding `contents` (may be NULL) and stores
+// its path in `path` (at least 64 bytes)
+static inline int test_temp_file(char *path, const char *contents) {
+    strcpy(path, "/tmp/epubtrans-test-XXXXXX");
+    int fd = mkstemp(path);
+    if (fd < 0) return -1;
+    size_t len = contents ? strlen(contents) : 0;
+    int rc = (write(fd, contents, len) == (ssize_t)len) ? 0 : -1;
+    close(fd);
+    return rc;
+}
+
+#endif // TEST_H
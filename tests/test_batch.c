@@ -0,0 +1,59 @@
+#include "test.h"
+#include "batch.h"
+
+static void test_round_trip(void) {
+    batch_segment_t segments[] = {
+        { 3, "First paragraph.", NULL },
+        { 7, "Second one.", NULL },
+    };
+    char *input = batch_build_input(segments, 2, NULL);
+    CHECK_STR(input, "<<<SEG 3>>>\nFirst paragraph.\n<<<SEG 7>>>\nSecond one.\n");
+    free(input);
+
+    const char *reply = "<<<SEG 3>>>\nPremier paragraphe.\n<<<SEG 7>>>\nLe second.\n";
+    CHECK(batch_parse_reply(reply, segments, 2, NULL) == 2);
+    CHECK_STR(segments[0].translation, "Premier paragraphe.");
+    CHECK_STR(segments[1].translation, "Le second.");
+    free(segments[0].translation);
+    free(segments[1].translation);
+}
+
+static void test_sloppy_reply(void) {
+    batch_segment_t segments[] = {
+        { 1, "One.", NULL },
+        { 2, "Two.", NULL },
+        { 3, "Three.", NULL },
+    };
+    // Out of order, trailing blanks and CRLF after a marker, an unknown id,
+    // a repeated id and a lost segment
+    const char *reply =
+        "Here you go:\n"
+        "<<<SEG 2>>>  \r\nDeux.\r\n"
+        "<<<SEG 9>>>\nNeuf.\n"
+        "<<<SEG 1>>>\nUn.\n"
+        "<<<SEG 2>>>\nDeux bis.\n";
+    CHECK(batch_parse_reply(reply, segments, 3, NULL) == 2);
+    CHECK_STR(segments[0].translation, "Un.");
+    CHECK_STR(segments[1].translation, "Deux.");
+    CHECK(segments[2].translation == NULL);
+    free(segments[0].translation);
+    free(segments[1].translation);
+}
+
+static void test_malformed_markers(void) {
+    batch_segment_t segments[] = { { 4, "Four.", NULL } };
+    CHECK(batch_parse_reply("<<<SEG x>>>\nNo.\n<<<SEG 4\nNo.\n", segments, 1, NULL) == 0);
+    CHECK(batch_parse_reply(NULL, segments, 1, NULL) == 0);
+
+    arena_t *arena = arena_create(0);
+    CHECK(batch_parse_reply("<<<SEG 4>>>\nQuatre.", segments, 1, arena) == 1);
+    CHECK_STR(segments[0].translation, "Quatre.");
+    arena_destroy(arena);
+}
+
+int main(void) {
+    test_round_trip();
+    test_sloppy_reply();
+    test_malformed_markers();
+    return test_finish("batch");
+}
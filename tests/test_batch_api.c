@@ -0,0 +1,76 @@
+#include "test.h"
+#include "batch_api.h"
+
+static const char *RESULTS =
+    "{\"custom_id\":\"c1-s0-aaaa\",\"response\":{\"status_code\":200,\"body\":"
+        "{\"choices\":[{\"message\":{\"role\":\"assistant\",\"content\":\"Bonjour\"}}],"
+        "\"usage\":{\"prompt_tokens\":10,\"completion_tokens\":2}}},\"error\":null}\n"
+    "\n"
+    "{\"custom_id\":\"c1-s1-bbbb\",\"response\":{\"status_code\":429,\"body\":"
+        "{\"error\":{\"message\":\"Rate limited\"}}},\"error\":null}\n"
+    "{\"custom_id\":\"c1-s2-cccc\",\"response\":null,\"error\":{\"message\":\"expired\"}}\n"
+    "{\"custom_id\":\"c1-s3-dddd\",\"response\":{\"status_code\":200,\"body\":{\"choices\":[]}}}\n"
+    "not json at all\n"
+    "{\"custom_id\":\"c2-s0-eeee\",\"response\":{\"body\":"
+        "{\"choices\":[{\"message\":{\"content\":\"<<<SEG 0>>>\\nUn\\n<<<SEG 1>>>\\nDeux\"}}]}}}\n"
+    "{\"custom_id\":\"c9-s9-ffff\",\"response\":{\"status_code\":200,\"body\":"
+        "{\"choices\":[{\"message\":{\"content\":\"never asked for\"}}]}}}\n";
+
+static void test_import(const char *path) {
+    config_t config = { .batch_import_file = (char*)path };
+    CHECK(batch_api_init(&config) == 0);
+    CHECK(batch_api_mode() == BATCH_API_IMPORT);
+
+    arena_t *arena = arena_create(0);
+    CHECK_STR(batch_api_result("c1-s0-aaaa", arena), "Bonjour");
+    CHECK_STR(batch_api_result("c2-s0-eeee", arena), "<<<SEG 0>>>\nUn\n<<<SEG 1>>>\nDeux");
+    // Failed, empty and absent results count as missing
+    CHECK(batch_api_result("c1-s1-bbbb", arena) == NULL);
+    CHECK(batch_api_result("c1-s2-cccc", arena) == NULL);
+    CHECK(batch_api_result("c1-s3-dddd", arena) == NULL);
+    CHECK(batch_api_result("c3-s0-0000", arena) == NULL);
+    arena_destroy(arena);
+
+    // Segments: one each for the four missing requests, one left out of a
+    // batched reply
+    batch_api_missing("c1-s1-bbbb", 1);
+    batch_api_missing("c1-s2-cccc", 1);
+    batch_api_missing("c1-s3-dddd", 1);
+    batch_api_missing("c3-s0-0000", 1);
+    batch_api_missing("c2-s0-eeee", 1);
+    CHECK(batch_api_finish() == 5);
+    batch_api_cleanup();
+    CHECK(batch_api_mode() == BATCH_API_OFF);
+}
+
+static void test_ids(void) {
+    config_t config = { .model = "test-model" };
+    llm_request_t request = { .system_prompt = "Translate.", .user_content = "Hello" };
+    char a[BATCH_API_ID_SIZE], b[BATCH_API_ID_SIZE];
+    batch_api_make_id(a, 3, 12, &config, &request);
+    batch_api_make_id(b, 3, 12, &config, &request);
+    CHECK_STR(a, b);
+    CHECK(strncmp(a, "c3-s12-", 7) == 0);
+
+    // Any change to the request gives a different id
+    request.user_content = "Hello!";
+    batch_api_make_id(b, 3, 12, &config, &request);
+    CHECK(strcmp(a, b) != 0);
+    request.user_content = "Hello";
+    config.model = "other-model";
+    batch_api_make_id(b, 3, 12, &config, &request);
+    CHECK(strcmp(a, b) != 0);
+}
+
+int main(void) {
+    char path[64];
+    if (test_temp_file(path, RESULTS) != 0) return 1;
+    test_import(path);
+    test_ids();
+
+    config_t missing = { .batch_import_file = "/nonexistent/results.jsonl" };
+    CHECK(batch_api_init(&missing) == -1);
+    batch_api_cleanup();
+    unlink(path);
+    return test_finish("batch_api");
+}
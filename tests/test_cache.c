@@ -0,0 +1,124 @@
+#include "test.h"
+#include "cache.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+
+static off_t file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? st.st_size : -1;
+}
+
+static void test_keys(config_t *config) {
+    cache_key_t a, b;
+    cache_make_key(&a, "Hello", config, NULL);
+    cache_make_key(&b, "Hello", config, "");
+    CHECK(a.hi == b.hi && a.lo == b.lo);
+
+    // Every input of the translation changes the key
+    cache_make_key(&b, "Hello", config, "Previous chapter");
+    CHECK(a.hi != b.hi || a.lo != b.lo);
+    cache_make_key(&b, "Hello.", config, NULL);
+    CHECK(a.hi != b.hi || a.lo != b.lo);
+    cache_make_key(&b, "Hello", config, NULL);
+    cache_key_add(&b, "Hello\tBonjour");
+    CHECK(a.hi != b.hi || a.lo != b.lo);
+
+    // Fields are length-prefixed: moving bytes between them is a new key
+    cache_make_key(&a, "ab", config, "c");
+    cache_make_key(&b, "a", config, "bc");
+    CHECK(a.hi != b.hi || a.lo != b.lo);
+}
+
+static void test_records(config_t *config) {
+    CHECK(cache_init(config) == 0);
+    cache_key_t key;
+    char *value;
+    cache_make_key(&key, "Good morning", config, NULL);
+    CHECK(cache_acquire(&key, &value, 1) == CACHE_OWNER);
+    CHECK(value == NULL);
+    // Another thread asking without waiting is told the key is busy
+    CHECK(cache_acquire(&key, &value, 0) == CACHE_BUSY);
+    cache_release(&key, "Bonjour");
+    CHECK(cache_acquire(&key, &value, 1) == CACHE_HIT);
+    CHECK_STR(value, "Bonjour");
+    free(value);
+
+    // A later record for the same key wins
+    cache_key_t other;
+    cache_make_key(&other, "Good night", config, NULL);
+    CHECK(cache_acquire(&other, &value, 1) == CACHE_OWNER);
+    cache_release(&other, "Bonne nuit");
+    CHECK(cache_acquire(&other, &value, 1) == CACHE_HIT);
+    free(value);
+    cache_release(&other, "Bonne nuit !");
+    cache_cleanup();
+
+    // The records survive a restart
+    CHECK(cache_init(config) == 0);
+    CHECK(cache_acquire(&key, &value, 1) == CACHE_HIT);
+    CHECK_STR(value, "Bonjour");
+    free(value);
+    CHECK(cache_acquire(&other, &value, 1) == CACHE_HIT);
+    CHECK_STR(value, "Bonne nuit !");
+    free(value);
+    cache_cleanup();
+}
+
+static void test_torn_record(config_t *config) {
+    off_t good = file_size(config->cache_file);
+    int fd = open(config->cache_file, O_WRONLY | O_APPEND);
+    if (fd >= 0) {
+        // The start of a record header, as left by a crash
+        if (write(fd, "ETC1\x10\0\0\0garbage", 15) != 15) perror("write");
+        close(fd);
+    }
+    CHECK(cache_init(config) == 0);
+    CHECK(file_size(config->cache_file) == good);
+
+    cache_key_t key;
+    char *value;
+    cache_make_key(&key, "Good morning", config, NULL);
+    CHECK(cache_acquire(&key, &value, 1) == CACHE_HIT);
+    CHECK_STR(value, "Bonjour");
+    free(value);
+
+    // New records go after the truncated tail and are found again
+    cache_make_key(&key, "Good evening", config, NULL);
+    CHECK(cache_acquire(&key, &value, 1) == CACHE_OWNER);
+    cache_release(&key, "Bonsoir");
+    cache_cleanup();
+    CHECK(cache_init(config) == 0);
+    CHECK(cache_acquire(&key, &value, 1) == CACHE_HIT);
+    CHECK_STR(value, "Bonsoir");
+    free(value);
+    cache_cleanup();
+}
+
+static void test_disabled(config_t *config) {
+    config->cache_file = NULL;
+    CHECK(cache_init(config) == 0);
+    cache_key_t key;
+    char *value;
+    cache_make_key(&key, "Good morning", config, NULL);
+    CHECK(cache_acquire(&key, &value, 1) == CACHE_OWNER);
+    cache_release(&key, "Bonjour");
+    CHECK(cache_acquire(&key, &value, 1) == CACHE_OWNER);
+    cache_cleanup();
+}
+
+int main(void) {
+    char path[64];
+    if (test_temp_file(path, NULL) != 0) return 1;
+    config_t config = {
+        .model = "test-model",
+        .target_language = "French",
+        .prompt_translation = "Translate into %s.%s",
+        .cache_file = path,
+    };
+    test_keys(&config);
+    test_records(&config);
+    test_torn_record(&config);
+    test_disabled(&config);
+    unlink(path);
+    return test_finish("cache");
+}
@@ -0,0 +1,131 @@
+#include "test.h"
+#include "glossary.h"
+
+static const char *GLOSSARY =
+    "# Names\n"
+    "Frodo\tFrodon\n"
+    "Baggins\tSacquet\n"
+    "Bag End\tCul-de-Sac\n"
+    "\n"
+    "the Shire\tla Comté\n"
+    "ring\tanneau\n"
+    "Ring-wraith\tSpectre de l'Anneau\n"
+    "C++\tC++\n"
+    "東京\tTokyo\n"
+    "a line without a tab\n"
+    "  Mordor \t Mordor\r\n";
+
+// Entries found in text, as their source terms joined by "|" in the order
+// they were found
+static void find(const char *text, char *out, size_t size) {
+    int found[GLOSSARY_MAX_MATCHES];
+    int count = glossary_find(text, strlen(text), found, 0, GLOSSARY_MAX_MATCHES);
+    out[0] = 0;
+    for (int i = 0; i < count; i++) {
+        if (i > 0) strncat(out, "|", size - strlen(out) - 1);
+        strncat(out, glossary_source(found[i]), size - strlen(out) - 1);
+    }
+}
+
+static void test_find(void) {
+    char out[256];
+    find("Frodo Baggins left Bag End for the Shire.", out, sizeof(out));
+    CHECK_STR(out, "Frodo|Baggins|Bag End|the Shire");
+
+    // Whole words only, ASCII case ignored, each entry once
+    find("FRODO and frodo; Frodos and Bagginses", out, sizeof(out));
+    CHECK_STR(out, "Frodo");
+    find("The Ring, the ring-wraith and a ringing bell", out, sizeof(out));
+    CHECK_STR(out, "ring|Ring-wraith");
+    find("Code in C++, not C.", out, sizeof(out));
+    CHECK_STR(out, "C++");
+    find("Mordor", out, sizeof(out));
+    CHECK_STR(out, "Mordor");
+
+    // Terms in unspaced scripts match inside a sentence
+    find("彼は東京に行った", out, sizeof(out));
+    CHECK_STR(out, "東京");
+
+    find("Nothing to see here", out, sizeof(out));
+    CHECK_STR(out, "");
+
+    // `max` bounds the entries collected
+    const char *text = "Frodo Baggins of the Shire";
+    int found[2];
+    CHECK(glossary_find(text, strlen(text), found, 0, 2) == 2);
+}
+
+static void test_prompt(void) {
+    const char *text = "Frodo of the Shire";
+    int found[GLOSSARY_MAX_MATCHES];
+    int count = glossary_find(text, strlen(text), found, 0, GLOSSARY_MAX_MATCHES);
+    char *prompt = glossary_prompt(found, count, NULL);
+    CHECK(prompt && strstr(prompt, "Frodo => Frodon\n"));
+    CHECK(prompt && strstr(prompt, "the Shire => la Comté\n"));
+    CHECK(prompt && !strstr(prompt, "Baggins"));
+    free(prompt);
+    CHECK(glossary_prompt(found, 0, NULL) == NULL);
+
+    CHECK(glossary_followed(found[0], "FRODON de la Comté"));
+    CHECK(!glossary_followed(found[0], "Frodo de la Comté"));
+}
+
+static void test_reload(config_t *config) {
+    glossary_cleanup();
+    char out[64];
+    find("Frodo", out, sizeof(out));
+    CHECK_STR(out, "");
+    CHECK(glossary_init(config) == 0);
+    find("Frodo", out, sizeof(out));
+    CHECK_STR(out, "Frodo");
+
+    config_t missing = { .glossary_file = "/nonexistent/glossary.tsv" };
+    glossary_cleanup();
+    CHECK(glossary_init(&missing) == -1);
+}
+
+// A text with more entries than GLOSSARY_MAX_MATCHES: a full array is
+// grown and the scan repeated, which must add the rest without duplicates
+static void test_many(void) {
+    char glossary[4096] = "", text[4096] = "";
+    for (int i = 0; i < 100; i++) {
+        char line[64];
+        snprintf(line, sizeof(line), "term%d\tterme%d\n", i, i);
+        strcat(glossary, line);
+        snprintf(line, sizeof(line), "term%d ", i);
+        strcat(text, line);
+    }
+    char path[64];
+    if (test_temp_file(path, glossary) != 0) return;
+    config_t config = { .glossary_file = path };
+    glossary_cleanup();
+    CHECK(glossary_init(&config) == 0);
+
+    int found[128];
+    int count = glossary_find(text, strlen(text), found, 0, GLOSSARY_MAX_MATCHES);
+    CHECK(count == GLOSSARY_MAX_MATCHES);
+    count = glossary_find(text, strlen(text), found, count, 128);
+    CHECK(count == 100);
+    int seen[100] = {0}, duplicates = 0;
+    for (int i = 0; i < count; i++) duplicates += seen[found[i]]++;
+    CHECK(duplicates == 0);
+
+    char *prompt = glossary_prompt(found, count, NULL);
+    CHECK(prompt && strstr(prompt, "term99 => terme99\n"));
+    free(prompt);
+    glossary_cleanup();
+    unlink(path);
+}
+
+int main(void) {
+    char path[64];
+    if (test_temp_file(path, GLOSSARY) != 0) return 1;
+    config_t config = { .glossary_file = path };
+    CHECK(glossary_init(&config) == 0);
+    test_find();
+    test_prompt();
+    test_reload(&config);
+    unlink(path);
+    test_many();
+    return test_finish("glossary");
+}
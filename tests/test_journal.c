@@ -0,0 +1,120 @@
+#include "test.h"
+#include "journal.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+
+static off_t file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? st.st_size : -1;
+}
+
+static void append_bytes(const char *path, const char *bytes) {
+    int fd = open(path, O_WRONLY | O_APPEND);
+    if (fd < 0) return;
+    if (write(fd, bytes, strlen(bytes)) < 0) perror("write");
+    close(fd);
+}
+
+static void test_records(const char *path) {
+    journal_t *journal = journal_open(path, "run-1", 0);
+    CHECK(journal != NULL);
+    if (!journal) return;
+    int ids[] = { 0, 1, 2 };
+    const char *texts[] = { "zéro", NULL, "deux\nlignes" };
+    CHECK(journal_record_segments(journal, 4, ids, texts, 3) == 0);
+    CHECK(journal_record_chapter(journal, 4, "{\"history\":\"state\"}") == 0);
+    journal_close(journal);
+
+    journal = journal_open(path, "run-1", 1);
+    CHECK(journal != NULL);
+    if (!journal) return;
+    CHECK_STR(journal_lookup_segment(journal, 4, 0), "zéro");
+    CHECK(journal_lookup_segment(journal, 4, 1) == NULL);
+    CHECK_STR(journal_lookup_segment(journal, 4, 2), "deux\nlignes");
+    CHECK(journal_lookup_segment(journal, 5, 0) == NULL);
+    CHECK(journal_chapter_done(journal, 4));
+    CHECK(!journal_chapter_done(journal, 5));
+    CHECK_STR(journal_chapter_state(journal, 4), "{\"history\":\"state\"}");
+    journal_close(journal);
+
+    // Another run must not pick the journal up
+    CHECK(journal_open(path, "run-2", 1) == NULL);
+}
+
+static void test_torn_tail(const char *path) {
+    off_t good = file_size(path);
+
+    // A crash in the middle of an append: a header with half its payload
+    append_bytes(path, "@S 4 3 100 12345\nhalf a rec");
+    journal_t *journal = journal_open(path, "run-1", 1);
+    CHECK(journal != NULL);
+    if (!journal) return;
+    CHECK(file_size(path) == good);
+    CHECK(journal_lookup_segment(journal, 4, 3) == NULL);
+    CHECK_STR(journal_lookup_segment(journal, 4, 0), "zéro");
+
+    // Appends after the truncation are read back
+    int id = 3;
+    const char *text = "trois";
+    CHECK(journal_record_segments(journal, 4, &id, &text, 1) == 0);
+    journal_close(journal);
+
+    // A complete record with a bad checksum counts as torn as well
+    good = file_size(path);
+    append_bytes(path, "@S 4 4 4 1\nfour\n");
+    journal = journal_open(path, "run-1", 1);
+    CHECK(journal != NULL);
+    if (!journal) return;
+    CHECK_STR(journal_lookup_segment(journal, 4, 3), "trois");
+    CHECK(journal_lookup_segment(journal, 4, 4) == NULL);
+    CHECK(file_size(path) == good);
+    journal_close(journal);
+
+    // A fresh run discards everything
+    journal = journal_open(path, "run-1", 0);
+    CHECK(journal != NULL);
+    if (!journal) return;
+    CHECK(journal_lookup_segment(journal, 4, 0) == NULL);
+    CHECK(!journal_chapter_done(journal, 4));
+    journal_close(journal);
+}
+
+// A run id carries the input's identity, so the journal of a book is not
+// resumed once the file at that path has changed
+static void test_changed_input(const char *path) {
+    char input[64], id[64], same[64], changed[64];
+    if (test_temp_file(input, "PK\3\4 the first edition") != 0) return;
+    CHECK(journal_input_identity(input, id, sizeof(id)) == 0);
+    CHECK(journal_input_identity(input, same, sizeof(same)) == 0);
+    CHECK_STR(same, id);
+
+    char run_id[128];
+    snprintf(run_id, sizeof(run_id), "input=%s %s", input, id);
+    journal_t *journal = journal_open(path, run_id, 0);
+    CHECK(journal != NULL);
+    journal_close(journal);
+
+    // Same size, one byte different
+    FILE *fp = fopen(input, "w");
+    if (fp) {
+        fputs("PK\3\4 the final edition", fp);
+        fclose(fp);
+    }
+    CHECK(journal_input_identity(input, changed, sizeof(changed)) == 0);
+    CHECK(strcmp(changed, id) != 0);
+    snprintf(run_id, sizeof(run_id), "input=%s %s", input, changed);
+    CHECK(journal_open(path, run_id, 1) == NULL);
+
+    unlink(input);
+    CHECK(journal_input_identity(input, changed, sizeof(changed)) == -1);
+}
+
+int main(void) {
+    char path[64];
+    if (test_temp_file(path, NULL) != 0) return 1;
+    test_records(path);
+    test_torn_tail(path);
+    test_changed_input(path);
+    unlink(path);
+    return test_finish("journal");
+}
@@ -0,0 +1,120 @@
+#include "test.h"
+#include "json_lite.h"
+#include <json-c/json.h>
+
+// What json-c reads back from a string written by json_write_string()
+static void check_string_round_trip(const char *text) {
+    json_buffer_t buffer = {0};
+    CHECK(json_write_string(&buffer, text) == 0);
+    CHECK(buffer.size == strlen(buffer.data));
+    struct json_object *parsed = json_tokener_parse(buffer.data);
+    CHECK(parsed && json_object_is_type(parsed, json_type_string));
+    if (parsed) CHECK_STR(json_object_get_string(parsed), text);
+    json_object_put(parsed);
+    json_buffer_free(&buffer);
+}
+
+static void test_writer(void) {
+    json_buffer_t buffer = {0};
+    CHECK(json_write_string(&buffer, "a \"quote\"\n\tand \\ \x01") == 0);
+    CHECK_STR(buffer.data, "\"a \\\"quote\\\"\\n\\tand \\\\ \\u0001\"");
+    json_buffer_reset(&buffer);
+    CHECK(buffer.size == 0);
+    CHECK(json_write_string(&buffer, NULL) == 0);
+    CHECK(json_write_raw(&buffer, ",") == 0);
+    CHECK(json_write_double(&buffer, 0.3) == 0);
+    CHECK_STR(buffer.data, "null,0.3");
+    json_buffer_free(&buffer);
+
+    check_string_round_trip("");
+    check_string_round_trip("Plain ASCII text.");
+    check_string_round_trip("Ünïcödé — 漢字 and 😀 stay as they are");
+    check_string_round_trip("\r\n\b\f\x1f<>&'");
+
+    // A long text with escapes spread through it grows the buffer
+    char text[10000];
+    for (size_t i = 0; i < sizeof(text) - 1; i++) text[i] = (i % 37 == 0) ? '\n' : 'a' + i % 26;
+    text[sizeof(text) - 1] = 0;
+    check_string_round_trip(text);
+}
+
+static void test_reply(void) {
+    const char *json =
+        "{\"id\":\"x\",\"choices\":[{\"index\":0,\"message\":{\"role\":\"assistant\","
+        "\"content\":\"Bonjour \\\"toi\\\"\\n\\u00e9\\ud83d\\ude00\"},\"finish_reason\":\"stop\"}],"
+        "\"usage\":{\"prompt_tokens\":12,\"completion_tokens\":5,\"total_tokens\":17,"
+        "\"prompt_tokens_details\":{\"cached_tokens\":8}}}";
+    json_reply_t reply;
+    json_buffer_t content = {0};
+    CHECK(json_extract_reply(json, strlen(json), &reply, &content) == 0);
+    CHECK(reply.has_content);
+    CHECK_STR(content.data, "Bonjour \"toi\"\né😀");
+    CHECK(reply.prompt_tokens == 12);
+    CHECK(reply.completion_tokens == 5);
+    CHECK(reply.total_tokens == 17);
+    CHECK(reply.cached_tokens == 8);
+    CHECK(!reply.has_error);
+
+    // A streamed chunk appends its delta to what came before
+    json = "{\"choices\":[{\"delta\":{\"content\":\" encore\"}}]}";
+    CHECK(json_extract_reply(json, strlen(json), &reply, &content) == 0);
+    CHECK_STR(content.data, "Bonjour \"toi\"\né😀 encore");
+    CHECK(reply.prompt_tokens == -1);
+    CHECK(reply.cached_tokens == -1);
+
+    // Other providers' names for cached tokens
+    json = "{\"usage\":{\"prompt_tokens\":3,\"prompt_cache_hit_tokens\":2}}";
+    CHECK(json_extract_reply(json, strlen(json), &reply, &content) == 0);
+    CHECK(!reply.has_content);
+    CHECK(reply.cached_tokens == 2);
+    json = "{\"usage\":{\"cache_read_input_tokens\":4}}";
+    CHECK(json_extract_reply(json, strlen(json), &reply, &content) == 0);
+    CHECK(reply.cached_tokens == 4);
+
+    // A lone surrogate becomes U+FFFD rather than invalid UTF-8
+    json_buffer_reset(&content);
+    json = "{\"choices\":[{\"delta\":{\"content\":\"\\ud83d!\"}}]}";
+    CHECK(json_extract_reply(json, strlen(json), &reply, &content) == 0);
+    CHECK_STR(content.data, "\xEF\xBF\xBD!");
+    json_buffer_free(&content);
+}
+
+static void test_errors(void) {
+    json_reply_t reply;
+    json_buffer_t content = {0};
+    const char *json = "{\"error\":{\"message\":\"Rate limit reached\",\"type\":\"requests\"}}";
+    CHECK(json_extract_reply(json, strlen(json), &reply, &content) == 0);
+    CHECK(reply.has_error);
+    CHECK_STR(reply.error, "Rate limit reached");
+
+    json = "{\"error\":\"Bad key\"}";
+    CHECK(json_extract_reply(json, strlen(json), &reply, &content) == 0);
+    CHECK_STR(reply.error, "Bad key");
+
+    json = "{\"error\":null,\"choices\":[]}";
+    CHECK(json_extract_reply(json, strlen(json), &reply, &content) == 0);
+    CHECK(!reply.has_error);
+    CHECK(!reply.has_content);
+
+    // Malformed JSON leaves the content buffer as it was
+    json_buffer_append(&content, "kept", 4);
+    const char *bad[] = {
+        "{\"choices\":[{\"message\":{\"content\":\"cut",
+        "{\"choices\":[{\"message\":{\"content\":\"x\"}}]} trailing",
+        "{\"content\":\"bad \\q escape\"}",
+        "[1,2",
+        "",
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        CHECK(json_extract_reply(bad[i], strlen(bad[i]), &reply, &content) == -1);
+        CHECK_STR(content.data, "kept");
+    }
+    json_buffer_free(&content);
+}
+
+int main(void) {
+    test_writer();
+    test_reply();
+    test_errors();
+    return test_finish("json_lite");
+}
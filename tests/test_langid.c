@@ -0,0 +1,94 @@
+#include "test.h"
+#include "langid.h"
+
+// Language detected in text, or "" when langid_detect() cannot tell
+static const char* detect(const char *text) {
+    double confidence;
+    const char *code = langid_detect(text, strlen(text), &confidence);
+    return code ? code : "";
+}
+
+static void test_latin(void) {
+    CHECK_STR(detect("The old man walked slowly down the road, thinking about what his daughter had told him that morning."), "en");
+    CHECK_STR(detect("Le vieil homme descendait lentement la route en pensant à ce que sa fille lui avait dit ce matin-là."), "fr");
+    CHECK_STR(detect("Der alte Mann ging langsam die Straße hinunter und dachte darüber nach, was seine Tochter ihm an diesem Morgen gesagt hatte."), "de");
+    CHECK_STR(detect("El anciano bajaba lentamente por el camino, pensando en lo que su hija le había dicho aquella mañana."), "es");
+    CHECK_STR(detect("Il vecchio scendeva lentamente lungo la strada, pensando a quello che sua figlia gli aveva detto quella mattina."), "it");
+    CHECK_STR(detect("O velho descia lentamente a estrada, pensando no que a sua filha lhe tinha dito naquela manhã."), "pt");
+    CHECK_STR(detect("De oude man liep langzaam over de weg en dacht na over wat zijn dochter hem die ochtend had verteld."), "nl");
+    CHECK_STR(detect("El vell baixava lentament pel camí, pensant en el que la seva filla li havia dit aquell matí."), "ca");
+    CHECK_STR(detect("O vello baixaba amodo polo camiño, pensando no que a súa filla lle dixera aquela mañá."), "gl");
+}
+
+// Latin-script text without a profile is not forced onto the nearest one
+static void test_latin_unprofiled(void) {
+    const char *texts[] = {
+        "Bătrânul cobora încet pe drum, gândindu-se la ce îi spusese fiica lui în dimineața aceea.",
+        "Stary człowiek schodził powoli drogą, myśląc o tym, co córka powiedziała mu tego ranka.",
+        "Vanha mies käveli hitaasti tietä pitkin ja mietti, mitä hänen tyttärensä oli sanonut hänelle.",
+        "Orang tua itu berjalan perlahan menyusuri jalan, memikirkan apa yang dikatakan putrinya pagi itu.",
+    };
+    for (size_t i = 0; i < sizeof(texts) / sizeof(texts[0]); i++) CHECK_STR(detect(texts[i]), "");
+
+    // Galician never passes for Portuguese with the default threshold
+    const char *galician = "O comité aprobou o orzamento despois dun longo debate sobre impostos.";
+    CHECK(!langid_is_language(galician, strlen(galician), "Portuguese", LANGID_DEFAULT_THRESHOLD));
+    const char *catalan = "Els nens jugaven a la plaça mentre les seves mares parlaven de les coses del poble.";
+    CHECK(!langid_is_language(catalan, strlen(catalan), "Spanish", LANGID_DEFAULT_THRESHOLD));
+    CHECK(!langid_is_language(catalan, strlen(catalan), "French", LANGID_DEFAULT_THRESHOLD));
+}
+
+static void test_scripts(void) {
+    CHECK_STR(detect("Ο γέρος κατέβαινε αργά τον δρόμο, σκεπτόμενος όσα του είχε πει η κόρη του."), "el");
+    CHECK_STR(detect("הזקן ירד לאט בדרך וחשב על מה שבתו אמרה לו באותו בוקר."), "he");
+    CHECK_STR(detect("ชายชราเดินลงไปตามถนนอย่างช้าๆ คิดถึงสิ่งที่ลูกสาวบอกเขาเมื่อเช้า"), "th");
+    CHECK_STR(detect("노인은 그날 아침 딸이 한 말을 생각하며 천천히 길을 걸어 내려갔다."), "ko");
+    CHECK_STR(detect("老人はその朝娘に言われたことを考えながら、ゆっくりと道を下っていった。"), "ja");
+}
+
+// Scripts shared by several languages only name one with evidence
+static void test_shared_scripts(void) {
+    CHECK_STR(detect("Старик медленно спускался по дороге, думая о том, что сказала ему дочь в это утро."), "ru");
+    CHECK_STR(detect("Старий повільно спускався дорогою, думаючи про те, що сказала йому донька того ранку."), "");   // Ukrainian
+    CHECK_STR(detect("Старецът бавно слизаше по пътя, мислейки за това, което дъщеря му му каза сутринта."), "");  // Bulgarian
+    CHECK_STR(detect("Стари је полако силазио низ пут, мислећи о ономе што му је ћерка рекла тог јутра."), "");   // Serbian
+
+    CHECK_STR(detect("كان الرجل العجوز يسير ببطء على الطريق، يفكر فيما قالته له ابنته في ذلك الصباح."), "ar");
+    CHECK_STR(detect("پیرمرد آهسته در جاده پایین می‌رفت و به حرفی که دخترش آن روز صبح به او زده بود فکر می‌کرد."), "");  // Persian
+    CHECK_STR(detect("بوڑھا آدمی آہستہ آہستہ سڑک پر چل رہا تھا اور سوچ رہا تھا کہ اس کی بیٹی نے صبح کیا کہا تھا۔"), "");  // Urdu
+
+    CHECK_STR(detect("बूढ़ा आदमी धीरे-धीरे सड़क पर चल रहा था और सोच रहा था कि उसकी बेटी ने सुबह उससे क्या कहा था।"), "hi");
+    CHECK_STR(detect("म्हातारा माणूस हळूहळू रस्त्यावरून चालत होता आणि आपल्या मुलीने सकाळी काय सांगितले याचा विचार करत होता."), "");  // Marathi
+    CHECK_STR(detect("बूढो मान्छे बिस्तारै बाटोमा हिँड्दै थियो र छोरीले बिहान के भनेकी थिई भनेर सोच्दै थियो।"), "");  // Nepali
+
+    CHECK_STR(detect("老人沿着路慢慢地走下去，想着那天早上女儿对他说的话。他不知道她是不是对的。"), "zh");
+    CHECK_STR(detect("第一章　東京都内某所"), "");             // Japanese heading in kanji alone
+}
+
+static void test_unknown(void) {
+    // Too little text
+    CHECK_STR(detect("Hello"), "");
+    CHECK_STR(detect("12345 67890 !!!"), "");
+    CHECK_STR(detect(""), "");
+}
+
+static void test_codes(void) {
+    CHECK_STR(langid_code("French"), "fr");
+    CHECK_STR(langid_code("pt-br"), "pt");
+    CHECK_STR(langid_code("de"), "de");
+    CHECK(langid_code("Klingon") == NULL);
+
+    const char *text = "Le vieil homme descendait lentement la route en pensant à ce que sa fille lui avait dit ce matin-là.";
+    CHECK(langid_is_language(text, strlen(text), "French", 0.5));
+    CHECK(!langid_is_language(text, strlen(text), "English", 0.5));
+}
+
+int main(void) {
+    test_latin();
+    test_latin_unprofiled();
+    test_scripts();
+    test_shared_scripts();
+    test_unknown();
+    test_codes();
+    return test_finish("langid");
+}
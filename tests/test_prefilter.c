@@ -0,0 +1,77 @@
+#include "test.h"
+#include "prefilter.h"
+
+static prefilter_class_t classify(const char *text) {
+    return prefilter_classify(text, strlen(text));
+}
+
+// Checks a list of texts, naming the ones classified otherwise
+static void check_all(const char **texts, size_t count, prefilter_class_t expected) {
+    for (size_t i = 0; i < count; i++) {
+        int ok = classify(texts[i]) == expected;
+        if (!ok) fprintf(stderr, "  \"%s\" misclassified\n", texts[i]);
+        CHECK(ok);
+    }
+}
+
+static void test_blank(void) {
+    CHECK(classify("") == PREFILTER_BLANK);
+    CHECK(classify(" \t\r\n") == PREFILTER_BLANK);
+    CHECK(classify("\xC2\xA0\xE3\x80\x80\xE2\x80\xAF") == PREFILTER_BLANK);    // NBSP, U+3000, U+202F
+
+    size_t start, end;
+    const char *text = "\xC2\xA0 Text \xE3\x80\x80";
+    prefilter_trim(text, strlen(text), &start, &end);
+    CHECK(start == 3 && end == 7);
+    prefilter_trim("   ", 3, &start, &end);
+    CHECK(start == 0 && end == 0);
+}
+
+static void test_verbatim(void) {
+    const char *verbatim[] = {
+        "42", "3.14", "– 17 –", "* * *", "§ 12", "© 2024", "→", "…", "😀",
+        "XIV", "MCMXCIV", "xii", "xii–xiv, 23",
+        "https://example.com/book?id=1", "(www.example.org).", "mailto:a@b.c",
+        "editor@example.com", "<someone.else@mail.example.co.uk>",
+    };
+    check_all(verbatim, sizeof(verbatim) / sizeof(verbatim[0]), PREFILTER_VERBATIM);
+    // Long runs go through the vector scan
+    char digits[200];
+    memset(digits, '7', sizeof(digits) - 1);
+    digits[sizeof(digits) - 1] = 0;
+    CHECK(classify(digits) == PREFILTER_VERBATIM);
+}
+
+static void test_translate(void) {
+    const char *translate[] = {
+        "Hello", "Chapter-less IV.", "mix", "di", "MIXED case", "Ünter", "漢字", "ª",
+        "IIII", "VX", "visit https://example.com", "at @home", "user@localhost",
+        "Straße", "Это", "42 apples",
+    };
+    check_all(translate, sizeof(translate) / sizeof(translate[0]), PREFILTER_TRANSLATE);
+    // A letter far into a long run of symbols
+    char text[200];
+    memset(text, '-', sizeof(text) - 1);
+    text[150] = 'a';
+    text[sizeof(text) - 1] = 0;
+    CHECK(classify(text) == PREFILTER_TRANSLATE);
+}
+
+// Numerals that are also words: "I" the pronoun, "vi" or "li" in Italian,
+// "xi" in Greek transliteration
+static void test_short_numerals(void) {
+    const char *words[] = { "I", "i", "vi", "xi", "li", "ci", "ix", "v", "I ", " vi " };
+    check_all(words, sizeof(words) / sizeof(words[0]), PREFILTER_TRANSLATE);
+    const char *numerals[] = {
+        "I.", "(ii)", "vi)", "iv.", "i, ii, iii", "vi–x", "xi, 24", "I, II", "II", "IV", "VI", "x.", "xiv",
+    };
+    check_all(numerals, sizeof(numerals) / sizeof(numerals[0]), PREFILTER_VERBATIM);
+}
+
+int main(void) {
+    test_blank();
+    test_verbatim();
+    test_translate();
+    test_short_numerals();
+    return test_finish("prefilter");
+}
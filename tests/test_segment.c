@@ -0,0 +1,65 @@
+#include "test.h"
+#include "segment.h"
+#include "tokenizer.h"
+
+// The pieces must cover the text exactly, in order
+static void check_cover(const char *text, const text_piece_t *pieces, int count) {
+    size_t pos = 0;
+    for (int i = 0; i < count; i++) {
+        CHECK(pieces[i].start == pos);
+        pos = pieces[i].start + pieces[i].length + pieces[i].separator;
+    }
+    CHECK(pos == strlen(text));
+}
+
+static void test_short_text(void) {
+    text_piece_t *pieces = NULL;
+    const char *text = "A short sentence.";
+    int count = segment_text(text, 100, &pieces);
+    CHECK(count == 1);
+    if (count == 1) CHECK(pieces[0].length == strlen(text));
+    free(pieces);
+
+    count = segment_text(text, 0, &pieces);
+    CHECK(count == 1);
+    free(pieces);
+}
+
+static void test_sentence_boundaries(void) {
+    char text[4096] = "";
+    for (int i = 0; i < 40; i++) {
+        strcat(text, "The quick brown fox jumps over the lazy dog again. ");
+    }
+    text_piece_t *pieces = NULL;
+    int count = segment_text(text, 64, &pieces);
+    CHECK(count > 1);
+    check_cover(text, pieces, count);
+    for (int i = 0; i < count; i++) {
+        CHECK(count_tokens(text + pieces[i].start, pieces[i].length) <= 64);
+        // Every piece ends a sentence
+        CHECK(text[pieces[i].start + pieces[i].length - 1] == '.');
+    }
+    free(pieces);
+}
+
+static void test_utf8_never_cut(void) {
+    // Unspaced CJK text can only be cut between code points
+    char text[4096] = "";
+    for (int i = 0; i < 300; i++) strcat(text, "漢字");
+    text_piece_t *pieces = NULL;
+    int count = segment_text(text, 64, &pieces);
+    CHECK(count > 1);
+    check_cover(text, pieces, count);
+    for (int i = 0; i < count; i++) {
+        CHECK(((unsigned char)text[pieces[i].start] & 0xC0) != 0x80);
+        CHECK(count_tokens(text + pieces[i].start, pieces[i].length) <= 64);
+    }
+    free(pieces);
+}
+
+int main(void) {
+    test_short_text();
+    test_sentence_boundaries();
+    test_utf8_never_cut();
+    return test_finish("segment");
+}
@@ -0,0 +1,102 @@
+#include "test.h"
+#include "context_strategy.h"
+#include "tokenizer.h"
+
+// Whether text is well-formed UTF-8: no sequence cut at either end
+static int valid_utf8(const char *text) {
+    const unsigned char *s = (const unsigned char*)text;
+    while (*s) {
+        int n = *s < 0x80 ? 1 : (*s & 0xE0) == 0xC0 ? 2 : (*s & 0xF0) == 0xE0 ? 3 : (*s & 0xF8) == 0xF0 ? 4 : 0;
+        if (n == 0) return 0;
+        for (int i = 1; i < n; i++) {
+            if ((s[i] & 0xC0) != 0x80) return 0;
+        }
+        s += n;
+    }
+    return 1;
+}
+
+// A chapter of `paragraphs` paragraphs, each naming the chapter and its index
+static char* chapter(int number, int paragraphs) {
+    size_t size = 128 + paragraphs * 96;
+    char *xhtml = malloc(size);
+    size_t pos = snprintf(xhtml, size, "<html><body><h1>Chapter %d</h1>", number);
+    for (int p = 0; p < paragraphs; p++) {
+        pos += snprintf(xhtml + pos, size - pos, "<p>Paragraph %d of chapter %d, with a few more words.</p>", p, number);
+    }
+    snprintf(xhtml + pos, size - pos, "</body></html>");
+    return xhtml;
+}
+
+static void test_token_bound(ContextStrategy *window, config_t *config) {
+    CHECK(window->get_prompt(window->state, config) == NULL);
+    // Enough chapters for the rings to wrap around many times
+    for (int c = 1; c <= 30; c++) {
+        char *xhtml = chapter(c, 1 + c % 7);
+        window->update(window->state, xhtml, config);
+        free(xhtml);
+
+        char *text = window->save_state(window->state);
+        CHECK(text && count_tokens_str(text) <= config->sliding_window_size);
+        free(text);
+    }
+    char *text = window->save_state(window->state);
+    // The window is nearly full, ends with the latest text and has let go
+    // of the oldest
+    CHECK(count_tokens_str(text) > config->sliding_window_size / 2);
+    CHECK(text && strstr(text, "Paragraph 1 of chapter 30, with a few more words.") != NULL);
+    CHECK(text && strstr(text, "chapter 28") == NULL);
+
+    char *prompt = window->get_prompt(window->state, config);
+    CHECK(prompt && text && strstr(prompt, text) != NULL);
+    free(prompt);
+    free(text);
+}
+
+// Text without spaces is cut into slices on code-point boundaries
+static void test_unspaced(ContextStrategy *window, config_t *config) {
+    char xhtml[8192] = "<html><body><p>";
+    for (int i = 0; i < 600; i++) strcat(xhtml, i % 3 ? "字" : "😀");
+    strcat(xhtml, "</p></body></html>");
+    window->update(window->state, xhtml, config);
+    char *text = window->save_state(window->state);
+    CHECK(text && valid_utf8(text));
+    CHECK(text && count_tokens_str(text) <= config->sliding_window_size);
+    CHECK(text && strstr(text, "Paragraph") == NULL);
+    free(text);
+}
+
+// A snapshot loads back into the same window
+static void test_round_trip(ContextStrategy *window, config_t *config) {
+    char *xhtml = chapter(7, 5);
+    window->update(window->state, xhtml, config);
+    free(xhtml);
+    char *saved = window->save_state(window->state);
+
+    void *copy = window->init(config);
+    window->load_state(copy, saved);
+    char *loaded = window->save_state(copy);
+    CHECK(saved && loaded);
+    if (saved && loaded) CHECK_STR(loaded, saved);
+    window->cleanup(copy);
+    free(loaded);
+    free(saved);
+}
+
+int main(void) {
+    config_t config = { .sliding_window_size = 60 };
+    ContextStrategy *window = create_sliding_window_strategy();
+    window->state = window->init(&config);
+    CHECK(window->state != NULL);
+    test_token_bound(window, &config);
+    test_unspaced(window, &config);
+    test_round_trip(window, &config);
+    window->cleanup(window->state);
+    free(window);
+
+    config.sliding_window_size = 0;
+    window = create_sliding_window_strategy();
+    CHECK(window->init(&config) == NULL);
+    free(window);
+    return test_finish("sliding_window");
+}
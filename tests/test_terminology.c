@@ -0,0 +1,51 @@
+#include "test.h"
+#include "context_strategy.h"
+
+static char* candidates(const char **chapters, int count, int max) {
+    return terminology_candidates((char**)chapters, count, max);
+}
+
+static void test_candidates(void) {
+    const char *chapters[] = {
+        "<html><body>"
+        "<p>The road to Minas Tirith was long. Frodo looked at the ring in his hand.</p>"
+        "<p>Suddenly the wind rose. He thought of Frodo and of Minas Tirith again.</p>"
+        "<p>Then he gave the Ring to Frodo, and the ring was heavy.</p>"
+        "</body></html>",
+        NULL,   // A chapter that could not be read
+        "<html><body>"
+        "<p>Suddenly it was night. Sam and Frodo slept, and Sam dreamt of a ring.</p>"
+        "<p>Suddenly they woke. Sam asked whether Наташа had come, and Наташа had.</p>"
+        "<p>Where was Наташа now? Nobody at the gate of Minas Tirith knew, but Sam did.</p>"
+        "</body></html>",
+    };
+    char *list = candidates(chapters, 3, 10);
+    // Runs count once per word, so "Minas Tirith" ranks first. "Minas" and
+    // "Tirith" are covered by it, "Ring" is mostly seen in lower case,
+    // "Suddenly" only starts sentences and "The" is a stop word.
+    CHECK(list != NULL);
+    if (list) CHECK_STR(list, "Minas Tirith\nFrodo\nSam\nНаташа\n");
+    free(list);
+
+    // The best ones when there are more candidates than wanted
+    list = candidates(chapters, 3, 2);
+    if (list) CHECK_STR(list, "Minas Tirith\nFrodo\n");
+    CHECK(list != NULL);
+    free(list);
+}
+
+static void test_no_candidates(void) {
+    const char *chapters[] = {
+        "<html><body><p>Frodo left once.</p><p>there was nothing else to tell.</p></body></html>",
+        // Scripts without capital letters yield nothing
+        "<html><body><p>東京は大きい。東京に行った。東京が好きだ。</p></body></html>",
+    };
+    CHECK(candidates(chapters, 2, 10) == NULL);
+    CHECK(candidates(chapters, 0, 10) == NULL);
+}
+
+int main(void) {
+    test_candidates();
+    test_no_candidates();
+    return test_finish("terminology");
+}